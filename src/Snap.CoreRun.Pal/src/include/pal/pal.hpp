@@ -74,15 +74,240 @@ typedef FILE pal_file_handle_t;
 typedef DWORD pal_pid_t;
 typedef int pal_mode_t;
 typedef DWORD pal_exit_code_t;
+typedef uintptr_t pal_socket_t;
 #elif defined(PAL_PLATFORM_LINUX)
 typedef pid_t pal_pid_t;
 typedef mode_t pal_mode_t;
 typedef int pal_exit_code_t;
+typedef int pal_socket_t;
 #endif
 
+// - Structures
+
+typedef struct pal_process_exec_stats
+{
+    pal_exit_code_t exit_code;
+    int term_signal; // Signal that terminated the process, always 0 on Windows.
+    BOOL timed_out; // TRUE when the process was terminated because it ran past the timeout.
+    uint64_t wall_time_us;
+    uint64_t user_time_us;
+    uint64_t system_time_us;
+    uint64_t max_rss_kb; // Peak working set on Windows.
+    uint64_t major_faults; // Always 0 on Windows.
+    uint64_t minor_faults; // All page faults on Windows.
+    uint64_t voluntary_context_switches; // Always 0 on Windows.
+    uint64_t involuntary_context_switches; // Always 0 on Windows.
+} pal_process_exec_stats_t;
+
+typedef struct pal_process_sample
+{
+    uint64_t timestamp_us; // Monotonic clock, only meaningful relative to other samples.
+    uint64_t interval_us; // Time since the previous sample of the sampler, 0 for the first sample.
+    uint64_t user_time_us; // Totals since the process started.
+    uint64_t system_time_us;
+    uint32_t cpu_permille; // CPU time used during the interval per wall time, 1000 is one fully busy core.
+    uint32_t threads_count; // Always 0 on Windows.
+    uint64_t rss_bytes;
+    uint64_t vm_bytes; // Commit charge on Windows.
+    uint64_t io_read_bytes; // Totals, 0 when the I/O counters of the process are not readable.
+    uint64_t io_write_bytes;
+    uint64_t io_read_bytes_delta; // Since the previous sample.
+    uint64_t io_write_bytes_delta;
+    uint64_t context_switches; // Voluntary and involuntary, always 0 on Windows.
+    uint64_t context_switches_delta;
+} pal_process_sample_t;
+
+typedef struct pal_cpu
+{
+    uint32_t id;
+    int32_t numa_node; // -1 when unknown.
+} pal_cpu_t;
+
+// Samples the resource usage of one process without reopening its files, see pal_process_sampler_sample.
+typedef struct pal_process_sampler pal_process_sampler_t;
+
+typedef enum pal_process_scheduler
+{
+    PAL_PROCESS_SCHEDULER_INHERIT = 0,
+    PAL_PROCESS_SCHEDULER_OTHER = 1,
+    PAL_PROCESS_SCHEDULER_BATCH = 2,
+    PAL_PROCESS_SCHEDULER_IDLE = 3,
+    PAL_PROCESS_SCHEDULER_FIFO = 4,
+    PAL_PROCESS_SCHEDULER_RR = 5
+} pal_process_scheduler_t;
+
+typedef enum pal_process_io_class
+{
+    PAL_PROCESS_IO_CLASS_INHERIT = 0,
+    PAL_PROCESS_IO_CLASS_REALTIME = 1,
+    PAL_PROCESS_IO_CLASS_BEST_EFFORT = 2,
+    PAL_PROCESS_IO_CLASS_IDLE = 3
+} pal_process_io_class_t;
+
+// Applied by the child before exec, a setting that cannot be applied fails the start. Linux only.
+typedef struct pal_process_launch_policy
+{
+    const uint32_t* affinity_cpus; // No cpus keeps the inherited affinity.
+    size_t affinity_cpus_len;
+    pal_process_scheduler_t scheduler;
+    int scheduler_priority; // 1 to 99, only used by FIFO and RR.
+    BOOL nice_set;
+    int nice;
+    pal_process_io_class_t io_class;
+    int io_level; // 0 (highest) to 7, not used by the idle class.
+    BOOL oom_score_adj_set;
+    int oom_score_adj; // -1000 to 1000.
+    uint64_t rlimit_nofile; // Soft limit clamped to the hard limit, 0 keeps the inherited limit and UINT64_MAX is unlimited.
+    uint64_t rlimit_memlock;
+} pal_process_launch_policy_t;
+
+typedef struct pal_process_spawn_options
+{
+    int cmd_show; // Only applicable on Windows.
+    BOOL gated; // The process waits in pal_standby_wait until its gate is released.
+    const pal_socket_t* listen_sockets; // Passed as fds 3, 4, ... with LISTEN_FDS and LISTEN_PID (sd_listen_fds), Linux only.
+    size_t listen_sockets_len;
+    const char* output_log_filename; // stdout and stderr are written to this log instead of being inherited, Linux only.
+    uint64_t output_log_max_bytes; // The log is rotated after the first line that crosses this size, 0 never rotates.
+    uint32_t output_log_max_files; // Rotated logs are kept as <filename>.1 (most recent) to <filename>.<n>.
+    const char* const* environment; // "NAME=value" replaces and "NAME" removes a variable of the inherited environment.
+    size_t environment_len;
+    const pal_process_launch_policy_t* policy; // Optional, Linux only.
+} pal_process_spawn_options_t;
+
+// Holds back a process started gated by pal_process_daemonize_ex, see pal_process_gate_release.
+typedef struct pal_process_gate pal_process_gate_t;
+
+// Heartbeat counter in named shared memory, see pal_watchdog_beat.
+typedef struct pal_watchdog pal_watchdog_t;
+
+// Receives shutdown signals synchronously, see pal_process_wait_exit_or_signal.
+typedef struct pal_signal_listener pal_signal_listener_t;
+
+typedef struct pal_fs_rmdir_stats
+{
+    size_t removed_count; // Files, links and directories removed, including the root directory.
+    int first_error; // errno (GetLastError on Windows) of the first entry that could not be removed.
+} pal_fs_rmdir_stats_t;
+
+typedef enum pal_fs_type
+{
+    PAL_FS_TYPE_UNKNOWN = 0,
+    PAL_FS_TYPE_FILE = 1,
+    PAL_FS_TYPE_DIRECTORY = 2,
+    PAL_FS_TYPE_SYMLINK = 3,
+    PAL_FS_TYPE_OTHER = 4 // Sockets, pipes and devices.
+} pal_fs_type_t;
+
+typedef struct pal_fs_stat
+{
+    uint64_t size;
+    uint64_t mtime_ns; // Nanoseconds since the unix epoch.
+    uint64_t inode; // File index on Windows.
+    uint64_t dev; // Volume serial number on Windows.
+    uint32_t nlink;
+    uint32_t mode; // Permission bits, always 0 on Windows.
+    uint32_t type; // pal_fs_type_t
+} pal_fs_stat_t;
+
+typedef enum pal_fs_batch_op_type
+{
+    PAL_FS_BATCH_OP_STAT = 0, // Follows symlinks.
+    PAL_FS_BATCH_OP_READ = 1,
+    PAL_FS_BATCH_OP_UNLINK = 2,
+    PAL_FS_BATCH_OP_RMDIR = 3 // Directory must be empty.
+} pal_fs_batch_op_type_t;
+
+typedef struct pal_fs_batch_op
+{
+    uint32_t type; // pal_fs_batch_op_type_t
+    const char* path; // Relative to the batch directory, or absolute.
+    pal_fs_stat_t stat; // PAL_FS_BATCH_OP_STAT only.
+    char* data; // PAL_FS_BATCH_OP_READ only, release with delete[].
+    size_t data_len;
+    int error; // errno of the failed operation, 0 on success.
+} pal_fs_batch_op_t;
+
+// Executes many independent filesystem operations together, see pal_fs_batch_execute.
+typedef struct pal_fs_batch pal_fs_batch_t;
+
+// Work stealing pool, see pal_threadpool_submit and pal_wait_group_wait.
+typedef struct pal_threadpool pal_threadpool_t;
+typedef struct pal_wait_group pal_wait_group_t;
+
+// Collects atomic writes so that they can be made durable together, see pal_fs_write_batch_commit.
+typedef struct pal_fs_write_batch pal_fs_write_batch_t;
+
+#define PAL_HASH_DIGEST_SIZE 32
+
+typedef enum pal_hash_algorithm
+{
+    PAL_HASH_SHA256 = 0,
+    PAL_HASH_BLAKE3 = 1
+} pal_hash_algorithm_t;
+
+// Incremental hash state, digests are always PAL_HASH_DIGEST_SIZE bytes.
+typedef struct pal_hash pal_hash_t;
+
+typedef enum pal_fs_verify_status
+{
+    PAL_FS_VERIFY_OK = 0,
+    PAL_FS_VERIFY_MISSING = 1,
+    PAL_FS_VERIFY_SIZE_MISMATCH = 2,
+    PAL_FS_VERIFY_HASH_MISMATCH = 3,
+    PAL_FS_VERIFY_ERROR = 4 // Unreadable file or a path that escapes the directory.
+} pal_fs_verify_status_t;
+
+typedef struct pal_fs_verify_entry
+{
+    const char* path; // Relative to the verified directory.
+    uint64_t size;
+    uint8_t digest[PAL_HASH_DIGEST_SIZE];
+    uint32_t status; // pal_fs_verify_status_t, set by pal_fs_verify_directory.
+    BOOL cached; // TRUE when the verdict was taken from the cache instead of hashing the file.
+} pal_fs_verify_entry_t;
+
+typedef struct pal_fs_patch_op
+{
+    const char* old_filename; // File of the previous version.
+    const char* patch_filename;
+    const char* new_filename; // Created, or replaced when it exists.
+    int error; // errno (GetLastError on Windows) of the failed patch, 0 on success.
+} pal_fs_patch_op_t;
+
+typedef struct pal_fs_zip_extract_stats
+{
+    size_t files_count;
+    size_t directories_count; // Including parent directories that only appear in file paths.
+    uint64_t bytes_written;
+    int first_error; // errno (GetLastError on Windows) of the first entry that failed, 0 on success.
+} pal_fs_zip_extract_stats_t;
+
+// Read-only view of a pack written by pal_fs_pack_create.
+typedef struct pal_fs_pack pal_fs_pack_t;
+
+typedef struct pal_fs_pack_entry
+{
+    const char* path; // '/' separated, valid until the pack is freed.
+    uint64_t size;
+    uint32_t mode; // Permission bits, 0 for files packed on Windows.
+    uint8_t digest[PAL_HASH_DIGEST_SIZE]; // Hash algorithm of the pack, see pal_fs_pack_get_info.
+    const uint8_t* data; // Payload inside the mapped pack, valid until the pack is freed.
+} pal_fs_pack_entry_t;
+
+typedef struct pal_fs_pack_install_stats
+{
+    size_t files_count;
+    size_t cloned_count; // Files that share their extents with the pack (reflinks).
+    uint64_t bytes_copied; // Bytes of the files that were not cloned.
+    int first_error; // errno (GetLastError on Windows) of the first file that failed, 0 on success.
+} pal_fs_pack_install_stats_t;
+
 // - Callbacks
 
 typedef BOOL(*pal_fs_list_filter_callback_t)(const char* filename);
+typedef void(*pal_threadpool_callback_t)(void* user_data_in);
+typedef BOOL(*pal_fs_read_chunk_callback_t)(const char* chunk_in, size_t chunk_len_in, void* user_data_in);
 
 // - Generic
 
@@ -98,15 +323,33 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_has_icon(const char * filename_in);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_real_path(char **real_path_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_cwd(char **cwd_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_is_running(pal_pid_t pid);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_is_running_batch(const pal_pid_t* pids_in, const uint64_t* start_times_in,
+        size_t pids_len_in, uint8_t* running_bitmap_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_start_time(pal_pid_t pid_in, uint64_t* start_time_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_kill(pal_pid_t pid);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_pid(pal_pid_t* pid_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_name(char **exe_name_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_find_by_exe_prefix(const char* exe_prefix_in, pal_pid_t** pids_out, size_t* pids_len_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_exec(const char *filename_in, const char *working_dir_in,
                                                      int argc_in, char **argv_in, pal_exit_code_t *exit_code_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_exec_ex(const char *filename_in, const char *working_dir_in,
+        int argc_in, char **argv_in, uint32_t timeout_ms_in, uint32_t kill_grace_ms_in, pal_process_exec_stats_t *stats_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_wait_exit(pal_pid_t pid_in, uint32_t timeout_ms_in, BOOL* exited_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_wait_exit_or_signal(pal_pid_t pid_in, uint32_t timeout_ms_in,
+        pal_signal_listener_t* listener_in, BOOL* exited_out, int* signum_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_signal(pal_pid_t pid_in, int signum_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_sampler_create(pal_pid_t pid_in, pal_process_sampler_t** sampler_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_sampler_sample(pal_process_sampler_t* sampler_in, pal_process_sample_t* sample_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_sampler_free(pal_process_sampler_t* sampler_in);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_daemonize(const char *filename_in, const char *working_dir_in, int argc_in,
                                                           char **argv_in,
                                                           int cmd_show_in /* Only applicable on Windows */,
                                                           pal_pid_t *pid_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_daemonize_ex(const char *filename_in, const char *working_dir_in, int argc_in,
+        char **argv_in, const pal_process_spawn_options_t *options_in, pal_pid_t *pid_out, pal_process_gate_t** gate_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_gate_release(pal_process_gate_t* gate_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_gate_cancel(pal_process_gate_t* gate_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_standby_wait(BOOL* released_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_sleep_ms(uint32_t milliseconds);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows();
 PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows_8_or_greater();
@@ -114,6 +357,40 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows_7_or_greater();
 PAL_API BOOL PAL_CALLING_CONVENTION pal_is_linux();
 PAL_API BOOL PAL_CALLING_CONVENTION pal_is_unknown_os();
 
+// - Watchdog
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_open(const char* name_in, pal_watchdog_t** watchdog_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_beat(pal_watchdog_t* watchdog_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_read(const pal_watchdog_t* watchdog_in, uint64_t* beats_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_free(pal_watchdog_t* watchdog_in);
+
+// - Signals
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_signal_listener_create(pal_signal_listener_t** listener_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_signal_listener_free(pal_signal_listener_t* listener_in);
+
+// - Sockets
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_listen(const char* address_in, pal_socket_t* socket_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_listen_inherited(const char* address_in, pal_socket_t* socket_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_get_port(pal_socket_t socket_in, uint16_t* port_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_close(pal_socket_t socket_in);
+
+// - Threading
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_cpu_get_effective_count(size_t* count_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_cpu_get_affinity(pal_cpu_t** cpus_out, size_t* cpus_len_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_memory_get_limit(uint64_t* limit_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_create(size_t max_workers_in, pal_threadpool_t** threadpool_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_get_worker_count(const pal_threadpool_t* threadpool_in, size_t* worker_count_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_submit(pal_threadpool_t* threadpool_in, pal_wait_group_t* wait_group_in,
+        pal_threadpool_callback_t callback_in, void* user_data_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_free(pal_threadpool_t* threadpool_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_free_shared();
+PAL_API BOOL PAL_CALLING_CONVENTION pal_wait_group_create(pal_wait_group_t** wait_group_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_wait_group_wait(pal_threadpool_t* threadpool_in, pal_wait_group_t* wait_group_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_wait_group_free(pal_wait_group_t* wait_group_in);
+
 // - Environment
 
 PAL_API BOOL PAL_CALLING_CONVENTION pal_env_set(const char* name_in, const char* value_in);
@@ -129,15 +406,56 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_directories(const char* path_in,
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_files(const char* path_in, pal_fs_list_filter_callback_t filter_callback_in,
         const char* filter_extension_in, char*** files_out, size_t* files_out_len);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_file_exists(const char* file_path_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_stat(const char* path_in, BOOL follow_symlinks_in, pal_fs_stat_t* stat_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_stat_batch(const char* directory_in, const char** names_in, size_t names_len_in,
+        BOOL follow_symlinks_in, pal_fs_stat_t* stats_out, int* errors_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_get_cwd(char** working_directory_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_link_replace(const char* link_path_in, const char* target_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_link_read(const char* link_path_in, char** target_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_directory_exists(const char* path_in);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_get_file_size(const char* filename_in, size_t* file_size_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_read_file(const char *filename_in, char **bytes_out, size_t *bytes_read_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_read_file_chunked(const char *filename_in, size_t chunk_size_in,
+        pal_fs_read_chunk_callback_t callback_in, void* user_data_in, size_t *bytes_read_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_mkdir(const char* directory_in, pal_mode_t mode_in);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_mkdirp(const char *directory_in, pal_mode_t mode_in);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmdir(const char* directory_in, BOOL recursive);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmdir_recursive(const char* directory_in, BOOL parallel, pal_fs_rmdir_stats_t* stats_out);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmfile(const char* filename_in);
 PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write(const char* filename_in, const char* data_in, size_t data_len_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_atomic(const char* filename_in, const char* data_in, size_t data_len_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_create(pal_fs_write_batch_t** batch_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_add(pal_fs_write_batch_t* batch_in, const char* filename_in, const char* data_in, size_t data_len_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_commit(pal_fs_write_batch_t* batch_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_free(pal_fs_write_batch_t* batch_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_create(const char* directory_in, BOOL use_io_uring_in, pal_fs_batch_t** batch_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_is_io_uring(const pal_fs_batch_t* batch_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_execute(pal_fs_batch_t* batch_in, pal_fs_batch_op_t* ops_in, size_t ops_len_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_free(pal_fs_batch_t* batch_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_patch_apply(const char* old_filename_in, const char* patch_filename_in, const char* new_filename_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_patch_apply_batch(pal_fs_patch_op_t* ops_in, size_t ops_len_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_zip_extract(const char* archive_filename_in, const char* directory_in,
+        pal_fs_zip_extract_stats_t* stats_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_create(const char* pack_filename_in, const char* directory_in,
+        const char** paths_in, size_t paths_len_in, uint32_t algorithm_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_open(const char* pack_filename_in, pal_fs_pack_t** pack_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_get_info(const pal_fs_pack_t* pack_in, size_t* entries_len_out, uint32_t* algorithm_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_get_entry(const pal_fs_pack_t* pack_in, size_t index_in, pal_fs_pack_entry_t* entry_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_find(const pal_fs_pack_t* pack_in, const char* path_in, pal_fs_pack_entry_t* entry_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_install(const pal_fs_pack_t* pack_in, const char* directory_in, BOOL verify_in,
+        pal_fs_pack_install_stats_t* stats_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_free(pal_fs_pack_t* pack_in);
+
+// - Hashing
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_create(uint32_t algorithm_in, pal_hash_t** hash_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_update(pal_hash_t* hash_in, const void* data_in, size_t data_len_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_final(pal_hash_t* hash_in, uint8_t* digest_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_free(pal_hash_t* hash_in);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_get_implementation(uint32_t algorithm_in, const char** name_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_file(const char* filename_in, uint32_t algorithm_in, BOOL use_mmap_in, uint8_t* digest_out);
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_verify_directory(const char* directory_in, uint32_t algorithm_in, pal_fs_verify_entry_t* entries_in,
+        size_t entries_len_in, const char* cache_filename_in);
 
 // - Path
 PAL_API BOOL PAL_CALLING_CONVENTION pal_path_normalize(const char* path_in, char** path_normalized_out);
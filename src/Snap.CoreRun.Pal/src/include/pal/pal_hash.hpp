@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pal.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming SHA-256. Blocks are compressed with SHA-NI on x86 or the ARMv8 crypto extensions when
+// the cpu has them, and with a portable implementation otherwise.
+class pal_sha256 final
+{
+    uint32_t m_state[8];
+    uint8_t m_buffer[64];
+    size_t m_buffer_len;
+    uint64_t m_total_len;
+
+public:
+    pal_sha256();
+    void update(const uint8_t* data, size_t data_len);
+    void finalize(uint8_t digest_out[PAL_HASH_DIGEST_SIZE]);
+
+    [[nodiscard]] static const char* get_implementation();
+};
+
+// Streaming BLAKE3 (unkeyed, 32 byte output). Whole chunks are hashed several at a time with
+// AVX2, SSE4.1 or NEON when available.
+class pal_blake3 final
+{
+public:
+    struct output
+    {
+        uint32_t cv[8];
+        uint8_t block[64];
+        uint64_t counter;
+        uint32_t block_len;
+        uint32_t flags;
+    };
+
+private:
+    uint32_t m_chunk_cv[8];
+    uint64_t m_chunk_counter;
+    uint8_t m_block[64];
+    size_t m_block_len;
+    size_t m_blocks_compressed;
+    // One entry per level of the chunk tree, 2^54 chunks of 1 KiB cover every possible input.
+    uint32_t m_cv_stack[54][8];
+    size_t m_cv_stack_len;
+
+public:
+    pal_blake3();
+    void update(const uint8_t* data, size_t data_len);
+    void finalize(uint8_t digest_out[PAL_HASH_DIGEST_SIZE]) const;
+
+    [[nodiscard]] static const char* get_implementation();
+
+private:
+    [[nodiscard]] size_t chunk_len() const;
+    void chunk_reset(uint64_t chunk_counter);
+    void chunk_update(const uint8_t* data, size_t data_len);
+    [[nodiscard]] output chunk_output() const;
+    void push_chunk_cv(const uint32_t cv[8], uint64_t total_chunks);
+};
+
+// Restricts both algorithms to their portable implementation, used to compare the accelerated ones against it.
+void pal_hash_force_portable(bool force_portable);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CRC-32 (IEEE 802.3) as used by zip and gzip. Pass 0 as crc for the first chunk.
+uint32_t pal_crc32(uint32_t crc, const uint8_t* data, size_t data_len);
+
+// Decoder for raw deflate streams (RFC 1951). Output is produced into a sliding window that is handed
+// to the sink whenever it fills up, so entries of any size decode in constant memory.
+class pal_inflate final
+{
+public:
+    typedef bool(*sink_t)(const uint8_t* data, size_t data_len, void* user_data);
+
+private:
+    struct huffman
+    {
+        // (symbol << 4) | length for codes of at most fast_bits bits, 0 for longer codes.
+        uint16_t fast[1 << 10];
+        uint16_t count[16];
+        uint16_t symbol[288];
+    };
+
+    std::vector<uint8_t> m_window;
+    size_t m_window_len;
+    size_t m_window_flushed;
+    sink_t m_sink;
+    void* m_user_data;
+    bool m_sink_failed;
+    const uint8_t* m_input;
+    size_t m_input_len;
+    size_t m_input_pos;
+    uint64_t m_bit_buffer;
+    unsigned m_bit_count;
+    unsigned m_pad_bits;
+    uint64_t m_total_out;
+    huffman m_fixed_litlen;
+    huffman m_fixed_dist;
+    huffman m_litlen;
+    huffman m_dist;
+
+public:
+    pal_inflate();
+    pal_inflate(const pal_inflate&) = delete;
+    pal_inflate& operator=(const pal_inflate&) = delete;
+
+    // Decodes a complete stream. Returns false when the input is truncated or invalid, or when
+    // the sink returned false.
+    bool run(const uint8_t* input, size_t input_len, sink_t sink, void* user_data);
+    [[nodiscard]] uint64_t total_out() const { return m_total_out; }
+    // Bytes of input consumed by the last successful run.
+    [[nodiscard]] size_t input_used() const { return m_input_pos; }
+
+private:
+    static bool build(huffman& huffman_out, const uint8_t* lengths, size_t lengths_len);
+    void refill();
+    uint32_t bits(unsigned count);
+    int decode(const huffman& huffman_in);
+    bool ensure_space(size_t len);
+    bool flush(bool final);
+    bool stored_block();
+    bool dynamic_tables();
+    bool codes(const huffman& litlen, const huffman& dist);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#if defined(PAL_PLATFORM_LINUX)
+#include <sys/stat.h> // STATX_BASIC_STATS
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+// Unlinkat was added in 5.11 and native workers in 5.12, so headers that define the latter
+// know about every opcode used by the batch executor.
+#if defined(IORING_FEAT_NATIVE_WORKERS) && defined(STATX_BASIC_STATS)
+#define PAL_IO_URING_SUPPORTED
+#endif
+#endif
+
+#if defined(PAL_IO_URING_SUPPORTED)
+
+#include <cstddef>
+#include <cstdint>
+
+// Minimal submission/completion ring on top of the raw io_uring syscalls.
+class pal_io_uring final {
+private:
+    int m_ring_fd;
+    void* m_sq_ring;
+    size_t m_sq_ring_size;
+    void* m_cq_ring;
+    size_t m_cq_ring_size;
+    io_uring_sqe* m_sqes;
+    size_t m_sqes_size;
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_mask;
+    unsigned* m_sq_array;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned* m_cq_mask;
+    io_uring_cqe* m_cqes;
+    unsigned m_sq_entries;
+    unsigned m_sq_tail_local;
+    unsigned m_queued;
+
+public:
+    pal_io_uring();
+    pal_io_uring(const pal_io_uring&) = delete;
+    pal_io_uring& operator=(const pal_io_uring&) = delete;
+    ~pal_io_uring();
+    // Returns 0 or the errno of io_uring_setup (ENOSYS, EPERM under seccomp, ...).
+    int try_create(unsigned entries);
+    unsigned sq_entries() const { return m_sq_entries; }
+    unsigned sq_space_left() const;
+    // Returns a zeroed submission entry, or nullptr when the submission queue is full.
+    io_uring_sqe* get_sqe();
+    // Entries returned by get_sqe that the kernel has not consumed yet.
+    unsigned queued() const { return m_queued; }
+    // Submits queued entries and waits for at least wait_nr completions. Returns 0 or errno.
+    int submit_and_wait(unsigned wait_nr);
+    // Waits for one completion without submitting anything. Returns 0 or errno.
+    int wait_cqe();
+    // Pops one completion, returns false when the completion queue is empty.
+    bool pop_cqe(uint64_t* user_data_out, int* res_out);
+};
+
+#endif
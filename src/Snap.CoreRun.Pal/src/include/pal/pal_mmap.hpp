@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Read-only mapping of a whole file, unmapped in the destructor. Empty files map to an empty range.
+class pal_mapped_file final {
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+#if defined(PAL_PLATFORM_WINDOWS)
+    HANDLE m_mapping;
+#endif
+
+public:
+    pal_mapped_file();
+    pal_mapped_file(const pal_mapped_file&) = delete;
+    pal_mapped_file& operator=(const pal_mapped_file&) = delete;
+    ~pal_mapped_file();
+    // Returns 0 or errno (GetLastError on Windows). Files that cannot be mapped, such as pipes and
+    // procfs entries, fail with ENODEV. sequential hints the kernel to read ahead aggressively.
+    int try_open(const char* filename_in, bool sequential);
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
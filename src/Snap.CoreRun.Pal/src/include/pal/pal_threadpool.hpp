@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts outstanding tasks so that a caller can wait for a group of submissions to complete.
+// Waiting is done through the pool that runs the tasks, see pal_threadpool::wait.
+struct pal_wait_group final
+{
+private:
+    std::atomic<size_t> m_count;
+
+public:
+    pal_wait_group();
+    pal_wait_group(const pal_wait_group&) noexcept = delete;
+    pal_wait_group& operator=(const pal_wait_group&) noexcept = delete;
+    pal_wait_group(pal_wait_group&&) noexcept = delete;
+    pal_wait_group& operator=(pal_wait_group&&) noexcept = delete;
+    ~pal_wait_group() = default;
+
+    void add();
+    // Returns true for the task that completed the group. The group is not touched after the
+    // decrement, so a waiter that observes is_done may destroy it right away.
+    bool done();
+    [[nodiscard]] bool is_done() const;
+};
+
+// Fixed size work stealing pool. Every worker owns a deque: it pushes and pops at the back while idle
+// workers steal from the front of the others. Submissions from threads outside the pool (including
+// P/Invoke callers) go to a shared injection queue. Threads that wait on a group run queued tasks
+// instead of blocking, so tasks may submit and wait on nested work.
+//
+// Workers are joined in the destructor after the queues have drained. Idle workers only wait on a
+// condition variable, so a process may fork while a pool exists as long as the child does not use it.
+struct pal_threadpool final
+{
+public:
+    typedef void(*callback_t)(void* user_data);
+
+private:
+    struct task
+    {
+        callback_t callback;
+        void* user_data;
+        pal_wait_group* wait_group;
+    };
+
+    struct task_queue
+    {
+        std::mutex mutex{};
+        std::deque<task> tasks{};
+    };
+
+    // Fixed before any worker starts, workers must not look at m_workers while it is being filled.
+    const size_t m_worker_count;
+    // Queues [0, m_worker_count) belong to workers, the last one is the injection queue.
+    std::vector<std::unique_ptr<task_queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_queued;
+    std::atomic<size_t> m_steal_offset;
+    std::mutex m_sleep_mutex;
+    // Workers sleep on m_sleep_condition, threads in wait on m_wait_condition. Both use m_sleep_mutex.
+    std::condition_variable m_sleep_condition;
+    std::condition_variable m_wait_condition;
+    bool m_stopping;
+
+public:
+    explicit pal_threadpool(size_t worker_count);
+    pal_threadpool(const pal_threadpool&) noexcept = delete;
+    pal_threadpool& operator=(const pal_threadpool&) noexcept = delete;
+    pal_threadpool(pal_threadpool&&) noexcept = delete;
+    pal_threadpool& operator=(pal_threadpool&&) noexcept = delete;
+    ~pal_threadpool();
+
+    [[nodiscard]] size_t get_worker_count() const;
+    void submit(callback_t callback, void* user_data, pal_wait_group* wait_group);
+    // Runs queued tasks on the calling thread until every task in wait_group has completed.
+    void wait(pal_wait_group& wait_group);
+
+    // Runs fn(index) for every index in [0, count) on at most threads_len threads, the calling thread
+    // included, and returns once all have completed.
+    template<typename TFn>
+    void parallel_for(const size_t count, const size_t threads_len, TFn&& fn)
+    {
+        std::atomic<size_t> next_index{ 0 };
+        const auto worker = [&]()
+        {
+            size_t index;
+            while ((index = next_index++) < count)
+            {
+                fn(index);
+            }
+        };
+
+        const auto tasks_len = std::min({ get_worker_count(), count > 0 ? count - 1 : 0, threads_len > 0 ? threads_len - 1 : 0 });
+
+        pal_wait_group wait_group;
+        for (auto i = 0u; i < tasks_len; i++)
+        {
+            submit([](void* user_data) { (*static_cast<decltype(worker)*>(user_data))(); },
+                const_cast<void*>(static_cast<const void*>(&worker)), &wait_group);
+        }
+
+        worker();
+        wait(wait_group);
+    }
+
+private:
+    void stop();
+    void worker_main(size_t index);
+    bool try_pop(size_t own_index, task& task_out);
+    void run(const task& task);
+};
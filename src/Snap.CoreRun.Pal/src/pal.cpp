@@ -1,4 +1,9 @@
 #include "pal/pal.hpp"
+#include "pal/pal_io_uring.hpp"
+#include "pal/pal_threadpool.hpp"
+#include "pal/pal_hash.hpp"
+#include "pal/pal_mmap.hpp"
+#include "pal/pal_inflate.hpp"
 #include <cassert>
 
 #if defined(PAL_PLATFORM_WINDOWS)
@@ -7,12 +12,22 @@
 #include <cctype> // toupper
 #include <direct.h> // mkdir
 #include <TlHelp32.h> // CreateToolhelp32Snapshot
+#include <Psapi.h> // GetProcessMemoryInfo
+#include <csignal> // SIGINT
 #include <VersionHelpers.h>
 #include "vendor/rcedit/rcedit.hpp"
 #include <system_error>
 #elif defined(PAL_PLATFORM_LINUX)
 #include <sys/types.h> // O_RDONLY
-#include <sys/wait.h> // wait
+#include <sys/wait.h> // wait4
+#include <sys/resource.h> // rusage, setrlimit
+#include <poll.h> // poll
+#include <sys/signalfd.h> // signalfd
+#include <sys/mman.h> // shm_open
+#include <sys/socket.h> // socket
+#include <sys/un.h> // sockaddr_un
+#include <netinet/in.h> // sockaddr_in
+#include <netdb.h> // getaddrinfo
 #include <unistd.h> // getcwd
 #include <fcntl.h> // open
 #include <dirent.h> // opendir
@@ -20,10 +35,41 @@
 #include <dlfcn.h> // dlopen
 #include <signal.h> // kill
 #include <time.h> // nanosleep
+#include <sys/syscall.h> // SYS_getdents64
+#include <sys/sysmacros.h> // makedev
+#include <sched.h> // sched_getaffinity
+#include <sys/ioctl.h> // ioctl
+#include <sys/file.h> // flock
+#include <pthread.h> // pthread_atfork
+#include <linux/fs.h> // FICLONERANGE
 static const char* symlink_entrypoint_executable = "/proc/self/exe";
+
+#if !defined(SYS_pidfd_open)
+#define SYS_pidfd_open 434
+#endif
+
+#if !defined(SYS_close_range)
+#define SYS_close_range 436
+#endif
+
+// https://man7.org/linux/man-pages/man2/getdents.2.html
+struct pal_linux_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
 #endif
 
 #include <regex>
+#include <algorithm>
+#include <atomic>
+#include <set>
+#include <sstream>
+#include <system_error>
+#include <unordered_map>
 
 // - Generic
 PAL_API BOOL PAL_CALLING_CONVENTION pal_isdebuggerpresent()
@@ -384,18 +430,161 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_process_is_running(pal_pid_t pid)
 
     return is_running ? TRUE : FALSE;
 #elif defined(PAL_PLATFORM_LINUX)
-    struct stat dontcare = { 0 };
-    std::string proc_path("/proc/" + std::to_string(pid));
-    if (stat(proc_path.c_str(), &dontcare) != -1)
+    uint8_t running = 0;
+    return pal_process_is_running_batch(&pid, nullptr, 1, &running) && running != 0 ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+#if defined(PAL_PLATFORM_LINUX)
+// Returns field_in (numbered from 1 as in proc(5)) of a /proc/<pid>/stat line, nullptr when it is missing.
+// The command name is skipped by its closing parenthesis because it may contain spaces.
+static const char* pal_process_stat_field(const char* stat_in, const int field_in)
+{
+    const auto* field = std::strrchr(stat_in, ')');
+    if (field == nullptr)
     {
-        return TRUE;
+        return nullptr;
     }
-    return FALSE;
+
+    for (auto index = 2; index < field_in; index++)
+    {
+        field = std::strchr(field + 1, ' ');
+        if (field == nullptr)
+        {
+            return nullptr;
+        }
+    }
+
+    return field + 1;
+}
+
+static bool pal_process_read_start_time(const pal_pid_t pid, uint64_t* start_time_out)
+{
+    char stat_path[32];
+    snprintf(stat_path, sizeof stat_path, "/proc/%d/stat", static_cast<int>(pid));
+
+    const auto fd = open(stat_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    char buffer[1024];
+    const auto bytes_read = read(fd, buffer, sizeof buffer - 1);
+    close(fd);
+    if (bytes_read <= 0)
+    {
+        return false;
+    }
+    buffer[bytes_read] = '\0';
+
+    const auto* field = pal_process_stat_field(buffer, 22);
+    if (field == nullptr)
+    {
+        return false;
+    }
+
+    char* field_end = nullptr;
+    *start_time_out = std::strtoull(field, &field_end, 10);
+    return field_end != field;
+}
+#endif
+
+// Returns an opaque value that changes when pid_in is reused by another process: the start time of
+// the process in clock ticks after boot on Linux and its creation time on Windows.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_start_time(const pal_pid_t pid_in, uint64_t* start_time_out)
+{
+    if (start_time_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    auto* const process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid_in);
+    if (process == nullptr)
+    {
+        return FALSE;
+    }
+
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    const auto success = GetProcessTimes(process, &creation_time, &exit_time, &kernel_time, &user_time);
+    CloseHandle(process);
+    if (0 == success)
+    {
+        return FALSE;
+    }
+
+    *start_time_out = static_cast<uint64_t>(creation_time.dwHighDateTime) << 32 | creation_time.dwLowDateTime;
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    return pid_in > 0 && pal_process_read_start_time(pid_in, start_time_out) ? TRUE : FALSE;
 #else
     return FALSE;
 #endif
 }
 
+// Checks pids_len_in processes in one pass and sets bit i of running_bitmap_out, which holds
+// (pids_len_in + 7) / 8 bytes, when pids_in[i] is running. When start_times_in is given, a process
+// only counts as running if it still has the start time returned by pal_process_get_start_time, so a
+// reused pid is reported as exited. A start time of 0 skips that check for the process. Like
+// pal_process_is_running, processes that exited but were not reaped yet count as running.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_is_running_batch(const pal_pid_t* pids_in, const uint64_t* start_times_in,
+        const size_t pids_len_in, uint8_t* running_bitmap_out)
+{
+    if (pids_len_in == 0)
+    {
+        return TRUE;
+    }
+
+    if (pids_in == nullptr
+        || running_bitmap_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    std::memset(running_bitmap_out, 0, (pids_len_in + 7) / 8);
+
+    for (auto i = 0u; i < pids_len_in; i++)
+    {
+        const auto pid = pids_in[i];
+        auto is_running = false;
+
+#if defined(PAL_PLATFORM_WINDOWS)
+        auto* const process = OpenProcess(SYNCHRONIZE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+        if (process != nullptr)
+        {
+            is_running = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+            CloseHandle(process);
+        }
+        else
+        {
+            // Protected processes exist even though they cannot be opened.
+            is_running = GetLastError() == ERROR_ACCESS_DENIED;
+        }
+#elif defined(PAL_PLATFORM_LINUX)
+        // kill(0) and negative pids address process groups.
+        is_running = pid > 0 && (0 == kill(pid, 0) || errno == EPERM);
+#endif
+
+        if (is_running
+            && start_times_in != nullptr
+            && start_times_in[i] != 0)
+        {
+            uint64_t start_time = 0;
+            is_running = pal_process_get_start_time(pid, &start_time) && start_time == start_times_in[i];
+        }
+
+        if (is_running)
+        {
+            running_bitmap_out[i / 8] = static_cast<uint8_t>(running_bitmap_out[i / 8] | 1u << (i % 8));
+        }
+    }
+
+    return TRUE;
+}
+
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_kill(pal_pid_t pid)
 {
 #if defined(PAL_PLATFORM_WINDOWS)
@@ -454,12 +643,103 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_process_get_name(char **exe_name_out)
 PAL_API BOOL PAL_CALLING_CONVENTION pal_process_exec(const char *filename_in, const char *working_dir_in,
     const int argc_in, char **argv_in, pal_exit_code_t *exit_code_out)
 {
-    if (filename_in == nullptr)
+    if (exit_code_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    pal_process_exec_stats_t stats = {};
+    if (!pal_process_exec_ex(filename_in, working_dir_in, argc_in, argv_in, 0, 0, &stats))
+    {
+        return FALSE;
+    }
+
+    *exit_code_out = stats.exit_code;
+    return TRUE;
+}
+
+#if defined(PAL_PLATFORM_LINUX)
+// The signal mask survives exec, a child must not inherit the shutdown signals blocked by pal_signal_listener_create.
+// Only called between fork and exec, so it is limited to async-signal-safe functions.
+static void pal_process_child_reset_signal_mask()
+{
+    sigset_t signal_mask;
+    sigemptyset(&signal_mask);
+    sigprocmask(SIG_SETMASK, &signal_mask, nullptr);
+}
+
+// Waits until the child exits, without reaping it. Returns 1 once it exited, 0 when it is still running
+// after timeout_ms and -1 with errno set when waiting failed.
+static int pal_process_wait_child(const pid_t pid, const uint32_t timeout_ms)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    const auto remaining_ms = [&deadline]()
+    {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, remaining.count()));
+    };
+
+    // A pidfd becomes readable when the process exits (Linux 5.3+), older kernels poll with waitid instead.
+    const auto pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    if (pidfd != -1)
+    {
+        struct pollfd poll_fd = { pidfd, POLLIN, 0 };
+        int result;
+        do
+        {
+            result = poll(&poll_fd, 1, remaining_ms());
+        } while (result == -1 && errno == EINTR);
+        const auto poll_errno = errno;
+        close(pidfd);
+        errno = poll_errno;
+        return result == -1 ? -1 : result > 0 ? 1 : 0;
+    }
+
+    uint32_t sleep_ms = 1;
+    while (true)
+    {
+        siginfo_t info = {};
+        if (0 != waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOHANG | WNOWAIT))
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        if (info.si_pid == pid)
+        {
+            return 1;
+        }
+
+        const auto remaining = remaining_ms();
+        if (remaining == 0)
+        {
+            return 0;
+        }
+
+        pal_sleep_ms(std::min(sleep_ms, static_cast<uint32_t>(remaining)));
+        sleep_ms = std::min(sleep_ms * 2, 50u);
+    }
+}
+#endif
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_exec_ex(const char *filename_in, const char *working_dir_in,
+    const int argc_in, char **argv_in, const uint32_t timeout_ms_in, const uint32_t kill_grace_ms_in,
+    pal_process_exec_stats_t *stats_out)
+{
+    if (filename_in == nullptr
+        || stats_out == nullptr)
     {
         return FALSE;
     }
 
+    *stats_out = {};
+
 #if defined(PAL_PLATFORM_WINDOWS)
+    PAL_UNUSED(kill_grace_ms_in);
+
     if (working_dir_in == nullptr)
     {
         return FALSE;
@@ -498,6 +778,7 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_process_exec(const char *filename_in, co
     PROCESS_INFORMATION pi = {};
     pi.hProcess = nullptr;
 
+    const auto started = std::chrono::steady_clock::now();
     const auto create_process_result = CreateProcess(nullptr,
         lp_command_line_utf16_string.data(),
         nullptr, nullptr, false,
@@ -509,1213 +790,7639 @@ PAL_API BOOL PAL_CALLING_CONVENTION pal_process_exec(const char *filename_in, co
         return FALSE;
     }
 
-    const auto result = WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hThread);
+
+    // Windows has no graceful equivalent of SIGTERM for console processes, so the process is terminated right away.
+    auto result = WaitForSingleObject(pi.hProcess, timeout_ms_in == 0 ? INFINITE : timeout_ms_in);
+    if (result == WAIT_TIMEOUT)
+    {
+        stats_out->timed_out = TRUE;
+        TerminateProcess(pi.hProcess, 1);
+        result = WaitForSingleObject(pi.hProcess, INFINITE);
+    }
+
     if (result != WAIT_OBJECT_0)
     {
         LOGE << "WaitForSingleObject: Process exit prematurely. Result: " << result << ". Error code: " << GetLastError();
+        CloseHandle(pi.hProcess);
         return FALSE;
     }
 
+    stats_out->wall_time_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count());
+
     DWORD exit_code;
     if (FALSE == GetExitCodeProcess(pi.hProcess, &exit_code))
     {
         LOGE << "GetExitCodeProcess: Process exit prematurely. Result: " << result << ". Error code: " << GetLastError();
+        CloseHandle(pi.hProcess);
         return FALSE;
     }
 
-    *exit_code_out = exit_code;
-
-    LOGV << "Process exited. Filename: " << filename_in << ". Pid: " << pi.dwProcessId << ". Exit code: " << exit_code;
-
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
+    stats_out->exit_code = exit_code;
 
-    if (working_dir_in != nullptr
-        && 0 != chdir(working_dir_in))
+    // FILETIME is in 100 nanosecond intervals.
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (GetProcessTimes(pi.hProcess, &creation_time, &exit_time, &kernel_time, &user_time))
     {
-        LOGE << "Error changing working directory: " << working_dir_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
-        return FALSE;
+        stats_out->user_time_us = ((static_cast<uint64_t>(user_time.dwHighDateTime) << 32) | user_time.dwLowDateTime) / 10;
+        stats_out->system_time_us = ((static_cast<uint64_t>(kernel_time.dwHighDateTime) << 32) | kernel_time.dwLowDateTime) / 10;
     }
 
-    auto exec_args_len = std::max(1, argc_in + 1);
-    auto exec_args_tmp = new char*[exec_args_len];
-    exec_args_tmp[0] = _strdup(filename_in);
-
-    for (auto i = 0; i < argc_in; i++)
+    PROCESS_MEMORY_COUNTERS memory_counters = {};
+    memory_counters.cb = sizeof memory_counters;
+    if (GetProcessMemoryInfo(pi.hProcess, &memory_counters, sizeof memory_counters))
     {
-        exec_args_tmp[i + 1] = argv_in[i];
+        stats_out->max_rss_kb = memory_counters.PeakWorkingSetSize / 1024;
+        stats_out->minor_faults = memory_counters.PageFaultCount;
     }
 
-    exec_args_tmp[exec_args_len] = nullptr;
+    CloseHandle(pi.hProcess);
 
-    auto exit_status = 0;
-    auto child_pid = fork();
-    if (child_pid == 0)
+    LOGV << "Process exited. Filename: " << filename_in << ". Pid: " << pi.dwProcessId << ". Exit code: " << exit_code;
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto exec_argc = argv_in != nullptr && argc_in > 0 ? argc_in : 0;
+    std::vector<char*> exec_args(static_cast<size_t>(exec_argc) + 2, nullptr);
+    exec_args[0] = const_cast<char*>(filename_in);
+    for (size_t i = 0; i < static_cast<size_t>(exec_argc); i++)
     {
-        if (execvp(exec_args_tmp[0], exec_args_tmp) == -1)
-        {
-            LOGE << "exec failed: " << exec_args_tmp[0] << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
-            return FALSE;
-        }
-    }
-    else if (child_pid > 0) {
-        wait(&exit_status);
-        *exit_code_out = WEXITSTATUS(exit_status);
-        LOGV << "Process exited. Filename: " << exec_args_tmp[0] << ". Pid: " << child_pid << ". Exit code: " << *exit_code_out;
-        return *exit_code_out == -1 ? FALSE : TRUE;
+        exec_args[i + 1] = argv_in[i];
     }
-    return FALSE;
-#else
-    return FALSE;
-#endif
-}
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_process_daemonize(const char *filename_in, const char *working_dir_in,
-    const int argc_in, char **argv_in,
-    const int cmd_show_in /* Only applicable on Windows */,
-    pal_pid_t *pid_out)
-{
-    if (filename_in == nullptr
-        || working_dir_in == nullptr)
+    // The child reports a failed chdir or exec through this pipe, a successful exec closes it.
+    int error_pipe[2];
+    if (0 != pipe2(error_pipe, O_CLOEXEC))
     {
+        LOGE << "pipe2 failed. Errno: " << errno << ". Error code: " << std::strerror(errno);
         return FALSE;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    const auto filename_in_str = std::string(filename_in);
-    if (filename_in_str.size() > PAL_MAX_PATH)
+    const auto started = std::chrono::steady_clock::now();
+    const auto child_pid = fork();
+    if (child_pid == -1)
     {
-        // pCommandLine is limited to MAX_PATH characters.
-        LOGE << "Unable to start executable: " << filename_in_str << ". "
-            << "The path component (filename) exceeds " << PAL_MAX_PATH << " characters. "
-            << "This is a hard limit in the WIN32 API and there is nothing that can be done about it.";
+        LOGE << "fork failed: " << filename_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        close(error_pipe[0]);
+        close(error_pipe[1]);
         return FALSE;
     }
 
-    auto cmd_line = std::string("\"");
-    cmd_line += filename_in_str;
-    cmd_line += "\" ";
-
-    for (auto i = 0; i < argc_in; i++)
+    if (child_pid == 0)
     {
-        cmd_line += argv_in[i];
-        if (i + 1 < argc_in)
+        close(error_pipe[0]);
+        pal_process_child_reset_signal_mask();
+        if (working_dir_in == nullptr || 0 == chdir(working_dir_in))
         {
-            cmd_line += " ";
+            execvp(exec_args[0], exec_args.data());
+        }
+        const auto exec_errno = errno;
+        if (write(error_pipe[1], &exec_errno, sizeof exec_errno) < 0)
+        {
+            // Nothing left to report to.
         }
+        _exit(127);
     }
 
-    pal_utf16_string lp_command_line_utf16_string(cmd_line);
-    pal_utf16_string lp_current_directory_utf16_string(working_dir_in);
+    close(error_pipe[1]);
 
-    STARTUPINFO si = {};
-    si.cb = sizeof si;
-    si.dwFlags = STARTF_USESHOWWINDOW;
-    si.wShowWindow = static_cast<WORD>(cmd_show_in);
+    auto exec_errno = 0;
+    ssize_t exec_errno_len;
+    do
+    {
+        exec_errno_len = read(error_pipe[0], &exec_errno, sizeof exec_errno);
+    } while (exec_errno_len == -1 && errno == EINTR);
+    close(error_pipe[0]);
 
-    PROCESS_INFORMATION pi = {};
-    pi.hProcess = nullptr;
+    const auto waited = exec_errno_len <= 0 && timeout_ms_in > 0 ? pal_process_wait_child(child_pid, timeout_ms_in) : 1;
+    const auto wait_errno = errno;
+    if (waited == 0)
+    {
+        stats_out->timed_out = TRUE;
+        if (kill_grace_ms_in == 0
+            || 0 != kill(child_pid, SIGTERM)
+            || 1 != pal_process_wait_child(child_pid, kill_grace_ms_in))
+        {
+            kill(child_pid, SIGKILL);
+        }
+    }
+    else if (waited == -1)
+    {
+        // The timeout can no longer be enforced, so the child does not get to outlive it.
+        LOGE << "Failed to wait for process: " << filename_in << ". Pid: " << child_pid << ". Errno: " << wait_errno << ". Error code: " << std::strerror(wait_errno);
+        kill(child_pid, SIGKILL);
+    }
 
-    const auto create_process_result = CreateProcess(nullptr, lp_command_line_utf16_string.data(),
-        nullptr, nullptr, false,
-        0, nullptr, lp_current_directory_utf16_string.data(), &si, &pi);
+    struct rusage usage = {};
+    auto status = 0;
+    pid_t wait_result;
+    do
+    {
+        wait_result = wait4(child_pid, &status, 0, &usage);
+    } while (wait_result == -1 && errno == EINTR);
 
-    if (!create_process_result)
+    if (exec_errno_len > 0)
     {
-        LOGE << "CreateProcess: " << cmd_line << ". Error code: " << GetLastError();
+        LOGE << "exec failed: " << filename_in << ". Errno: " << exec_errno << ". Error code: " << std::strerror(exec_errno);
+        errno = exec_errno;
         return FALSE;
     }
 
-    *pid_out = pi.dwProcessId;
-
-    AllowSetForegroundWindow(pi.dwProcessId);
-    WaitForInputIdle(pi.hProcess, 5 * 1000);
-
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    PAL_UNUSED(cmd_show_in);
-
-    if (working_dir_in != nullptr
-        && 0 != chdir(working_dir_in))
+    if (wait_result != child_pid)
     {
-        LOGE << "Error changing working directory: " << working_dir_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        LOGE << "wait4 failed: " << filename_in << ". Pid: " << child_pid << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
         return FALSE;
     }
 
-    auto exec_argc = std::max(1, argc_in + 1);
-    auto exec_args_tmp = new char*[exec_argc];
-    exec_args_tmp[0] = _strdup(filename_in);
-
-    for (auto i = 0; i < argc_in; i++)
+    if (waited == -1)
     {
-        exec_args_tmp[i + 1] = argv_in[i];
+        errno = wait_errno;
+        return FALSE;
     }
 
-    exec_args_tmp[exec_argc] = nullptr;
+    stats_out->wall_time_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count());
 
-    auto child_pid = fork();
-    if (child_pid == 0)
+    if (WIFSIGNALED(status))
     {
-        if (execvp(exec_args_tmp[0], exec_args_tmp) == -1)
-        {
-            LOGE << "exec failed: " << exec_args_tmp[0] << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
-            return FALSE;
-        }
+        // Same convention as the shell.
+        stats_out->term_signal = WTERMSIG(status);
+        stats_out->exit_code = 128 + stats_out->term_signal;
     }
-    else if (child_pid > 0) {
-        *pid_out = child_pid;
+    else
+    {
+        stats_out->exit_code = WEXITSTATUS(status);
     }
 
+    stats_out->user_time_us = static_cast<uint64_t>(usage.ru_utime.tv_sec) * 1000000 + static_cast<uint64_t>(usage.ru_utime.tv_usec);
+    stats_out->system_time_us = static_cast<uint64_t>(usage.ru_stime.tv_sec) * 1000000 + static_cast<uint64_t>(usage.ru_stime.tv_usec);
+    stats_out->max_rss_kb = static_cast<uint64_t>(usage.ru_maxrss);
+    stats_out->major_faults = static_cast<uint64_t>(usage.ru_majflt);
+    stats_out->minor_faults = static_cast<uint64_t>(usage.ru_minflt);
+    stats_out->voluntary_context_switches = static_cast<uint64_t>(usage.ru_nvcsw);
+    stats_out->involuntary_context_switches = static_cast<uint64_t>(usage.ru_nivcsw);
+
+    LOGV << "Process exited. Filename: " << filename_in << ". Pid: " << child_pid << ". Exit code: " << stats_out->exit_code;
+
     return TRUE;
 #else
+    PAL_UNUSED(working_dir_in);
+    PAL_UNUSED(argc_in);
+    PAL_UNUSED(argv_in);
+    PAL_UNUSED(timeout_ms_in);
+    PAL_UNUSED(kill_grace_ms_in);
     return FALSE;
 #endif
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_sleep_ms(const uint32_t milliseconds)
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_daemonize(const char *filename_in, const char *working_dir_in,
+    const int argc_in, char **argv_in,
+    const int cmd_show_in /* Only applicable on Windows */,
+    pal_pid_t *pid_out)
 {
-#if defined(PAL_PLATFORM_WINDOWS)
-    Sleep(milliseconds);
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    struct timespec ts = { 0 };
-    ts.tv_sec = milliseconds / 1000;
-    ts.tv_nsec = (milliseconds % 1000) * 1000000;
-    nanosleep(&ts, nullptr);
-    return TRUE;
-#else
-    return FALSE;
-#endif
+    pal_process_spawn_options_t options = {};
+    options.cmd_show = cmd_show_in;
+    return pal_process_daemonize_ex(filename_in, working_dir_in, argc_in, argv_in, &options, pid_out, nullptr);
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows()
+// Environment variable that tells a gated process where to wait for its release, see pal_standby_wait.
+static const char* pal_process_gate_environment_variable = "SNAPX_CORERUN_STANDBY_FD";
+
+static const size_t pal_process_listen_sockets_max = 64;
+
+#if defined(PAL_PLATFORM_LINUX)
+// Output the application writes while the log pump is busy is buffered in the pipe, see pal_process_output_pump.
+static const int pal_process_output_pipe_size = 1024 * 1024;
+
+// Lines longer than this are split when the log is rotated.
+static const size_t pal_process_output_line_max = 4096;
+
+// Built before fork because the log pump may only use async-signal-safe functions.
+struct pal_process_output_log
 {
-#if defined(PAL_PLATFORM_WINDOWS)
-    return TRUE;
-#else
-    return FALSE;
-#endif
-}
+    std::vector<std::string> filenames{}; // The active log followed by the rotated ones, most recent first.
+    uint64_t max_bytes = 0;
+};
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows_8_or_greater()
+// splice refuses files opened with O_APPEND, the offset is moved to the end instead.
+static int pal_process_output_log_open(const char* filename, uint64_t* size_out)
 {
+    const auto fd = open(filename, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    const auto size = lseek(fd, 0, SEEK_END);
+    *size_out = size > 0 ? static_cast<uint64_t>(size) : 0;
+    return fd;
+}
+
+// Every instance of an application has its own pump, and instances overlap (a standby, the previous version
+// while it drains), so they share the log. Writes happen under an exclusive flock of the active log at its end,
+// and a log that another pump rotated meanwhile is reopened first. Returns the locked log.
+static int pal_process_output_log_lock(const pal_process_output_log& log, int fd, uint64_t* size_out)
+{
+    while (true)
+    {
+        while (-1 == flock(fd, LOCK_EX) && errno == EINTR)
+        {
+        }
+
+        struct stat fd_stat = {};
+        struct stat path_stat = {};
+        if (0 != fstat(fd, &fd_stat)
+            || (0 == stat(log.filenames[0].c_str(), &path_stat)
+                && path_stat.st_dev == fd_stat.st_dev
+                && path_stat.st_ino == fd_stat.st_ino))
+        {
+            break;
+        }
+
+        const auto reopened_fd = pal_process_output_log_open(log.filenames[0].c_str(), size_out);
+        if (reopened_fd == -1)
+        {
+            break;
+        }
+
+        flock(fd, LOCK_UN);
+        close(fd);
+        fd = reopened_fd;
+    }
+
+    const auto size = lseek(fd, 0, SEEK_END);
+    *size_out = size > 0 ? static_cast<uint64_t>(size) : 0;
+    return fd;
+}
+
+// Called with the log locked, returns the new log unlocked.
+static int pal_process_output_log_rotate(const pal_process_output_log& log, const int fd, uint64_t* size_out)
+{
+    if (log.filenames.size() == 1)
+    {
+        if (0 == ftruncate(fd, 0))
+        {
+            lseek(fd, 0, SEEK_SET);
+            *size_out = 0;
+        }
+        flock(fd, LOCK_UN);
+        return fd;
+    }
+
+    for (auto i = log.filenames.size() - 1; i > 0; i--)
+    {
+        rename(log.filenames[i - 1].c_str(), log.filenames[i].c_str());
+    }
+
+    // Not truncated, another pump may already have created the new log and written to it.
+    const auto rotated_fd = pal_process_output_log_open(log.filenames[0].c_str(), size_out);
+    flock(fd, LOCK_UN);
+    if (rotated_fd == -1)
+    {
+        return fd;
+    }
+
+    close(fd);
+    return rotated_fd;
+}
+
+// Moves everything written to output_fd into the log with splice, the data never passes through this process.
+// Only the first bytes after the size limit are copied out (through tee) to rotate the log at the end of a line.
+// When writing the log falls behind so far that the pipe is nearly full the oldest output is dropped instead of
+// blocking the application, and a note with the number of dropped bytes is written to the log. The log is only
+// locked once output is available, see pal_process_output_log_lock.
+// Runs in a forked process until every copy of the write end is closed.
+static void pal_process_output_pump(const int output_fd, int log_fd, uint64_t size, const pal_process_output_log& log)
+{
+    // Both are optional, without them output is never dropped and lines may be split by a rotation.
+    const auto null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    int peek_pipe[2] = { -1, -1 };
+    if (0 != pipe2(peek_pipe, O_CLOEXEC))
+    {
+        peek_pipe[0] = peek_pipe[1] = -1;
+    }
+
+    const auto pipe_size = fcntl(output_fd, F_GETPIPE_SZ);
+    const auto backlog_max = pipe_size > 0 ? pipe_size / 4 * 3 : 0;
+    uint64_t dropped = 0;
+
+    while (true)
+    {
+        auto queued = 0;
+        if (backlog_max > 0
+            && null_fd != -1
+            && 0 == ioctl(output_fd, FIONREAD, &queued)
+            && queued > backlog_max)
+        {
+            const auto drop_len = splice(output_fd, nullptr, null_fd, nullptr,
+                static_cast<size_t>(queued - pipe_size / 4), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (drop_len > 0)
+            {
+                dropped += static_cast<uint64_t>(drop_len);
+                continue;
+            }
+        }
+
+        struct pollfd poll_fd = { output_fd, POLLIN, 0 };
+        if (-1 == poll(&poll_fd, 1, -1))
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        log_fd = pal_process_output_log_lock(log, log_fd, &size);
+
+        if (dropped > 0)
+        {
+            char note[64] = "[corerun] output dropped, bytes: ";
+            auto note_len = std::strlen(note);
+            char digits[24];
+            auto digits_len = 0;
+            for (auto value = dropped; value > 0; value /= 10)
+            {
+                digits[digits_len++] = static_cast<char>('0' + value % 10);
+            }
+            while (digits_len > 0)
+            {
+                note[note_len++] = digits[--digits_len];
+            }
+            note[note_len++] = '\n';
+            if (write(log_fd, note, note_len) > 0)
+            {
+                size += note_len;
+            }
+            dropped = 0;
+        }
+
+        size_t splice_len = pal_process_output_pipe_size;
+        auto rotate = false;
+        if (log.max_bytes > 0 && size >= log.max_bytes)
+        {
+            if (peek_pipe[0] == -1)
+            {
+                log_fd = pal_process_output_log_rotate(log, log_fd, &size);
+                continue;
+            }
+
+            // Only sees what is buffered right now. When the line that crossed the limit is not complete yet
+            // the log is rotated after the part that is there, and the rest of the line starts the new log.
+            const auto peek_len = tee(output_fd, peek_pipe[1], pal_process_output_line_max, 0);
+            if (peek_len <= 0)
+            {
+                flock(log_fd, LOCK_UN);
+                if (peek_len == -1 && errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+
+            char line[pal_process_output_line_max];
+            auto line_len = static_cast<size_t>(peek_len);
+            const auto read_len = read(peek_pipe[0], line, line_len);
+            for (size_t i = 0; read_len > 0 && i < static_cast<size_t>(read_len); i++)
+            {
+                if (line[i] == '\n')
+                {
+                    line_len = i + 1;
+                    break;
+                }
+            }
+            splice_len = line_len;
+            rotate = true;
+        }
+        else if (log.max_bytes > 0)
+        {
+            splice_len = static_cast<size_t>(std::min<uint64_t>(splice_len, log.max_bytes - size));
+        }
+
+        auto written = splice(output_fd, nullptr, log_fd, nullptr, splice_len, SPLICE_F_MOVE);
+        if (written == -1 && errno == EINTR)
+        {
+            flock(log_fd, LOCK_UN);
+            continue;
+        }
+        if (written == -1 && null_fd != -1)
+        {
+            // The log is not writable (ENOSPC, EIO), the application keeps running without its output.
+            flock(log_fd, LOCK_UN);
+            written = splice(output_fd, nullptr, null_fd, nullptr, splice_len, SPLICE_F_MOVE);
+            if (written > 0)
+            {
+                dropped += static_cast<uint64_t>(written);
+                continue;
+            }
+        }
+        if (written <= 0)
+        {
+            flock(log_fd, LOCK_UN);
+            break;
+        }
+        size += static_cast<uint64_t>(written);
+
+        if (rotate)
+        {
+            log_fd = pal_process_output_log_rotate(log, log_fd, &size);
+        }
+        else
+        {
+            flock(log_fd, LOCK_UN);
+        }
+    }
+
+    for (const auto fd : { peek_pipe[0], peek_pipe[1], null_fd, log_fd })
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+}
+
+// Starts the log pump of a process that is about to be started and returns the write end of its pipe.
+// The pump is forked twice so that it is adopted by init and never becomes a zombie of this process.
+static int pal_process_output_pump_start(const pal_process_spawn_options_t* options_in)
+{
+    pal_process_output_log log;
+    log.max_bytes = options_in->output_log_max_bytes;
+    log.filenames.emplace_back(options_in->output_log_filename);
+    for (uint32_t i = 1; log.max_bytes > 0 && i <= options_in->output_log_max_files; i++)
+    {
+        log.filenames.push_back(std::string(options_in->output_log_filename) + "." + std::to_string(i));
+    }
+
+    uint64_t log_size = 0;
+    const auto log_fd = pal_process_output_log_open(options_in->output_log_filename, &log_size);
+    if (log_fd == -1)
+    {
+        LOGE << "Unable to open output log: " << options_in->output_log_filename << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return -1;
+    }
+
+    int output_pipe[2];
+    if (0 != pipe2(output_pipe, O_CLOEXEC))
+    {
+        LOGE << "pipe2 failed. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        close(log_fd);
+        return -1;
+    }
+
+    // Best effort, the default of 64 KiB is used when this exceeds /proc/sys/fs/pipe-max-size.
+    fcntl(output_pipe[1], F_SETPIPE_SZ, pal_process_output_pipe_size);
+
+    const auto pump_parent_pid = fork();
+    if (pump_parent_pid == 0)
+    {
+        if (fork() == 0)
+        {
+            // Everything else this process inherited, listening sockets in particular, would be kept open
+            // for as long as the application writes output.
+            pal_process_child_reset_signal_mask();
+            if (dup2(output_pipe[0], 0) != -1
+                && dup2(log_fd, 1) != -1)
+            {
+                if (0 != syscall(SYS_close_range, 2, ~0U, 0))
+                {
+                    // Kernels before 5.9, descriptors above the default soft limit are left open.
+                    for (auto fd = 2; fd < 1024; fd++)
+                    {
+                        close(fd);
+                    }
+                }
+                pal_process_output_pump(0, 1, log_size, log);
+            }
+            _exit(0);
+        }
+        _exit(0);
+    }
+
+    close(output_pipe[0]);
+    close(log_fd);
+    if (pump_parent_pid == -1)
+    {
+        LOGE << "fork failed: " << options_in->output_log_filename << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        close(output_pipe[1]);
+        return -1;
+    }
+
+    waitpid(pump_parent_pid, nullptr, 0);
+    return output_pipe[1];
+}
+
+// Everything pal_process_launch_policy_apply needs that would allocate, built before fork.
+struct pal_process_launch_policy_state
+{
+    cpu_set_t* cpu_set = nullptr;
+    size_t cpu_set_size = 0;
+    char oom_score_adj[16] = {};
+    size_t oom_score_adj_len = 0;
+
+    ~pal_process_launch_policy_state()
+    {
+        if (cpu_set != nullptr)
+        {
+            CPU_FREE(cpu_set);
+        }
+    }
+};
+
+static bool pal_process_launch_policy_prepare(const pal_process_launch_policy_t* policy, pal_process_launch_policy_state& state)
+{
+    const auto realtime = policy->scheduler == PAL_PROCESS_SCHEDULER_FIFO || policy->scheduler == PAL_PROCESS_SCHEDULER_RR;
+    if ((policy->affinity_cpus_len > 0 && policy->affinity_cpus == nullptr)
+        || static_cast<int>(policy->scheduler) < PAL_PROCESS_SCHEDULER_INHERIT
+        || static_cast<int>(policy->scheduler) > PAL_PROCESS_SCHEDULER_RR
+        || (realtime && (policy->scheduler_priority < 1 || policy->scheduler_priority > 99))
+        || (policy->nice_set && (policy->nice < -20 || policy->nice > 19))
+        || static_cast<int>(policy->io_class) < PAL_PROCESS_IO_CLASS_INHERIT
+        || static_cast<int>(policy->io_class) > PAL_PROCESS_IO_CLASS_IDLE
+        || policy->io_level < 0
+        || policy->io_level > 7
+        || (policy->oom_score_adj_set && (policy->oom_score_adj < -1000 || policy->oom_score_adj > 1000)))
+    {
+        LOGE << "Invalid launch policy.";
+        return false;
+    }
+
+    if (policy->affinity_cpus_len > 0)
+    {
+        const auto cpus_len = static_cast<size_t>(*std::max_element(policy->affinity_cpus, policy->affinity_cpus + policy->affinity_cpus_len)) + 1;
+        state.cpu_set = CPU_ALLOC(cpus_len);
+        if (state.cpu_set == nullptr)
+        {
+            return false;
+        }
+
+        state.cpu_set_size = CPU_ALLOC_SIZE(cpus_len);
+        CPU_ZERO_S(state.cpu_set_size, state.cpu_set);
+        for (size_t i = 0; i < policy->affinity_cpus_len; i++)
+        {
+            CPU_SET_S(policy->affinity_cpus[i], state.cpu_set_size, state.cpu_set);
+        }
+    }
+
+    if (policy->oom_score_adj_set)
+    {
+        const auto oom_score_adj = std::to_string(policy->oom_score_adj);
+        state.oom_score_adj_len = oom_score_adj.size();
+        std::memcpy(state.oom_score_adj, oom_score_adj.data(), oom_score_adj.size());
+    }
+
+    return true;
+}
+
+// Runs in the child between fork and exec, so it only makes system calls. Returns false with errno set.
+static bool pal_process_launch_policy_apply(const pal_process_launch_policy_t* policy, const pal_process_launch_policy_state& state)
+{
+    if (state.cpu_set != nullptr
+        && 0 != sched_setaffinity(0, state.cpu_set_size, state.cpu_set))
+    {
+        return false;
+    }
+
+    if (policy->scheduler != PAL_PROCESS_SCHEDULER_INHERIT)
+    {
+        static const int schedulers[] = { SCHED_OTHER, SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR };
+        struct sched_param param = {};
+        param.sched_priority = policy->scheduler == PAL_PROCESS_SCHEDULER_FIFO || policy->scheduler == PAL_PROCESS_SCHEDULER_RR
+            ? policy->scheduler_priority : 0;
+        if (0 != sched_setscheduler(0, schedulers[policy->scheduler], &param))
+        {
+            return false;
+        }
+    }
+
+    if (policy->nice_set
+        && 0 != setpriority(PRIO_PROCESS, 0, policy->nice))
+    {
+        return false;
+    }
+
+    // ioprio_set has no glibc wrapper, the value is IOPRIO_PRIO_VALUE(class, level) of IOPRIO_WHO_PROCESS.
+    if (policy->io_class != PAL_PROCESS_IO_CLASS_INHERIT)
+    {
+        const auto io_priority = static_cast<int>(policy->io_class) << 13
+            | (policy->io_class == PAL_PROCESS_IO_CLASS_IDLE ? 0 : policy->io_level);
+        if (0 != syscall(SYS_ioprio_set, 1, 0, io_priority))
+        {
+            return false;
+        }
+    }
+
+    if (policy->oom_score_adj_set)
+    {
+        const auto fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return false;
+        }
+        const auto written = write(fd, state.oom_score_adj, state.oom_score_adj_len);
+        const auto write_errno = errno;
+        close(fd);
+        if (written != static_cast<ssize_t>(state.oom_score_adj_len))
+        {
+            errno = write_errno;
+            return false;
+        }
+    }
+
+    // Only the soft limit is set. Raising the hard limit needs privileges, and lowering it would bind
+    // everything the application starts; a limit above the hard limit is clamped to it.
+    const auto set_limit = [](const int resource, const uint64_t limit)
+    {
+        struct rlimit value = {};
+        if (limit == 0)
+        {
+            return true;
+        }
+        if (0 != getrlimit(resource, &value))
+        {
+            return false;
+        }
+        const auto soft_limit = limit == UINT64_MAX ? RLIM_INFINITY : static_cast<rlim_t>(limit);
+        value.rlim_cur = value.rlim_max == RLIM_INFINITY ? soft_limit : std::min(soft_limit, value.rlim_max);
+        return 0 == setrlimit(resource, &value);
+    };
+
+    return set_limit(RLIMIT_NOFILE, policy->rlimit_nofile)
+        && set_limit(RLIMIT_MEMLOCK, policy->rlimit_memlock);
+}
+#endif
+
+struct pal_process_gate
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    HANDLE write_handle;
+#elif defined(PAL_PLATFORM_LINUX)
+    int write_fd;
+#endif
+};
+
+// Starts a process without waiting for it. When options_in->gated is set the process receives the read end
+// of a pipe and blocks in pal_standby_wait until pal_process_gate_release is called with gate_out.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_daemonize_ex(const char *filename_in, const char *working_dir_in,
+    const int argc_in, char **argv_in, const pal_process_spawn_options_t *options_in,
+    pal_pid_t *pid_out, pal_process_gate_t** gate_out)
+{
+    if (filename_in == nullptr
+        || working_dir_in == nullptr
+        || options_in == nullptr
+        || pid_out == nullptr
+        || (options_in->gated && gate_out == nullptr)
+        || (options_in->listen_sockets_len > 0 && options_in->listen_sockets == nullptr)
+        || options_in->listen_sockets_len > pal_process_listen_sockets_max
+        || (options_in->environment_len > 0 && options_in->environment == nullptr))
+    {
+        return FALSE;
+    }
+
+    // Length of the name of an environment entry, "NAME=value" or just "NAME".
+    const auto environment_name_len = [](const char* entry)
+    {
+        const auto* const separator = std::strchr(entry, '=');
+        return separator != nullptr ? static_cast<size_t>(separator - entry) : std::strlen(entry);
+    };
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    if (options_in->listen_sockets_len > 0)
+    {
+        LOGE << "Passing listening sockets to a process is not supported on Windows.";
+        return FALSE;
+    }
+
+    if (options_in->output_log_filename != nullptr)
+    {
+        LOGE << "Capturing the output of a process is not supported on Windows.";
+        return FALSE;
+    }
+
+    if (options_in->policy != nullptr)
+    {
+        LOGE << "Launch policies are not supported on Windows.";
+        return FALSE;
+    }
+
+    const auto filename_in_str = std::string(filename_in);
+    if (filename_in_str.size() > PAL_MAX_PATH)
+    {
+        // pCommandLine is limited to MAX_PATH characters.
+        LOGE << "Unable to start executable: " << filename_in_str << ". "
+            << "The path component (filename) exceeds " << PAL_MAX_PATH << " characters. "
+            << "This is a hard limit in the WIN32 API and there is nothing that can be done about it.";
+        return FALSE;
+    }
+
+    auto cmd_line = std::string("\"");
+    cmd_line += filename_in_str;
+    cmd_line += "\" ";
+
+    for (auto i = 0; i < argc_in; i++)
+    {
+        cmd_line += argv_in[i];
+        if (i + 1 < argc_in)
+        {
+            cmd_line += " ";
+        }
+    }
+
+    pal_utf16_string lp_command_line_utf16_string(cmd_line);
+    pal_utf16_string lp_current_directory_utf16_string(working_dir_in);
+
+    // Only the read end is inherited. The handle value is passed through the environment, which the child
+    // copies from this process while CreateProcess runs.
+    HANDLE gate_read = nullptr;
+    HANDLE gate_write = nullptr;
+    pal_utf16_string gate_variable_utf16_string(pal_process_gate_environment_variable);
+    if (options_in->gated)
+    {
+        SECURITY_ATTRIBUTES security_attributes = {};
+        security_attributes.nLength = sizeof security_attributes;
+        security_attributes.bInheritHandle = TRUE;
+        if (!CreatePipe(&gate_read, &gate_write, &security_attributes, 0))
+        {
+            LOGE << "CreatePipe: " << cmd_line << ". Error code: " << GetLastError();
+            return FALSE;
+        }
+        SetHandleInformation(gate_write, HANDLE_FLAG_INHERIT, 0);
+
+        pal_utf16_string gate_value_utf16_string(std::to_string(reinterpret_cast<uintptr_t>(gate_read)));
+        SetEnvironmentVariable(gate_variable_utf16_string.data(), gate_value_utf16_string.data());
+    }
+
+    // Built from the environment of this process after the gate variable was set. Names are case insensitive.
+    std::wstring environment_block;
+    if (options_in->environment_len > 0)
+    {
+        std::vector<std::wstring> environment_names;
+        for (size_t i = 0; i < options_in->environment_len; i++)
+        {
+            const std::string entry(options_in->environment[i]);
+            environment_names.emplace_back(pal_utf16_string(entry.substr(0, environment_name_len(entry.c_str()))).data());
+        }
+
+        auto* const environment_strings = GetEnvironmentStringsW();
+        for (const auto* variable = environment_strings; *variable != L'\0'; variable += wcslen(variable) + 1)
+        {
+            // Names of the per-drive working directories start with '='.
+            const std::wstring entry(variable);
+            const auto name = entry.substr(0, entry.find(L'=', 1));
+            if (std::none_of(environment_names.begin(), environment_names.end(), [&name](const std::wstring& environment_name)
+                {
+                    return _wcsicmp(environment_name.c_str(), name.c_str()) == 0;
+                }))
+            {
+                environment_block += entry;
+                environment_block += L'\0';
+            }
+        }
+        FreeEnvironmentStringsW(environment_strings);
+
+        for (size_t i = 0; i < options_in->environment_len; i++)
+        {
+            if (std::strchr(options_in->environment[i], '=') != nullptr)
+            {
+                environment_block += pal_utf16_string(std::string(options_in->environment[i])).data();
+                environment_block += L'\0';
+            }
+        }
+        environment_block += L'\0';
+    }
+
+    STARTUPINFO si = {};
+    si.cb = sizeof si;
+    si.dwFlags = STARTF_USESHOWWINDOW;
+    si.wShowWindow = static_cast<WORD>(options_in->cmd_show);
+
+    PROCESS_INFORMATION pi = {};
+    pi.hProcess = nullptr;
+
+    const auto create_process_result = CreateProcess(nullptr, lp_command_line_utf16_string.data(),
+        nullptr, nullptr, options_in->gated ? TRUE : FALSE,
+        environment_block.empty() ? 0 : CREATE_UNICODE_ENVIRONMENT,
+        environment_block.empty() ? nullptr : &environment_block[0],
+        lp_current_directory_utf16_string.data(), &si, &pi);
+    const auto create_process_error = GetLastError();
+
+    if (options_in->gated)
+    {
+        SetEnvironmentVariable(gate_variable_utf16_string.data(), nullptr);
+        CloseHandle(gate_read);
+    }
+
+    if (!create_process_result)
+    {
+        LOGE << "CreateProcess: " << cmd_line << ". Error code: " << create_process_error;
+        if (gate_write != nullptr)
+        {
+            CloseHandle(gate_write);
+        }
+        return FALSE;
+    }
+
+    *pid_out = pi.dwProcessId;
+
+    if (options_in->gated)
+    {
+        auto gate = new pal_process_gate();
+        gate->write_handle = gate_write;
+        *gate_out = gate;
+    }
+    else
+    {
+        AllowSetForegroundWindow(pi.dwProcessId);
+        WaitForInputIdle(pi.hProcess, 5 * 1000);
+    }
+
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto exec_argc = argv_in != nullptr && argc_in > 0 ? argc_in : 0;
+    std::vector<char*> exec_args(static_cast<size_t>(exec_argc) + 2, nullptr);
+    exec_args[0] = const_cast<char*>(filename_in);
+    for (size_t i = 0; i < static_cast<size_t>(exec_argc); i++)
+    {
+        exec_args[i + 1] = argv_in[i];
+    }
+
+    pal_process_launch_policy_state policy_state;
+    if (options_in->policy != nullptr
+        && !pal_process_launch_policy_prepare(options_in->policy, policy_state))
+    {
+        return FALSE;
+    }
+
+    // Started first, the pump must not inherit the pipes below or it would keep them open.
+    auto output_fd = -1;
+    if (options_in->output_log_filename != nullptr)
+    {
+        output_fd = pal_process_output_pump_start(options_in);
+        if (output_fd == -1)
+        {
+            return FALSE;
+        }
+    }
+
+    int gate_pipe[2] = { -1, -1 };
+    if (options_in->gated && 0 != pipe2(gate_pipe, O_CLOEXEC))
+    {
+        LOGE << "pipe2 failed. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        if (output_fd != -1)
+        {
+            close(output_fd);
+        }
+        return FALSE;
+    }
+
+    // The child reports a failed chdir or exec through this pipe, a successful exec closes it.
+    int error_pipe[2];
+    if (0 != pipe2(error_pipe, O_CLOEXEC))
+    {
+        LOGE << "pipe2 failed. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        for (const auto fd : { gate_pipe[0], gate_pipe[1], output_fd })
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+        return FALSE;
+    }
+
+    // Listening sockets become fds 3, 4, ... in the child, the pipes it keeps must not be in the way.
+    const auto listen_fds_len = static_cast<int>(options_in->listen_sockets_len);
+    const auto first_free_fd = 3 + listen_fds_len;
+    const auto move_fd_above_listen_fds = [first_free_fd](int& fd)
+    {
+        if (fd != -1 && fd < first_free_fd)
+        {
+            const auto moved_fd = fcntl(fd, F_DUPFD_CLOEXEC, first_free_fd);
+            if (moved_fd != -1)
+            {
+                close(fd);
+                fd = moved_fd;
+            }
+        }
+        return fd >= first_free_fd || fd == -1;
+    };
+
+    if (!move_fd_above_listen_fds(gate_pipe[0])
+        || !move_fd_above_listen_fds(error_pipe[1])
+        || !move_fd_above_listen_fds(output_fd))
+    {
+        LOGE << "Unable to make room for listening sockets. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        for (const auto fd : { gate_pipe[0], gate_pipe[1], error_pipe[0], error_pipe[1], output_fd })
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+        return FALSE;
+    }
+
+    // Built before fork because the child may only use async-signal-safe functions. A gate or sockets inherited
+    // from the process that started this one are never passed on.
+    std::vector<char*> exec_env;
+    for (auto* variable = environ; *variable != nullptr; variable++)
+    {
+        const auto is_variable = [variable](const char* name, const size_t name_len)
+        {
+            return 0 == std::strncmp(*variable, name, name_len) && (*variable)[name_len] == '=';
+        };
+
+        const auto is_replaced = std::any_of(options_in->environment, options_in->environment + options_in->environment_len,
+            [&](const char* entry)
+            {
+                return is_variable(entry, environment_name_len(entry));
+            });
+
+        if (!is_replaced
+            && !is_variable(pal_process_gate_environment_variable, std::strlen(pal_process_gate_environment_variable))
+            && !is_variable("LISTEN_FDS", std::strlen("LISTEN_FDS"))
+            && !is_variable("LISTEN_PID", std::strlen("LISTEN_PID"))
+            && !is_variable("LISTEN_FDNAMES", std::strlen("LISTEN_FDNAMES")))
+        {
+            exec_env.push_back(*variable);
+        }
+    }
+
+    for (size_t i = 0; i < options_in->environment_len; i++)
+    {
+        if (std::strchr(options_in->environment[i], '=') != nullptr)
+        {
+            exec_env.push_back(const_cast<char*>(options_in->environment[i]));
+        }
+    }
+
+    const auto gate_variable = std::string(pal_process_gate_environment_variable) + "=" + std::to_string(gate_pipe[0]);
+    if (options_in->gated)
+    {
+        exec_env.push_back(const_cast<char*>(gate_variable.c_str()));
+    }
+
+    // The pid is only known in the child, which fills in the digits.
+    const auto listen_fds_variable = "LISTEN_FDS=" + std::to_string(listen_fds_len);
+    char listen_pid_variable[32] = "LISTEN_PID=";
+    if (listen_fds_len > 0)
+    {
+        exec_env.push_back(const_cast<char*>(listen_fds_variable.c_str()));
+        exec_env.push_back(listen_pid_variable);
+    }
+    exec_env.push_back(nullptr);
+
+    const auto child_pid = fork();
+    if (child_pid == 0)
+    {
+        close(error_pipe[0]);
+        pal_process_child_reset_signal_mask();
+
+        auto listen_fds_ready = true;
+        if (listen_fds_len > 0)
+        {
+            char pid_digits[16];
+            auto pid_digits_len = 0;
+            for (auto pid = getpid(); pid > 0; pid /= 10)
+            {
+                pid_digits[pid_digits_len++] = static_cast<char>('0' + pid % 10);
+            }
+            auto* listen_pid_end = listen_pid_variable + std::strlen("LISTEN_PID=");
+            while (pid_digits_len > 0)
+            {
+                *listen_pid_end++ = pid_digits[--pid_digits_len];
+            }
+            *listen_pid_end = '\0';
+
+            // Copied out of the way first because a socket may already occupy the slot of another one.
+            int listen_fds_tmp[pal_process_listen_sockets_max];
+            for (auto i = 0; listen_fds_ready && i < listen_fds_len; i++)
+            {
+                listen_fds_tmp[i] = fcntl(options_in->listen_sockets[i], F_DUPFD, first_free_fd);
+                listen_fds_ready = listen_fds_tmp[i] != -1;
+            }
+            for (auto i = 0; listen_fds_ready && i < listen_fds_len; i++)
+            {
+                listen_fds_ready = dup2(listen_fds_tmp[i], 3 + i) != -1;
+                close(listen_fds_tmp[i]);
+            }
+        }
+
+        if (listen_fds_ready
+            && (options_in->policy == nullptr || pal_process_launch_policy_apply(options_in->policy, policy_state))
+            && (output_fd == -1 || (dup2(output_fd, STDOUT_FILENO) != -1 && dup2(output_fd, STDERR_FILENO) != -1))
+            && (!options_in->gated || 0 == fcntl(gate_pipe[0], F_SETFD, 0))
+            && 0 == chdir(working_dir_in))
+        {
+            execvpe(exec_args[0], exec_args.data(), exec_env.data());
+        }
+        const auto exec_errno = errno;
+        if (write(error_pipe[1], &exec_errno, sizeof exec_errno) < 0)
+        {
+            // Nothing left to report to.
+        }
+        _exit(127);
+    }
+
+    close(error_pipe[1]);
+    if (options_in->gated)
+    {
+        close(gate_pipe[0]);
+    }
+    if (output_fd != -1)
+    {
+        close(output_fd);
+    }
+
+    auto exec_errno = child_pid == -1 ? errno : 0;
+    ssize_t exec_errno_len = 0;
+    if (child_pid != -1)
+    {
+        do
+        {
+            exec_errno_len = read(error_pipe[0], &exec_errno, sizeof exec_errno);
+        } while (exec_errno_len == -1 && errno == EINTR);
+    }
+    close(error_pipe[0]);
+
+    if (child_pid == -1 || exec_errno_len > 0)
+    {
+        LOGE << "exec failed: " << filename_in << ". Errno: " << exec_errno << ". Error code: " << std::strerror(exec_errno);
+        if (child_pid != -1)
+        {
+            waitpid(child_pid, nullptr, 0);
+        }
+        if (options_in->gated)
+        {
+            close(gate_pipe[1]);
+        }
+        errno = exec_errno;
+        return FALSE;
+    }
+
+    *pid_out = child_pid;
+
+    if (options_in->gated)
+    {
+        auto gate = new pal_process_gate();
+        gate->write_fd = gate_pipe[1];
+        *gate_out = gate;
+    }
+
+    return TRUE;
+#else
+    PAL_UNUSED(argc_in);
+    PAL_UNUSED(argv_in);
+    PAL_UNUSED(gate_out);
+    return FALSE;
+#endif
+}
+
+// Lets the gated process continue and frees the gate.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_gate_release(pal_process_gate_t* gate_in)
+{
+    if (gate_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    const char release = 1;
+#if defined(PAL_PLATFORM_WINDOWS)
+    DWORD bytes_written = 0;
+    const auto released = WriteFile(gate_in->write_handle, &release, 1, &bytes_written, nullptr) && bytes_written == 1;
+    CloseHandle(gate_in->write_handle);
+#elif defined(PAL_PLATFORM_LINUX)
+    ssize_t bytes_written;
+    do
+    {
+        bytes_written = write(gate_in->write_fd, &release, 1);
+    } while (bytes_written == -1 && errno == EINTR);
+    const auto released = bytes_written == 1;
+    close(gate_in->write_fd);
+#else
+    const auto released = false;
+#endif
+
+    delete gate_in;
+    return released ? TRUE : FALSE;
+}
+
+// Frees the gate without releasing the process, pal_standby_wait returns with released_out set to FALSE.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_gate_cancel(pal_process_gate_t* gate_in)
+{
+    if (gate_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    CloseHandle(gate_in->write_handle);
+#elif defined(PAL_PLATFORM_LINUX)
+    close(gate_in->write_fd);
+#endif
+
+    delete gate_in;
+    return TRUE;
+}
+
+// Called by an application after its own initialization. When it was started gated by pal_process_daemonize_ex
+// this blocks until the gate is released (released_out is TRUE) or cancelled (FALSE, the application should exit).
+// Otherwise it returns right away with released_out set to TRUE.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_standby_wait(BOOL* released_out)
+{
+    if (released_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    *released_out = TRUE;
+
+    char* gate_value = nullptr;
+    if (!pal_env_get(pal_process_gate_environment_variable, &gate_value))
+    {
+        return TRUE;
+    }
+
+    // Processes started by the application must not wait on the same gate.
+    const auto gate = std::strtoull(gate_value, nullptr, 10);
+    free(gate_value);
+
+    char release = 0;
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string gate_variable_utf16_string(pal_process_gate_environment_variable);
+    SetEnvironmentVariable(gate_variable_utf16_string.data(), nullptr);
+
+    const auto gate_handle = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(gate));
+    DWORD bytes_read = 0;
+    *released_out = ReadFile(gate_handle, &release, 1, &bytes_read, nullptr) && bytes_read == 1 ? TRUE : FALSE;
+    CloseHandle(gate_handle);
+#elif defined(PAL_PLATFORM_LINUX)
+    unsetenv(pal_process_gate_environment_variable);
+
+    const auto gate_fd = static_cast<int>(gate);
+    ssize_t bytes_read;
+    do
+    {
+        bytes_read = read(gate_fd, &release, 1);
+    } while (bytes_read == -1 && errno == EINTR);
+    *released_out = bytes_read == 1 ? TRUE : FALSE;
+    close(gate_fd);
+#endif
+
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_sleep_ms(const uint32_t milliseconds)
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    Sleep(milliseconds);
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    struct timespec ts = { 0 };
+    ts.tv_sec = milliseconds / 1000;
+    ts.tv_nsec = (milliseconds % 1000) * 1000000;
+    nanosleep(&ts, nullptr);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows()
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows_8_or_greater()
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    return ::IsWindows8OrGreater() ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows_7_or_greater()
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    return ::IsWindows7OrGreater() ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_is_linux()
+{
+#if defined(PAL_PLATFORM_LINUX)
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_is_unknown_os()
+{
+    return pal_is_linux()
+        || pal_is_windows() ? FALSE : TRUE;
+}
+
+// - Threading
+
+#if defined(PAL_PLATFORM_LINUX)
+static size_t pal_cpu_get_affinity_count()
+{
+    // The mask has to be large enough for every possible cpu, otherwise sched_getaffinity fails with EINVAL.
+    for (size_t cpus_len = 1024; cpus_len <= 1u << 16; cpus_len *= 2)
+    {
+        auto* const cpu_set = CPU_ALLOC(cpus_len);
+        if (cpu_set == nullptr)
+        {
+            break;
+        }
+
+        const auto cpu_set_size = CPU_ALLOC_SIZE(cpus_len);
+        CPU_ZERO_S(cpu_set_size, cpu_set);
+
+        if (0 == sched_getaffinity(0, cpu_set_size, cpu_set))
+        {
+            const auto count = CPU_COUNT_S(cpu_set_size, cpu_set);
+            CPU_FREE(cpu_set);
+            return static_cast<size_t>(count);
+        }
+
+        const auto error = errno;
+        CPU_FREE(cpu_set);
+
+        if (error != EINVAL)
+        {
+            break;
+        }
+    }
+
+    const auto online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? static_cast<size_t>(online) : 1;
+}
+
+// Parses a cgroup v2 cpu.max ("max 100000" or "<quota> <period>") or a cgroup v1 quota/period pair
+// and rounds the quota up to whole cpus.
+static BOOL pal_cpu_quota_to_count(const long long quota, const long long period, size_t* count_out)
+{
+    if (quota <= 0 || period <= 0)
+    {
+        return FALSE;
+    }
+
+    *count_out = static_cast<size_t>(std::max(1LL, (quota + period - 1) / period));
+    return TRUE;
+}
+
+static BOOL pal_cpu_read_file_str(const std::string& filename, std::string& contents_out)
+{
+    char* contents = nullptr;
+    size_t contents_len = 0;
+    if (!pal_fs_file_exists(filename.c_str())
+        || !pal_fs_read_file(filename.c_str(), &contents, &contents_len))
+    {
+        return FALSE;
+    }
+
+    contents_out.assign(contents, contents_len);
+    delete[] contents;
+    return TRUE;
+}
+
+// Calls fn with every cgroup directory that can limit controller for this process: on cgroup v2 its cgroup and
+// each of the ancestors, which can impose limits of their own. On cgroup v1 the cgroup in the hierarchy of the
+// controller, or its root because inside a container the cgroup is usually mounted there. fn returns true when
+// it found the limit files of a v1 directory, which ends the search of that hierarchy.
+template <typename TFn>
+static BOOL pal_cgroup_visit(const std::string& controller, TFn&& fn)
+{
+    std::string cgroups;
+    if (!pal_cpu_read_file_str("/proc/self/cgroup", cgroups))
+    {
+        return FALSE;
+    }
+
+    std::istringstream cgroups_stream(cgroups);
+    std::string line;
+    while (std::getline(cgroups_stream, line))
+    {
+        // hierarchy-id:controllers:path
+        const auto controllers_start = line.find(':');
+        const auto path_start = controllers_start == std::string::npos ? std::string::npos : line.find(':', controllers_start + 1);
+        if (path_start == std::string::npos)
+        {
+            continue;
+        }
+
+        const auto controllers = line.substr(controllers_start + 1, path_start - controllers_start - 1);
+        auto cgroup_path = line.substr(path_start + 1);
+
+        if (controllers.empty())
+        {
+            while (true)
+            {
+                fn("/sys/fs/cgroup" + cgroup_path, true);
+
+                if (cgroup_path.empty() || cgroup_path == "/")
+                {
+                    break;
+                }
+
+                cgroup_path.erase(cgroup_path.find_last_of('/'));
+            }
+            continue;
+        }
+
+        std::istringstream controllers_stream(controllers);
+        std::string controller_name;
+        auto has_controller = false;
+        while (std::getline(controllers_stream, controller_name, ','))
+        {
+            has_controller |= controller_name == controller;
+        }
+
+        if (!has_controller)
+        {
+            continue;
+        }
+
+        for (const auto& cgroup_dir : { "/sys/fs/cgroup/" + controller + cgroup_path, "/sys/fs/cgroup/" + controller })
+        {
+            if (fn(cgroup_dir, false))
+            {
+                break;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+static BOOL pal_cpu_get_cgroup_limit(size_t* limit_out)
+{
+    auto limited = FALSE;
+    auto limit = SIZE_MAX;
+    const auto apply = [&](const long long quota, const long long period)
+    {
+        size_t count;
+        if (pal_cpu_quota_to_count(quota, period, &count))
+        {
+            limit = std::min(limit, count);
+            limited = TRUE;
+        }
+    };
+
+    pal_cgroup_visit("cpu", [&](const std::string& cgroup_dir, const bool v2)
+    {
+        if (v2)
+        {
+            std::string cpu_max;
+            if (pal_cpu_read_file_str(cgroup_dir + "/cpu.max", cpu_max))
+            {
+                long long period = 0;
+                std::string quota;
+                std::istringstream cpu_max_stream(cpu_max);
+                if (cpu_max_stream >> quota >> period
+                    && quota != "max")
+                {
+                    apply(std::atoll(quota.c_str()), period);
+                }
+            }
+            return false;
+        }
+
+        std::string quota;
+        std::string period;
+        if (pal_cpu_read_file_str(cgroup_dir + "/cpu.cfs_quota_us", quota)
+            && pal_cpu_read_file_str(cgroup_dir + "/cpu.cfs_period_us", period))
+        {
+            apply(std::atoll(quota.c_str()), std::atoll(period.c_str()));
+            return true;
+        }
+        return false;
+    });
+
+    if (limited)
+    {
+        *limit_out = limit;
+    }
+
+    return limited;
+}
+
+// Parses a sysfs cpu list such as "0-3,8,10-11".
+static std::vector<uint32_t> pal_cpu_parse_list(const std::string& list)
+{
+    std::vector<uint32_t> cpus;
+    std::istringstream list_stream(list);
+    std::string range;
+    while (std::getline(list_stream, range, ','))
+    {
+        const auto separator = range.find('-');
+        const auto first = std::strtoul(range.c_str(), nullptr, 10);
+        const auto last = separator == std::string::npos ? first : std::strtoul(range.c_str() + separator + 1, nullptr, 10);
+        for (auto cpu = first; cpu <= last && range.find_first_of("0123456789") != std::string::npos; cpu++)
+        {
+            cpus.push_back(static_cast<uint32_t>(cpu));
+        }
+    }
+    return cpus;
+}
+#endif
+
+// Number of cpus this process can actually run on: the affinity mask, further limited by the cgroup cpu
+// quota on Linux. Always at least 1.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_cpu_get_effective_count(size_t* count_out)
+{
+    if (count_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    DWORD_PTR process_affinity_mask = 0;
+    DWORD_PTR system_affinity_mask = 0;
+    size_t count = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_affinity_mask, &system_affinity_mask))
+    {
+        for (; process_affinity_mask != 0; process_affinity_mask &= process_affinity_mask - 1)
+        {
+            count++;
+        }
+    }
+
+    if (count == 0)
+    {
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        count = system_info.dwNumberOfProcessors;
+    }
+
+    *count_out = std::max<size_t>(1, count);
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    auto count = pal_cpu_get_affinity_count();
+
+    size_t cgroup_limit;
+    if (pal_cpu_get_cgroup_limit(&cgroup_limit))
+    {
+        count = std::min(count, cgroup_limit);
+    }
+
+    *count_out = std::max<size_t>(1, count);
+    return TRUE;
+#else
+    *count_out = 1;
+    return TRUE;
+#endif
+}
+
+// Cpus this process may run on ordered by id, with the NUMA node of each. cpus_out must be released with delete[].
+// On Windows only the processor group of this process is reported.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_cpu_get_affinity(pal_cpu_t** cpus_out, size_t* cpus_len_out)
+{
+    if (cpus_out == nullptr
+        || cpus_len_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    std::vector<pal_cpu_t> cpus;
+#if defined(PAL_PLATFORM_WINDOWS)
+    DWORD_PTR process_affinity_mask = 0;
+    DWORD_PTR system_affinity_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_affinity_mask, &system_affinity_mask))
+    {
+        return FALSE;
+    }
+
+    for (uint32_t id = 0; id < sizeof(DWORD_PTR) * 8; id++)
+    {
+        if (process_affinity_mask & static_cast<DWORD_PTR>(1) << id)
+        {
+            UCHAR node = 0;
+            cpus.push_back({ id, GetNumaProcessorNode(static_cast<UCHAR>(id), &node) && node != 0xFF ? node : -1 });
+        }
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    // The mask has to be large enough for every possible cpu, otherwise sched_getaffinity fails with EINVAL.
+    for (size_t cpus_len = 1024; cpus.empty() && cpus_len <= 1u << 16; cpus_len *= 2)
+    {
+        auto* const cpu_set = CPU_ALLOC(cpus_len);
+        if (cpu_set == nullptr)
+        {
+            break;
+        }
+
+        const auto cpu_set_size = CPU_ALLOC_SIZE(cpus_len);
+        CPU_ZERO_S(cpu_set_size, cpu_set);
+
+        const auto result = sched_getaffinity(0, cpu_set_size, cpu_set);
+        const auto error = errno;
+        for (size_t id = 0; result == 0 && id < cpus_len; id++)
+        {
+            if (CPU_ISSET_S(id, cpu_set_size, cpu_set))
+            {
+                cpus.push_back({ static_cast<uint32_t>(id), -1 });
+            }
+        }
+        CPU_FREE(cpu_set);
+
+        if (result != 0 && error != EINVAL)
+        {
+            break;
+        }
+    }
+
+    // Machines without NUMA support have no node directories, every cpu stays at -1.
+    auto* const nodes_dir = opendir("/sys/devices/system/node");
+    if (nodes_dir != nullptr)
+    {
+        for (auto* entry = readdir(nodes_dir); entry != nullptr; entry = readdir(nodes_dir))
+        {
+            if (0 != std::strncmp(entry->d_name, "node", 4)
+                || !std::isdigit(static_cast<unsigned char>(entry->d_name[4])))
+            {
+                continue;
+            }
+
+            std::string cpu_list;
+            if (!pal_cpu_read_file_str(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist", cpu_list))
+            {
+                continue;
+            }
+
+            const auto node = std::atoi(entry->d_name + 4);
+            for (const auto id : pal_cpu_parse_list(cpu_list))
+            {
+                const auto cpu = std::lower_bound(cpus.begin(), cpus.end(), id, [](const pal_cpu_t& lhs, const uint32_t rhs)
+                {
+                    return lhs.id < rhs;
+                });
+                if (cpu != cpus.end() && cpu->id == id)
+                {
+                    cpu->numa_node = node;
+                }
+            }
+        }
+        closedir(nodes_dir);
+    }
+#endif
+
+    if (cpus.empty())
+    {
+        return FALSE;
+    }
+
+    *cpus_out = new pal_cpu_t[cpus.size()];
+    std::copy(cpus.begin(), cpus.end(), *cpus_out);
+    *cpus_len_out = cpus.size();
+    return TRUE;
+}
+
+// Memory this process may use according to its cgroup (the job object on Windows). Returns FALSE when unlimited.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_memory_get_limit(uint64_t* limit_out)
+{
+    if (limit_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    auto limited = FALSE;
+    auto limit = UINT64_MAX;
+#if defined(PAL_PLATFORM_WINDOWS)
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limit_information = {};
+    if (QueryInformationJobObject(nullptr, JobObjectExtendedLimitInformation,
+        &limit_information, sizeof limit_information, nullptr))
+    {
+        if (limit_information.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_JOB_MEMORY)
+        {
+            limit = std::min<uint64_t>(limit, limit_information.JobMemoryLimit);
+            limited = TRUE;
+        }
+        if (limit_information.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_PROCESS_MEMORY)
+        {
+            limit = std::min<uint64_t>(limit, limit_information.ProcessMemoryLimit);
+            limited = TRUE;
+        }
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    pal_cgroup_visit("memory", [&](const std::string& cgroup_dir, const bool v2)
+    {
+        std::string value;
+        if (!pal_cpu_read_file_str(cgroup_dir + (v2 ? "/memory.max" : "/memory.limit_in_bytes"), value))
+        {
+            return false;
+        }
+
+        // cgroup v1 reports no limit as a value close to INT64_MAX.
+        const auto bytes = std::strtoull(value.c_str(), nullptr, 10);
+        if (value.compare(0, 3, "max") != 0
+            && bytes > 0
+            && bytes < 1ULL << 60)
+        {
+            limit = std::min<uint64_t>(limit, bytes);
+            limited = TRUE;
+        }
+        return !v2;
+    });
+#endif
+
+    if (limited)
+    {
+        *limit_out = limit;
+    }
+
+    return limited;
+}
+
+// Workers are capped at the effective cpu count, max_workers_in of 0 uses all of them.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_create(const size_t max_workers_in, pal_threadpool_t** threadpool_out)
+{
+    if (threadpool_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    size_t workers_len;
+    pal_cpu_get_effective_count(&workers_len);
+
+    if (max_workers_in > 0)
+    {
+        workers_len = std::min(workers_len, max_workers_in);
+    }
+
+    try
+    {
+        *threadpool_out = new pal_threadpool(workers_len);
+    }
+    catch (const std::system_error& e)
+    {
+        LOGE << "Failed to start thread pool workers. Error: " << e.what();
+        *threadpool_out = nullptr;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_get_worker_count(const pal_threadpool_t* threadpool_in, size_t* worker_count_out)
+{
+    if (threadpool_in == nullptr
+        || worker_count_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    *worker_count_out = threadpool_in->get_worker_count();
+    return TRUE;
+}
+
+// callback_in runs on a pool worker, or on a thread waiting in pal_wait_group_wait. wait_group_in is optional.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_submit(pal_threadpool_t* threadpool_in, pal_wait_group_t* wait_group_in,
+    const pal_threadpool_callback_t callback_in, void* user_data_in)
+{
+    if (threadpool_in == nullptr
+        || callback_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    threadpool_in->submit(callback_in, user_data_in, wait_group_in);
+    return TRUE;
+}
+
+// Completes every queued task and joins the workers. Must not be called from a task.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_free(pal_threadpool_t* threadpool_in)
+{
+    if (threadpool_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    delete threadpool_in;
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_wait_group_create(pal_wait_group_t** wait_group_out)
+{
+    if (wait_group_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    *wait_group_out = new pal_wait_group();
+    return TRUE;
+}
+
+// Runs queued tasks on the calling thread until every task submitted with wait_group_in has completed.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_wait_group_wait(pal_threadpool_t* threadpool_in, pal_wait_group_t* wait_group_in)
+{
+    if (threadpool_in == nullptr
+        || wait_group_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    threadpool_in->wait(*wait_group_in);
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_wait_group_free(pal_wait_group_t* wait_group_in)
+{
+    if (wait_group_in == nullptr
+        || !wait_group_in->is_done())
+    {
+        return FALSE;
+    }
+
+    delete wait_group_in;
+    return TRUE;
+}
+
+// Read once, re-reading the cgroup files on every loop costs more than small loops themselves.
+static size_t pal_parallel_for_cpus()
+{
+    static const auto cpus = []
+    {
+        size_t count = 1;
+        return pal_cpu_get_effective_count(&count) && count > 0 ? count : 1;
+    }();
+    return cpus;
+}
+
+// Shared by every pal_parallel_for and created on first use. The calling thread takes part in each
+// loop, so it has one worker less than there are cpus. Loops hold a reference while they run, so the
+// pool is joined by the last of pal_threadpool_free_shared and the loops still using it.
+// Never destroyed, so that exit does not join workers while other threads still use them.
+static std::mutex pal_parallel_for_mutex;
+static auto& pal_parallel_for_pool = *new std::shared_ptr<pal_threadpool>();
+
+static std::shared_ptr<pal_threadpool> pal_parallel_for_threadpool()
+{
+    std::lock_guard<std::mutex> lock(pal_parallel_for_mutex);
+
+#if defined(PAL_PLATFORM_LINUX)
+    // The workers of the parent do not exist in a forked child. The child drops the pool without
+    // joining it and creates its own on first use.
+    static const auto atfork = pthread_atfork(
+        [] { pal_parallel_for_mutex.lock(); },
+        [] { pal_parallel_for_mutex.unlock(); },
+        []
+        {
+            static_cast<void>(new std::shared_ptr<pal_threadpool>(std::move(pal_parallel_for_pool)));
+            pal_parallel_for_mutex.unlock();
+        });
+    PAL_UNUSED(atfork);
+#endif
+
+    if (pal_parallel_for_pool == nullptr)
+    {
+        pal_parallel_for_pool = std::make_shared<pal_threadpool>(pal_parallel_for_cpus() - 1);
+    }
+    return pal_parallel_for_pool;
+}
+
+// Joins the workers of the pool shared by the bulk operations, e.g. before exec. It is created again
+// by the next operation that runs in parallel.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_threadpool_free_shared()
+{
+    std::shared_ptr<pal_threadpool> threadpool;
+    {
+        std::lock_guard<std::mutex> lock(pal_parallel_for_mutex);
+        threadpool = std::move(pal_parallel_for_pool);
+    }
+    return TRUE;
+}
+
+// Runs fn(index) for every index in [0, count) with at least items_per_worker items per thread.
+// The calling thread takes part as well.
+template<typename TFn>
+static void pal_parallel_for(const size_t count, const size_t items_per_worker, TFn&& fn)
+{
+    const auto cpus = pal_parallel_for_cpus();
+    const auto threads_len = std::min(cpus, (count + items_per_worker - 1) / items_per_worker);
+    if (threads_len <= 1)
+    {
+        for (auto i = 0u; i < count; i++)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    std::shared_ptr<pal_threadpool> threadpool;
+    try
+    {
+        threadpool = pal_parallel_for_threadpool();
+    }
+    catch (const std::system_error& e)
+    {
+        LOGE << "Failed to start thread pool workers, running on the calling thread. Error: " << e.what();
+        for (auto i = 0u; i < count; i++)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    threadpool->parallel_for(count, threads_len, fn);
+}
+
+// - Process discovery
+
+// Links resolved per thread, a scan of a few hundred processes does not pay for starting threads.
+static const size_t pal_process_find_links_per_worker = 512;
+
+// True when exe_in is prefix_in itself or a path below it, so that app-1.0 does not match app-1.0.1.
+static bool pal_process_exe_has_prefix(const char* exe_in, const size_t exe_len_in, const std::string& prefix)
+{
+    if (exe_len_in < prefix.size())
+    {
+        return false;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    for (auto i = 0u; i < prefix.size(); i++)
+    {
+        if (std::tolower(static_cast<unsigned char>(exe_in[i])) != std::tolower(static_cast<unsigned char>(prefix[i])))
+        {
+            return false;
+        }
+    }
+#else
+    if (0 != std::memcmp(exe_in, prefix.data(), prefix.size()))
+    {
+        return false;
+    }
+#endif
+
+    return exe_len_in == prefix.size()
+        || exe_in[prefix.size()] == PAL_DIRECTORY_SEPARATOR_C
+        || prefix.back() == PAL_DIRECTORY_SEPARATOR_C;
+}
+
+// Returns the processes whose executable is exe_prefix_in or lives below it, including the calling
+// process. Executables that were deleted after the process started still match. pids_out must be
+// released with delete[]. Processes of other users are skipped when their executable cannot be read.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_find_by_exe_prefix(const char* exe_prefix_in, pal_pid_t** pids_out, size_t* pids_len_out)
+{
+    if (exe_prefix_in == nullptr
+        || exe_prefix_in[0] == '\0'
+        || pids_out == nullptr
+        || pids_len_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    std::string prefix(exe_prefix_in);
+    while (prefix.size() > 1 && prefix.back() == PAL_DIRECTORY_SEPARATOR_C)
+    {
+        prefix.pop_back();
+    }
+
+    std::vector<pal_pid_t> matches;
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    auto* const pss = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (pss == INVALID_HANDLE_VALUE)
+    {
+        LOGE << "Failed to create process snapshot. Error code: " << GetLastError();
+        return FALSE;
+    }
+
+    PROCESSENTRY32 pe = {};
+    pe.dwSize = sizeof (PROCESSENTRY32);
+
+    for (auto has_entry = Process32First(pss, &pe); has_entry; has_entry = Process32Next(pss, &pe))
+    {
+        auto* const process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pe.th32ProcessID);
+        if (process == nullptr)
+        {
+            continue;
+        }
+
+        wchar_t exe_utf16[PAL_MAX_PATH_UNICODE];
+        DWORD exe_utf16_len = PAL_MAX_PATH_UNICODE;
+        if (0 != QueryFullProcessImageName(process, 0, exe_utf16, &exe_utf16_len))
+        {
+            pal_utf8_string exe(std::wstring(exe_utf16, exe_utf16_len));
+            if (pal_process_exe_has_prefix(exe.data(), exe.size(), prefix))
+            {
+                matches.push_back(pe.th32ProcessID);
+            }
+        }
+
+        CloseHandle(process);
+    }
+
+    CloseHandle(pss);
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (proc_fd == -1)
+    {
+        LOGE << "Failed to open /proc. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    std::vector<pal_pid_t> pids;
+    alignas(pal_linux_dirent64) char buffer[32768];
+
+    while (true)
+    {
+        const auto bytes_read = syscall(SYS_getdents64, proc_fd, buffer, sizeof buffer);
+        if (bytes_read < 0)
+        {
+            LOGE << "Failed to list /proc. Errno: " << errno << ". Error code: " << std::strerror(errno);
+            close(proc_fd);
+            return FALSE;
+        }
+
+        if (bytes_read == 0)
+        {
+            break;
+        }
+
+        for (auto offset = 0l; offset < bytes_read;)
+        {
+            const auto* const entry = reinterpret_cast<pal_linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+            {
+                continue;
+            }
+
+            pal_pid_t pid = 0;
+            const auto* name = entry->d_name;
+            for (; *name >= '0' && *name <= '9'; name++)
+            {
+                pid = pid * 10 + (*name - '0');
+            }
+
+            if (*name == '\0' && name != entry->d_name)
+            {
+                pids.push_back(pid);
+            }
+        }
+    }
+
+    // Kernel threads have no executable and a process may exit while it is being looked at, both are
+    // skipped like processes that are not ours to inspect.
+    std::vector<uint8_t> matched(pids.size());
+    pal_parallel_for(pids.size(), pal_process_find_links_per_worker, [&](const size_t index)
+    {
+        char link_path[32];
+        snprintf(link_path, sizeof link_path, "%d/exe", static_cast<int>(pids[index]));
+
+        char exe[PAL_MAX_PATH];
+        const auto exe_len = readlinkat(proc_fd, link_path, exe, sizeof exe);
+        if (exe_len > 0
+            && static_cast<size_t>(exe_len) < sizeof exe)
+        {
+            // The link of an executable that was deleted or replaced reads "<path> (deleted)".
+            static const char deleted_suffix[] = " (deleted)";
+            auto path_len = static_cast<size_t>(exe_len);
+            if (path_len > sizeof deleted_suffix - 1
+                && 0 == std::memcmp(exe + path_len - (sizeof deleted_suffix - 1), deleted_suffix, sizeof deleted_suffix - 1))
+            {
+                path_len -= sizeof deleted_suffix - 1;
+            }
+            matched[index] = pal_process_exe_has_prefix(exe, path_len, prefix) ? 1 : 0;
+        }
+    });
+
+    close(proc_fd);
+
+    for (auto i = 0u; i < pids.size(); i++)
+    {
+        if (matched[i] != 0)
+        {
+            matches.push_back(pids[i]);
+        }
+    }
+#else
+    return FALSE;
+#endif
+
+    *pids_len_out = matches.size();
+    *pids_out = new pal_pid_t[matches.size()];
+    std::copy(matches.begin(), matches.end(), *pids_out);
+
+    return TRUE;
+}
+
+// - Signals
+
+struct pal_signal_listener
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    HANDLE event;
+#elif defined(PAL_PLATFORM_LINUX)
+    int fd;
+    sigset_t previous_mask;
+#endif
+};
+
+#if defined(PAL_PLATFORM_WINDOWS)
+static HANDLE pal_signal_listener_event = nullptr;
+static std::atomic<int> pal_signal_listener_signum(0);
+
+// Runs on a thread of its own, the event hands the control event over to pal_process_wait_exit_or_signal.
+static BOOL WINAPI pal_signal_listener_ctrl_handler(const DWORD ctrl_type)
+{
+    pal_signal_listener_signum = ctrl_type == CTRL_C_EVENT ? SIGINT : SIGTERM;
+    SetEvent(pal_signal_listener_event);
+    return TRUE;
+}
+#endif
+
+// Blocks SIGTERM, SIGINT and SIGHUP and receives them through a signalfd instead, so that a shutdown is handled
+// by the caller in its own time rather than by a signal handler. On Windows console control events are reported
+// as SIGINT (Ctrl+C) and SIGTERM (everything else). Only one listener may exist at a time.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_signal_listener_create(pal_signal_listener_t** listener_out)
+{
+    if (listener_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    if (pal_signal_listener_event != nullptr)
+    {
+        return FALSE;
+    }
+
+    const auto event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (event == nullptr)
+    {
+        LOGE << "Unable to create signal listener event. Error code: " << GetLastError();
+        return FALSE;
+    }
+
+    pal_signal_listener_event = event;
+    if (!SetConsoleCtrlHandler(pal_signal_listener_ctrl_handler, TRUE))
+    {
+        LOGE << "Unable to install console control handler. Error code: " << GetLastError();
+        pal_signal_listener_event = nullptr;
+        CloseHandle(event);
+        return FALSE;
+    }
+
+    auto listener = new pal_signal_listener();
+    listener->event = event;
+    *listener_out = listener;
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    sigset_t signal_mask;
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGTERM);
+    sigaddset(&signal_mask, SIGINT);
+    sigaddset(&signal_mask, SIGHUP);
+
+    sigset_t previous_mask;
+    if (0 != sigprocmask(SIG_BLOCK, &signal_mask, &previous_mask))
+    {
+        LOGE << "Unable to block shutdown signals. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    const auto fd = signalfd(-1, &signal_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (fd == -1)
+    {
+        LOGE << "Unable to create signalfd. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        sigprocmask(SIG_SETMASK, &previous_mask, nullptr);
+        return FALSE;
+    }
+
+    auto listener = new pal_signal_listener();
+    listener->fd = fd;
+    listener->previous_mask = previous_mask;
+    *listener_out = listener;
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+// Signals that arrived but were never waited for are delivered as usual once the mask is restored.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_signal_listener_free(pal_signal_listener_t* listener_in)
+{
+    if (listener_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    SetConsoleCtrlHandler(pal_signal_listener_ctrl_handler, FALSE);
+    pal_signal_listener_event = nullptr;
+    CloseHandle(listener_in->event);
+#elif defined(PAL_PLATFORM_LINUX)
+    close(listener_in->fd);
+    sigprocmask(SIG_SETMASK, &listener_in->previous_mask, nullptr);
+#endif
+
+    delete listener_in;
+    return TRUE;
+}
+
+// Windows has no signals to forward, the process is terminated regardless of signum_in.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_signal(const pal_pid_t pid_in, const int signum_in)
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    PAL_UNUSED(signum_in);
+    return pal_process_kill(pid_in);
+#elif defined(PAL_PLATFORM_LINUX)
+    if (pid_in <= 0)
+    {
+        return FALSE;
+    }
+
+    if (0 != kill(pid_in, signum_in))
+    {
+        LOGE << "Unable to send signal " << signum_in << " to process: " << pid_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    return TRUE;
+#else
+    PAL_UNUSED(pid_in);
+    PAL_UNUSED(signum_in);
+    return FALSE;
+#endif
+}
+
+// - Process sampling
+
+// Waits up to timeout_ms_in for a process that is not necessarily a child of this process to exit.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_wait_exit(const pal_pid_t pid_in, const uint32_t timeout_ms_in, BOOL* exited_out)
+{
+    return pal_process_wait_exit_or_signal(pid_in, timeout_ms_in, nullptr, exited_out, nullptr);
+}
+
+// Same as pal_process_wait_exit, but also returns early when listener_in received a signal. signum_out is 0 when
+// no signal arrived. A signal and the exit of the process may be reported by the same call.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_wait_exit_or_signal(const pal_pid_t pid_in, const uint32_t timeout_ms_in,
+    pal_signal_listener_t* listener_in, BOOL* exited_out, int* signum_out)
+{
+    if (exited_out == nullptr
+        || (listener_in != nullptr && signum_out == nullptr))
+    {
+        return FALSE;
+    }
+
+    if (signum_out != nullptr)
+    {
+        *signum_out = 0;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    const auto process = OpenProcess(SYNCHRONIZE, FALSE, pid_in);
+    if (process == nullptr)
+    {
+        if (GetLastError() != ERROR_INVALID_PARAMETER)
+        {
+            return FALSE;
+        }
+        *exited_out = TRUE;
+        return TRUE;
+    }
+
+    const HANDLE handles[] = { process, listener_in != nullptr ? listener_in->event : nullptr };
+    const auto result = WaitForMultipleObjects(listener_in != nullptr ? 2 : 1, handles, FALSE, timeout_ms_in);
+    CloseHandle(process);
+    if (result == WAIT_FAILED)
+    {
+        return FALSE;
+    }
+
+    *exited_out = result == WAIT_OBJECT_0 ? TRUE : FALSE;
+    if (result == WAIT_OBJECT_0 + 1)
+    {
+        *signum_out = pal_signal_listener_signum.exchange(0);
+    }
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    if (pid_in <= 0)
+    {
+        return FALSE;
+    }
+
+    // A pidfd is readable once the process exited (Linux 5.3+), older kernels check every 50 ms.
+    const auto pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid_in, 0));
+    if (pidfd == -1 && errno == ESRCH)
+    {
+        *exited_out = TRUE;
+        return TRUE;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_in);
+    auto exited = FALSE;
+    auto signum = 0;
+    while (true)
+    {
+        if (pidfd == -1 && 0 != kill(pid_in, 0) && errno == ESRCH)
+        {
+            exited = TRUE;
+            break;
+        }
+
+        const auto remaining = std::max<std::chrono::milliseconds::rep>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+
+        // poll ignores negative fds, a missing pidfd or listener leaves its entry unused.
+        struct pollfd poll_fds[] = {
+            { pidfd, POLLIN, 0 },
+            { listener_in != nullptr ? listener_in->fd : -1, POLLIN, 0 }
+        };
+        const auto result = poll(poll_fds, 2, static_cast<int>(pidfd == -1
+            ? std::min<std::chrono::milliseconds::rep>(remaining, 50) : remaining));
+        if (result == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (pidfd != -1)
+            {
+                close(pidfd);
+            }
+            return FALSE;
+        }
+
+        if (poll_fds[1].revents & POLLIN)
+        {
+            struct signalfd_siginfo signal_info = {};
+            if (read(listener_in->fd, &signal_info, sizeof signal_info) == sizeof signal_info)
+            {
+                signum = static_cast<int>(signal_info.ssi_signo);
+            }
+        }
+
+        if (poll_fds[0].revents & POLLIN)
+        {
+            exited = TRUE;
+        }
+
+        if (exited
+            || signum != 0
+            || remaining == 0)
+        {
+            break;
+        }
+    }
+
+    if (pidfd != -1)
+    {
+        close(pidfd);
+    }
+
+    *exited_out = exited;
+    if (signum_out != nullptr)
+    {
+        *signum_out = signum;
+    }
+    return TRUE;
+#else
+    PAL_UNUSED(pid_in);
+    PAL_UNUSED(timeout_ms_in);
+    PAL_UNUSED(listener_in);
+    return FALSE;
+#endif
+}
+
+struct pal_process_sampler
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    HANDLE process;
+#elif defined(PAL_PLATFORM_LINUX)
+    // Kept open so that a sample is a handful of preads. The files belong to the process that was opened,
+    // reads fail once it exited even if its pid is reused.
+    int stat_fd;
+    int statm_fd;
+    int io_fd; // -1 when the process does not allow reading its I/O counters.
+    int status_fd;
+    uint64_t clock_ticks;
+    uint64_t page_size;
+#endif
+    bool has_previous;
+    pal_process_sample_t previous;
+};
+
+#if defined(PAL_PLATFORM_LINUX)
+static bool pal_process_sampler_pread(const int fd, char* buffer, const size_t buffer_len)
+{
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    ssize_t bytes_read;
+    do
+    {
+        bytes_read = pread(fd, buffer, buffer_len - 1, 0);
+    } while (bytes_read == -1 && errno == EINTR);
+
+    if (bytes_read <= 0)
+    {
+        return false;
+    }
+
+    buffer[bytes_read] = '\0';
+    return true;
+}
+
+// Value of a "name:  value" line of /proc/<pid>/io or /proc/<pid>/status, name_in includes the leading newline
+// so that write_bytes does not match cancelled_write_bytes.
+static uint64_t pal_process_sampler_value(const char* buffer_in, const char* name_in)
+{
+    const auto* line = std::strstr(buffer_in, name_in);
+    return line == nullptr ? 0 : std::strtoull(line + std::strlen(name_in), nullptr, 10);
+}
+#endif
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_sampler_create(const pal_pid_t pid_in, pal_process_sampler_t** sampler_out)
+{
+    if (sampler_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    const auto process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, pid_in);
+    if (process == nullptr)
+    {
+        LOGE << "Unable to open process for sampling: " << pid_in << ". Error code: " << GetLastError();
+        return FALSE;
+    }
+
+    auto sampler = new pal_process_sampler();
+    sampler->process = process;
+#elif defined(PAL_PLATFORM_LINUX)
+    if (pid_in <= 0)
+    {
+        return FALSE;
+    }
+
+    const auto open_proc_file = [pid_in](const char* name)
+    {
+        char path[64];
+        snprintf(path, sizeof path, "/proc/%d/%s", static_cast<int>(pid_in), name);
+        return open(path, O_RDONLY | O_CLOEXEC);
+    };
+
+    auto sampler = new pal_process_sampler();
+    sampler->stat_fd = open_proc_file("stat");
+    sampler->statm_fd = open_proc_file("statm");
+    sampler->io_fd = open_proc_file("io");
+    sampler->status_fd = open_proc_file("status");
+    sampler->clock_ticks = static_cast<uint64_t>(std::max(1L, sysconf(_SC_CLK_TCK)));
+    sampler->page_size = static_cast<uint64_t>(std::max(1L, sysconf(_SC_PAGESIZE)));
+
+    if (sampler->stat_fd == -1
+        || sampler->statm_fd == -1
+        || sampler->status_fd == -1)
+    {
+        LOGE << "Unable to open process for sampling: " << pid_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        pal_process_sampler_free(sampler);
+        return FALSE;
+    }
+#else
+    PAL_UNUSED(pid_in);
+    return FALSE;
+#endif
+
+    *sampler_out = sampler;
+    return TRUE;
+}
+
+// Takes a sample and computes the deltas against the previous one. Returns FALSE once the process exited.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_sampler_sample(pal_process_sampler_t* sampler_in, pal_process_sample_t* sample_out)
+{
+    if (sampler_in == nullptr
+        || sample_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    pal_process_sample_t sample = {};
+    sample.timestamp_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    if (WaitForSingleObject(sampler_in->process, 0) != WAIT_TIMEOUT)
+    {
+        return FALSE;
+    }
+
+    // FILETIME is in 100 nanosecond intervals.
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetProcessTimes(sampler_in->process, &creation_time, &exit_time, &kernel_time, &user_time))
+    {
+        return FALSE;
+    }
+    sample.user_time_us = ((static_cast<uint64_t>(user_time.dwHighDateTime) << 32) | user_time.dwLowDateTime) / 10;
+    sample.system_time_us = ((static_cast<uint64_t>(kernel_time.dwHighDateTime) << 32) | kernel_time.dwLowDateTime) / 10;
+
+    PROCESS_MEMORY_COUNTERS memory_counters = {};
+    memory_counters.cb = sizeof memory_counters;
+    if (GetProcessMemoryInfo(sampler_in->process, &memory_counters, sizeof memory_counters))
+    {
+        sample.rss_bytes = memory_counters.WorkingSetSize;
+        sample.vm_bytes = memory_counters.PagefileUsage;
+    }
+
+    IO_COUNTERS io_counters = {};
+    if (GetProcessIoCounters(sampler_in->process, &io_counters))
+    {
+        sample.io_read_bytes = io_counters.ReadTransferCount;
+        sample.io_write_bytes = io_counters.WriteTransferCount;
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    char stat[1024];
+    char statm[256];
+    char status[4096];
+    if (!pal_process_sampler_pread(sampler_in->stat_fd, stat, sizeof stat)
+        || !pal_process_sampler_pread(sampler_in->statm_fd, statm, sizeof statm)
+        || !pal_process_sampler_pread(sampler_in->status_fd, status, sizeof status))
+    {
+        return FALSE;
+    }
+
+    const auto* utime = pal_process_stat_field(stat, 14);
+    const auto* num_threads = pal_process_stat_field(stat, 20);
+    if (utime == nullptr
+        || num_threads == nullptr)
+    {
+        return FALSE;
+    }
+
+    char* stime = nullptr;
+    const auto utime_ticks = std::strtoull(utime, &stime, 10);
+    const auto stime_ticks = std::strtoull(stime, nullptr, 10);
+    sample.user_time_us = utime_ticks * 1000000 / sampler_in->clock_ticks;
+    sample.system_time_us = stime_ticks * 1000000 / sampler_in->clock_ticks;
+    sample.threads_count = static_cast<uint32_t>(std::strtoul(num_threads, nullptr, 10));
+
+    char* resident = nullptr;
+    const auto size_pages = std::strtoull(statm, &resident, 10);
+    const auto resident_pages = std::strtoull(resident, nullptr, 10);
+    sample.vm_bytes = size_pages * sampler_in->page_size;
+    sample.rss_bytes = resident_pages * sampler_in->page_size;
+
+    char io[512];
+    if (pal_process_sampler_pread(sampler_in->io_fd, io, sizeof io))
+    {
+        sample.io_read_bytes = pal_process_sampler_value(io, "\nread_bytes:");
+        sample.io_write_bytes = pal_process_sampler_value(io, "\nwrite_bytes:");
+    }
+
+    sample.context_switches = pal_process_sampler_value(status, "\nvoluntary_ctxt_switches:")
+        + pal_process_sampler_value(status, "\nnonvoluntary_ctxt_switches:");
+#else
+    return FALSE;
+#endif
+
+    if (sampler_in->has_previous)
+    {
+        const auto& previous = sampler_in->previous;
+        const auto delta = [](const uint64_t current, const uint64_t before)
+        {
+            return current > before ? current - before : 0;
+        };
+
+        sample.interval_us = delta(sample.timestamp_us, previous.timestamp_us);
+        sample.io_read_bytes_delta = delta(sample.io_read_bytes, previous.io_read_bytes);
+        sample.io_write_bytes_delta = delta(sample.io_write_bytes, previous.io_write_bytes);
+        sample.context_switches_delta = delta(sample.context_switches, previous.context_switches);
+
+        if (sample.interval_us > 0)
+        {
+            const auto cpu_us = delta(sample.user_time_us + sample.system_time_us,
+                previous.user_time_us + previous.system_time_us);
+            sample.cpu_permille = static_cast<uint32_t>(std::min<uint64_t>(cpu_us * 1000 / sample.interval_us, UINT32_MAX));
+        }
+    }
+
+    sampler_in->has_previous = true;
+    sampler_in->previous = sample;
+    *sample_out = sample;
+
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_process_sampler_free(pal_process_sampler_t* sampler_in)
+{
+    if (sampler_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    CloseHandle(sampler_in->process);
+#elif defined(PAL_PLATFORM_LINUX)
+    for (const auto fd : { sampler_in->stat_fd, sampler_in->statm_fd, sampler_in->io_fd, sampler_in->status_fd })
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+#endif
+
+    delete sampler_in;
+    return TRUE;
+}
+
+// - Watchdog
+
+// Shared between the application and its supervisor. The counter must not need a lock, a process that dies
+// while holding one would stall the other side.
+struct pal_watchdog_segment
+{
+    std::atomic<uint64_t> beats;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Heartbeats in shared memory require lock-free atomics");
+
+struct pal_watchdog
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    HANDLE mapping;
+#endif
+    pal_watchdog_segment* segment;
+};
+
+// Opens the heartbeat segment of name_in, creating it when neither the application nor its supervisor did so yet.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_open(const char* name_in, pal_watchdog_t** watchdog_out)
+{
+    if (name_in == nullptr
+        || watchdog_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    // Shared memory names are a single path component.
+    std::string name("corerun-watchdog-");
+    for (const auto* c = name_in; *c != '\0'; c++)
+    {
+        name += std::isalnum(static_cast<unsigned char>(*c)) || *c == '-' || *c == '_' || *c == '.' ? *c : '_';
+    }
+
+    if (name.size() > PAL_MAX_PATH)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string name_utf16_string("Local\\" + name);
+    const auto mapping = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        0, sizeof(pal_watchdog_segment), name_utf16_string.data());
+    if (mapping == nullptr)
+    {
+        LOGE << "Unable to create watchdog: " << name << ". Error code: " << GetLastError();
+        return FALSE;
+    }
+
+    auto* segment = static_cast<pal_watchdog_segment*>(MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE,
+        0, 0, sizeof(pal_watchdog_segment)));
+    if (segment == nullptr)
+    {
+        LOGE << "Unable to map watchdog: " << name << ". Error code: " << GetLastError();
+        CloseHandle(mapping);
+        return FALSE;
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto shm_name = "/" + name;
+    const auto fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        LOGE << "Unable to open watchdog: " << shm_name << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    // A new segment is zero filled, growing it does not disturb a counter that is already in use.
+    struct stat fd_stat = {};
+    if (0 != fstat(fd, &fd_stat)
+        || (static_cast<size_t>(fd_stat.st_size) < sizeof(pal_watchdog_segment)
+            && 0 != ftruncate(fd, sizeof(pal_watchdog_segment))))
+    {
+        LOGE << "Unable to size watchdog: " << shm_name << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        close(fd);
+        return FALSE;
+    }
+
+    auto* mapping = mmap(nullptr, sizeof(pal_watchdog_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        LOGE << "Unable to map watchdog: " << shm_name << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    auto* segment = static_cast<pal_watchdog_segment*>(mapping);
+#else
+    return FALSE;
+#endif
+
+    auto watchdog = new pal_watchdog();
+#if defined(PAL_PLATFORM_WINDOWS)
+    watchdog->mapping = mapping;
+#endif
+    watchdog->segment = segment;
+    *watchdog_out = watchdog;
+
+    return TRUE;
+}
+
+// Called by the application to signal that it is making progress. This is a single atomic increment
+// and never enters the kernel, so it is safe to call from hot paths.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_beat(pal_watchdog_t* watchdog_in)
+{
+    if (watchdog_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    watchdog_in->segment->beats.fetch_add(1, std::memory_order_relaxed);
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_read(const pal_watchdog_t* watchdog_in, uint64_t* beats_out)
+{
+    if (watchdog_in == nullptr
+        || beats_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    *beats_out = watchdog_in->segment->beats.load(std::memory_order_relaxed);
+    return TRUE;
+}
+
+// The segment itself is kept, a restarted application continues to beat the same counter.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_watchdog_free(pal_watchdog_t* watchdog_in)
+{
+    if (watchdog_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    UnmapViewOfFile(watchdog_in->segment);
+    CloseHandle(watchdog_in->mapping);
+#elif defined(PAL_PLATFORM_LINUX)
+    munmap(watchdog_in->segment, sizeof(pal_watchdog_segment));
+#endif
+
+    delete watchdog_in;
+    return TRUE;
+}
+
+// - Sockets
+
+#if defined(PAL_PLATFORM_LINUX)
+// Resolves "tcp:<host>:<port>" or "unix:<path>". The host may be an [ipv6] address, or * or empty for any address.
+static bool pal_socket_resolve(const char* address_in, sockaddr_storage& address_out, socklen_t& address_len_out)
+{
+    const std::string address(address_in);
+    address_out = {};
+
+    if (address.rfind("unix:", 0) == 0)
+    {
+        const auto path = address.substr(5);
+        sockaddr_un address_un = {};
+        if (path.empty() || path.size() >= sizeof address_un.sun_path)
+        {
+            return false;
+        }
+
+        address_un.sun_family = AF_UNIX;
+        std::memcpy(address_un.sun_path, path.data(), path.size());
+        std::memcpy(&address_out, &address_un, sizeof address_un);
+        address_len_out = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+        return true;
+    }
+
+    const auto port_pos = address.rfind(':');
+    if (address.rfind("tcp:", 0) != 0 || port_pos == 3)
+    {
+        return false;
+    }
+
+    auto host = address.substr(4, port_pos - 4);
+    const auto port = address.substr(port_pos + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+    {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+    addrinfo* result = nullptr;
+    if (0 != getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &result))
+    {
+        return false;
+    }
+
+    std::memcpy(&address_out, result->ai_addr, result->ai_addrlen);
+    address_len_out = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+static bool pal_socket_address_equals(const sockaddr_storage& lhs, const sockaddr_storage& rhs)
+{
+    if (lhs.ss_family != rhs.ss_family)
+    {
+        return false;
+    }
+
+    switch (lhs.ss_family)
+    {
+    case AF_UNIX:
+        return 0 == std::strcmp(reinterpret_cast<const sockaddr_un&>(lhs).sun_path, reinterpret_cast<const sockaddr_un&>(rhs).sun_path);
+    case AF_INET:
+    {
+        const auto& lhs_in = reinterpret_cast<const sockaddr_in&>(lhs);
+        const auto& rhs_in = reinterpret_cast<const sockaddr_in&>(rhs);
+        return lhs_in.sin_port == rhs_in.sin_port && lhs_in.sin_addr.s_addr == rhs_in.sin_addr.s_addr;
+    }
+    case AF_INET6:
+    {
+        const auto& lhs_in6 = reinterpret_cast<const sockaddr_in6&>(lhs);
+        const auto& rhs_in6 = reinterpret_cast<const sockaddr_in6&>(rhs);
+        return lhs_in6.sin6_port == rhs_in6.sin6_port
+            && 0 == std::memcmp(&lhs_in6.sin6_addr, &rhs_in6.sin6_addr, sizeof lhs_in6.sin6_addr);
+    }
+    default:
+        return false;
+    }
+}
+#endif
+
+// Creates a listening stream socket for address_in, see pal_socket_resolve for the format. A stale unix
+// socket file left behind by a previous owner is replaced, one that still accepts connections is not.
+// errno is EADDRINUSE when another socket owns the address.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_listen(const char* address_in, pal_socket_t* socket_out)
+{
+    if (address_in == nullptr
+        || socket_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    sockaddr_storage address = {};
+    socklen_t address_len = 0;
+    if (!pal_socket_resolve(address_in, address, address_len))
+    {
+        LOGE << "Invalid listen address: " << address_in;
+        return FALSE;
+    }
+
+    const auto fd = socket(address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        LOGE << "Unable to create socket: " << address_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    if (address.ss_family == AF_UNIX)
+    {
+        // Only a socket file nobody listens on anymore refuses connections, anything else is left alone
+        // and makes bind fail below.
+        const auto* path = reinterpret_cast<const sockaddr_un&>(address).sun_path;
+        struct stat path_stat = {};
+        if (0 == lstat(path, &path_stat) && S_ISSOCK(path_stat.st_mode))
+        {
+            const auto probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (probe_fd != -1
+                && 0 != connect(probe_fd, reinterpret_cast<const sockaddr*>(&address), address_len)
+                && errno == ECONNREFUSED)
+            {
+                unlink(path);
+            }
+            if (probe_fd != -1)
+            {
+                close(probe_fd);
+            }
+        }
+    }
+    else
+    {
+        const auto reuse_address = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse_address, sizeof reuse_address);
+    }
+
+    if (0 != bind(fd, reinterpret_cast<const sockaddr*>(&address), address_len)
+        || 0 != listen(fd, SOMAXCONN))
+    {
+        const auto listen_errno = errno;
+        LOGE << "Unable to listen on: " << address_in << ". Errno: " << listen_errno << ". Error code: " << std::strerror(listen_errno);
+        close(fd);
+        errno = listen_errno;
+        return FALSE;
+    }
+
+    *socket_out = fd;
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+// Finds a listening socket for address_in among the fds passed to this process with LISTEN_FDS, either by
+// pal_process_daemonize_ex or systemd. LISTEN_PID is not checked so that processes started by the receiver,
+// like its supervisor, can take the sockets over as well.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_listen_inherited(const char* address_in, pal_socket_t* socket_out)
+{
+    if (address_in == nullptr
+        || socket_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    const auto* listen_fds = getenv("LISTEN_FDS");
+    sockaddr_storage address = {};
+    socklen_t address_len = 0;
+    if (listen_fds == nullptr
+        || !pal_socket_resolve(address_in, address, address_len))
+    {
+        return FALSE;
+    }
+
+    const auto listen_fds_len = std::strtol(listen_fds, nullptr, 10);
+    for (auto fd = 3; fd < 3 + listen_fds_len; fd++)
+    {
+        auto accepting = 0;
+        socklen_t accepting_len = sizeof accepting;
+        sockaddr_storage fd_address = {};
+        socklen_t fd_address_len = sizeof fd_address;
+        if (0 != getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &accepting_len)
+            || accepting == 0
+            || 0 != getsockname(fd, reinterpret_cast<sockaddr*>(&fd_address), &fd_address_len)
+            || !pal_socket_address_equals(address, fd_address))
+        {
+            continue;
+        }
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        *socket_out = fd;
+        return TRUE;
+    }
+
+    return FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+// Port of a tcp socket, useful when it was bound to port 0.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_get_port(const pal_socket_t socket_in, uint16_t* port_out)
+{
+    if (port_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    sockaddr_storage address = {};
+    socklen_t address_len = sizeof address;
+    if (0 != getsockname(socket_in, reinterpret_cast<sockaddr*>(&address), &address_len))
+    {
+        return FALSE;
+    }
+
+    switch (address.ss_family)
+    {
+    case AF_INET:
+        *port_out = ntohs(reinterpret_cast<const sockaddr_in&>(address).sin_port);
+        return TRUE;
+    case AF_INET6:
+        *port_out = ntohs(reinterpret_cast<const sockaddr_in6&>(address).sin6_port);
+        return TRUE;
+    default:
+        return FALSE;
+    }
+#else
+    PAL_UNUSED(socket_in);
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_socket_close(const pal_socket_t socket_in)
+{
+#if defined(PAL_PLATFORM_LINUX)
+    return 0 == close(socket_in) ? TRUE : FALSE;
+#else
+    PAL_UNUSED(socket_in);
+    return FALSE;
+#endif
+}
+
+// - Environment
+PAL_API BOOL PAL_CALLING_CONVENTION pal_env_set(const char* name_in, const char* value_in)
+{
+    if (name_in == nullptr)
+    {
+        return FALSE;
+    }
+#if defined(PAL_PLATFORM_WINDOWS) 
+    pal_utf16_string name_in_utf16_string(name_in);
+    pal_utf16_string value_in_utf16_string(value_in == nullptr ? "" : value_in);
+    const auto success = SetEnvironmentVariable(name_in_utf16_string.data(), value_in_utf16_string.empty() ? nullptr : value_in_utf16_string.data());
+    return success != 0 ? TRUE : FALSE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto success = value_in == nullptr ? unsetenv(name_in) : setenv(name_in, value_in, 1 /* overwrite */);
+    return success == 0;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_env_get(const char * environment_variable_in, char ** environment_variable_value_out)
+{
+    if (environment_variable_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string environment_variable_in_utf16_string(environment_variable_in);
+    const auto buffer_size = 65535;
+    auto* const buffer = new wchar_t[buffer_size];
+    const auto actual_len = GetEnvironmentVariable(environment_variable_in_utf16_string.data(), buffer, buffer_size);
+    if (actual_len <= 0)
+    {
+        delete[] buffer;
+        return FALSE;
+    }
+
+    *environment_variable_value_out = pal_utf8_string(&buffer[L'\0']).dup();
+
+    delete[] buffer;
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto value = ::getenv(environment_variable_in);
+    if (value == nullptr)
+    {
+        return FALSE;
+    }
+    *environment_variable_value_out = strdup(value);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_env_get_bool(const char * environment_variable_in)
+{
+    char* environment_variable_value_out = nullptr;
+    if (!pal_env_get(environment_variable_in, &environment_variable_value_out))
+    {
+        return FALSE;
+    }
+
+    auto true_or_false = FALSE;
+    if (pal_str_iequals(environment_variable_value_out, "1")
+        || pal_str_iequals(environment_variable_value_out, "true"))
+    {
+        true_or_false = TRUE;
+    }
+
+    delete environment_variable_value_out;
+
+    return true_or_false;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_env_expand_str(const char * environment_in, char ** environment_out)
+{
+    if (environment_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    std::string environment_in_str(environment_in);
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    static std::regex expression(R"(%([0-9A-Za-z\\/\(\)]*)%)", std::regex_constants::icase);
+#else
+    static std::regex expression(R"(\$\{([^}]+)\})", std::regex_constants::icase);
+#endif
+
+    auto replacements = 0;
+    std::smatch match;
+    while (std::regex_search(environment_in_str, match, expression)) {
+        const auto match_str = match[1].str();
+        char* environment_variable_value = nullptr;
+        if (!pal_env_get(match_str.c_str(), &environment_variable_value))
+        {
+            continue;
+        }
+
+        const std::string environment_variable_value_s(environment_variable_value);
+        delete environment_variable_value;
+
+        environment_in_str.replace(match[0].first, match[0].second, environment_variable_value_s);
+
+        replacements++;
+    }
+
+    if (replacements <= 0)
+    {
+        return FALSE;
+    }
+
+    *environment_out = _strdup(environment_in_str.c_str());
+
+    return TRUE;
+}
+
+// - Filesystem
+
+BOOL pal_fs_chmod(const char *path_in, const pal_mode_t mode) {
+    if (path_in == nullptr) {
+        return FALSE;
+    }
+
+    BOOL is_success;
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string path_in_utf16_string(path_in);
+    is_success = 0 == _wchmod(path_in_utf16_string.data(), mode) ? TRUE : FALSE;
+#elif defined(PAL_PLATFORM_LINUX)
+    is_success = 0 == chmod(path_in, mode) ? TRUE : FALSE;
+#endif
+    return is_success;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_path_get_directory_name_from_file_path(const char * path_in, char ** path_out)
+{
+    if (path_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string path_in_utf16_string(path_in);
+
+    wchar_t path_in_without_filespec[PAL_MAX_PATH];
+    wcscpy_s(path_in_without_filespec, PAL_MAX_PATH, path_in_utf16_string.data());
+
+    if (pal_is_windows_8_or_greater())
+    {
+        pal_module pathcch_module("api-ms-win-core-path-l1-1-0.dll");
+        if (!pathcch_module.is_loaded())
+        {
+            return FALSE;
+        }
+
+        using PathCchRemoveFileSpecFn = HRESULT(WINAPI*)(PWSTR  pszPath, size_t cchPath);
+
+        const auto path_cch_remove_file_spec_fn = pathcch_module.bind<PathCchRemoveFileSpecFn>("PathCchRemoveFileSpec");
+        if (path_cch_remove_file_spec_fn == nullptr)
+        {
+            return FALSE;
+        }
+
+        const auto hr = path_cch_remove_file_spec_fn(path_in_without_filespec, PAL_MAX_PATH);
+        if (!SUCCEEDED(hr))
+        {
+            return FALSE;
+        }
+
+        *path_out = pal_utf8_string(path_in_without_filespec).dup();
+
+        return TRUE;
+    }
+
+    PathRemoveFileSpec(path_in_without_filespec);
+    *path_out = pal_utf8_string(path_in_without_filespec).dup();
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    auto path_in_cpy = strdup(path_in);
+    auto dir = dirname(path_in_cpy);
+    if (dir != nullptr)
+    {
+        //  Both dirname() and basename() return pointers to null-terminated
+        // strings.  (Do not pass these pointers to free(3).)
+        *path_out = strdup(dir);
+        return TRUE;
+    }
+    delete path_in_cpy;
+    return FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_path_get_directory_name(const char * path_in, char ** path_out)
+{
+    if (path_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    const std::string path_in_s(path_in);
+
+    const auto directory_name_start_pos = path_in_s.find_last_of(PAL_DIRECTORY_SEPARATOR_C);
+    if (directory_name_start_pos == std::string::npos)
+    {
+        return FALSE;
+    }
+
+    const auto directory_name = path_in_s.substr(directory_name_start_pos + 1);
+
+    *path_out = _strdup(directory_name.c_str());
+
+    return TRUE;
+}
+
+#if defined(PAL_PLATFORM_LINUX)
+
+// https://github.com/qpalzmqaz123/path_combine/blob/master/path_combine.c
+
+inline int unix_path_combine_cleanup(char *path)
+{
+    char *str;
+    char *parent_dir;
+    char *current_dir;
+    char *tail;
+
+    if (0 == strlen(path)) {
+        return 0;
+    }
+
+    /* resolve parent dir */
+    while (TRUE) {
+        str = strstr(path, "/../");
+        if (nullptr == str) {
+            break;
+        }
+
+        *str = 0;
+        if (nullptr == strchr(path, '/')) {
+            return 1;
+        }
+        parent_dir = strrchr(path, '/') + 1;
+
+        current_dir = str + 4;
+
+        /* replace parent dir */
+        memcpy(parent_dir, current_dir, strlen(current_dir) + 1);
+    }
+
+    /* resolve current dir */
+    while (TRUE) {
+        str = strstr(path, "/./");
+        if (nullptr == str) {
+            break;
+        }
+
+        memcpy(str + 1, str + 3, strlen(str + 3) + 1);
+    }
+
+    /* remove tail '/' or '/.' */
+    tail = path + strlen(path) - 1;
+    if ('/' == *tail) {
+        *tail = 0;
+    }
+    else if (0 == strcmp(tail - 1, "/.")) {
+        *(tail - 1) = 0;
+    }
+    else if (0 == strcmp(tail - 2, "/..")) {
+        strcat(path, "/");
+        unix_path_combine_cleanup(path);
+    }
+
+    return 0;
+}
+
+inline char* unix_path_combine(const char *path1, const char *path2, char *buffer)
+{
+    if (pal_str_is_null_or_whitespace(path1)
+        || pal_str_is_null_or_whitespace(path2)) {
+        return nullptr;
+    }
+    else if (nullptr == path1) {
+        strcpy(buffer, path2);
+        goto EXIT;
+    }
+    else if (nullptr == path2) {
+        strcpy(buffer, path1);
+        goto EXIT;
+    }
+
+    if ('/' == path2[0]) {
+        strcpy(buffer, path2);
+        goto EXIT;
+    }
+
+    strcpy(buffer, path1);
+
+    if ('/' != path1[strlen(path1) - 1]) {
+        strcat(buffer, "/");
+    }
+
+    strcat(buffer, path2);
+
+EXIT:
+    return 0 == unix_path_combine_cleanup(buffer) ? buffer : nullptr;
+}
+#endif
+
+#if defined(PAL_PLATFORM_LINUX)
+static uint32_t pal_fs_type_from_mode(const mode_t mode)
+{
+    switch (mode & S_IFMT)
+    {
+    case S_IFREG:
+        return PAL_FS_TYPE_FILE;
+    case S_IFDIR:
+        return PAL_FS_TYPE_DIRECTORY;
+    case S_IFLNK:
+        return PAL_FS_TYPE_SYMLINK;
+    default:
+        return PAL_FS_TYPE_OTHER;
+    }
+}
+
+#if defined(STATX_BASIC_STATS)
+static const unsigned int pal_fs_statx_mask = STATX_TYPE | STATX_MODE | STATX_NLINK | STATX_INO | STATX_SIZE | STATX_MTIME;
+
+static void pal_fs_stat_from_statx(const struct statx& stx, pal_fs_stat_t* stat_out)
+{
+    stat_out->size = stx.stx_size;
+    stat_out->mtime_ns = static_cast<uint64_t>(stx.stx_mtime.tv_sec) * 1000000000ull + stx.stx_mtime.tv_nsec;
+    stat_out->inode = stx.stx_ino;
+    stat_out->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    stat_out->nlink = stx.stx_nlink;
+    stat_out->mode = stx.stx_mode & 07777;
+    stat_out->type = pal_fs_type_from_mode(stx.stx_mode);
+}
+#endif
+
+// Kernels older than 4.11 (and some seccomp profiles) reject statx with ENOSYS.
+static std::atomic<bool> pal_fs_statx_unsupported(false);
+
+// Fills stat_out for path_in relative to dir_fd with a single syscall. Returns 0 or errno.
+static int pal_fs_stat_at(const int dir_fd, const char* path_in, const BOOL follow_symlinks_in, pal_fs_stat_t* stat_out)
+{
+    *stat_out = {};
+
+#if defined(STATX_BASIC_STATS)
+    if (!pal_fs_statx_unsupported.load(std::memory_order_relaxed))
+    {
+        struct statx stx = {};
+        const auto flags = AT_STATX_SYNC_AS_STAT | (follow_symlinks_in ? 0 : AT_SYMLINK_NOFOLLOW);
+        if (statx(dir_fd, path_in, flags, pal_fs_statx_mask, &stx) == 0)
+        {
+            pal_fs_stat_from_statx(stx, stat_out);
+            return 0;
+        }
+
+        if (errno != ENOSYS)
+        {
+            return errno;
+        }
+
+        pal_fs_statx_unsupported.store(true, std::memory_order_relaxed);
+    }
+#endif
+
+    struct stat st = {};
+    if (fstatat(dir_fd, path_in, &st, follow_symlinks_in ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+    {
+        return errno;
+    }
+
+    stat_out->size = static_cast<uint64_t>(st.st_size);
+    stat_out->mtime_ns = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+    stat_out->inode = st.st_ino;
+    stat_out->dev = st.st_dev;
+    stat_out->nlink = static_cast<uint32_t>(st.st_nlink);
+    stat_out->mode = st.st_mode & 07777;
+    stat_out->type = pal_fs_type_from_mode(st.st_mode);
+    return 0;
+}
+#endif
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_stat(const char* path_in, const BOOL follow_symlinks_in, pal_fs_stat_t* stat_out)
+{
+    if (path_in == nullptr
+        || stat_out == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    *stat_out = {};
+
+    pal_utf16_string path_in_utf16_string(path_in);
+
+    // Backup semantics is required to open a directory handle.
+    DWORD flags = FILE_FLAG_BACKUP_SEMANTICS;
+    if (!follow_symlinks_in)
+    {
+        flags |= FILE_FLAG_OPEN_REPARSE_POINT;
+    }
+
+    auto* const h_file = CreateFile(path_in_utf16_string.data(),
+                                    FILE_READ_ATTRIBUTES,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    flags,
+                                    nullptr);
+
+    if (h_file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info = {};
+    const auto success = GetFileInformationByHandle(h_file, &info);
+
+    assert(0 != CloseHandle(h_file));
+
+    if (!success)
+    {
+        return FALSE;
+    }
+
+    // FILETIME counts 100 nanosecond intervals since 1601-01-01.
+    const auto mtime = static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32 | info.ftLastWriteTime.dwLowDateTime;
+    const auto filetime_unix_epoch = 116444736000000000ull;
+
+    stat_out->size = static_cast<uint64_t>(info.nFileSizeHigh) << 32 | info.nFileSizeLow;
+    stat_out->mtime_ns = mtime > filetime_unix_epoch ? (mtime - filetime_unix_epoch) * 100 : 0;
+    stat_out->inode = static_cast<uint64_t>(info.nFileIndexHigh) << 32 | info.nFileIndexLow;
+    stat_out->dev = info.dwVolumeSerialNumber;
+    stat_out->nlink = info.nNumberOfLinks;
+
+    if (info.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT && !follow_symlinks_in)
+    {
+        stat_out->type = PAL_FS_TYPE_SYMLINK;
+    }
+    else if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        stat_out->type = PAL_FS_TYPE_DIRECTORY;
+    }
+    else
+    {
+        stat_out->type = PAL_FS_TYPE_FILE;
+    }
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    return pal_fs_stat_at(AT_FDCWD, path_in, follow_symlinks_in, stat_out) == 0 ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_stat_batch(const char* directory_in, const char** names_in, const size_t names_len_in,
+    const BOOL follow_symlinks_in, pal_fs_stat_t* stats_out, int* errors_out)
+{
+    if (directory_in == nullptr
+        || names_in == nullptr
+        || stats_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    auto success = TRUE;
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    for (auto i = 0u; i < names_len_in; i++)
+    {
+        auto error = 0;
+
+        char* path = nullptr;
+        if (names_in[i] == nullptr
+            || !pal_path_combine(directory_in, names_in[i], &path)
+            || !pal_fs_stat(path, follow_symlinks_in, &stats_out[i]))
+        {
+            stats_out[i] = {};
+            error = static_cast<int>(GetLastError());
+            error = error == 0 ? ERROR_FILE_NOT_FOUND : error;
+            success = FALSE;
+        }
+
+        free(path);
+
+        if (errors_out != nullptr)
+        {
+            errors_out[i] = error;
+        }
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    // Resolve the directory once so that each entry costs a single statx.
+    const auto dir_fd = open(directory_in, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+    {
+        LOGE << "Failed to open directory: " << directory_in << ". Error: " << strerror(errno);
+        return FALSE;
+    }
+
+    for (auto i = 0u; i < names_len_in; i++)
+    {
+        const auto error = names_in[i] == nullptr ? EINVAL
+            : pal_fs_stat_at(dir_fd, names_in[i], follow_symlinks_in, &stats_out[i]);
+
+        if (error != 0)
+        {
+            stats_out[i] = {};
+            success = FALSE;
+        }
+
+        if (errors_out != nullptr)
+        {
+            errors_out[i] = error;
+        }
+    }
+
+    close(dir_fd);
+#else
+    success = FALSE;
+#endif
+
+    return success;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_file_exists(const char * file_path_in)
+{
+    if (file_path_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    BOOL file_exists;
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string file_path_in_utf16_string(file_path_in);
+    const auto file_attributes = GetFileAttributes(file_path_in_utf16_string.data());
+    if (file_attributes == INVALID_FILE_ATTRIBUTES
+        || file_attributes & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        file_exists = FALSE;
+    }
+    else
+    {
+        file_exists = PathFileExists(file_path_in_utf16_string.data()) == TRUE ? TRUE : FALSE;
+    }
+
+    return file_exists;
+#elif defined(PAL_PLATFORM_LINUX)
+    pal_fs_stat_t st;
+    file_exists = pal_fs_stat(file_path_in, TRUE, &st) && st.type != PAL_FS_TYPE_DIRECTORY;
+    return file_exists;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_impl(const char * path_in, const pal_fs_list_filter_callback_t filter_callback_in,
+    const char* filter_extension_in, char *** paths_out, size_t * paths_out_len, const int type)
+{
+    if (path_in == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<char*> paths;
+
+#if defined(PAL_PLATFORM_WINDOWS)
+
+    const pal_utf16_string extension_filter_in_utf16_string(
+        filter_extension_in != nullptr ? filter_extension_in : "*.*");
+
+    pal_utf16_string path_root_utf16_string(path_in);
+    path_root_utf16_string.append_if_not_ends_width(PAL_DIRECTORY_SEPARATOR_WIDE_STR);
+    path_root_utf16_string.append(extension_filter_in_utf16_string.c_str());
+
+    WIN32_FIND_DATA file;
+    auto* const h_file = FindFirstFile(path_root_utf16_string.data(), &file);
+    if (h_file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    do
+    {
+        switch (type)
+        {
+        case 0:
+            if (!(file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                continue;
+            }
+            break;
+        case 1:
+            if (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                continue;
+            }
+            break;
+        default:
+            continue;
+        }
+
+        const auto relative_path = pal_utf8_string(file.cFileName).str();
+        if (relative_path == "."
+            || relative_path == "..")
+        {
+            continue;
+        }
+
+        char* absolute_path = nullptr;
+        if (!pal_path_combine(path_in, relative_path.data(), &absolute_path))
+        {
+            delete[] absolute_path;
+            continue;
+        }
+
+        const auto filter_callback_fn = filter_callback_in;
+        if (filter_callback_fn != nullptr
+            && !filter_callback_fn(absolute_path))
+        {
+            delete[] absolute_path;
+            continue;
+        }
+
+        paths.emplace_back(absolute_path);
+
+    } while (FindNextFile(h_file, &file));
+
+    FindClose(h_file);
+
+#elif defined(PAL_PLATFORM_LINUX)
+    std::string filter_extension_s(filter_extension_in == nullptr ? std::string() : filter_extension_in);
+
+    DIR* dir = opendir(path_in);
+    if (dir != nullptr)
+    {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr)
+        {
+            std::string absolute_path_s;
+            std::string entry_name(entry->d_name);
+
+            switch (type)
+            {
+            case 0:
+                if (entry->d_type == DT_UNKNOWN)
+                {
+                    // Symlinks to directories are not listed, same as when d_type is available.
+                    pal_fs_stat_t entry_stat;
+                    if (0 != pal_fs_stat_at(dirfd(dir), entry->d_name, FALSE, &entry_stat)
+                        || entry_stat.type != PAL_FS_TYPE_DIRECTORY)
+                    {
+                        continue;
+                    }
+                }
+                else if (entry->d_type != DT_DIR)
+                {
+                    continue;
+                }
+
+                if (entry_name == "." || entry_name == "..")
+                {
+                    continue;
+                }
+
+                absolute_path_s.assign(path_in);
+                absolute_path_s.append("/");
+                absolute_path_s.append(entry_name);
+
+                break;
+            case 1:
+                switch (entry->d_type)
+                {
+                default:
+                    continue;
+                    // Regular file
+                case DT_REG:
+                    if (filter_extension_in != nullptr
+                        && FALSE == pal_str_endswith(entry_name.c_str(), filter_extension_in))
+                    {
+                        continue;
+                    }
+
+                    absolute_path_s.assign(path_in);
+                    absolute_path_s.append("/");
+                    absolute_path_s.append(entry_name);
+                    break;
+
+                    // Handle symlinks and file systems that do not support d_type
+                case DT_LNK:
+                case DT_UNKNOWN:
+                    if (filter_extension_in != nullptr
+                        && FALSE == pal_str_endswith(entry_name.c_str(), filter_extension_in))
+                    {
+                        continue;
+                    }
+
+                    absolute_path_s.assign(path_in);
+                    absolute_path_s.append("/");
+                    absolute_path_s.append(entry_name);
+
+                    // Relative to the open directory so the path is not resolved again.
+                    pal_fs_stat_t file_stat;
+                    if (0 != pal_fs_stat_at(dirfd(dir), entry->d_name, TRUE, &file_stat))
+                    {
+                        absolute_path_s.clear();
+                        continue;
+                    }
+
+                    // Must be a regular file.
+                    if (file_stat.type != PAL_FS_TYPE_FILE)
+                    {
+                        absolute_path_s.clear();
+                        continue;
+                    }
+
+                    break;
+                }
+                break;
+            default:
+                // void
+                break;
+            }
+
+            if (absolute_path_s.empty())
+            {
+                continue;
+            }
+
+            const auto filter_callback_fn = filter_callback_in;
+            if (filter_callback_fn != nullptr
+                && !filter_callback_fn(absolute_path_s.c_str()))
+            {
+                continue;
+            }
+
+            paths.emplace_back(strdup(absolute_path_s.data()));
+        }
+
+        closedir(dir);
+    }
+#endif
+
+    *paths_out_len = paths.size();
+
+    auto* const paths_array = new char*[*paths_out_len];
+
+    for (auto i = 0u; i < *paths_out_len; i++)
+    {
+        paths_array[i] = paths[i];
+    }
+
+    *paths_out = paths_array;
+
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_directories(const char * path_in, const pal_fs_list_filter_callback_t filter_callback_in,
+    const char* filter_extension_in, char *** directories_out, size_t* directories_out_len)
+{
+    return pal_fs_list_impl(path_in, filter_callback_in, filter_extension_in, directories_out, directories_out_len, 0);
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_files(const char * path_in, const pal_fs_list_filter_callback_t filter_callback_in,
+    const char* filter_extension_in, char *** files_out, size_t * files_out_len)
+{
+    return pal_fs_list_impl(path_in, filter_callback_in, filter_extension_in, files_out, files_out_len, 1);
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_get_cwd(char ** working_directory_out)
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    wchar_t* buffer;
+    if ((buffer = _wgetcwd(nullptr, 0)) == nullptr)
+    {
+        return FALSE;
+    }
+
+    *working_directory_out = pal_utf8_string(buffer).dup();
+    delete buffer;
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    char cwd[PAL_MAX_PATH];
+    auto status = getcwd(cwd, sizeof(cwd));
+    if (status != nullptr)
+    {
+        *working_directory_out = strdup(cwd);
+        return TRUE;
+    }
+    return FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+static std::string pal_fs_build_tmp_filename(const std::string& filename)
+{
+    static std::atomic<uint32_t> tmp_filename_counter{ 0 };
+
+    pal_pid_t pid = 0;
+    pal_process_get_pid(&pid);
+
+    return filename + ".tmp-" + std::to_string(pid) + "-" + std::to_string(tmp_filename_counter++);
+}
+
+// Symbolic links require elevated privileges on Windows, so there the link is a marker file
+// that contains the target. In both cases the link is replaced with a single rename.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_link_replace(const char* link_path_in, const char* target_in)
+{
+    if (link_path_in == nullptr
+        || pal_str_is_null_or_whitespace(target_in))
+    {
+        return FALSE;
+    }
+
+    const auto link_tmp_path = pal_fs_build_tmp_filename(link_path_in);
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    if (!pal_fs_write(link_tmp_path.c_str(), target_in, strlen(target_in)))
+    {
+        LOGE << "Error writing link: " << link_tmp_path << ". Error code: " << GetLastError();
+        return FALSE;
+    }
+
+    pal_utf16_string link_tmp_path_utf16_string(link_tmp_path);
+    pal_utf16_string link_path_in_utf16_string(link_path_in);
+    if (0 == MoveFileEx(link_tmp_path_utf16_string.data(), link_path_in_utf16_string.data(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        LOGE << "Error replacing link: " << link_path_in_utf16_string << ". Error code: " << GetLastError();
+        pal_fs_rmfile(link_tmp_path.c_str());
+        return FALSE;
+    }
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    if (0 != symlink(target_in, link_tmp_path.c_str()))
+    {
+        LOGE << "Error creating link: " << link_tmp_path << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+
+    // rename(2) atomically replaces an existing link, readers either see the old or the new target.
+    if (0 != rename(link_tmp_path.c_str(), link_path_in))
+    {
+        LOGE << "Error replacing link: " << link_path_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        unlink(link_tmp_path.c_str());
+        return FALSE;
+    }
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_link_read(const char* link_path_in, char** target_out)
+{
+    if (link_path_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    char* target = nullptr;
+    size_t target_len = 0;
+    if (!pal_fs_read_file(link_path_in, &target, &target_len))
+    {
+        return FALSE;
+    }
+
+    const auto target_str = std::string(target, target_len);
+    delete[] target;
+
+    if (target_str.empty())
+    {
+        return FALSE;
+    }
+
+    *target_out = _strdup(target_str.c_str());
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    char target[PAL_MAX_PATH];
+    const auto target_len = readlink(link_path_in, target, sizeof target - 1);
+    if (target_len <= 0)
+    {
+        return FALSE;
+    }
+
+    target[target_len] = '\0';
+    *target_out = strdup(target);
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_directory_exists(const char * path_in)
+{
+    if (path_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string path_in_utf16_string(path_in);
+    const auto attributes = GetFileAttributes(path_in_utf16_string.data());
+    if (attributes == INVALID_FILE_ATTRIBUTES)
+    {
+        return FALSE;
+    }
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return FALSE;
+    }
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    pal_fs_stat_t st;
+    return pal_fs_stat(path_in, TRUE, &st) && st.type == PAL_FS_TYPE_DIRECTORY;
+#else
+    RETURN FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_get_file_size(const char* filename_in, size_t* file_size_out)
+{
+    if (filename_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string path_in_utf16_string(filename_in);
+
+    auto* const h_file = CreateFile(path_in_utf16_string.data(),
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ,
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL,
+                                    nullptr);
+
+    if (h_file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    *file_size_out = GetFileSize(h_file, nullptr);
+
+    assert(0 != CloseHandle(h_file));
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    pal_fs_stat_t st;
+    if (pal_fs_stat(filename_in, TRUE, &st))
+    {
+        *file_size_out = st.size;
+        return TRUE;
+    }
+    return FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+#if defined(PAL_PLATFORM_LINUX)
+// Reads from the current position of fd until EOF, appending to buffer (allocated with new[],
+// may be nullptr) and growing it as needed. Returns 0 or errno, buffer is freed on error.
+static int pal_fs_read_fd_append(const int fd, char** buffer, size_t* capacity, size_t* bytes_read)
+{
+    while (true)
+    {
+        if (*bytes_read == *capacity)
+        {
+            *capacity = *capacity == 0 ? 4096 : *capacity * 2;
+            auto* const buffer_grown = new char[*capacity];
+            if (*bytes_read > 0)
+            {
+                std::memcpy(buffer_grown, *buffer, *bytes_read);
+            }
+            delete[] *buffer;
+            *buffer = buffer_grown;
+        }
+
+        const auto result = read(fd, *buffer + *bytes_read, *capacity - *bytes_read);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            const auto error = errno;
+            delete[] *buffer;
+            *buffer = nullptr;
+            return error;
+        }
+
+        if (result == 0)
+        {
+            return 0;
+        }
+
+        *bytes_read += static_cast<size_t>(result);
+    }
+}
+
+// The size reported for pipes and procfs files is zero or an estimate, so it is only used
+// as a hint and the file is read until EOF. One extra byte lets a regular file hit EOF
+// without growing the buffer.
+static size_t pal_fs_read_capacity_hint(const bool is_regular_file, const uint64_t size)
+{
+    return is_regular_file && size > 0 ? static_cast<size_t>(size) + 1 : 4096;
+}
+
+static int pal_fs_read_fd(const int fd, char** bytes_out, size_t* bytes_read_out)
+{
+    struct stat fd_stat = {};
+    const auto have_stat = 0 == fstat(fd, &fd_stat);
+    auto capacity = pal_fs_read_capacity_hint(have_stat && S_ISREG(fd_stat.st_mode),
+        have_stat ? static_cast<uint64_t>(fd_stat.st_size) : 0);
+
+    *bytes_out = new char[capacity];
+    *bytes_read_out = 0;
+
+    return pal_fs_read_fd_append(fd, bytes_out, &capacity, bytes_read_out);
+}
+#endif
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_read_file(const char *filename_in, char **bytes_out, size_t *bytes_read_out)
+{
+    if (filename_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string path_in_utf16_string(filename_in);
+
+    auto* const h_file = CreateFile(path_in_utf16_string.data(),
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL,
+                                    nullptr);
+
+    if (h_file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    LARGE_INTEGER bytes_to_read_li;
+    if(0 == GetFileSizeEx(h_file, &bytes_to_read_li))
+    {
+        LOGE << "Failed to get file size for filename: " << path_in_utf16_string << ". Error code: " << GetLastError();
+        assert(TRUE == CloseHandle(h_file));
+        return FALSE;                    
+    }
+
+    const auto bytes_to_read = static_cast<size_t>(bytes_to_read_li.QuadPart);
+
+    size_t read_offset = 0;
+    DWORD read_buffer_bytes_read = 0;
+    const auto read_buffer_size = 8096;
+    char read_buffer[read_buffer_size];
+
+    bool readfile_success;
+    do
+    {
+        // https://docs.microsoft.com/en-us/windows/win32/fileio/testing-for-the-end-of-a-file
+        readfile_success = TRUE == ReadFile(h_file, read_buffer, read_buffer_size, &read_buffer_bytes_read, nullptr);
+        if(read_buffer_bytes_read > 0)
+        {
+           assert(read_offset < bytes_to_read);
+
+           if (read_offset == 0)
+           {
+                *bytes_out = new char[bytes_to_read];
+                if (bytes_to_read < read_buffer_size)
+                {
+                    std::memcpy(*bytes_out, &read_buffer, read_buffer_bytes_read);
+                    read_offset = read_buffer_bytes_read;
+                    continue;
+                }
+           }
+
+           std::memcpy(*bytes_out + read_offset, &read_buffer[0], read_buffer_bytes_read * sizeof read_buffer[0]);
+           read_offset += read_buffer_bytes_read;          
+        }
+    } while(readfile_success && read_buffer_bytes_read > 0);
+
+    assert(TRUE == CloseHandle(h_file));
+
+    if (read_offset != bytes_to_read)
+    {
+        if (read_offset > 0)
+        {
+            delete[] bytes_out;
+        }
+        return FALSE;
+    }
+
+    *bytes_read_out = read_offset;
+
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto fd = open(filename_in, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return FALSE;
+    }
+
+    char* buffer = nullptr;
+    size_t bytes_read = 0;
+    const auto error = pal_fs_read_fd(fd, &buffer, &bytes_read);
+
+    close(fd);
+
+    if (error != 0)
+    {
+        LOGE << "Error reading file: " << filename_in << ". Errno: " << error << ". Error code: " << std::strerror(error);
+        return FALSE;
+    }
+
+    *bytes_out = buffer;
+    *bytes_read_out = bytes_read;
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+// Reads a file sequentially into a single reusable buffer and hands each chunk to callback_in, so
+// that arbitrarily large files can be processed in constant memory. The callback can stop the read
+// early by returning FALSE, in which case this function returns FALSE as well.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_read_file_chunked(const char *filename_in, size_t chunk_size_in,
+    pal_fs_read_chunk_callback_t callback_in, void* user_data_in, size_t *bytes_read_out)
+{
+    if (filename_in == nullptr
+        || callback_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    const size_t chunk_alignment = 4096;
+    const size_t chunk_size_default = 1024 * 1024;
+
+    auto chunk_size = chunk_size_in == 0 ? chunk_size_default : chunk_size_in;
+    chunk_size = (chunk_size + chunk_alignment - 1) / chunk_alignment * chunk_alignment;
+
+    size_t bytes_read = 0;
+    auto success = true;
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string path_in_utf16_string(filename_in);
+
+    auto* const h_file = CreateFile(path_in_utf16_string.data(),
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                                    nullptr);
+
+    if (h_file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    auto* const chunk = static_cast<char*>(_aligned_malloc(chunk_size, chunk_alignment));
+    if (chunk == nullptr)
+    {
+        CloseHandle(h_file);
+        return FALSE;
+    }
+
+    while (true)
+    {
+        DWORD chunk_len = 0;
+        if (0 == ReadFile(h_file, chunk, static_cast<DWORD>(chunk_size), &chunk_len, nullptr))
+        {
+            LOGE << "Error reading file: " << path_in_utf16_string << ". Error code: " << GetLastError();
+            success = false;
+            break;
+        }
+
+        if (chunk_len == 0)
+        {
+            break;
+        }
+
+        bytes_read += chunk_len;
+
+        if (!callback_in(chunk, chunk_len, user_data_in))
+        {
+            success = false;
+            break;
+        }
+    }
+
+    _aligned_free(chunk);
+    CloseHandle(h_file);
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto fd = open(filename_in, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return FALSE;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    void* chunk = nullptr;
+    if (0 != posix_memalign(&chunk, chunk_alignment, chunk_size))
+    {
+        close(fd);
+        return FALSE;
+    }
+
+    while (true)
+    {
+        const auto chunk_len = read(fd, chunk, chunk_size);
+        if (chunk_len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            LOGE << "Error reading file: " << filename_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+            success = false;
+            break;
+        }
+
+        if (chunk_len == 0)
+        {
+            break;
+        }
+
+        bytes_read += static_cast<size_t>(chunk_len);
+
+        if (!callback_in(static_cast<const char*>(chunk), static_cast<size_t>(chunk_len), user_data_in))
+        {
+            success = false;
+            break;
+        }
+    }
+
+    free(chunk);
+    close(fd);
+#else
+    success = false;
+#endif
+
+    if (bytes_read_out != nullptr)
+    {
+        *bytes_read_out = bytes_read;
+    }
+
+    return success ? TRUE : FALSE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_mkdir(const char* directory_in, pal_mode_t mode_in)
+{
+    if (directory_in == nullptr || mode_in <= 0)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    PAL_UNUSED(mode_in);
+    pal_utf16_string directory_in_utf16_string(directory_in);
+    const auto status = CreateDirectory(directory_in_utf16_string.data(), nullptr);
+    if (status == 0)
+    {
+        LOGE << "Error creating directory: " << directory_in_utf16_string << ". Status: " << status << ". Error code: " << GetLastError();
+        return FALSE;
+    }
+    return TRUE;
+#else
+    const auto status = mkdir(directory_in, mode_in);
+    if (status != 0)
+    {
+        LOGE << "Error creating directory: " << directory_in << ". Mode: " << mode_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+    return TRUE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_mkdirp(const char *directory_in, pal_mode_t mode_in)
+{
+    if (directory_in == nullptr || mode_in <= 0)
+    {
+        return FALSE;
+    }
+
+    const auto directory_in_normalized = std::make_unique<char*>(new char);
+    if (!pal_path_normalize(directory_in, directory_in_normalized.get()))
+    {
+        return FALSE;
+    }
+
+    const auto* const directory_sep = PAL_DIRECTORY_SEPARATOR_STR;
+    const auto directory_in_str = std::string(*directory_in_normalized);
+
+    const auto expand_paths = [&directory_in_str, &directory_sep]()
+    {
+        auto last_index = directory_in_str.find_first_not_of(directory_sep, 0);
+        auto current_index = directory_in_str.find_first_of(directory_sep, last_index);
+        auto paths = std::vector<std::string>();
+
+        while (std::string::npos != current_index
+            || std::string::npos != last_index)
+        {
+            const auto path = directory_in_str.substr(0, current_index);
+            paths.emplace_back(path);
+
+            last_index = directory_in_str.find_first_not_of(directory_sep, current_index);
+            current_index = directory_in_str.find_first_of(directory_sep, last_index);
+        }
+
+        return paths;
+    };
+
+    auto directories_created = 0;
+    const auto paths = expand_paths();
+    for (const auto& path : paths)
+    {
+        if (pal_fs_directory_exists(path.c_str()))
+        {
+            continue;
+        }
+
+        if (!pal_fs_mkdir(path.c_str(), mode_in))
+        {
+            return FALSE;
+        }
+
+        ++directories_created;
+    }
+
+    return directories_created > 0 ? TRUE : FALSE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmfile(const char* filename_in)
+{
+    if (filename_in == nullptr)
+    {
+        return FALSE;
+    }
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string filename_in_utf16_string(filename_in);
+    const auto status = DeleteFile(filename_in_utf16_string.data());
+    if (status == 0)
+    {
+        LOGE << "Error removing file: " << filename_in_utf16_string << ". Error code: " << GetLastError();
+        return FALSE;
+    }
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto status = remove(filename_in);
+    if (status != 0)
+    {
+        LOGE << "Error removing file: " << filename_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+    return TRUE;
+#else 
+    return FALSE;
+#endif
+}
+
+#if defined(PAL_PLATFORM_LINUX)
+
+struct pal_fs_rmdir_state
+{
+    std::atomic<size_t> removed_count{ 0 };
+    std::atomic<int> first_error{ 0 };
+
+    void record_error(const int error)
+    {
+        auto expected = 0;
+        first_error.compare_exchange_strong(expected, error);
+    }
+};
+
+inline bool pal_fs_is_dot_or_dot_dot(const char* name)
+{
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// Bounds the descriptors a walk holds open, one per level. Deeper trees are left in place with ELOOP.
+static const size_t pal_fs_rmdir_max_depth = 256;
+static const size_t pal_fs_rmdir_buffer_len = 32768;
+
+struct pal_fs_rmdir_frame
+{
+    int dir_fd = -1;
+    std::string name{}; // Name of the directory inside the directory of the previous frame.
+    std::vector<std::string> subdirectories{};
+};
+
+// Unlinks every non-directory entry of dir_fd and collects the names of its subdirectories.
+static void pal_fs_rmdir_read(const int dir_fd, char* buffer, pal_fs_rmdir_state& state, std::vector<std::string>& subdirectories_out)
+{
+    while (true)
+    {
+        const auto bytes_read = syscall(SYS_getdents64, dir_fd, buffer, pal_fs_rmdir_buffer_len);
+        if (bytes_read <= 0)
+        {
+            if (bytes_read < 0)
+            {
+                state.record_error(errno);
+            }
+            break;
+        }
+
+        for (auto offset = 0l; offset < bytes_read;)
+        {
+            const auto* const entry = reinterpret_cast<pal_linux_dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+
+            if (pal_fs_is_dot_or_dot_dot(entry->d_name))
+            {
+                continue;
+            }
+
+            // Filesystems that do not fill in d_type report DT_UNKNOWN. Instead of issuing a stat we
+            // optimistically unlink the entry and only treat it as a directory if the kernel says so.
+            if (entry->d_type != DT_DIR)
+            {
+                if (0 == unlinkat(dir_fd, entry->d_name, 0))
+                {
+                    ++state.removed_count;
+                    continue;
+                }
+
+                if (errno != EISDIR || entry->d_type != DT_UNKNOWN)
+                {
+                    state.record_error(errno);
+                    continue;
+                }
+            }
+
+            subdirectories_out.emplace_back(entry->d_name);
+        }
+    }
+}
+
+// Removes everything below dir_fd without ever resolving a path from the root. Subdirectories are
+// either removed inline or, when subdirectories_out is set, handed back to the caller. The walk keeps
+// an explicit stack, so deep trees cost heap memory instead of thread stack.
+static void pal_fs_rmdir_walk(const int dir_fd, pal_fs_rmdir_state& state, std::vector<std::string>* subdirectories_out)
+{
+    const std::unique_ptr<char[]> buffer(new char[pal_fs_rmdir_buffer_len]);
+
+    std::vector<pal_fs_rmdir_frame> stack(1);
+    stack.back().dir_fd = dir_fd;
+    pal_fs_rmdir_read(dir_fd, buffer.get(), state, stack.back().subdirectories);
+
+    if (subdirectories_out != nullptr)
+    {
+        *subdirectories_out = std::move(stack.back().subdirectories);
+        return;
+    }
+
+    while (!stack.empty())
+    {
+        if (stack.back().subdirectories.empty())
+        {
+            const auto finished = std::move(stack.back());
+            stack.pop_back();
+            if (stack.empty())
+            {
+                break;
+            }
+
+            close(finished.dir_fd);
+            if (0 != unlinkat(stack.back().dir_fd, finished.name.c_str(), AT_REMOVEDIR))
+            {
+                state.record_error(errno);
+                continue;
+            }
+
+            ++state.removed_count;
+            continue;
+        }
+
+        auto name = std::move(stack.back().subdirectories.back());
+        stack.back().subdirectories.pop_back();
+
+        if (stack.size() >= pal_fs_rmdir_max_depth)
+        {
+            state.record_error(ELOOP);
+            continue;
+        }
+
+        const auto sub_dir_fd = openat(stack.back().dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sub_dir_fd == -1)
+        {
+            state.record_error(errno);
+            continue;
+        }
+
+        pal_fs_rmdir_frame frame;
+        frame.dir_fd = sub_dir_fd;
+        frame.name = std::move(name);
+        pal_fs_rmdir_read(sub_dir_fd, buffer.get(), state, frame.subdirectories);
+        stack.push_back(std::move(frame));
+    }
+}
+
+static void pal_fs_rmdir_subdirectories_parallel(const int dir_fd, const std::vector<std::string>& subdirectories, pal_fs_rmdir_state& state)
+{
+    pal_parallel_for(subdirectories.size(), 1, [&](const size_t index)
+    {
+        const auto& name = subdirectories[index];
+
+        const auto sub_dir_fd = openat(dir_fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sub_dir_fd == -1)
+        {
+            state.record_error(errno);
+            return;
+        }
+
+        pal_fs_rmdir_walk(sub_dir_fd, state, nullptr);
+        close(sub_dir_fd);
+
+        if (0 != unlinkat(dir_fd, name.c_str(), AT_REMOVEDIR))
+        {
+            state.record_error(errno);
+            return;
+        }
+
+        ++state.removed_count;
+    });
+}
+
+#else
+
+static BOOL pal_fs_rmdir_recursive_by_path(const char* directory_in, pal_fs_rmdir_stats_t& stats)
+{
+    char** files_array = nullptr;
+    size_t files_array_len = 0u;
+    if (pal_fs_list_files(directory_in, nullptr, nullptr, &files_array, &files_array_len))
+    {
+        std::vector<std::string> files(files_array, files_array + files_array_len);
+        for (const auto &filename : files)
+        {
+            if (pal_fs_rmfile(filename.c_str()))
+            {
+                ++stats.removed_count;
+            }
+            else if (stats.first_error == 0)
+            {
+                stats.first_error = static_cast<int>(GetLastError());
+            }
+        }
+
+        delete[] files_array;
+        files_array = nullptr;
+        files_array_len = 0;
+    }
+
+    char** directories_array = nullptr;
+    size_t directories_array_len = 0u;
+    if (pal_fs_list_directories(directory_in, nullptr, nullptr, &directories_array, &directories_array_len)
+        && directories_array_len > 0)
+    {
+        std::vector<std::string> directories(directories_array, directories_array + directories_array_len);
+
+        delete[] directories_array;
+        directories_array = nullptr;
+        directories_array_len = 0;
+
+        for (const auto &directory : directories)
+        {
+            if (!pal_fs_rmdir_recursive_by_path(directory.c_str(), stats))
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    if (!pal_fs_rmdir(directory_in, FALSE))
+    {
+        if (stats.first_error == 0)
+        {
+            stats.first_error = static_cast<int>(GetLastError());
+        }
+        return FALSE;
+    }
+
+    ++stats.removed_count;
+
+    return TRUE;
+}
+
+#endif
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmdir(const char* directory_in, BOOL recursive)
+{
+    if (directory_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    if (recursive)
+    {
+        return pal_fs_rmdir_recursive(directory_in, FALSE, nullptr);
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string directory_in_utf16_string(directory_in);
+    const auto status = RemoveDirectory(directory_in_utf16_string.data());
+    if (status == 0)
+    {
+        LOGE << "Error removing directory: " << directory_in_utf16_string << ". Status: " << status << ". Error code: " << GetLastError();
+        return FALSE;
+    }
+    return TRUE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto status = rmdir(directory_in);
+    if (status != 0)
+    {
+        LOGE << "Error removing directory: " << directory_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return FALSE;
+    }
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmdir_recursive(const char* directory_in, BOOL parallel, pal_fs_rmdir_stats_t* stats_out)
+{
+    if (directory_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    const auto dir_fd = open(directory_in, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir_fd == -1)
+    {
+        const auto open_error = errno;
+        LOGE << "Error opening directory: " << directory_in << ". Errno: " << open_error << ". Error code: " << std::strerror(open_error);
+        if (stats_out != nullptr)
+        {
+            stats_out->removed_count = 0;
+            stats_out->first_error = open_error;
+        }
+        return FALSE;
+    }
+
+    pal_fs_rmdir_state state;
+
+    if (parallel)
+    {
+        std::vector<std::string> subdirectories;
+        pal_fs_rmdir_walk(dir_fd, state, &subdirectories);
+        pal_fs_rmdir_subdirectories_parallel(dir_fd, subdirectories, state);
+    }
+    else
+    {
+        pal_fs_rmdir_walk(dir_fd, state, nullptr);
+    }
+
+    close(dir_fd);
+
+    if (0 == rmdir(directory_in))
+    {
+        ++state.removed_count;
+    }
+    else
+    {
+        state.record_error(errno);
+    }
+
+    const auto first_error = state.first_error.load();
+    if (first_error != 0)
+    {
+        LOGE << "Error removing directory: " << directory_in << ". Errno: " << first_error << ". Error code: " << std::strerror(first_error);
+    }
+
+    if (stats_out != nullptr)
+    {
+        stats_out->removed_count = state.removed_count.load();
+        stats_out->first_error = first_error;
+    }
+
+    return first_error == 0 ? TRUE : FALSE;
+#elif defined(PAL_PLATFORM_WINDOWS)
+    PAL_UNUSED(parallel);
+
+    pal_fs_rmdir_stats_t stats = {};
+    const auto success = pal_fs_rmdir_recursive_by_path(directory_in, stats);
+
+    if (stats_out != nullptr)
+    {
+        *stats_out = stats;
+    }
+
+    return success && stats.first_error == 0 ? TRUE : FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write(const char* filename_in, const char* data_in, const size_t data_len_in)
+{
+    if (filename_in == nullptr
+        || data_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string filename_in_utf16_string(filename_in);
+    auto* const h_file  = CreateFile(filename_in_utf16_string.data(),   
+                       GENERIC_WRITE,          // open for writing
+                       FILE_SHARE_READ,        // allow read while writing
+                       nullptr,                // default security
+                       CREATE_ALWAYS,          // open existing file or create a new file
+                       FILE_ATTRIBUTE_NORMAL,  // normal file
+                       nullptr);               // no attr. template
+
+    if(h_file == INVALID_HANDLE_VALUE)
+    {
+        return FALSE;
+    }
+
+    DWORD bytes_written;
+
+    const auto success = WriteFile( 
+                    h_file,              // open file handle
+                    data_in,             // start of data to write
+                    data_len_in,         // number of bytes to write
+                    &bytes_written,      // number of bytes that were written
+                    nullptr);            // no overlapped structure
+
+    CloseHandle(h_file);
+
+    return success == TRUE && bytes_written == data_len_in ? TRUE : FALSE;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto h_file = fopen(filename_in, "wb");
+    if(h_file == nullptr)
+    {
+        return FALSE;
+    }
+
+    const auto bytes_written = fwrite(data_in, sizeof(char), data_len_in, h_file);
+
+    fclose(h_file);
+
+    if(bytes_written == data_len_in)
+    {
+        return TRUE;
+    }
+
+    return FALSE;
+#else
+    return FALSE;
+#endif
+}
+
+struct pal_fs_write_batch
+{
+    // Temporary filename and the filename it replaces on commit.
+    std::vector<std::pair<std::string, std::string>> pending{};
+};
+
+// Batches at least this large are flushed with one syncfs per filesystem instead of one fdatasync per file.
+static const size_t pal_fs_write_batch_syncfs_threshold = 16;
+
+#if defined(PAL_PLATFORM_LINUX)
+
+static std::string pal_fs_parent_directory(const std::string& filename)
+{
+    const auto directory_separator_pos = filename.find_last_of(PAL_DIRECTORY_SEPARATOR_C);
+    if (directory_separator_pos == std::string::npos)
+    {
+        return ".";
+    }
+    if (directory_separator_pos == 0)
+    {
+        return PAL_DIRECTORY_SEPARATOR_STR;
+    }
+    return filename.substr(0, directory_separator_pos);
+}
+
+static bool pal_fs_fsync_directory(const std::string& directory)
+{
+    const auto dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1)
+    {
+        return false;
+    }
+    const auto success = 0 == fsync(dir_fd);
+    close(dir_fd);
+    return success;
+}
+
+static bool pal_fs_write_all(const int fd, const char* data_in, size_t data_len_in)
+{
+    while (data_len_in > 0)
+    {
+        const auto bytes_written = write(fd, data_in, data_len_in);
+        if (bytes_written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data_in += bytes_written;
+        data_len_in -= static_cast<size_t>(bytes_written);
+    }
+    return true;
+}
+
+// Writes data into a new file in the same directory as filename_in and returns its temporary name.
+// When the filesystem supports O_TMPFILE the inode stays anonymous until all data has been written,
+// so a crash never leaves a partially written temporary file behind.
+static bool pal_fs_write_tmp_file(const char* filename_in, const char* data_in, const size_t data_len_in,
+    const bool sync, std::string& tmp_filename_out)
+{
+    const std::string filename_str(filename_in);
+    const auto tmp_filename = pal_fs_build_tmp_filename(filename_str);
+
+    auto fd = -1;
+    auto anonymous = false;
+#if defined(O_TMPFILE)
+    fd = open(pal_fs_parent_directory(filename_str).c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+    anonymous = fd != -1;
+#endif
+    if (fd == -1)
+    {
+        fd = open(tmp_filename.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    }
+
+    if (fd == -1)
+    {
+        LOGE << "Error creating temporary file for: " << filename_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return false;
+    }
+
+    // Preserve the permissions of the file that is about to be replaced.
+    struct stat filename_stat = {};
+    if (0 == stat(filename_in, &filename_stat))
+    {
+        fchmod(fd, filename_stat.st_mode & 07777);
+    }
+
+    auto success = pal_fs_write_all(fd, data_in, data_len_in)
+        && (!sync || 0 == fdatasync(fd));
+
+    if (success && anonymous)
+    {
+        const auto fd_path = "/proc/self/fd/" + std::to_string(fd);
+        success = 0 == linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, tmp_filename.c_str(), AT_SYMLINK_FOLLOW);
+    }
+
+    const auto write_errno = errno;
+
+    close(fd);
+
+    if (!success)
+    {
+        LOGE << "Error writing temporary file: " << tmp_filename << ". Errno: " << write_errno << ". Error code: " << std::strerror(write_errno);
+        if (!anonymous)
+        {
+            unlink(tmp_filename.c_str());
+        }
+        return false;
+    }
+
+    tmp_filename_out = tmp_filename;
+    return true;
+}
+
+#elif defined(PAL_PLATFORM_WINDOWS)
+
+static bool pal_fs_write_tmp_file(const char* filename_in, const char* data_in, const size_t data_len_in,
+    const bool sync, std::string& tmp_filename_out)
+{
+    const auto tmp_filename = pal_fs_build_tmp_filename(filename_in);
+
+    pal_utf16_string tmp_filename_utf16_string(tmp_filename);
+    auto* const h_file = CreateFile(tmp_filename_utf16_string.data(),
+        GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (h_file == INVALID_HANDLE_VALUE)
+    {
+        LOGE << "Error creating temporary file: " << tmp_filename_utf16_string << ". Error code: " << GetLastError();
+        return false;
+    }
+
+    DWORD bytes_written = 0;
+    auto success = TRUE == WriteFile(h_file, data_in, static_cast<DWORD>(data_len_in), &bytes_written, nullptr)
+        && bytes_written == data_len_in
+        && (!sync || TRUE == FlushFileBuffers(h_file));
+
+    CloseHandle(h_file);
+
+    if (!success)
+    {
+        LOGE << "Error writing temporary file: " << tmp_filename_utf16_string << ". Error code: " << GetLastError();
+        DeleteFile(tmp_filename_utf16_string.data());
+        return false;
+    }
+
+    tmp_filename_out = tmp_filename;
+    return true;
+}
+
+#endif
+
+static bool pal_fs_replace_file(const std::string& tmp_filename, const std::string& filename)
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string tmp_filename_utf16_string(tmp_filename);
+    pal_utf16_string filename_utf16_string(filename);
+    if (0 == MoveFileEx(tmp_filename_utf16_string.data(), filename_utf16_string.data(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    {
+        LOGE << "Error replacing file: " << filename_utf16_string << ". Error code: " << GetLastError();
+        return false;
+    }
+    return true;
+#elif defined(PAL_PLATFORM_LINUX)
+    if (0 != rename(tmp_filename.c_str(), filename.c_str()))
+    {
+        LOGE << "Error replacing file: " << filename << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void pal_fs_write_batch_discard(pal_fs_write_batch_t* batch_in)
+{
+    for (const auto& pending : batch_in->pending)
+    {
+        pal_fs_rmfile(pending.first.c_str());
+    }
+
+    batch_in->pending.clear();
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_atomic(const char* filename_in, const char* data_in, const size_t data_len_in)
+{
+    if (filename_in == nullptr
+        || data_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS) || defined(PAL_PLATFORM_LINUX)
+    std::string tmp_filename;
+    if (!pal_fs_write_tmp_file(filename_in, data_in, data_len_in, true, tmp_filename))
+    {
+        return FALSE;
+    }
+
+    if (!pal_fs_replace_file(tmp_filename, filename_in))
+    {
+        pal_fs_rmfile(tmp_filename.c_str());
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    // The rename itself is only durable once the directory entry has been flushed.
+    if (!pal_fs_fsync_directory(pal_fs_parent_directory(filename_in)))
+    {
+        return FALSE;
+    }
+#endif
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_create(pal_fs_write_batch_t** batch_out)
+{
+    if (batch_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    *batch_out = new pal_fs_write_batch();
+
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_add(pal_fs_write_batch_t* batch_in, const char* filename_in,
+    const char* data_in, const size_t data_len_in)
+{
+    if (batch_in == nullptr
+        || filename_in == nullptr
+        || data_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS) || defined(PAL_PLATFORM_LINUX)
+    std::string tmp_filename;
+    if (!pal_fs_write_tmp_file(filename_in, data_in, data_len_in, false, tmp_filename))
+    {
+        return FALSE;
+    }
+
+    batch_in->pending.emplace_back(tmp_filename, filename_in);
+
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+// Flushes the data of every pending file, then renames all of them into place and finally flushes the
+// parent directories. Small batches use one fdatasync per file, large batches a single syncfs per filesystem.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_commit(pal_fs_write_batch_t* batch_in)
+{
+    if (batch_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    auto success = true;
+
+#if defined(PAL_PLATFORM_LINUX)
+    std::vector<std::string> directories;
+    for (const auto& pending : batch_in->pending)
+    {
+        auto directory = pal_fs_parent_directory(pending.second);
+        if (std::find(directories.begin(), directories.end(), directory) == directories.end())
+        {
+            directories.emplace_back(std::move(directory));
+        }
+    }
+
+    if (batch_in->pending.size() >= pal_fs_write_batch_syncfs_threshold)
+    {
+        std::vector<dev_t> filesystems;
+        for (const auto& directory : directories)
+        {
+            const auto dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd == -1)
+            {
+                success = false;
+                continue;
+            }
+
+            struct stat dir_stat = {};
+            if (0 == fstat(dir_fd, &dir_stat)
+                && std::find(filesystems.begin(), filesystems.end(), dir_stat.st_dev) == filesystems.end())
+            {
+                filesystems.emplace_back(dir_stat.st_dev);
+                success = 0 == syncfs(dir_fd) && success;
+            }
+
+            close(dir_fd);
+        }
+    }
+    else
+    {
+        for (const auto& pending : batch_in->pending)
+        {
+            const auto fd = open(pending.first.c_str(), O_RDONLY | O_CLOEXEC);
+            success = fd != -1 && 0 == fdatasync(fd) && success;
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    if (!success)
+    {
+        LOGE << "Error flushing write batch. Errno: " << errno << ". Error code: " << std::strerror(errno);
+        pal_fs_write_batch_discard(batch_in);
+        return FALSE;
+    }
+
+    for (const auto& pending : batch_in->pending)
+    {
+        if (!pal_fs_replace_file(pending.first, pending.second))
+        {
+            pal_fs_rmfile(pending.first.c_str());
+            success = false;
+        }
+    }
+
+    batch_in->pending.clear();
+
+    for (const auto& directory : directories)
+    {
+        success = pal_fs_fsync_directory(directory) && success;
+    }
+#elif defined(PAL_PLATFORM_WINDOWS)
+    for (const auto& pending : batch_in->pending)
+    {
+        pal_utf16_string tmp_filename_utf16_string(pending.first);
+        auto* const h_file = CreateFile(tmp_filename_utf16_string.data(),
+            GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        success = h_file != INVALID_HANDLE_VALUE && TRUE == FlushFileBuffers(h_file) && success;
+        if (h_file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(h_file);
+        }
+    }
+
+    if (!success)
+    {
+        pal_fs_write_batch_discard(batch_in);
+        return FALSE;
+    }
+
+    for (const auto& pending : batch_in->pending)
+    {
+        if (!pal_fs_replace_file(pending.first, pending.second))
+        {
+            pal_fs_rmfile(pending.first.c_str());
+            success = false;
+        }
+    }
+
+    batch_in->pending.clear();
+#else
+    success = false;
+#endif
+
+    return success ? TRUE : FALSE;
+}
+
+// Discards files that have not been committed and releases the batch.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write_batch_free(pal_fs_write_batch_t* batch_in)
+{
+    if (batch_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    pal_fs_write_batch_discard(batch_in);
+
+    delete batch_in;
+
+    return TRUE;
+}
+
+struct pal_fs_batch
+{
+    std::string directory{};
+#if defined(PAL_PLATFORM_LINUX)
+    int dir_fd = -1;
+#endif
+#if defined(PAL_IO_URING_SUPPORTED)
+    std::unique_ptr<pal_io_uring> ring{};
+#endif
+};
+
+#if defined(PAL_IO_URING_SUPPORTED)
+static const unsigned pal_fs_batch_ring_entries = 256;
+#endif
+
+// Executes a single batch operation with blocking syscalls. Returns 0 or errno (GetLastError on Windows).
+static int pal_fs_batch_execute_op_sync(const pal_fs_batch_t* batch_in, pal_fs_batch_op_t* op)
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    if (op->path == nullptr)
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    std::string path(op->path);
+    const auto is_absolute = path.size() > 1 && (path[1] == ':' || path[0] == PAL_DIRECTORY_SEPARATOR_C);
+    if (!is_absolute)
+    {
+        char* path_combined = nullptr;
+        if (!pal_path_combine(batch_in->directory.c_str(), op->path, &path_combined))
+        {
+            return ERROR_BAD_PATHNAME;
+        }
+        path.assign(path_combined);
+        free(path_combined);
+    }
+
+    BOOL success;
+    switch (op->type)
+    {
+    case PAL_FS_BATCH_OP_STAT:
+        success = pal_fs_stat(path.c_str(), TRUE, &op->stat);
+        break;
+    case PAL_FS_BATCH_OP_READ:
+        success = pal_fs_read_file(path.c_str(), &op->data, &op->data_len);
+        break;
+    case PAL_FS_BATCH_OP_UNLINK:
+        success = pal_fs_rmfile(path.c_str());
+        break;
+    case PAL_FS_BATCH_OP_RMDIR:
+        success = pal_fs_rmdir(path.c_str(), FALSE);
+        break;
+    default:
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    if (success)
+    {
+        return 0;
+    }
+
+    const auto error = static_cast<int>(GetLastError());
+    return error == 0 ? ERROR_GEN_FAILURE : error;
+#elif defined(PAL_PLATFORM_LINUX)
+    if (op->path == nullptr)
+    {
+        return EINVAL;
+    }
+
+    switch (op->type)
+    {
+    case PAL_FS_BATCH_OP_STAT:
+        return pal_fs_stat_at(batch_in->dir_fd, op->path, TRUE, &op->stat);
+    case PAL_FS_BATCH_OP_READ:
+    {
+        const auto fd = openat(batch_in->dir_fd, op->path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return errno;
+        }
+        const auto error = pal_fs_read_fd(fd, &op->data, &op->data_len);
+        close(fd);
+        return error;
+    }
+    case PAL_FS_BATCH_OP_UNLINK:
+        return 0 == unlinkat(batch_in->dir_fd, op->path, 0) ? 0 : errno;
+    case PAL_FS_BATCH_OP_RMDIR:
+        return 0 == unlinkat(batch_in->dir_fd, op->path, AT_REMOVEDIR) ? 0 : errno;
+    default:
+        return EINVAL;
+    }
+#else
+    return -1;
+#endif
+}
+
+// Operations are independent, so without io_uring they are spread across threads to overlap
+// the per-syscall latency instead.
+static void pal_fs_batch_execute_parallel(const pal_fs_batch_t* batch_in, pal_fs_batch_op_t* ops_in, const std::vector<size_t>& indices)
+{
+    pal_parallel_for(indices.size(), 32, [&](const size_t i)
+    {
+        auto& op = ops_in[indices[i]];
+        op.stat = {};
+        op.data = nullptr;
+        op.data_len = 0;
+        op.error = pal_fs_batch_execute_op_sync(batch_in, &op);
+    });
+}
+
+#if defined(PAL_IO_URING_SUPPORTED)
+enum pal_fs_batch_uring_tag : uint64_t
+{
+    pal_fs_batch_uring_tag_op = 0, // statx, unlinkat or the openat of a read.
+    pal_fs_batch_uring_tag_read_statx = 1,
+    pal_fs_batch_uring_tag_read = 2
+};
+
+struct pal_fs_batch_uring_op
+{
+    struct statx stx;
+    int fd;
+    int open_res;
+    int statx_res;
+    uint32_t pending;
+    size_t capacity;
+    size_t requested;
+};
+
+static bool pal_fs_batch_uring_is_unsupported(const int res)
+{
+    // Opcodes that the running kernel does not know about complete with EINVAL.
+    return res == -EINVAL || res == -EOPNOTSUPP;
+}
+
+// Queues every operation on the ring, keeping at most one ring worth of entries in flight so that
+// the completion queue (twice the size of the submission queue) can never overflow. Reads take two
+// rounds: openat and statx are queued together, the read itself once both have completed.
+// When the ring fails it is torn down and the operations without a result are returned in remaining_out.
+static int pal_fs_batch_execute_uring(pal_fs_batch_t* batch_in, pal_fs_batch_op_t* ops_in, const size_t ops_len_in,
+    std::vector<size_t>& remaining_out)
+{
+    auto& ring = *batch_in->ring;
+    std::vector<pal_fs_batch_uring_op> uring_ops(ops_len_in);
+    std::vector<size_t> reads_ready;
+    std::vector<bool> completed(ops_len_in);
+
+    const auto encode = [](const size_t index, const pal_fs_batch_uring_tag tag) { return static_cast<uint64_t>(index) << 2 | tag; };
+
+    const auto finish_sync = [&](const size_t index)
+    {
+        auto& op = ops_in[index];
+        delete[] op.data;
+        op.data = nullptr;
+        op.data_len = 0;
+        op.error = pal_fs_batch_execute_op_sync(batch_in, &op);
+        completed[index] = true;
+    };
+
+    // Stores the result of a stat, unlink or rmdir completion. Returns false if the kernel does not support it.
+    const auto finish_op = [&](const size_t index, const int res)
+    {
+        auto& op = ops_in[index];
+        if (pal_fs_batch_uring_is_unsupported(res))
+        {
+            return false;
+        }
+        if (res < 0)
+        {
+            op.error = -res;
+        }
+        else if (op.type == PAL_FS_BATCH_OP_STAT)
+        {
+            pal_fs_stat_from_statx(uring_ops[index].stx, &op.stat);
+        }
+        completed[index] = true;
+        return true;
+    };
+
+    const auto finish_read = [&](const size_t index, const int error)
+    {
+        auto& op = ops_in[index];
+        auto& uring_op = uring_ops[index];
+        close(uring_op.fd);
+        uring_op.fd = -1;
+        if (error != 0)
+        {
+            delete[] op.data;
+            op.data = nullptr;
+            op.data_len = 0;
+        }
+        op.error = error;
+        completed[index] = true;
+    };
+
+    // Reset up front, a failed submission leaves the outputs of every operation safe to free.
+    for (auto i = 0u; i < ops_len_in; i++)
+    {
+        ops_in[i].stat = {};
+        ops_in[i].data = nullptr;
+        ops_in[i].data_len = 0;
+        ops_in[i].error = 0;
+    }
+
+    size_t next_index = 0;
+    size_t in_flight = 0;
+
+    while (next_index < ops_len_in || in_flight > 0 || !reads_ready.empty())
+    {
+        while (!reads_ready.empty()
+            && in_flight < ring.sq_entries()
+            && ring.sq_space_left() > 0)
+        {
+            const auto index = reads_ready.back();
+            reads_ready.pop_back();
+
+            auto& op = ops_in[index];
+            auto* const sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = uring_ops[index].fd;
+            sqe->addr = reinterpret_cast<uint64_t>(op.data);
+            // Keep the length within the range of the int result.
+            uring_ops[index].requested = std::min<size_t>(uring_ops[index].capacity, 1u << 30);
+            sqe->len = static_cast<uint32_t>(uring_ops[index].requested);
+            sqe->off = 0;
+            sqe->user_data = encode(index, pal_fs_batch_uring_tag_read);
+            in_flight++;
+        }
+
+        while (next_index < ops_len_in)
+        {
+            const auto index = next_index;
+            auto& op = ops_in[index];
+            auto& uring_op = uring_ops[index];
+            const auto sqes_needed = op.type == PAL_FS_BATCH_OP_READ ? 2u : 1u;
+
+            uring_op.fd = -1;
+
+            if (op.path == nullptr || op.type > PAL_FS_BATCH_OP_RMDIR)
+            {
+                op.error = EINVAL;
+                completed[index] = true;
+                next_index++;
+                continue;
+            }
+
+            if (in_flight + sqes_needed > ring.sq_entries()
+                || ring.sq_space_left() < sqes_needed)
+            {
+                break;
+            }
+
+            auto* const sqe = ring.get_sqe();
+            sqe->fd = batch_in->dir_fd;
+            sqe->addr = reinterpret_cast<uint64_t>(op.path);
+            sqe->user_data = encode(index, pal_fs_batch_uring_tag_op);
+
+            switch (op.type)
+            {
+            case PAL_FS_BATCH_OP_STAT:
+                sqe->opcode = IORING_OP_STATX;
+                sqe->len = pal_fs_statx_mask;
+                sqe->off = reinterpret_cast<uint64_t>(&uring_op.stx);
+                sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+                break;
+            case PAL_FS_BATCH_OP_UNLINK:
+            case PAL_FS_BATCH_OP_RMDIR:
+                sqe->opcode = IORING_OP_UNLINKAT;
+                sqe->unlink_flags = op.type == PAL_FS_BATCH_OP_RMDIR ? AT_REMOVEDIR : 0;
+                break;
+            case PAL_FS_BATCH_OP_READ:
+            {
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+                auto* const sqe_statx = ring.get_sqe();
+                sqe_statx->opcode = IORING_OP_STATX;
+                sqe_statx->fd = batch_in->dir_fd;
+                sqe_statx->addr = reinterpret_cast<uint64_t>(op.path);
+                sqe_statx->len = STATX_TYPE | STATX_SIZE;
+                sqe_statx->off = reinterpret_cast<uint64_t>(&uring_op.stx);
+                sqe_statx->statx_flags = AT_STATX_SYNC_AS_STAT;
+                sqe_statx->user_data = encode(index, pal_fs_batch_uring_tag_read_statx);
+
+                uring_op.pending = 2;
+                break;
+            }
+            default:
+                break;
+            }
+
+            in_flight += sqes_needed;
+            next_index++;
+        }
+
+        if (in_flight == 0)
+        {
+            continue;
+        }
+
+        const auto error = ring.submit_and_wait(1);
+        if (error != 0)
+        {
+            // Closing the ring does not cancel requests the kernel already consumed, they could still
+            // write into the statx and read buffers. Wait for each of them, keep the results of the
+            // operations that completed and the fds of opens.
+            auto outstanding = in_flight - ring.queued();
+            auto drained = true;
+            while (outstanding > 0)
+            {
+                uint64_t user_data;
+                int res;
+                if (!ring.pop_cqe(&user_data, &res))
+                {
+                    if (ring.wait_cqe() != 0)
+                    {
+                        drained = false;
+                        break;
+                    }
+                    continue;
+                }
+
+                outstanding--;
+                const auto index = static_cast<size_t>(user_data >> 2);
+                if (ops_in[index].type != PAL_FS_BATCH_OP_READ)
+                {
+                    finish_op(index, res);
+                }
+                else if (static_cast<pal_fs_batch_uring_tag>(user_data & 3) == pal_fs_batch_uring_tag_op && res >= 0)
+                {
+                    uring_ops[index].fd = res;
+                }
+            }
+
+            if (!drained)
+            {
+                LOGE << "Unable to wait for io_uring requests in flight, tearing down the ring.";
+            }
+            batch_in->ring.reset();
+
+            for (auto i = 0u; i < next_index; i++)
+            {
+                if (uring_ops[i].fd != -1)
+                {
+                    close(uring_ops[i].fd);
+                }
+            }
+
+            // Reads are finished from scratch, their partial buffers are released.
+            for (size_t i = 0; i < ops_len_in; i++)
+            {
+                if (!completed[i])
+                {
+                    delete[] ops_in[i].data;
+                    ops_in[i].data = nullptr;
+                    remaining_out.push_back(i);
+                }
+            }
+            return error;
+        }
+
+        uint64_t user_data;
+        int res;
+        while (ring.pop_cqe(&user_data, &res))
+        {
+            in_flight--;
+
+            const auto index = static_cast<size_t>(user_data >> 2);
+            const auto tag = static_cast<pal_fs_batch_uring_tag>(user_data & 3);
+            auto& op = ops_in[index];
+            auto& uring_op = uring_ops[index];
+
+            if (op.type != PAL_FS_BATCH_OP_READ)
+            {
+                if (!finish_op(index, res))
+                {
+                    finish_sync(index);
+                }
+                continue;
+            }
+
+            if (tag == pal_fs_batch_uring_tag_read)
+            {
+                if (res < 0)
+                {
+                    finish_read(index, -res);
+                    continue;
+                }
+
+                op.data_len = static_cast<size_t>(res);
+
+                // A short read of a regular file is EOF. Anything else (the file grew, or procfs
+                // files without a meaningful size) is finished with blocking reads.
+                auto error = 0;
+                if (!S_ISREG(uring_op.stx.stx_mode) || op.data_len == uring_op.requested)
+                {
+                    error = lseek(uring_op.fd, static_cast<off_t>(op.data_len), SEEK_SET) == -1 ? errno
+                        : pal_fs_read_fd_append(uring_op.fd, &op.data, &uring_op.capacity, &op.data_len);
+                }
+
+                finish_read(index, error);
+                continue;
+            }
+
+            if (tag == pal_fs_batch_uring_tag_op)
+            {
+                uring_op.open_res = res;
+                uring_op.fd = res >= 0 ? res : -1;
+            }
+            else
+            {
+                uring_op.statx_res = res;
+            }
+
+            if (--uring_op.pending > 0)
+            {
+                continue;
+            }
+
+            if (pal_fs_batch_uring_is_unsupported(uring_op.open_res)
+                || pal_fs_batch_uring_is_unsupported(uring_op.statx_res))
+            {
+                if (uring_op.fd != -1)
+                {
+                    close(uring_op.fd);
+                    uring_op.fd = -1;
+                }
+                finish_sync(index);
+                continue;
+            }
+
+            if (uring_op.open_res < 0)
+            {
+                op.error = -uring_op.open_res;
+                completed[index] = true;
+                continue;
+            }
+
+            if (uring_op.statx_res < 0)
+            {
+                uring_op.stx = {};
+            }
+
+            uring_op.capacity = pal_fs_read_capacity_hint(S_ISREG(uring_op.stx.stx_mode), uring_op.stx.stx_size);
+            op.data = new char[uring_op.capacity];
+            reads_ready.push_back(index);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+// Binds a batch to directory_in, relative paths of operations are resolved against it. When use_io_uring_in
+// is set and the kernel allows it, operations are queued on an io_uring instance; otherwise (and on Windows)
+// they are executed by a set of worker threads.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_create(const char* directory_in, const BOOL use_io_uring_in, pal_fs_batch_t** batch_out)
+{
+    if (directory_in == nullptr
+        || batch_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    auto batch = std::make_unique<pal_fs_batch_t>();
+    batch->directory.assign(directory_in);
+
 #if defined(PAL_PLATFORM_WINDOWS)
-    return ::IsWindows8OrGreater() ? TRUE : FALSE;
+    PAL_UNUSED(use_io_uring_in);
+
+    if (!pal_fs_directory_exists(directory_in))
+    {
+        return FALSE;
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    batch->dir_fd = open(directory_in, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (batch->dir_fd == -1)
+    {
+        LOGE << "Failed to open directory: " << directory_in << ". Error: " << strerror(errno);
+        return FALSE;
+    }
+
+#if defined(PAL_IO_URING_SUPPORTED)
+    if (use_io_uring_in)
+    {
+        auto ring = std::make_unique<pal_io_uring>();
+        const auto error = ring->try_create(pal_fs_batch_ring_entries);
+        if (error == 0)
+        {
+            batch->ring = std::move(ring);
+        }
+        else
+        {
+            LOGD << "io_uring is unavailable, falling back to worker threads. Error: " << strerror(error);
+        }
+    }
 #else
-    return FALSE;
+    PAL_UNUSED(use_io_uring_in);
+#endif
 #endif
+
+    *batch_out = batch.release();
+    return TRUE;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_is_windows_7_or_greater()
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_is_io_uring(const pal_fs_batch_t* batch_in)
 {
-#if defined(PAL_PLATFORM_WINDOWS)
-    return ::IsWindows7OrGreater() ? TRUE : FALSE;
+#if defined(PAL_IO_URING_SUPPORTED)
+    return batch_in != nullptr && batch_in->ring != nullptr ? TRUE : FALSE;
 #else
+    PAL_UNUSED(batch_in);
     return FALSE;
 #endif
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_is_linux()
+// Executes every operation in ops_in. Operations are independent and may complete in any order, so a
+// batch must not contain operations that depend on each other (e.g. unlinking files and then their
+// directory). Each operation reports its own error; returns TRUE only if all of them succeeded.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_execute(pal_fs_batch_t* batch_in, pal_fs_batch_op_t* ops_in, const size_t ops_len_in)
 {
-#if defined(PAL_PLATFORM_LINUX)
+    if (batch_in == nullptr
+        || (ops_in == nullptr && ops_len_in > 0))
+    {
+        return FALSE;
+    }
+
+    std::vector<size_t> remaining;
+
+#if defined(PAL_IO_URING_SUPPORTED)
+    if (batch_in->ring != nullptr)
+    {
+        const auto error = pal_fs_batch_execute_uring(batch_in, ops_in, ops_len_in, remaining);
+        if (error != 0)
+        {
+            // Operations that completed in the kernel keep their results, unlinks must not run twice.
+            LOGE << "io_uring submission failed, falling back to worker threads. Error: " << strerror(error);
+        }
+    }
+    else
+#endif
+    {
+        for (size_t i = 0; i < ops_len_in; i++)
+        {
+            remaining.push_back(i);
+        }
+    }
+
+    pal_fs_batch_execute_parallel(batch_in, ops_in, remaining);
+
+    for (auto i = 0u; i < ops_len_in; i++)
+    {
+        if (ops_in[i].error != 0)
+        {
+            return FALSE;
+        }
+    }
+
     return TRUE;
-#else
-    return FALSE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_batch_free(pal_fs_batch_t* batch_in)
+{
+    if (batch_in == nullptr)
+    {
+        return FALSE;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    close(batch_in->dir_fd);
 #endif
+
+    delete batch_in;
+    return TRUE;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_is_unknown_os()
+// - Hashing
+
+struct pal_hash
 {
-    return pal_is_linux()
-        || pal_is_windows() ? FALSE : TRUE;
+    uint32_t algorithm = PAL_HASH_SHA256;
+    pal_sha256 sha256{};
+    pal_blake3 blake3{};
+};
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_create(const uint32_t algorithm_in, pal_hash_t** hash_out)
+{
+    if (hash_out == nullptr
+        || (algorithm_in != PAL_HASH_SHA256 && algorithm_in != PAL_HASH_BLAKE3))
+    {
+        return FALSE;
+    }
+
+    auto* const hash = new pal_hash();
+    hash->algorithm = algorithm_in;
+
+    *hash_out = hash;
+    return TRUE;
 }
 
-// - Environment
-PAL_API BOOL PAL_CALLING_CONVENTION pal_env_set(const char* name_in, const char* value_in)
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_update(pal_hash_t* hash_in, const void* data_in, const size_t data_len_in)
 {
-    if (name_in == nullptr)
+    if (hash_in == nullptr
+        || (data_in == nullptr && data_len_in > 0))
     {
         return FALSE;
     }
-#if defined(PAL_PLATFORM_WINDOWS) 
-    pal_utf16_string name_in_utf16_string(name_in);
-    pal_utf16_string value_in_utf16_string(value_in == nullptr ? "" : value_in);
-    const auto success = SetEnvironmentVariable(name_in_utf16_string.data(), value_in_utf16_string.empty() ? nullptr : value_in_utf16_string.data());
-    return success != 0 ? TRUE : FALSE;
-#elif defined(PAL_PLATFORM_LINUX)
-    const auto success = value_in == nullptr ? unsetenv(name_in) : setenv(name_in, value_in, 1 /* overwrite */);
-    return success == 0;
-#else
-    return FALSE;
-#endif
+
+    if (data_len_in == 0)
+    {
+        return TRUE;
+    }
+
+    const auto* const data = static_cast<const uint8_t*>(data_in);
+    if (hash_in->algorithm == PAL_HASH_SHA256)
+    {
+        hash_in->sha256.update(data, data_len_in);
+    }
+    else
+    {
+        hash_in->blake3.update(data, data_len_in);
+    }
+
+    return TRUE;
+}
+
+// Writes PAL_HASH_DIGEST_SIZE bytes to digest_out. The state must not be updated afterwards.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_final(pal_hash_t* hash_in, uint8_t* digest_out)
+{
+    if (hash_in == nullptr
+        || digest_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    if (hash_in->algorithm == PAL_HASH_SHA256)
+    {
+        hash_in->sha256.finalize(digest_out);
+    }
+    else
+    {
+        hash_in->blake3.finalize(digest_out);
+    }
+
+    return TRUE;
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_free(pal_hash_t* hash_in)
+{
+    if (hash_in == nullptr)
+    {
+        return FALSE;
+    }
+
+    delete hash_in;
+    return TRUE;
+}
+
+// Returns the name of the kernel selected for this cpu, e.g. "sha-ni", "avx2" or "portable".
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_get_implementation(const uint32_t algorithm_in, const char** name_out)
+{
+    if (name_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    switch (algorithm_in)
+    {
+    case PAL_HASH_SHA256:
+        *name_out = pal_sha256::get_implementation();
+        return TRUE;
+    case PAL_HASH_BLAKE3:
+        *name_out = pal_blake3::get_implementation();
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+// Hashes a whole file. With use_mmap_in the file is mapped and hashed in place, which avoids copying
+// every page through a read buffer; otherwise it is streamed with pal_fs_read_file_chunked. Files
+// that cannot be mapped (procfs, pipes) are always streamed.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_hash_file(const char* filename_in, const uint32_t algorithm_in, const BOOL use_mmap_in, uint8_t* digest_out)
+{
+    if (filename_in == nullptr
+        || digest_out == nullptr)
+    {
+        return FALSE;
+    }
+
+    pal_hash_t* hash = nullptr;
+    if (!pal_hash_create(algorithm_in, &hash))
+    {
+        return FALSE;
+    }
+
+    std::unique_ptr<pal_hash_t, decltype(&pal_hash_free)> hash_ptr(hash, pal_hash_free);
+
+    if (use_mmap_in)
+    {
+        pal_mapped_file mapped_file;
+        const auto error = mapped_file.try_open(filename_in, true);
+        if (error == 0)
+        {
+            pal_hash_update(hash, mapped_file.data(), mapped_file.size());
+            return pal_hash_final(hash, digest_out);
+        }
+
+        LOGD << "Unable to map file, falling back to reading it: " << filename_in << ". Error: " << error;
+    }
+
+    const auto update_callback = [](const char* chunk_in, const size_t chunk_len_in, void* user_data_in) -> BOOL
+    {
+        return pal_hash_update(static_cast<pal_hash_t*>(user_data_in), chunk_in, chunk_len_in);
+    };
+
+    if (!pal_fs_read_file_chunked(filename_in, 0, update_callback, hash, nullptr))
+    {
+        return FALSE;
+    }
+
+    return pal_hash_final(hash, digest_out);
+}
+
+// - Verification
+
+static const char* const pal_fs_verify_cache_header = "snapx-verify-cache 1";
+
+// Verdicts for files modified this close to the time the cache is written are not stored: a file
+// rewritten within the timestamp granularity of the filesystem can keep its inode, size and mtime.
+static const uint64_t pal_fs_verify_racy_window_ns = 2000000000ull;
+
+struct pal_fs_verify_cache_entry
+{
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    uint64_t mtime_ns = 0;
+    std::string digest_hex{};
+};
+
+static std::string pal_fs_verify_digest_to_hex(const uint8_t* digest)
+{
+    static const char* const hex = "0123456789abcdef";
+
+    std::string str;
+    str.reserve(PAL_HASH_DIGEST_SIZE * 2);
+    for (auto i = 0; i < PAL_HASH_DIGEST_SIZE; i++)
+    {
+        str.push_back(hex[digest[i] >> 4]);
+        str.push_back(hex[digest[i] & 0xf]);
+    }
+    return str;
+}
+
+static bool pal_fs_verify_is_safe_path(const std::string& path)
+{
+    if (path.empty()
+        || path[0] == '/'
+        || path[0] == '\\'
+        || path.find(':') != std::string::npos)
+    {
+        return false;
+    }
+
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        const auto end = std::min(path.find_first_of("/\\", start), path.size());
+        if (path.compare(start, end - start, "..") == 0)
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+
+    return true;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_env_get(const char * environment_variable_in, char ** environment_variable_value_out)
+// Format: a header line followed by "<inode> <size> <mtime_ns> <hex digest> <path>" for every file
+// that verified successfully. Unknown or corrupt caches are ignored, they only cost a re-hash.
+static std::unordered_map<std::string, pal_fs_verify_cache_entry> pal_fs_verify_cache_read(const char* cache_filename_in, const uint32_t algorithm_in)
 {
-    if (environment_variable_in == nullptr)
+    std::unordered_map<std::string, pal_fs_verify_cache_entry> cache;
+
+    if (cache_filename_in == nullptr
+        || !pal_fs_file_exists(cache_filename_in))
     {
-        return FALSE;
+        return cache;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string environment_variable_in_utf16_string(environment_variable_in);
-    const auto buffer_size = 65535;
-    auto* const buffer = new wchar_t[buffer_size];
-    const auto actual_len = GetEnvironmentVariable(environment_variable_in_utf16_string.data(), buffer, buffer_size);
-    if (actual_len <= 0)
+    char* data = nullptr;
+    size_t data_len = 0;
+    if (!pal_fs_read_file(cache_filename_in, &data, &data_len))
     {
-        delete[] buffer;
-        return FALSE;
+        return cache;
     }
 
-    *environment_variable_value_out = pal_utf8_string(&buffer[L'\0']).dup();
+    std::istringstream stream(std::string(data, data_len));
+    delete[] data;
 
-    delete[] buffer;
+    std::string line;
+    if (!std::getline(stream, line)
+        || line != std::string(pal_fs_verify_cache_header) + " " + std::to_string(algorithm_in))
+    {
+        LOGW << "Ignoring verification cache with unexpected header: " << cache_filename_in;
+        return cache;
+    }
 
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    const auto value = ::getenv(environment_variable_in);
-    if (value == nullptr)
+    while (std::getline(stream, line))
     {
-        return FALSE;
+        std::istringstream line_stream(line);
+
+        pal_fs_verify_cache_entry entry;
+        if (!(line_stream >> entry.inode >> entry.size >> entry.mtime_ns >> entry.digest_hex)
+            || line_stream.get() != ' ')
+        {
+            continue;
+        }
+
+        std::string path;
+        std::getline(line_stream, path);
+        if (!path.empty())
+        {
+            cache[path] = entry;
+        }
     }
-    *environment_variable_value_out = strdup(value);
-    return TRUE;
-#else
-    return FALSE;
-#endif
+
+    return cache;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_env_get_bool(const char * environment_variable_in)
+// Checks every entry of a manifest against directory_in, hashing files in parallel on all available cpus.
+// When cache_filename_in is given, files whose inode, size and mtime match a previous successful run are
+// not hashed again and the cache is rewritten with the verdicts of this run. Returns TRUE when every
+// entry has status PAL_FS_VERIFY_OK.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_verify_directory(const char* directory_in, const uint32_t algorithm_in, pal_fs_verify_entry_t* entries_in,
+    const size_t entries_len_in, const char* cache_filename_in)
 {
-    char* environment_variable_value_out = nullptr;
-    if (!pal_env_get(environment_variable_in, &environment_variable_value_out))
+    const char* implementation = nullptr;
+    if (directory_in == nullptr
+        || (entries_in == nullptr && entries_len_in > 0)
+        || !pal_hash_get_implementation(algorithm_in, &implementation))
     {
         return FALSE;
     }
 
-    auto true_or_false = FALSE;
-    if (pal_str_iequals(environment_variable_value_out, "1")
-        || pal_str_iequals(environment_variable_value_out, "true"))
+    std::vector<const char*> names(entries_len_in);
+    for (auto i = 0u; i < entries_len_in; i++)
     {
-        true_or_false = TRUE;
-    }
+        auto& entry = entries_in[i];
+        entry.status = PAL_FS_VERIFY_OK;
+        entry.cached = FALSE;
 
-    delete environment_variable_value_out;
+        if (entry.path == nullptr
+            || !pal_fs_verify_is_safe_path(entry.path))
+        {
+            entry.status = PAL_FS_VERIFY_ERROR;
+        }
 
-    return true_or_false;
-}
+        names[i] = entry.status == PAL_FS_VERIFY_OK ? entry.path : "";
+    }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_env_expand_str(const char * environment_in, char ** environment_out)
-{
-    if (environment_in == nullptr)
+    std::vector<pal_fs_stat_t> stats(entries_len_in);
+    std::vector<int> errors(entries_len_in);
+    if (entries_len_in > 0)
     {
-        return FALSE;
+        pal_fs_stat_batch(directory_in, names.data(), entries_len_in, TRUE, stats.data(), errors.data());
     }
 
-    std::string environment_in_str(environment_in);
+    const auto cache = pal_fs_verify_cache_read(cache_filename_in, algorithm_in);
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    static std::regex expression(R"(%([0-9A-Za-z\\/\(\)]*)%)", std::regex_constants::icase);
-#else
-    static std::regex expression(R"(\$\{([^}]+)\})", std::regex_constants::icase);
-#endif
+    std::vector<size_t> pending;
+    for (auto i = 0u; i < entries_len_in; i++)
+    {
+        auto& entry = entries_in[i];
+        if (entry.status != PAL_FS_VERIFY_OK)
+        {
+            continue;
+        }
 
-    auto replacements = 0;
-    std::smatch match;
-    while (std::regex_search(environment_in_str, match, expression)) {
-        const auto match_str = match[1].str();
-        char* environment_variable_value = nullptr;
-        if (!pal_env_get(match_str.c_str(), &environment_variable_value))
+        if (errors[i] != 0)
         {
+            entry.status = PAL_FS_VERIFY_MISSING;
             continue;
         }
 
-        const std::string environment_variable_value_s(environment_variable_value);
-        delete environment_variable_value;
+        if (stats[i].type != PAL_FS_TYPE_FILE)
+        {
+            entry.status = PAL_FS_VERIFY_ERROR;
+            continue;
+        }
 
-        environment_in_str.replace(match[0].first, match[0].second, environment_variable_value_s);
+        if (stats[i].size != entry.size)
+        {
+            entry.status = PAL_FS_VERIFY_SIZE_MISMATCH;
+            continue;
+        }
 
-        replacements++;
+        const auto cached = cache.find(entry.path);
+        if (cached != cache.end()
+            && cached->second.inode == stats[i].inode
+            && cached->second.size == stats[i].size
+            && cached->second.mtime_ns == stats[i].mtime_ns
+            && cached->second.digest_hex == pal_fs_verify_digest_to_hex(entry.digest))
+        {
+            entry.cached = TRUE;
+            continue;
+        }
+
+        pending.push_back(i);
     }
 
-    if (replacements <= 0)
+    pal_parallel_for(pending.size(), 4, [&](const size_t index)
     {
-        return FALSE;
+        auto& entry = entries_in[pending[index]];
+
+        char* path = nullptr;
+        uint8_t digest[PAL_HASH_DIGEST_SIZE];
+        if (!pal_path_combine(directory_in, entry.path, &path)
+            || !pal_hash_file(path, algorithm_in, TRUE, digest))
+        {
+            entry.status = PAL_FS_VERIFY_ERROR;
+        }
+        else if (0 != std::memcmp(digest, entry.digest, PAL_HASH_DIGEST_SIZE))
+        {
+            entry.status = PAL_FS_VERIFY_HASH_MISMATCH;
+        }
+
+        free(path);
+    });
+
+    auto success = TRUE;
+    for (auto i = 0u; i < entries_len_in; i++)
+    {
+        if (entries_in[i].status != PAL_FS_VERIFY_OK)
+        {
+            LOGE << "Verification failed for: " << (entries_in[i].path == nullptr ? "(null)" : entries_in[i].path)
+                 << ". Status: " << entries_in[i].status << ". Directory: " << directory_in;
+            success = FALSE;
+        }
     }
 
-    *environment_out = _strdup(environment_in_str.c_str());
+    if (cache_filename_in == nullptr
+        || (pending.empty() && cache.size() == entries_len_in))
+    {
+        return success;
+    }
 
-    return TRUE;
-}
+    const auto now_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
 
-// - Filesystem
+    std::ostringstream cache_stream;
+    cache_stream << pal_fs_verify_cache_header << " " << algorithm_in << "\n";
+    for (auto i = 0u; i < entries_len_in; i++)
+    {
+        const auto& entry = entries_in[i];
+        if (entry.status != PAL_FS_VERIFY_OK
+            || stats[i].mtime_ns + pal_fs_verify_racy_window_ns > now_ns)
+        {
+            continue;
+        }
 
-BOOL pal_fs_chmod(const char *path_in, const pal_mode_t mode) {
-    if (path_in == nullptr) {
-        return FALSE;
+        cache_stream << stats[i].inode << " " << stats[i].size << " " << stats[i].mtime_ns << " "
+                     << pal_fs_verify_digest_to_hex(entry.digest) << " " << entry.path << "\n";
     }
 
-    BOOL is_success;
+    const auto cache_str = cache_stream.str();
+    if (!pal_fs_write_atomic(cache_filename_in, cache_str.c_str(), cache_str.size()))
+    {
+        LOGW << "Failed to write verification cache: " << cache_filename_in;
+    }
+
+    return success;
+}
+
+// - Patching
+
+// Patches use the bsdiff control scheme without compression. Layout, all integers little endian:
+//
+//   "SNAPXDF1" | old size (u64) | new size (u64) | records...
+//   record: add length (u64) | copy length (u64) | seek (i64) | add bytes | copy bytes
+//
+// Each record adds its add bytes to the old file at the current old offset, appends its copy bytes
+// verbatim and then moves the old offset by add length + seek. Like bspatch, bytes outside of the old
+// file read as zero.
+static const char pal_fs_patch_magic[8] = { 'S', 'N', 'A', 'P', 'X', 'D', 'F', '1' };
+static const size_t pal_fs_patch_header_len = 24;
+static const size_t pal_fs_patch_record_len = 24;
+static const size_t pal_fs_output_file_buffer_len = 1024 * 1024;
+// Bounds seeks and the old offset so that corrupt patches cannot overflow offset arithmetic.
+static const int64_t pal_fs_patch_offset_limit = INT64_C(1) << 61;
+
+// Reported for malformed patches, archives and packs.
 #if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string path_in_utf16_string(path_in);
-    is_success = 0 == _wchmod(path_in_utf16_string.data(), mode) ? TRUE : FALSE;
-#elif defined(PAL_PLATFORM_LINUX)
-    is_success = 0 == chmod(path_in, mode) ? TRUE : FALSE;
+static const int pal_fs_invalid_data = ERROR_INVALID_DATA;
+#else
+static const int pal_fs_invalid_data = EINVAL;
 #endif
-    return is_success;
-}
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_path_get_directory_name_from_file_path(const char * path_in, char ** path_out)
+static uint64_t pal_fs_patch_load64(const uint8_t* data)
 {
-    if (path_in == nullptr)
+    uint64_t value = 0;
+    for (auto i = 7; i >= 0; i--)
     {
-        return FALSE;
+        value = value << 8 | data[i];
     }
+    return value;
+}
+
+// Buffers small writes and hands large ones straight to the kernel, so that output is written in
+// large sequential chunks. Used by patching and archive extraction.
+class pal_fs_output_file
+{
+#if defined(PAL_PLATFORM_WINDOWS)
+    HANDLE m_file;
+#elif defined(PAL_PLATFORM_LINUX)
+    int m_fd;
+#endif
+    std::vector<uint8_t> m_buffer;
+    size_t m_buffer_len;
 
+public:
+    pal_fs_output_file() :
 #if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string path_in_utf16_string(path_in);
+        m_file(INVALID_HANDLE_VALUE),
+#elif defined(PAL_PLATFORM_LINUX)
+        m_fd(-1),
+#endif
+        m_buffer(pal_fs_output_file_buffer_len),
+        m_buffer_len(0)
+    {
+    }
 
-    wchar_t path_in_without_filespec[PAL_MAX_PATH];
-    wcscpy_s(path_in_without_filespec, PAL_MAX_PATH, path_in_utf16_string.data());
+    pal_fs_output_file(const pal_fs_output_file&) = delete;
+    pal_fs_output_file& operator=(const pal_fs_output_file&) = delete;
 
-    if (pal_is_windows_8_or_greater())
+    ~pal_fs_output_file()
     {
-        pal_module pathcch_module("api-ms-win-core-path-l1-1-0.dll");
-        if (!pathcch_module.is_loaded())
+#if defined(PAL_PLATFORM_WINDOWS)
+        if (m_file != INVALID_HANDLE_VALUE)
         {
-            return FALSE;
+            CloseHandle(m_file);
         }
+#elif defined(PAL_PLATFORM_LINUX)
+        if (m_fd != -1)
+        {
+            close(m_fd);
+        }
+#endif
+    }
 
-        using PathCchRemoveFileSpecFn = HRESULT(WINAPI*)(PWSTR  pszPath, size_t cchPath);
+    // Creates filename_in, which must not exist, and reserves size_in bytes so that the file is laid out
+    // contiguously. Permission bits in mode_in are applied as is (ignoring the umask) unless mode_in is 0.
+    int create(const std::string& filename_in, const uint64_t size_in, const pal_mode_t mode_in)
+    {
+#if defined(PAL_PLATFORM_WINDOWS)
+        PAL_UNUSED(mode_in);
 
-        const auto path_cch_remove_file_spec_fn = pathcch_module.bind<PathCchRemoveFileSpecFn>("PathCchRemoveFileSpec");
-        if (path_cch_remove_file_spec_fn == nullptr)
+        pal_utf16_string filename_utf16_string(filename_in);
+        m_file = CreateFile(filename_utf16_string.data(), GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
         {
-            return FALSE;
+            return static_cast<int>(GetLastError());
         }
 
-        const auto hr = path_cch_remove_file_spec_fn(path_in_without_filespec, PAL_MAX_PATH);
-        if (!SUCCEEDED(hr))
+        FILE_ALLOCATION_INFO allocation_info = {};
+        allocation_info.AllocationSize.QuadPart = static_cast<LONGLONG>(size_in);
+        SetFileInformationByHandle(m_file, FileAllocationInfo, &allocation_info, sizeof allocation_info);
+        return 0;
+#elif defined(PAL_PLATFORM_LINUX)
+        m_fd = open(filename_in.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+        if (m_fd == -1)
         {
-            return FALSE;
+            return errno;
         }
 
-        *path_out = pal_utf8_string(path_in_without_filespec).dup();
+        if (mode_in != 0)
+        {
+            fchmod(m_fd, mode_in);
+        }
 
-        return TRUE;
+        // Unlike posix_fallocate, fallocate never falls back to writing zeroes on filesystems without
+        // support for it, which would double the amount of data written.
+        if (size_in > 0
+            && -1 == fallocate(m_fd, 0, 0, static_cast<off_t>(size_in))
+            && errno != EOPNOTSUPP
+            && errno != ENOSYS
+            && errno != EINVAL)
+        {
+            return errno;
+        }
+        return 0;
+#else
+        PAL_UNUSED(filename_in);
+        PAL_UNUSED(size_in);
+        PAL_UNUSED(mode_in);
+        return -1;
+#endif
     }
 
-    PathRemoveFileSpec(path_in_without_filespec);
-    *path_out = pal_utf8_string(path_in_without_filespec).dup();
-
-    return TRUE;
+    // True once create opened a new file, even when reserving its size failed afterwards.
+    bool created() const
+    {
+#if defined(PAL_PLATFORM_WINDOWS)
+        return m_file != INVALID_HANDLE_VALUE;
 #elif defined(PAL_PLATFORM_LINUX)
-    auto path_in_cpy = strdup(path_in);
-    auto dir = dirname(path_in_cpy);
-    if (dir != nullptr)
+        return m_fd != -1;
+#else
+        return false;
+#endif
+    }
+
+    // Returns a writable region of at most len_in bytes, flushing the buffer when it is full.
+    uint8_t* reserve(const size_t len_in, size_t* reserved_len_out, int* error_out)
     {
-        //  Both dirname() and basename() return pointers to null-terminated
-        // strings.  (Do not pass these pointers to free(3).)
-        *path_out = strdup(dir);
-        return TRUE;
+        if (m_buffer_len == m_buffer.size())
+        {
+            *error_out = flush();
+            if (*error_out != 0)
+            {
+                return nullptr;
+            }
+        }
+
+        *reserved_len_out = std::min(len_in, m_buffer.size() - m_buffer_len);
+        auto* const region = m_buffer.data() + m_buffer_len;
+        m_buffer_len += *reserved_len_out;
+        return region;
     }
-    delete path_in_cpy;
-    return FALSE;
+
+    int write(const uint8_t* data_in, size_t data_len_in)
+    {
+        if (data_len_in >= m_buffer.size())
+        {
+            const auto error = flush();
+            return error != 0 ? error : write_direct(data_in, data_len_in);
+        }
+
+        while (data_len_in > 0)
+        {
+            size_t region_len = 0;
+            auto error = 0;
+            auto* const region = reserve(data_len_in, &region_len, &error);
+            if (region == nullptr)
+            {
+                return error;
+            }
+
+            std::memcpy(region, data_in, region_len);
+            data_in += region_len;
+            data_len_in -= region_len;
+        }
+
+        return 0;
+    }
+
+    int flush()
+    {
+        if (m_buffer_len == 0)
+        {
+            return 0;
+        }
+
+        const auto error = write_direct(m_buffer.data(), m_buffer_len);
+        if (error == 0)
+        {
+            m_buffer_len = 0;
+        }
+        return error;
+    }
+
+private:
+    int write_direct(const uint8_t* data_in, size_t data_len_in)
+    {
+#if defined(PAL_PLATFORM_WINDOWS)
+        while (data_len_in > 0)
+        {
+            const auto chunk_len = static_cast<DWORD>(std::min<size_t>(data_len_in, 1u << 30));
+            DWORD bytes_written = 0;
+            if (0 == WriteFile(m_file, data_in, chunk_len, &bytes_written, nullptr)
+                || bytes_written != chunk_len)
+            {
+                return static_cast<int>(GetLastError());
+            }
+            data_in += chunk_len;
+            data_len_in -= chunk_len;
+        }
+#elif defined(PAL_PLATFORM_LINUX)
+        if (!pal_fs_write_all(m_fd, reinterpret_cast<const char*>(data_in), data_len_in))
+        {
+            return errno;
+        }
 #else
-    return FALSE;
+        PAL_UNUSED(data_in);
+        PAL_UNUSED(data_len_in);
 #endif
-}
+        return 0;
+    }
+};
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_path_get_directory_name(const char * path_in, char ** path_out)
+static int pal_fs_patch_apply_impl(const char* old_filename_in, const char* patch_filename_in, const std::string& new_filename_in)
 {
-    if (path_in == nullptr)
+    pal_mapped_file old_file;
+    pal_mapped_file patch_file;
+
+    auto error = old_file.try_open(old_filename_in, false);
+    if (error != 0)
     {
-        return FALSE;
+        return error;
     }
 
-    const std::string path_in_s(path_in);
-
-    const auto directory_name_start_pos = path_in_s.find_last_of(PAL_DIRECTORY_SEPARATOR_C);
-    if (directory_name_start_pos == std::string::npos)
+    error = patch_file.try_open(patch_filename_in, true);
+    if (error != 0)
     {
-        return FALSE;
+        return error;
     }
 
-    const auto directory_name = path_in_s.substr(directory_name_start_pos + 1);
+    const auto* patch = patch_file.data();
+    auto patch_len = patch_file.size();
 
-    *path_out = _strdup(directory_name.c_str());
+    if (patch_len < pal_fs_patch_header_len
+        || 0 != std::memcmp(patch, pal_fs_patch_magic, sizeof pal_fs_patch_magic)
+        || pal_fs_patch_load64(patch + 8) != old_file.size())
+    {
+        return pal_fs_invalid_data;
+    }
 
-    return TRUE;
-}
+    const auto new_size = pal_fs_patch_load64(patch + 16);
+    patch += pal_fs_patch_header_len;
+    patch_len -= pal_fs_patch_header_len;
 
+    // Executables must stay executable after an upgrade.
+    pal_mode_t mode = 0;
 #if defined(PAL_PLATFORM_LINUX)
+    struct stat old_stat = {};
+    if (0 == stat(old_filename_in, &old_stat))
+    {
+        mode = old_stat.st_mode & 07777;
+    }
+#endif
 
-// https://github.com/qpalzmqaz123/path_combine/blob/master/path_combine.c
-
-inline int unix_path_combine_cleanup(char *path)
-{
-    char *str;
-    char *parent_dir;
-    char *current_dir;
-    char *tail;
-
-    if (0 == strlen(path)) {
-        return 0;
+    pal_fs_output_file output;
+    error = output.create(new_filename_in, new_size, mode);
+    if (error != 0)
+    {
+        return error;
     }
 
-    /* resolve parent dir */
-    while (TRUE) {
-        str = strstr(path, "/../");
-        if (nullptr == str) {
-            break;
+    const auto* const old_data = old_file.data();
+    const auto old_size = static_cast<int64_t>(old_file.size());
+    int64_t old_pos = 0;
+    uint64_t new_pos = 0;
+
+    while (new_pos < new_size)
+    {
+        if (patch_len < pal_fs_patch_record_len)
+        {
+            return pal_fs_invalid_data;
         }
 
-        *str = 0;
-        if (nullptr == strchr(path, '/')) {
-            return 1;
+        const auto add_len = pal_fs_patch_load64(patch);
+        const auto copy_len = pal_fs_patch_load64(patch + 8);
+        const auto seek = static_cast<int64_t>(pal_fs_patch_load64(patch + 16));
+        patch += pal_fs_patch_record_len;
+        patch_len -= pal_fs_patch_record_len;
+
+        if (add_len > new_size - new_pos
+            || copy_len > new_size - new_pos - add_len
+            || add_len + copy_len > patch_len
+            || seek > pal_fs_patch_offset_limit
+            || seek < -pal_fs_patch_offset_limit)
+        {
+            return pal_fs_invalid_data;
         }
-        parent_dir = strrchr(path, '/') + 1;
 
-        current_dir = str + 4;
+        for (uint64_t done = 0; done < add_len;)
+        {
+            size_t region_len = 0;
+            auto* const region = output.reserve(static_cast<size_t>(std::min<uint64_t>(add_len - done, SIZE_MAX)), &region_len, &error);
+            if (region == nullptr)
+            {
+                return error;
+            }
 
-        /* replace parent dir */
-        memcpy(parent_dir, current_dir, strlen(current_dir) + 1);
-    }
+            // Only the part that overlaps the old file needs the addition, the rest is copied as is.
+            const auto pos = old_pos + static_cast<int64_t>(done);
+            const auto overlap_begin = static_cast<size_t>(std::min<int64_t>(std::max<int64_t>(-pos, 0), static_cast<int64_t>(region_len)));
+            const auto overlap_end = static_cast<size_t>(std::max<int64_t>(std::min<int64_t>(old_size - pos, static_cast<int64_t>(region_len)), static_cast<int64_t>(overlap_begin)));
 
-    /* resolve current dir */
-    while (TRUE) {
-        str = strstr(path, "/./");
-        if (nullptr == str) {
-            break;
+            std::memcpy(region, patch + done, region_len);
+            for (auto i = overlap_begin; i < overlap_end; i++)
+            {
+                region[i] = static_cast<uint8_t>(region[i] + old_data[pos + static_cast<int64_t>(i)]);
+            }
+
+            done += region_len;
         }
 
-        memcpy(str + 1, str + 3, strlen(str + 3) + 1);
-    }
+        patch += add_len;
+        patch_len -= add_len;
 
-    /* remove tail '/' or '/.' */
-    tail = path + strlen(path) - 1;
-    if ('/' == *tail) {
-        *tail = 0;
-    }
-    else if (0 == strcmp(tail - 1, "/.")) {
-        *(tail - 1) = 0;
-    }
-    else if (0 == strcmp(tail - 2, "/..")) {
-        strcat(path, "/");
-        unix_path_combine_cleanup(path);
+        for (uint64_t done = 0; done < copy_len;)
+        {
+            size_t region_len = 0;
+            auto* const region = output.reserve(static_cast<size_t>(std::min<uint64_t>(copy_len - done, SIZE_MAX)), &region_len, &error);
+            if (region == nullptr)
+            {
+                return error;
+            }
+
+            std::memcpy(region, patch + done, region_len);
+            done += region_len;
+        }
+
+        patch += copy_len;
+        patch_len -= copy_len;
+
+        new_pos += add_len + copy_len;
+        old_pos += static_cast<int64_t>(add_len) + seek;
+
+        if (old_pos > pal_fs_patch_offset_limit
+            || old_pos < -pal_fs_patch_offset_limit)
+        {
+            return pal_fs_invalid_data;
+        }
     }
 
-    return 0;
+    return output.flush();
 }
 
-inline char* unix_path_combine(const char *path1, const char *path2, char *buffer)
+static int pal_fs_patch_apply_op(const char* old_filename_in, const char* patch_filename_in, const char* new_filename_in)
 {
-    if (pal_str_is_null_or_whitespace(path1)
-        || pal_str_is_null_or_whitespace(path2)) {
-        return nullptr;
-    }
-    else if (nullptr == path1) {
-        strcpy(buffer, path2);
-        goto EXIT;
-    }
-    else if (nullptr == path2) {
-        strcpy(buffer, path1);
-        goto EXIT;
+    if (old_filename_in == nullptr
+        || patch_filename_in == nullptr
+        || new_filename_in == nullptr)
+    {
+        return pal_fs_invalid_data;
     }
 
-    if ('/' == path2[0]) {
-        strcpy(buffer, path2);
-        goto EXIT;
-    }
+    // The new file only appears once it is complete, a failed upgrade never leaves a truncated file behind.
+    const auto tmp_filename = pal_fs_build_tmp_filename(new_filename_in);
 
-    strcpy(buffer, path1);
+    const auto error = pal_fs_patch_apply_impl(old_filename_in, patch_filename_in, tmp_filename);
+    if (error != 0)
+    {
+        LOGE << "Failed to apply patch: " << patch_filename_in << ". Old file: " << old_filename_in << ". Error: " << error;
+        pal_fs_rmfile(tmp_filename.c_str());
+        return error;
+    }
 
-    if ('/' != path1[strlen(path1) - 1]) {
-        strcat(buffer, "/");
+    if (!pal_fs_replace_file(tmp_filename, new_filename_in))
+    {
+        pal_fs_rmfile(tmp_filename.c_str());
+        return pal_fs_invalid_data;
     }
 
-    strcat(buffer, path2);
+    return 0;
+}
 
-EXIT:
-    return 0 == unix_path_combine_cleanup(buffer) ? buffer : nullptr;
+// Reconstructs new_filename_in from old_filename_in and a patch, see pal_fs_patch_magic for the format.
+// Both inputs are mapped read-only and the result is streamed into a temporary file that replaces
+// new_filename_in once it is complete.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_patch_apply(const char* old_filename_in, const char* patch_filename_in, const char* new_filename_in)
+{
+    return pal_fs_patch_apply_op(old_filename_in, patch_filename_in, new_filename_in) == 0 ? TRUE : FALSE;
 }
-#endif
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_file_exists(const char * file_path_in)
+// Applies independent patches in parallel. Returns TRUE when every patch succeeded, otherwise the
+// error of each operation is available in ops_in[i].error.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_patch_apply_batch(pal_fs_patch_op_t* ops_in, const size_t ops_len_in)
 {
-    if (file_path_in == nullptr)
+    if (ops_in == nullptr && ops_len_in > 0)
     {
         return FALSE;
     }
 
-    BOOL file_exists;
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string file_path_in_utf16_string(file_path_in);
-    const auto file_attributes = GetFileAttributes(file_path_in_utf16_string.data());
-    if (file_attributes == INVALID_FILE_ATTRIBUTES
-        || file_attributes & FILE_ATTRIBUTE_DIRECTORY)
+    pal_parallel_for(ops_len_in, 1, [&](const size_t index)
     {
-        file_exists = FALSE;
-    }
-    else
+        auto& op = ops_in[index];
+        op.error = pal_fs_patch_apply_op(op.old_filename, op.patch_filename, op.new_filename);
+    });
+
+    for (auto i = 0u; i < ops_len_in; i++)
     {
-        file_exists = PathFileExists(file_path_in_utf16_string.data()) == TRUE ? TRUE : FALSE;
+        if (ops_in[i].error != 0)
+        {
+            return FALSE;
+        }
     }
 
-    return file_exists;
-#elif defined(PAL_PLATFORM_LINUX)
-    struct stat st = { 0 };
-    file_exists = stat(file_path_in, &st) == 0 && (st.st_mode & S_IFDIR) == 0;
-    return file_exists;
-#else
-    return FALSE;
+    return TRUE;
+}
+
+// - Archives
+
+// Joins a '/' separated archive path to the directory it is extracted to.
+static std::string pal_fs_archive_filename(const char* directory_in, const std::string& path)
+{
+    auto filename = std::string(directory_in) + PAL_DIRECTORY_SEPARATOR_STR + path;
+#if defined(PAL_PLATFORM_WINDOWS)
+    std::replace(filename.begin(), filename.end(), '/', PAL_DIRECTORY_SEPARATOR_C);
 #endif
+    return filename;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_impl(const char * path_in, const pal_fs_list_filter_callback_t filter_callback_in,
-    const char* filter_extension_in, char *** paths_out, size_t * paths_out_len, const int type)
+// Adds the directories an archive path needs, a directory path includes itself.
+static void pal_fs_archive_add_directories(const std::string& path, const bool is_directory, std::set<std::string>& directories)
 {
-    if (path_in == nullptr)
+    auto separator_pos = is_directory ? path.size() : path.rfind('/');
+    while (separator_pos != std::string::npos && separator_pos > 0)
+    {
+        if (!directories.insert(path.substr(0, separator_pos)).second)
+        {
+            break;
+        }
+        separator_pos = path.rfind('/', separator_pos - 1);
+    }
+}
+
+// Creates directory_in and every directory below it before workers start writing files, so that
+// workers never race on directory creation. Parents sort before their children.
+static bool pal_fs_archive_create_directories(const char* directory_in, const std::set<std::string>& directories)
+{
+    if (!pal_fs_directory_exists(directory_in)
+        && !pal_fs_mkdirp(directory_in, 0777))
     {
+        LOGE << "Failed to create directory: " << directory_in;
         return false;
     }
 
-    std::vector<char*> paths;
+    for (const auto& directory : directories)
+    {
+        const auto directory_filename = pal_fs_archive_filename(directory_in, directory);
+        if (!pal_fs_directory_exists(directory_filename.c_str())
+            && !pal_fs_mkdir(directory_filename.c_str(), 0777))
+        {
+            LOGE << "Failed to create directory: " << directory_filename;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Zip archives (nupkg). Sizes and offsets are only taken from the central directory, local headers
+// are consulted for the length of their variable fields and nothing else.
+static const uint32_t pal_fs_zip_eocd_signature = 0x06054b50;
+static const uint32_t pal_fs_zip64_locator_signature = 0x07064b50;
+static const uint32_t pal_fs_zip64_eocd_signature = 0x06064b50;
+static const uint32_t pal_fs_zip_central_signature = 0x02014b50;
+static const uint32_t pal_fs_zip_local_signature = 0x04034b50;
+static const size_t pal_fs_zip_eocd_len = 22;
+static const size_t pal_fs_zip64_locator_len = 20;
+static const size_t pal_fs_zip64_eocd_len = 56;
+static const size_t pal_fs_zip_central_len = 46;
+static const size_t pal_fs_zip_local_len = 30;
+static const size_t pal_fs_zip_max_comment_len = 0xffff;
+static const uint16_t pal_fs_zip_method_stored = 0;
+static const uint16_t pal_fs_zip_method_deflate = 8;
+static const uint16_t pal_fs_zip_host_unix = 3;
+// Stored entries are checksummed and written in chunks of this size so that the data is still in cache when written.
+static const size_t pal_fs_zip_stored_chunk_len = 256 * 1024;
 
 #if defined(PAL_PLATFORM_WINDOWS)
+static const int pal_fs_zip_unsupported = ERROR_NOT_SUPPORTED;
+#else
+static const int pal_fs_zip_unsupported = ENOTSUP;
+#endif
 
-    const pal_utf16_string extension_filter_in_utf16_string(
-        filter_extension_in != nullptr ? filter_extension_in : "*.*");
+struct pal_fs_zip_entry
+{
+    std::string path{}; // '/' separated and relative to the target directory.
+    uint64_t compressed_size = 0;
+    uint64_t uncompressed_size = 0;
+    uint64_t local_header_offset = 0;
+    uint32_t crc32 = 0;
+    uint16_t method = 0;
+    pal_mode_t mode = 0; // 0 unless the archive was created on unix.
+};
+
+static uint16_t pal_fs_zip_load16(const uint8_t* data)
+{
+    return static_cast<uint16_t>(data[0] | data[1] << 8);
+}
 
-    pal_utf16_string path_root_utf16_string(path_in);
-    path_root_utf16_string.append_if_not_ends_width(PAL_DIRECTORY_SEPARATOR_WIDE_STR);
-    path_root_utf16_string.append(extension_filter_in_utf16_string.c_str());
+static uint32_t pal_fs_zip_load32(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+        | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+}
 
-    WIN32_FIND_DATA file;
-    auto* const h_file = FindFirstFile(path_root_utf16_string.data(), &file);
-    if (h_file == INVALID_HANDLE_VALUE)
+// Replaces 32 bit fields that are saturated (0xffffffff) with their value from the zip64 extra field.
+static bool pal_fs_zip_read_zip64_extra(const uint8_t* extra, size_t extra_len, pal_fs_zip_entry& entry)
+{
+    while (extra_len >= 4)
     {
-        return FALSE;
-    }
+        const auto id = pal_fs_zip_load16(extra);
+        const auto len = pal_fs_zip_load16(extra + 2);
+        extra += 4;
+        extra_len -= 4;
+        if (len > extra_len)
+        {
+            return false;
+        }
 
-    do
-    {
-        switch (type)
+        if (id == 0x0001)
         {
-        case 0:
-            if (!(file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-            {
-                continue;
-            }
-            break;
-        case 1:
-            if (file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            auto* const fields = extra;
+            size_t offset = 0;
+            for (auto* value : { &entry.uncompressed_size, &entry.compressed_size, &entry.local_header_offset })
             {
-                continue;
+                if (*value != 0xffffffff)
+                {
+                    continue;
+                }
+                if (offset + 8 > len)
+                {
+                    return false;
+                }
+                *value = pal_fs_patch_load64(fields + offset);
+                offset += 8;
             }
-            break;
-        default:
-            continue;
+            return true;
         }
 
-        const auto relative_path = pal_utf8_string(file.cFileName).str();
-        if (relative_path == "."
-            || relative_path == "..")
-        {
-            continue;
-        }
+        extra += len;
+        extra_len -= len;
+    }
 
-        char* absolute_path = nullptr;
-        if (!pal_path_combine(path_in, relative_path.data(), &absolute_path))
-        {
-            delete[] absolute_path;
-            continue;
-        }
+    return true;
+}
 
-        const auto filter_callback_fn = filter_callback_in;
-        if (filter_callback_fn != nullptr
-            && !filter_callback_fn(absolute_path))
+static int pal_fs_zip_read_central_directory(const uint8_t* data, const size_t size, std::vector<pal_fs_zip_entry>& entries_out)
+{
+    if (size < pal_fs_zip_eocd_len)
+    {
+        return pal_fs_invalid_data;
+    }
+
+    // The end of central directory record is the last record in the file, followed by a comment of at most 64 KiB.
+    const auto lowest_eocd_pos = size - pal_fs_zip_eocd_len - std::min(size - pal_fs_zip_eocd_len, pal_fs_zip_max_comment_len);
+    auto eocd_pos = size - pal_fs_zip_eocd_len;
+    while (pal_fs_zip_load32(data + eocd_pos) != pal_fs_zip_eocd_signature
+        || eocd_pos + pal_fs_zip_eocd_len + pal_fs_zip_load16(data + eocd_pos + 20) > size)
+    {
+        if (eocd_pos == lowest_eocd_pos)
         {
-            delete[] absolute_path;
-            continue;
+            return pal_fs_invalid_data;
         }
+        eocd_pos--;
+    }
 
-        paths.emplace_back(absolute_path);
-
-    } while (FindNextFile(h_file, &file));
-
-    FindClose(h_file);
+    const auto* const eocd = data + eocd_pos;
+    if (pal_fs_zip_load16(eocd + 4) != 0
+        || pal_fs_zip_load16(eocd + 6) != 0)
+    {
+        // Split archives.
+        return pal_fs_zip_unsupported;
+    }
 
-#elif defined(PAL_PLATFORM_LINUX)
-    std::string filter_extension_s(filter_extension_in == nullptr ? std::string() : filter_extension_in);
+    uint64_t entries_len = pal_fs_zip_load16(eocd + 10);
+    uint64_t central_directory_len = pal_fs_zip_load32(eocd + 12);
+    uint64_t central_directory_offset = pal_fs_zip_load32(eocd + 16);
 
-    DIR* dir = opendir(path_in);
-    if (dir != nullptr)
+    if (entries_len == 0xffff
+        || central_directory_len == 0xffffffff
+        || central_directory_offset == 0xffffffff)
     {
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != nullptr)
+        if (eocd_pos < pal_fs_zip64_locator_len
+            || pal_fs_zip_load32(eocd - pal_fs_zip64_locator_len) != pal_fs_zip64_locator_signature)
         {
-            std::string absolute_path_s;
-            std::string entry_name(entry->d_name);
-
-            switch (type)
-            {
-            case 0:
-                if (entry->d_type != DT_DIR)
-                {
-                    continue;
-                }
+            return pal_fs_invalid_data;
+        }
 
-                if (entry_name == "." || entry_name == "..")
-                {
-                    continue;
-                }
+        // The zip64 record has to end in front of its locator, archives too short to hold both are truncated.
+        const auto locator_pos = eocd_pos - pal_fs_zip64_locator_len;
+        const auto zip64_eocd_pos = pal_fs_patch_load64(eocd - pal_fs_zip64_locator_len + 8);
+        if (locator_pos < pal_fs_zip64_eocd_len
+            || zip64_eocd_pos > locator_pos - pal_fs_zip64_eocd_len
+            || pal_fs_zip_load32(data + zip64_eocd_pos) != pal_fs_zip64_eocd_signature)
+        {
+            return pal_fs_invalid_data;
+        }
 
-                absolute_path_s.assign(path_in);
-                absolute_path_s.append("/");
-                absolute_path_s.append(entry_name);
+        const auto* const zip64_eocd = data + zip64_eocd_pos;
+        entries_len = pal_fs_patch_load64(zip64_eocd + 32);
+        central_directory_len = pal_fs_patch_load64(zip64_eocd + 40);
+        central_directory_offset = pal_fs_patch_load64(zip64_eocd + 48);
+    }
 
-                break;
-            case 1:
-                switch (entry->d_type)
-                {
-                default:
-                    continue;
-                    // Regular file
-                case DT_REG:
-                    if (filter_extension_in != nullptr
-                        && FALSE == pal_str_endswith(entry_name.c_str(), filter_extension_in))
-                    {
-                        continue;
-                    }
+    if (central_directory_offset > size
+        || central_directory_len > size - central_directory_offset
+        || entries_len > central_directory_len / pal_fs_zip_central_len)
+    {
+        return pal_fs_invalid_data;
+    }
 
-                    absolute_path_s.assign(path_in);
-                    absolute_path_s.append("/");
-                    absolute_path_s.append(entry_name);
-                    break;
+    const auto* record = data + central_directory_offset;
+    auto remaining = static_cast<size_t>(central_directory_len);
 
-                    // Handle symlinks and file systems that do not support d_type
-                case DT_LNK:
-                case DT_UNKNOWN:
-                    if (filter_extension_in != nullptr
-                        && FALSE == pal_str_endswith(entry_name.c_str(), filter_extension_in))
-                    {
-                        continue;
-                    }
+    entries_out.reserve(static_cast<size_t>(entries_len));
 
-                    absolute_path_s.assign(path_in);
-                    absolute_path_s.append("/");
-                    absolute_path_s.append(entry_name);
+    for (uint64_t i = 0; i < entries_len; i++)
+    {
+        if (remaining < pal_fs_zip_central_len
+            || pal_fs_zip_load32(record) != pal_fs_zip_central_signature)
+        {
+            return pal_fs_invalid_data;
+        }
 
-                    struct stat file_stat = { 0 };
-                    if (stat(absolute_path_s.c_str(), &file_stat) == -1)
-                    {
-                        absolute_path_s.clear();
-                        continue;
-                    }
+        const auto version_made_by = pal_fs_zip_load16(record + 4);
+        const auto flags = pal_fs_zip_load16(record + 8);
+        const auto name_len = pal_fs_zip_load16(record + 28);
+        const auto extra_len = pal_fs_zip_load16(record + 30);
+        const auto comment_len = pal_fs_zip_load16(record + 32);
+        const auto external_attributes = pal_fs_zip_load32(record + 38);
+        const auto record_len = pal_fs_zip_central_len + name_len + extra_len + comment_len;
+        if (record_len > remaining)
+        {
+            return pal_fs_invalid_data;
+        }
 
-                    // Must be a regular file.
-                    if (!S_ISREG(file_stat.st_mode))
-                    {
-                        absolute_path_s.clear();
-                        continue;
-                    }
+        pal_fs_zip_entry entry;
+        entry.path.assign(reinterpret_cast<const char*>(record + pal_fs_zip_central_len), name_len);
+        entry.method = pal_fs_zip_load16(record + 10);
+        entry.crc32 = pal_fs_zip_load32(record + 16);
+        entry.compressed_size = pal_fs_zip_load32(record + 20);
+        entry.uncompressed_size = pal_fs_zip_load32(record + 24);
+        entry.local_header_offset = pal_fs_zip_load32(record + 42);
+        entry.mode = 0;
 
-                    break;
-                }
-                break;
-            default:
-                // void
-                break;
-            }
+        if (!pal_fs_zip_read_zip64_extra(record + pal_fs_zip_central_len + name_len, extra_len, entry))
+        {
+            return pal_fs_invalid_data;
+        }
 
-            if (absolute_path_s.empty())
-            {
-                continue;
-            }
+        // Encrypted entries and compression methods other than deflate.
+        if ((flags & 1) != 0
+            || (entry.method != pal_fs_zip_method_stored && entry.method != pal_fs_zip_method_deflate))
+        {
+            LOGE << "Unsupported zip entry: " << entry.path << ". Method: " << entry.method << ". Flags: " << flags;
+            return pal_fs_zip_unsupported;
+        }
 
-            const auto filter_callback_fn = filter_callback_in;
-            if (filter_callback_fn != nullptr
-                && !filter_callback_fn(absolute_path_s.c_str()))
-            {
-                continue;
-            }
+        if (entry.method == pal_fs_zip_method_stored
+            && entry.compressed_size != entry.uncompressed_size)
+        {
+            return pal_fs_invalid_data;
+        }
 
-            paths.emplace_back(strdup(absolute_path_s.data()));
+        // Permission bits only: symbolic links are extracted as regular files, as on Windows.
+        if (version_made_by >> 8 == pal_fs_zip_host_unix)
+        {
+            entry.mode = static_cast<pal_mode_t>((external_attributes >> 16) & 0777);
         }
 
-        closedir(dir);
-    }
-#endif
+        // Archives written on Windows may use backslashes, and a path may never escape the target directory.
+        std::replace(entry.path.begin(), entry.path.end(), '\\', '/');
+        const auto is_directory = !entry.path.empty() && entry.path.back() == '/';
+        while (!entry.path.empty() && entry.path.back() == '/')
+        {
+            entry.path.pop_back();
+        }
 
-    *paths_out_len = paths.size();
+        if (entry.path.find('\0') != std::string::npos
+            || !pal_fs_verify_is_safe_path(entry.path))
+        {
+            LOGE << "Zip entry escapes the target directory: " << entry.path;
+            return pal_fs_invalid_data;
+        }
 
-    auto* const paths_array = new char*[*paths_out_len];
+        if (is_directory)
+        {
+            entry.method = pal_fs_zip_method_stored;
+            entry.compressed_size = 0;
+            entry.uncompressed_size = 0;
+            entry.local_header_offset = UINT64_MAX;
+        }
 
-    for (auto i = 0u; i < *paths_out_len; i++)
-    {
-        paths_array[i] = paths[i];
-    }
+        entries_out.emplace_back(std::move(entry));
 
-    *paths_out = paths_array;
+        record += record_len;
+        remaining -= record_len;
+    }
 
-    return TRUE;
+    return 0;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_directories(const char * path_in, const pal_fs_list_filter_callback_t filter_callback_in,
-    const char* filter_extension_in, char *** directories_out, size_t* directories_out_len)
+struct pal_fs_zip_sink_state
 {
-    return pal_fs_list_impl(path_in, filter_callback_in, filter_extension_in, directories_out, directories_out_len, 0);
-}
+    pal_fs_output_file* output;
+    uint64_t bytes_left;
+    uint32_t crc32;
+    int error;
+};
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_list_files(const char * path_in, const pal_fs_list_filter_callback_t filter_callback_in,
-    const char* filter_extension_in, char *** files_out, size_t * files_out_len)
+static bool pal_fs_zip_sink(const uint8_t* data, const size_t data_len, void* user_data)
 {
-    return pal_fs_list_impl(path_in, filter_callback_in, filter_extension_in, files_out, files_out_len, 1);
+    auto* const state = static_cast<pal_fs_zip_sink_state*>(user_data);
+
+    // Never write more than the central directory announced, the file was preallocated for that size.
+    if (data_len > state->bytes_left)
+    {
+        state->error = pal_fs_invalid_data;
+        return false;
+    }
+
+    state->bytes_left -= data_len;
+    state->crc32 = pal_crc32(state->crc32, data, data_len);
+    state->error = state->output->write(data, data_len);
+    return state->error == 0;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_get_cwd(char ** working_directory_out)
+// created_out is set when filename was created by this call, so that only then it is removed on failure.
+static int pal_fs_zip_extract_entry(const pal_mapped_file& archive, const pal_fs_zip_entry& entry,
+    const std::string& filename, pal_inflate& inflate, bool& created_out)
 {
-#if defined(PAL_PLATFORM_WINDOWS)
-    wchar_t* buffer;
-    if ((buffer = _wgetcwd(nullptr, 0)) == nullptr)
+    created_out = false;
+
+    const auto* const data = archive.data();
+    const auto size = archive.size();
+
+    if (entry.local_header_offset > size
+        || size - entry.local_header_offset < pal_fs_zip_local_len
+        || pal_fs_zip_load32(data + entry.local_header_offset) != pal_fs_zip_local_signature)
     {
-        return FALSE;
+        return pal_fs_invalid_data;
     }
 
-    *working_directory_out = pal_utf8_string(buffer).dup();
-    delete buffer;
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    char cwd[PAL_MAX_PATH];
-    auto status = getcwd(cwd, sizeof(cwd));
-    if (status != nullptr)
+    const auto* const local_header = data + entry.local_header_offset;
+    const auto data_offset = entry.local_header_offset + pal_fs_zip_local_len
+        + pal_fs_zip_load16(local_header + 26) + pal_fs_zip_load16(local_header + 28);
+    if (data_offset > size
+        || entry.compressed_size > size - data_offset)
     {
-        *working_directory_out = strdup(cwd);
-        return TRUE;
+        return pal_fs_invalid_data;
     }
-    return FALSE;
-#else
-    return FALSE;
-#endif
+
+    pal_fs_output_file output;
+    auto error = output.create(filename, entry.uncompressed_size, entry.mode);
+    created_out = output.created();
+    if (error != 0)
+    {
+        return error;
+    }
+
+    pal_fs_zip_sink_state state = { &output, entry.uncompressed_size, 0, 0 };
+    const auto* const compressed = data + data_offset;
+    const auto compressed_len = static_cast<size_t>(entry.compressed_size);
+
+    if (entry.method == pal_fs_zip_method_stored)
+    {
+        for (size_t done = 0; done < compressed_len;)
+        {
+            const auto chunk_len = std::min(compressed_len - done, pal_fs_zip_stored_chunk_len);
+            if (!pal_fs_zip_sink(compressed + done, chunk_len, &state))
+            {
+                return state.error;
+            }
+            done += chunk_len;
+        }
+    }
+    else if (!inflate.run(compressed, compressed_len, pal_fs_zip_sink, &state))
+    {
+        return state.error != 0 ? state.error : pal_fs_invalid_data;
+    }
+
+    if (state.bytes_left != 0
+        || state.crc32 != entry.crc32)
+    {
+        return pal_fs_invalid_data;
+    }
+
+    return output.flush();
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_directory_exists(const char * path_in)
+// Extracts every entry of a zip archive below directory_in, which is created when it does not exist.
+// The central directory is read from a read-only mapping of the archive, directories are created
+// up front and files are extracted in parallel, largest first. Entries must not exist yet, and
+// entries whose path would escape directory_in fail the whole extraction. On failure files that
+// were already extracted are left in place.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_zip_extract(const char* archive_filename_in, const char* directory_in,
+        pal_fs_zip_extract_stats_t* stats_out)
 {
-    if (path_in == nullptr)
+    if (archive_filename_in == nullptr
+        || directory_in == nullptr)
     {
         return FALSE;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string path_in_utf16_string(path_in);
-    const auto attributes = GetFileAttributes(path_in_utf16_string.data());
-    if (attributes == INVALID_FILE_ATTRIBUTES)
+    pal_mapped_file archive;
+    auto error = archive.try_open(archive_filename_in, false);
+    if (error != 0)
     {
+        LOGE << "Failed to open archive: " << archive_filename_in << ". Error: " << error;
         return FALSE;
     }
-    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+
+    std::vector<pal_fs_zip_entry> entries;
+    error = pal_fs_zip_read_central_directory(archive.data(), archive.size(), entries);
+    if (error != 0)
     {
+        LOGE << "Failed to read zip central directory: " << archive_filename_in << ". Error: " << error;
         return FALSE;
     }
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    auto directory = opendir(path_in);
-    if (directory != nullptr)
+
+    std::set<std::string> directories;
+    std::vector<size_t> files;
+    for (auto i = 0u; i < entries.size(); i++)
     {
-        assert(0 == closedir(directory));
-        return TRUE;
+        const auto is_directory = entries[i].local_header_offset == UINT64_MAX;
+        if (!is_directory)
+        {
+            files.push_back(i);
+        }
+        pal_fs_archive_add_directories(entries[i].path, is_directory, directories);
     }
-    return FALSE;
-#else
-    RETURN FALSE;
-#endif
-}
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_get_file_size(const char* filename_in, size_t* file_size_out)
-{
-    if (filename_in == nullptr)
+    if (!pal_fs_archive_create_directories(directory_in, directories))
     {
         return FALSE;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string path_in_utf16_string(filename_in);
+    std::sort(files.begin(), files.end(), [&entries](const size_t lhs, const size_t rhs)
+    {
+        return entries[lhs].compressed_size > entries[rhs].compressed_size;
+    });
 
-    auto* const h_file = CreateFile(path_in_utf16_string.data(),
-                                    GENERIC_READ,
-                                    FILE_SHARE_READ,
-                                    nullptr,
-                                    OPEN_EXISTING,
-                                    FILE_ATTRIBUTE_NORMAL,
-                                    nullptr);
+    // Inflate windows are reused between entries, small files would otherwise pay for a fresh one each.
+    std::mutex inflaters_mutex;
+    std::vector<std::unique_ptr<pal_inflate>> inflaters;
+    std::atomic<int> first_error(0);
+    std::atomic<uint64_t> bytes_written(0);
 
-    if (h_file == INVALID_HANDLE_VALUE)
+    pal_parallel_for(files.size(), 4, [&](const size_t index)
     {
-        return FALSE;
-    }
+        if (first_error.load(std::memory_order_relaxed) != 0)
+        {
+            return;
+        }
 
-    *file_size_out = GetFileSize(h_file, nullptr);
+        std::unique_ptr<pal_inflate> inflate;
+        {
+            std::lock_guard<std::mutex> lock(inflaters_mutex);
+            if (!inflaters.empty())
+            {
+                inflate = std::move(inflaters.back());
+                inflaters.pop_back();
+            }
+        }
+        if (inflate == nullptr)
+        {
+            inflate = std::make_unique<pal_inflate>();
+        }
 
-    assert(0 != CloseHandle(h_file));
+        const auto& entry = entries[files[index]];
+        const auto filename = pal_fs_archive_filename(directory_in, entry.path);
+        auto created = false;
+        const auto entry_error = pal_fs_zip_extract_entry(archive, entry, filename, *inflate, created);
+        if (entry_error != 0)
+        {
+            LOGE << "Failed to extract zip entry: " << entry.path << ". Archive: " << archive_filename_in << ". Error: " << entry_error;
+            // A file that was already there (EEXIST) belongs to someone else.
+            if (created)
+            {
+                pal_fs_rmfile(filename.c_str());
+            }
+            auto expected = 0;
+            first_error.compare_exchange_strong(expected, entry_error);
+        }
+        else
+        {
+            bytes_written += entry.uncompressed_size;
+        }
 
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    struct stat st = { 0 };
-    if (stat(filename_in, &st) == 0)
+        std::lock_guard<std::mutex> lock(inflaters_mutex);
+        inflaters.emplace_back(std::move(inflate));
+    });
+
+    if (stats_out != nullptr)
     {
-        *file_size_out = st.st_size;
-        return TRUE;
+        stats_out->files_count = files.size();
+        stats_out->directories_count = directories.size();
+        stats_out->bytes_written = bytes_written;
+        stats_out->first_error = first_error;
     }
-    return FALSE;
-#else
-    return FALSE;
+
+    return first_error == 0 ? TRUE : FALSE;
+}
+
+// - Packs
+
+// Uncompressed, page aligned pack of an app directory. Payloads can be reflinked or copied straight
+// out of the pack and the index is read in place from a mapping. Layout, all integers little endian:
+//
+//   header (64 bytes): "SNAPXPK1" | hash algorithm (u32) | alignment (u32) | entries (u64)
+//                      | names offset (u64) | names length (u64) | data offset (u64) | pack size (u64) | reserved (u64)
+//   index: one 64 byte record per file, sorted by path:
+//          name offset (u64) | name length (u32) | mode (u32) | data offset (u64) | size (u64) | digest (32 bytes)
+//   names: nul terminated '/' separated paths
+//   payloads: each starting at a multiple of alignment, the pack is padded to a multiple of alignment
+static const char pal_fs_pack_magic[8] = { 'S', 'N', 'A', 'P', 'X', 'P', 'K', '1' };
+static const size_t pal_fs_pack_header_len = 64;
+static const size_t pal_fs_pack_record_len = 64;
+// Matches the block size of common filesystems, reflinks need block aligned source ranges.
+static const uint32_t pal_fs_pack_alignment = 4096;
+static const uint32_t pal_fs_pack_max_alignment = 1024 * 1024;
+
+struct pal_fs_pack
+{
+    pal_mapped_file mapping{};
+#if defined(PAL_PLATFORM_LINUX)
+    int fd = -1;
 #endif
+    uint32_t algorithm = PAL_HASH_SHA256;
+    uint32_t alignment = 0;
+    size_t entries_len = 0;
+    const uint8_t* index = nullptr;
+    const char* names = nullptr;
+};
+
+static void pal_fs_pack_store32(uint8_t* data, const uint32_t value)
+{
+    for (auto i = 0; i < 4; i++)
+    {
+        data[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_read_file(const char *filename_in, char **bytes_out, size_t *bytes_read_out)
+static void pal_fs_pack_store64(uint8_t* data, const uint64_t value)
 {
-    if (filename_in == nullptr)
+    for (auto i = 0; i < 8; i++)
     {
-        return FALSE;
+        data[i] = static_cast<uint8_t>(value >> (i * 8));
     }
+}
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string path_in_utf16_string(filename_in);
+static uint64_t pal_fs_pack_align(const uint64_t value, const uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
 
-    auto* const h_file = CreateFile(path_in_utf16_string.data(),
-                                    GENERIC_READ,
-                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 
-                                    nullptr,
-                                    OPEN_EXISTING,
-                                    FILE_ATTRIBUTE_NORMAL,
-                                    nullptr);
+static void pal_fs_pack_read_entry(const pal_fs_pack_t* pack_in, const size_t index_in, pal_fs_pack_entry_t* entry_out)
+{
+    const auto* const record = pack_in->index + index_in * pal_fs_pack_record_len;
+    entry_out->path = pack_in->names + pal_fs_patch_load64(record);
+    entry_out->mode = pal_fs_zip_load32(record + 12);
+    entry_out->size = pal_fs_patch_load64(record + 24);
+    entry_out->data = pack_in->mapping.data() + pal_fs_patch_load64(record + 16);
+    std::memcpy(entry_out->digest, record + 32, PAL_HASH_DIGEST_SIZE);
+}
 
-    if (h_file == INVALID_HANDLE_VALUE)
+// Writes a pack of paths_in (relative to directory_in, '/' separated) to pack_filename_in. The pack
+// is written to a temporary file first and replaces pack_filename_in once it is complete. Files are
+// hashed in parallel with algorithm_in and must not change while the pack is written.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_create(const char* pack_filename_in, const char* directory_in,
+        const char** paths_in, const size_t paths_len_in, const uint32_t algorithm_in)
+{
+    if (pack_filename_in == nullptr
+        || directory_in == nullptr
+        || (paths_in == nullptr && paths_len_in > 0)
+        || (algorithm_in != PAL_HASH_SHA256 && algorithm_in != PAL_HASH_BLAKE3))
     {
         return FALSE;
     }
 
-    LARGE_INTEGER bytes_to_read_li;
-    if(0 == GetFileSizeEx(h_file, &bytes_to_read_li))
+    std::vector<std::string> paths;
+    paths.reserve(paths_len_in);
+    for (auto i = 0u; i < paths_len_in; i++)
     {
-        LOGE << "Failed to get file size for filename: " << path_in_utf16_string << ". Error code: " << GetLastError();
-        assert(TRUE == CloseHandle(h_file));
-        return FALSE;                    
-    }
-
-    const auto bytes_to_read = static_cast<size_t>(bytes_to_read_li.QuadPart);
-
-    size_t read_offset = 0;
-    DWORD read_buffer_bytes_read = 0;
-    const auto read_buffer_size = 8096;
-    char read_buffer[read_buffer_size];
+        if (paths_in[i] == nullptr)
+        {
+            return FALSE;
+        }
 
-    bool readfile_success;
-    do
-    {
-        // https://docs.microsoft.com/en-us/windows/win32/fileio/testing-for-the-end-of-a-file
-        readfile_success = TRUE == ReadFile(h_file, read_buffer, read_buffer_size, &read_buffer_bytes_read, nullptr);
-        if(read_buffer_bytes_read > 0)
+        std::string path(paths_in[i]);
+        std::replace(path.begin(), path.end(), '\\', '/');
+        if (!pal_fs_verify_is_safe_path(path))
         {
-           assert(read_offset < bytes_to_read);
+            LOGE << "Refusing to pack path outside of directory: " << path;
+            return FALSE;
+        }
+        paths.emplace_back(std::move(path));
+    }
 
-           if (read_offset == 0)
-           {
-                *bytes_out = new char[bytes_to_read];
-                if (bytes_to_read < read_buffer_size)
-                {
-                    std::memcpy(*bytes_out, &read_buffer, read_buffer_bytes_read);
-                    read_offset = read_buffer_bytes_read;
-                    continue;
-                }
-           }
+    std::sort(paths.begin(), paths.end());
+    if (std::adjacent_find(paths.begin(), paths.end()) != paths.end())
+    {
+        LOGE << "Duplicate paths in pack: " << pack_filename_in;
+        return FALSE;
+    }
 
-           std::memcpy(*bytes_out + read_offset, &read_buffer[0], read_buffer_bytes_read * sizeof read_buffer[0]);
-           read_offset += read_buffer_bytes_read;          
-        }
-    } while(readfile_success && read_buffer_bytes_read > 0);
+    std::vector<const char*> names(paths.size());
+    for (auto i = 0u; i < paths.size(); i++)
+    {
+        names[i] = paths[i].c_str();
+    }
 
-    assert(TRUE == CloseHandle(h_file));
+    std::vector<pal_fs_stat_t> stats(paths.size());
+    if (!pal_fs_stat_batch(directory_in, names.data(), names.size(), TRUE, stats.data(), nullptr))
+    {
+        LOGE << "Failed to stat files to pack in directory: " << directory_in;
+        return FALSE;
+    }
 
-    if (read_offset != bytes_to_read)
+    std::vector<uint8_t> digests(paths.size() * PAL_HASH_DIGEST_SIZE);
+    std::atomic<bool> hash_failed(false);
+    pal_parallel_for(paths.size(), 4, [&](const size_t index)
     {
-        if (read_offset > 0)
+        const auto filename = pal_fs_archive_filename(directory_in, paths[index]);
+        if (stats[index].type != PAL_FS_TYPE_FILE
+            || !pal_hash_file(filename.c_str(), algorithm_in, TRUE, digests.data() + index * PAL_HASH_DIGEST_SIZE))
         {
-            delete[] bytes_out;
+            LOGE << "Failed to hash file to pack: " << filename;
+            hash_failed = true;
         }
+    });
+
+    if (hash_failed)
+    {
         return FALSE;
     }
 
-    *bytes_read_out = read_offset;
+    const uint64_t names_offset = pal_fs_pack_header_len + paths.size() * pal_fs_pack_record_len;
+    uint64_t names_len = 0;
+    for (const auto& path : paths)
+    {
+        names_len += path.size() + 1;
+    }
 
-    return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    auto fp = fopen(filename_in, "rb");
-    if (fp == nullptr)
+    // Header, index and names are small enough to be built in memory.
+    const auto data_offset = pal_fs_pack_align(names_offset + names_len, pal_fs_pack_alignment);
+    std::vector<uint8_t> head(static_cast<size_t>(data_offset));
+    uint64_t name_offset = 0;
+    uint64_t payload_offset = data_offset;
+
+    for (auto i = 0u; i < paths.size(); i++)
     {
-        return FALSE;
+        auto* const record = head.data() + pal_fs_pack_header_len + i * pal_fs_pack_record_len;
+        pal_fs_pack_store64(record, name_offset);
+        pal_fs_pack_store32(record + 8, static_cast<uint32_t>(paths[i].size()));
+        pal_fs_pack_store32(record + 12, stats[i].mode & 0777);
+        pal_fs_pack_store64(record + 16, payload_offset);
+        pal_fs_pack_store64(record + 24, stats[i].size);
+        std::memcpy(record + 32, digests.data() + i * PAL_HASH_DIGEST_SIZE, PAL_HASH_DIGEST_SIZE);
+
+        std::memcpy(head.data() + names_offset + name_offset, paths[i].c_str(), paths[i].size() + 1);
+        name_offset += paths[i].size() + 1;
+        payload_offset += pal_fs_pack_align(stats[i].size, pal_fs_pack_alignment);
     }
 
-    fseek(fp, 0, SEEK_END);
-    auto total_size = static_cast<size_t>(ftell(fp));
-    rewind(fp);
+    std::memcpy(head.data(), pal_fs_pack_magic, sizeof pal_fs_pack_magic);
+    pal_fs_pack_store32(head.data() + 8, algorithm_in);
+    pal_fs_pack_store32(head.data() + 12, pal_fs_pack_alignment);
+    pal_fs_pack_store64(head.data() + 16, paths.size());
+    pal_fs_pack_store64(head.data() + 24, names_offset);
+    pal_fs_pack_store64(head.data() + 32, names_len);
+    pal_fs_pack_store64(head.data() + 40, data_offset);
+    pal_fs_pack_store64(head.data() + 48, payload_offset);
+
+    const auto tmp_filename = pal_fs_build_tmp_filename(pack_filename_in);
+    const auto write_pack = [&]()
+    {
+        static const uint8_t padding[pal_fs_pack_alignment] = {};
 
-    auto buffer = new char[total_size];
-    auto bytes_read = fread(buffer, sizeof(char), total_size, fp);
+        pal_fs_output_file output;
+        auto error = output.create(tmp_filename, payload_offset, 0);
+        if (error == 0)
+        {
+            error = output.write(head.data(), head.size());
+        }
 
-    *bytes_out = buffer;
-    *bytes_read_out = bytes_read;
+        for (auto i = 0u; error == 0 && i < paths.size(); i++)
+        {
+            const auto filename = pal_fs_archive_filename(directory_in, paths[i]);
 
-    assert(0 == fclose(fp));
+            pal_mapped_file file;
+            error = file.try_open(filename.c_str(), true);
+            if (error == 0 && file.size() != stats[i].size)
+            {
+                LOGE << "File changed while it was packed: " << filename;
+                error = pal_fs_invalid_data;
+            }
+            if (error == 0)
+            {
+                error = output.write(file.data(), file.size());
+            }
+            if (error == 0)
+            {
+                error = output.write(padding, static_cast<size_t>(pal_fs_pack_align(file.size(), pal_fs_pack_alignment) - file.size()));
+            }
+        }
 
-    return bytes_read == total_size;
-#else
-    return FALSE;
-#endif
-}
+        return error == 0 ? output.flush() : error;
+    };
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_mkdir(const char* directory_in, pal_mode_t mode_in)
-{
-    if (directory_in == nullptr || mode_in <= 0)
+    const auto error = write_pack();
+    if (error != 0)
     {
+        LOGE << "Failed to write pack: " << pack_filename_in << ". Error: " << error;
+        pal_fs_rmfile(tmp_filename.c_str());
         return FALSE;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    PAL_UNUSED(mode_in);
-    pal_utf16_string directory_in_utf16_string(directory_in);
-    const auto status = CreateDirectory(directory_in_utf16_string.data(), nullptr);
-    if (status == 0)
-    {
-        LOGE << "Error creating directory: " << directory_in_utf16_string << ". Status: " << status << ". Error code: " << GetLastError();
-        return FALSE;
-    }
-    return TRUE;
-#else
-    const auto status = mkdir(directory_in, mode_in);
-    if (status != 0)
+    if (!pal_fs_replace_file(tmp_filename, pack_filename_in))
     {
-        LOGE << "Error creating directory: " << directory_in << ". Mode: " << mode_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
+        pal_fs_rmfile(tmp_filename.c_str());
         return FALSE;
     }
+
     return TRUE;
-#endif
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_mkdirp(const char *directory_in, pal_mode_t mode_in)
+// Validates the whole index up front, accessors and installs trust it afterwards.
+static int pal_fs_pack_validate(pal_fs_pack_t* pack_in)
 {
-    if (directory_in == nullptr || mode_in <= 0)
+    const auto* const data = pack_in->mapping.data();
+    const auto size = static_cast<uint64_t>(pack_in->mapping.size());
+
+    if (size < pal_fs_pack_header_len
+        || 0 != std::memcmp(data, pal_fs_pack_magic, sizeof pal_fs_pack_magic))
     {
-        return FALSE;
+        return pal_fs_invalid_data;
     }
 
-    const auto directory_in_normalized = std::make_unique<char*>(new char);
-    if (!pal_path_normalize(directory_in, directory_in_normalized.get()))
+    pack_in->algorithm = pal_fs_zip_load32(data + 8);
+    pack_in->alignment = pal_fs_zip_load32(data + 12);
+    const auto entries_len = pal_fs_patch_load64(data + 16);
+    const auto names_offset = pal_fs_patch_load64(data + 24);
+    const auto names_len = pal_fs_patch_load64(data + 32);
+    const auto data_offset = pal_fs_patch_load64(data + 40);
+
+    if ((pack_in->algorithm != PAL_HASH_SHA256 && pack_in->algorithm != PAL_HASH_BLAKE3)
+        || pack_in->alignment == 0
+        || pack_in->alignment > pal_fs_pack_max_alignment
+        || (pack_in->alignment & (pack_in->alignment - 1)) != 0
+        || pal_fs_patch_load64(data + 48) != size
+        || entries_len > (size - pal_fs_pack_header_len) / pal_fs_pack_record_len
+        || names_offset != pal_fs_pack_header_len + entries_len * pal_fs_pack_record_len
+        || names_len > size - names_offset
+        || (names_len > 0 && data[names_offset + names_len - 1] != 0)
+        || data_offset < names_offset + names_len
+        || data_offset > size)
     {
-        return FALSE;
+        return pal_fs_invalid_data;
     }
 
-    const auto* const directory_sep = PAL_DIRECTORY_SEPARATOR_STR;
-    const auto directory_in_str = std::string(*directory_in_normalized);
+    pack_in->entries_len = static_cast<size_t>(entries_len);
+    pack_in->index = data + pal_fs_pack_header_len;
+    pack_in->names = reinterpret_cast<const char*>(data + names_offset);
 
-    const auto expand_paths = [&directory_in_str, &directory_sep]()
+    const char* previous_path = nullptr;
+    for (uint64_t i = 0; i < entries_len; i++)
     {
-        auto last_index = directory_in_str.find_first_not_of(directory_sep, 0);
-        auto current_index = directory_in_str.find_first_of(directory_sep, last_index);
-        auto paths = std::vector<std::string>();
-
-        while (std::string::npos != current_index
-            || std::string::npos != last_index)
+        const auto* const record = pack_in->index + i * pal_fs_pack_record_len;
+        const auto name_offset = pal_fs_patch_load64(record);
+        const auto name_len = pal_fs_zip_load32(record + 8);
+        const auto payload_offset = pal_fs_patch_load64(record + 16);
+        const auto payload_size = pal_fs_patch_load64(record + 24);
+
+        if (name_offset >= names_len
+            || name_len > names_len - name_offset - 1
+            || pack_in->names[name_offset + name_len] != '\0'
+            || std::strlen(pack_in->names + name_offset) != name_len
+            || payload_offset < data_offset
+            || payload_offset % pack_in->alignment != 0
+            || payload_offset > size
+            || payload_size > size - payload_offset)
         {
-            const auto path = directory_in_str.substr(0, current_index);
-            paths.emplace_back(path);
+            return pal_fs_invalid_data;
+        }
 
-            last_index = directory_in_str.find_first_not_of(directory_sep, current_index);
-            current_index = directory_in_str.find_first_of(directory_sep, last_index);
+        // Strictly ascending paths are unique and can be binary searched.
+        const auto* const path = pack_in->names + name_offset;
+        if (!pal_fs_verify_is_safe_path(path)
+            || (previous_path != nullptr && std::strcmp(previous_path, path) >= 0))
+        {
+            return pal_fs_invalid_data;
         }
+        previous_path = path;
+    }
 
-        return paths;
-    };
+    return 0;
+}
 
-    auto directories_created = 0;
-    const auto paths = expand_paths();
-    for (const auto& path : paths)
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_open(const char* pack_filename_in, pal_fs_pack_t** pack_out)
+{
+    if (pack_filename_in == nullptr
+        || pack_out == nullptr)
     {
-        if (pal_fs_directory_exists(path.c_str()))
-        {
-            continue;
-        }
+        return FALSE;
+    }
 
-        if (!pal_fs_mkdir(path.c_str(), mode_in))
+    auto pack = std::make_unique<pal_fs_pack>();
+#if defined(PAL_PLATFORM_LINUX)
+    pack->fd = -1;
+#endif
+
+    auto error = pack->mapping.try_open(pack_filename_in, false);
+#if defined(PAL_PLATFORM_LINUX)
+    if (error == 0)
+    {
+        // Installs clone and copy from a descriptor, the mapping is used for the index and as a fallback.
+        pack->fd = open(pack_filename_in, O_RDONLY | O_CLOEXEC);
+        error = pack->fd == -1 ? errno : 0;
+    }
+#endif
+    if (error == 0)
+    {
+        error = pal_fs_pack_validate(pack.get());
+    }
+
+    if (error != 0)
+    {
+        LOGE << "Failed to open pack: " << pack_filename_in << ". Error: " << error;
+#if defined(PAL_PLATFORM_LINUX)
+        if (pack->fd != -1)
         {
-            return FALSE;
+            close(pack->fd);
         }
-
-        ++directories_created;
+#endif
+        return FALSE;
     }
 
-    return directories_created > 0 ? TRUE : FALSE;
+    *pack_out = pack.release();
+    return TRUE;
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmfile(const char* filename_in)
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_get_info(const pal_fs_pack_t* pack_in, size_t* entries_len_out, uint32_t* algorithm_out)
 {
-    if (filename_in == nullptr)
+    if (pack_in == nullptr)
     {
         return FALSE;
     }
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string filename_in_utf16_string(filename_in);
-    const auto status = DeleteFile(filename_in_utf16_string.data());
-    if (status == 0)
+
+    if (entries_len_out != nullptr)
     {
-        LOGE << "Error removing file: " << filename_in_utf16_string << ". Error code: " << GetLastError();
-        return FALSE;
+        *entries_len_out = pack_in->entries_len;
     }
+
+    if (algorithm_out != nullptr)
+    {
+        *algorithm_out = pack_in->algorithm;
+    }
+
     return TRUE;
-#elif defined(PAL_PLATFORM_LINUX)
-    const auto status = remove(filename_in);
-    if (status != 0)
+}
+
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_get_entry(const pal_fs_pack_t* pack_in, const size_t index_in, pal_fs_pack_entry_t* entry_out)
+{
+    if (pack_in == nullptr
+        || entry_out == nullptr
+        || index_in >= pack_in->entries_len)
     {
-        LOGE << "Error removing file: " << filename_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
         return FALSE;
     }
+
+    pal_fs_pack_read_entry(pack_in, index_in, entry_out);
     return TRUE;
-#else 
-    return FALSE;
-#endif
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_rmdir(const char* directory_in, BOOL recursive)
+// Looks up path_in ('/' separated) with a binary search over the index.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_find(const pal_fs_pack_t* pack_in, const char* path_in, pal_fs_pack_entry_t* entry_out)
 {
-    if (directory_in == nullptr)
+    if (pack_in == nullptr
+        || path_in == nullptr
+        || entry_out == nullptr)
     {
         return FALSE;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string directory_in_utf16_string(directory_in);
-    if (!recursive)
+    size_t lower = 0;
+    size_t upper = pack_in->entries_len;
+    while (lower < upper)
     {
-        const auto status = RemoveDirectory(directory_in_utf16_string.data());
-        if (status == 0)
+        const auto middle = lower + (upper - lower) / 2;
+        const auto* const path = pack_in->names + pal_fs_patch_load64(pack_in->index + middle * pal_fs_pack_record_len);
+        const auto order = std::strcmp(path, path_in);
+        if (order == 0)
         {
-            LOGE << "Error removing directory: " << directory_in_utf16_string << ". Status: " << status << ". Error code: " << GetLastError();
-            return FALSE;
+            pal_fs_pack_read_entry(pack_in, middle, entry_out);
+            return TRUE;
         }
-        return TRUE;
-    }
-#elif defined(PAL_PLATFORM_LINUX)
-    if (!recursive)
-    {
-        const auto status = rmdir(directory_in);
-        if (status != 0)
+        if (order < 0)
         {
-            LOGE << "Error removing directory: " << directory_in << ". Errno: " << errno << ". Error code: " << std::strerror(errno);
-            return FALSE;
+            lower = middle + 1;
+        }
+        else
+        {
+            upper = middle;
         }
-        return TRUE;
     }
-#else
+
     return FALSE;
-#endif
+}
 
-    char** files_array = nullptr;
-    size_t files_array_len = 0u;
-    if (pal_fs_list_files(directory_in, nullptr, nullptr, &files_array, &files_array_len))
+// Creates filename and fills it with the payload of entry. On Linux the payload is reflinked when
+// the filesystem shares extents (btrfs, xfs), copied in the kernel with copy_file_range otherwise and
+// written from the mapping as a last resort. Returns 0 or errno (GetLastError on Windows).
+// created_out is set once filename was created by this call.
+static int pal_fs_pack_install_entry(const pal_fs_pack_t* pack_in, const pal_fs_pack_entry_t& entry, const std::string& filename,
+    bool* cloned_out, bool* created_out)
+{
+    *cloned_out = false;
+    *created_out = false;
+
+#if defined(PAL_PLATFORM_LINUX)
+    const auto fd = open(filename.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0644);
+    if (fd == -1)
     {
-        std::vector<std::string> files(files_array, files_array + files_array_len);
-        for (const auto &filename : files)
+        return errno;
+    }
+    *created_out = true;
+
+    const auto install = [&]()
+    {
+        if (entry.mode != 0
+            && -1 == fchmod(fd, entry.mode))
         {
-            pal_fs_rmfile(filename.c_str());
+            return errno;
         }
 
-        delete[] files_array;
-        files_array = nullptr;
-        files_array_len = 0;
-    }
+        if (entry.size == 0)
+        {
+            return 0;
+        }
 
-    char** directories_array = nullptr;
-    size_t directories_array_len = 0u;
-    if (!pal_fs_list_directories(directory_in, nullptr, nullptr, &directories_array, &directories_array_len)
-        || directories_array_len <= 0)
-    {
-        return pal_fs_rmdir(directory_in, FALSE);
-    }
+        auto offset = static_cast<uint64_t>(entry.data - pack_in->mapping.data());
+
+#if defined(FICLONERANGE)
+        // Clones must cover whole blocks, the padding of the payload is cut off again by the truncate.
+        struct file_clone_range clone_range = {};
+        clone_range.src_fd = pack_in->fd;
+        clone_range.src_offset = offset;
+        clone_range.src_length = std::min<uint64_t>(pal_fs_pack_align(entry.size, pack_in->alignment), pack_in->mapping.size() - offset);
+        if (0 == ioctl(fd, FICLONERANGE, &clone_range))
+        {
+            if (-1 == ftruncate(fd, static_cast<off_t>(entry.size)))
+            {
+                return errno;
+            }
+            *cloned_out = true;
+            return 0;
+        }
+#endif
+
+        if (-1 == fallocate(fd, 0, 0, static_cast<off_t>(entry.size))
+            && errno != EOPNOTSUPP
+            && errno != ENOSYS
+            && errno != EINVAL)
+        {
+            return errno;
+        }
 
-    std::vector<std::string> directories(directories_array, directories_array + directories_array_len);
+        uint64_t done = 0;
+#if defined(SYS_copy_file_range)
+        while (done < entry.size)
+        {
+            auto offset_in = static_cast<loff_t>(offset + done);
+            const auto copied = syscall(SYS_copy_file_range, pack_in->fd, &offset_in, fd, nullptr,
+                static_cast<size_t>(std::min<uint64_t>(entry.size - done, 1u << 30)), 0u);
+            if (copied > 0)
+            {
+                done += static_cast<uint64_t>(copied);
+                continue;
+            }
+            if (copied == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            // Kernels before 5.3 do not copy across filesystems, the rest is written from the mapping.
+            if (copied == 0 || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)
+            {
+                break;
+            }
+            return errno;
+        }
+#endif
 
-    delete[] directories_array;
-    directories_array = nullptr;
-    directories_array_len = 0;
+        if (done < entry.size
+            && -1 == lseek(fd, static_cast<off_t>(done), SEEK_SET))
+        {
+            return errno;
+        }
 
-    for (const auto &directory : directories)
-    {
-        if (!pal_fs_rmdir(directory.c_str(), TRUE))
+        if (!pal_fs_write_all(fd, reinterpret_cast<const char*>(entry.data + done), static_cast<size_t>(entry.size - done)))
         {
-            return FALSE;
+            return errno;
         }
-    }
 
-    return pal_fs_rmdir(directory_in, FALSE);
+        return 0;
+    };
+
+    const auto error = install();
+    close(fd);
+    return error;
+#else
+    pal_fs_output_file output;
+    auto error = output.create(filename, entry.size, static_cast<pal_mode_t>(entry.mode));
+    *created_out = output.created();
+    if (error == 0)
+    {
+        error = output.write(entry.data, static_cast<size_t>(entry.size));
+    }
+    return error == 0 ? output.flush() : error;
+#endif
 }
 
-PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_write(const char* filename_in, const char* data_in, const size_t data_len_in)
+// Installs every file of the pack below directory_in, which is created when it does not exist.
+// Directories are created up front and files installed in parallel, largest first. Files must not
+// exist yet. With verify_in each payload is hashed and compared against the index before it is
+// installed, without it the index is trusted and installing is pure data movement.
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_install(const pal_fs_pack_t* pack_in, const char* directory_in, const BOOL verify_in,
+        pal_fs_pack_install_stats_t* stats_out)
 {
-    if (filename_in == nullptr
-        || data_in == nullptr)
+    if (pack_in == nullptr
+        || directory_in == nullptr)
     {
         return FALSE;
     }
 
-#if defined(PAL_PLATFORM_WINDOWS)
-    pal_utf16_string filename_in_utf16_string(filename_in);
-    auto* const h_file  = CreateFile(filename_in_utf16_string.data(),   
-                       GENERIC_WRITE,          // open for writing
-                       FILE_SHARE_READ,        // allow read while writing
-                       nullptr,                // default security
-                       CREATE_ALWAYS,          // open existing file or create a new file
-                       FILE_ATTRIBUTE_NORMAL,  // normal file
-                       nullptr);               // no attr. template
+    std::vector<pal_fs_pack_entry_t> entries(pack_in->entries_len);
+    std::set<std::string> directories;
+    for (auto i = 0u; i < entries.size(); i++)
+    {
+        pal_fs_pack_read_entry(pack_in, i, &entries[i]);
+        pal_fs_archive_add_directories(entries[i].path, false, directories);
+    }
 
-    if(h_file == INVALID_HANDLE_VALUE)
+    if (!pal_fs_archive_create_directories(directory_in, directories))
     {
         return FALSE;
     }
 
-    DWORD bytes_written;
+    std::vector<size_t> order(entries.size());
+    for (auto i = 0u; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&entries](const size_t lhs, const size_t rhs)
+    {
+        return entries[lhs].size > entries[rhs].size;
+    });
 
-    const auto success = WriteFile( 
-                    h_file,              // open file handle
-                    data_in,             // start of data to write
-                    data_len_in,         // number of bytes to write
-                    &bytes_written,      // number of bytes that were written
-                    nullptr);            // no overlapped structure
+    std::atomic<int> first_error(0);
+    std::atomic<size_t> cloned_count(0);
+    std::atomic<uint64_t> bytes_copied(0);
 
-    CloseHandle(h_file);
+    pal_parallel_for(order.size(), 4, [&](const size_t index)
+    {
+        if (first_error.load(std::memory_order_relaxed) != 0)
+        {
+            return;
+        }
 
-    return success == TRUE && bytes_written == data_len_in ? TRUE : FALSE;
-#elif defined(PAL_PLATFORM_LINUX)
-    const auto h_file = fopen(filename_in, "wb");
-    if(h_file == nullptr)
+        const auto& entry = entries[order[index]];
+        const auto filename = pal_fs_archive_filename(directory_in, entry.path);
+
+        auto error = 0;
+        if (verify_in)
+        {
+            pal_hash hash;
+            hash.algorithm = pack_in->algorithm;
+            uint8_t digest[PAL_HASH_DIGEST_SIZE];
+            pal_hash_update(&hash, entry.data, static_cast<size_t>(entry.size));
+            pal_hash_final(&hash, digest);
+            if (0 != std::memcmp(digest, entry.digest, PAL_HASH_DIGEST_SIZE))
+            {
+                error = pal_fs_invalid_data;
+            }
+        }
+
+        auto cloned = false;
+        if (error == 0)
+        {
+            auto created = false;
+            error = pal_fs_pack_install_entry(pack_in, entry, filename, &cloned, &created);
+            // A file that was already there (EEXIST) belongs to someone else.
+            if (error != 0
+                && created)
+            {
+                pal_fs_rmfile(filename.c_str());
+            }
+        }
+
+        if (error != 0)
+        {
+            LOGE << "Failed to install file from pack: " << filename << ". Error: " << error;
+            auto expected = 0;
+            first_error.compare_exchange_strong(expected, error);
+        }
+        else if (cloned)
+        {
+            ++cloned_count;
+        }
+        else
+        {
+            bytes_copied += entry.size;
+        }
+    });
+
+    if (stats_out != nullptr)
     {
-        return FALSE;
+        stats_out->files_count = entries.size();
+        stats_out->cloned_count = cloned_count;
+        stats_out->bytes_copied = bytes_copied;
+        stats_out->first_error = first_error;
     }
 
-    const auto bytes_written = fwrite(data_in, sizeof(char), data_len_in, h_file);
-
-    fclose(h_file);
+    return first_error == 0 ? TRUE : FALSE;
+}
 
-    if(bytes_written == data_len_in)
+PAL_API BOOL PAL_CALLING_CONVENTION pal_fs_pack_free(pal_fs_pack_t* pack_in)
+{
+    if (pack_in == nullptr)
     {
-        return TRUE;
+        return FALSE;
     }
 
-    return FALSE;
-#else
-    return FALSE;
+#if defined(PAL_PLATFORM_LINUX)
+    close(pack_in->fd);
 #endif
+
+    delete pack_in;
+    return TRUE;
 }
 
 PAL_API BOOL PAL_CALLING_CONVENTION pal_path_normalize(const char * path_in, char ** path_normalized_out)
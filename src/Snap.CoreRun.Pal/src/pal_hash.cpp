@@ -0,0 +1,1027 @@
+#include "pal/pal.hpp"
+#include "pal/pal_hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PAL_HASH_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h> // __cpuid
+#else
+#include <cpuid.h> // __get_cpuid
+#endif
+#elif defined(__aarch64__) && defined(__GNUC__)
+#define PAL_HASH_ARM64
+#include <arm_neon.h>
+#if defined(PAL_PLATFORM_LINUX)
+#include <sys/auxv.h> // getauxval
+#include <asm/hwcap.h> // HWCAP_SHA2
+#endif
+#endif
+
+// Lets a single translation unit carry kernels for instruction sets that the rest of the build
+// does not enable. MSVC allows intrinsics without any annotation.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define PAL_HASH_TARGET(x)
+#else
+#define PAL_HASH_TARGET(x) __attribute__((target(x)))
+#endif
+
+// - Cpu features
+
+struct pal_hash_cpu_features
+{
+    bool sha256;
+    bool sse41;
+    bool avx2;
+    bool neon;
+};
+
+static std::atomic<bool> pal_hash_portable_only(false);
+
+static pal_hash_cpu_features pal_hash_detect_cpu_features()
+{
+    pal_hash_cpu_features features = {};
+
+#if defined(PAL_HASH_X86)
+    unsigned int leaf1[4] = {};
+    unsigned int leaf7[4] = {};
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    const auto max_leaf = static_cast<unsigned int>(regs[0]);
+    __cpuid(regs, 1);
+    for (auto i = 0; i < 4; i++) leaf1[i] = static_cast<unsigned int>(regs[i]);
+    if (max_leaf >= 7)
+    {
+        __cpuidex(regs, 7, 0);
+        for (auto i = 0; i < 4; i++) leaf7[i] = static_cast<unsigned int>(regs[i]);
+    }
+#else
+    __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+    __get_cpuid_count(7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3]);
+#endif
+
+    const auto ssse3 = (leaf1[2] & (1u << 9)) != 0;
+    features.sse41 = ssse3 && (leaf1[2] & (1u << 19)) != 0;
+
+    // AVX registers are only usable when the OS saves them, see XGETBV.
+    const auto osxsave = (leaf1[2] & (1u << 27)) != 0;
+    const auto avx = (leaf1[2] & (1u << 28)) != 0;
+    if (osxsave && avx)
+    {
+#if defined(_MSC_VER)
+        const auto xcr0 = _xgetbv(0);
+#else
+        unsigned int xcr0_lo, xcr0_hi;
+        __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        const auto xcr0 = static_cast<uint64_t>(xcr0_hi) << 32 | xcr0_lo;
+#endif
+        features.avx2 = (xcr0 & 6) == 6 && (leaf7[1] & (1u << 5)) != 0;
+    }
+
+    features.sha256 = features.sse41 && (leaf7[1] & (1u << 29)) != 0;
+#elif defined(PAL_HASH_ARM64)
+    // NEON is mandatory on AArch64.
+    features.neon = true;
+#if defined(PAL_PLATFORM_LINUX)
+    features.sha256 = (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#endif
+#endif
+
+    return features;
+}
+
+static pal_hash_cpu_features pal_hash_get_cpu_features()
+{
+    static const auto features = pal_hash_detect_cpu_features();
+    if (pal_hash_portable_only.load(std::memory_order_relaxed))
+    {
+        return pal_hash_cpu_features();
+    }
+    return features;
+}
+
+void pal_hash_force_portable(const bool force_portable)
+{
+    pal_hash_portable_only.store(force_portable);
+}
+
+static inline uint32_t pal_hash_load32_le(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0])
+        | static_cast<uint32_t>(data[1]) << 8
+        | static_cast<uint32_t>(data[2]) << 16
+        | static_cast<uint32_t>(data[3]) << 24;
+}
+
+static inline uint32_t pal_hash_load32_be(const uint8_t* data)
+{
+    return static_cast<uint32_t>(data[0]) << 24
+        | static_cast<uint32_t>(data[1]) << 16
+        | static_cast<uint32_t>(data[2]) << 8
+        | static_cast<uint32_t>(data[3]);
+}
+
+static inline void pal_hash_store32_le(uint8_t* data, const uint32_t value)
+{
+    data[0] = static_cast<uint8_t>(value);
+    data[1] = static_cast<uint8_t>(value >> 8);
+    data[2] = static_cast<uint8_t>(value >> 16);
+    data[3] = static_cast<uint8_t>(value >> 24);
+}
+
+static inline void pal_hash_store32_be(uint8_t* data, const uint32_t value)
+{
+    data[0] = static_cast<uint8_t>(value >> 24);
+    data[1] = static_cast<uint8_t>(value >> 16);
+    data[2] = static_cast<uint8_t>(value >> 8);
+    data[3] = static_cast<uint8_t>(value);
+}
+
+static inline uint32_t pal_hash_rotr32(const uint32_t value, const int bits)
+{
+    return value >> bits | value << (32 - bits);
+}
+
+// - SHA-256
+
+alignas(16) static const uint32_t pal_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+typedef void(*pal_sha256_compress_fn)(uint32_t state[8], const uint8_t* data, size_t blocks_len);
+
+static void pal_sha256_compress_portable(uint32_t state[8], const uint8_t* data, size_t blocks_len)
+{
+    for (; blocks_len > 0; blocks_len--, data += 64)
+    {
+        uint32_t w[64];
+        for (auto i = 0; i < 16; i++)
+        {
+            w[i] = pal_hash_load32_be(data + i * 4);
+        }
+
+        for (auto i = 16; i < 64; i++)
+        {
+            const auto s0 = pal_hash_rotr32(w[i - 15], 7) ^ pal_hash_rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const auto s1 = pal_hash_rotr32(w[i - 2], 17) ^ pal_hash_rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = state[0], b = state[1], c = state[2], d = state[3];
+        auto e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (auto i = 0; i < 64; i++)
+        {
+            const auto s1 = pal_hash_rotr32(e, 6) ^ pal_hash_rotr32(e, 11) ^ pal_hash_rotr32(e, 25);
+            const auto ch = (e & f) ^ (~e & g);
+            const auto t1 = h + s1 + ch + pal_sha256_k[i] + w[i];
+            const auto s0 = pal_hash_rotr32(a, 2) ^ pal_hash_rotr32(a, 13) ^ pal_hash_rotr32(a, 22);
+            const auto maj = (a & b) ^ (a & c) ^ (b & c);
+            const auto t2 = s0 + maj;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#if defined(PAL_HASH_X86)
+// The SHA extensions keep the state as ABEF/CDGH and process four rounds per pair of
+// sha256rnds2, computing the message schedule four words at a time.
+PAL_HASH_TARGET("sha,sse4.1")
+static void pal_sha256_compress_shani(uint32_t state[8], const uint8_t* data, size_t blocks_len)
+{
+    const auto byteswap_mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    auto tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    auto state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1); // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B); // EFGH
+    auto state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+    for (; blocks_len > 0; blocks_len--, data += 64)
+    {
+        const auto abef_save = state0;
+        const auto cdgh_save = state1;
+
+        __m128i msg[4];
+        for (auto i = 0; i < 4; i++)
+        {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)), byteswap_mask);
+        }
+
+        for (auto i = 0; i < 16; i++)
+        {
+            auto rounds_msg = _mm_add_epi32(msg[i & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(&pal_sha256_k[i * 4])));
+
+            if (i < 12)
+            {
+                auto next = _mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                msg[i & 3] = _mm_sha256msg2_epu32(next, msg[(i + 3) & 3]);
+            }
+
+            state1 = _mm_sha256rnds2_epu32(state1, state0, rounds_msg);
+            rounds_msg = _mm_shuffle_epi32(rounds_msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, rounds_msg);
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0); // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8); // ABEF
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+#endif
+
+#if defined(PAL_HASH_ARM64)
+PAL_HASH_TARGET("+crypto")
+static void pal_sha256_compress_armv8(uint32_t state[8], const uint8_t* data, size_t blocks_len)
+{
+    auto state0 = vld1q_u32(&state[0]);
+    auto state1 = vld1q_u32(&state[4]);
+
+    for (; blocks_len > 0; blocks_len--, data += 64)
+    {
+        const auto abcd_save = state0;
+        const auto efgh_save = state1;
+
+        uint32x4_t msg[4];
+        for (auto i = 0; i < 4; i++)
+        {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+        }
+
+        for (auto i = 0; i < 16; i++)
+        {
+            const auto rounds_msg = vaddq_u32(msg[i & 3], vld1q_u32(&pal_sha256_k[i * 4]));
+
+            if (i < 12)
+            {
+                msg[i & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[i & 3], msg[(i + 1) & 3]), msg[(i + 2) & 3], msg[(i + 3) & 3]);
+            }
+
+            const auto state0_prev = state0;
+            state0 = vsha256hq_u32(state0, state1, rounds_msg);
+            state1 = vsha256h2q_u32(state1, state0_prev, rounds_msg);
+        }
+
+        state0 = vaddq_u32(state0, abcd_save);
+        state1 = vaddq_u32(state1, efgh_save);
+    }
+
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+#endif
+
+static pal_sha256_compress_fn pal_sha256_get_compress(const char** name_out)
+{
+    const auto features = pal_hash_get_cpu_features();
+    PAL_UNUSED(features);
+
+#if defined(PAL_HASH_X86)
+    if (features.sha256)
+    {
+        *name_out = "sha-ni";
+        return pal_sha256_compress_shani;
+    }
+#elif defined(PAL_HASH_ARM64)
+    if (features.sha256)
+    {
+        *name_out = "armv8-crypto";
+        return pal_sha256_compress_armv8;
+    }
+#endif
+
+    *name_out = "portable";
+    return pal_sha256_compress_portable;
+}
+
+pal_sha256::pal_sha256() :
+    m_state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+    m_buffer{},
+    m_buffer_len(0),
+    m_total_len(0)
+{
+}
+
+void pal_sha256::update(const uint8_t* data, size_t data_len)
+{
+    const char* name;
+    const auto compress = pal_sha256_get_compress(&name);
+
+    m_total_len += data_len;
+
+    if (m_buffer_len > 0)
+    {
+        const auto take = std::min(sizeof m_buffer - m_buffer_len, data_len);
+        std::memcpy(m_buffer + m_buffer_len, data, take);
+        m_buffer_len += take;
+        data += take;
+        data_len -= take;
+
+        if (m_buffer_len < sizeof m_buffer)
+        {
+            return;
+        }
+
+        compress(m_state, m_buffer, 1);
+        m_buffer_len = 0;
+    }
+
+    const auto blocks_len = data_len / 64;
+    if (blocks_len > 0)
+    {
+        compress(m_state, data, blocks_len);
+        data += blocks_len * 64;
+        data_len -= blocks_len * 64;
+    }
+
+    if (data_len > 0)
+    {
+        std::memcpy(m_buffer, data, data_len);
+        m_buffer_len = data_len;
+    }
+}
+
+void pal_sha256::finalize(uint8_t digest_out[PAL_HASH_DIGEST_SIZE])
+{
+    const auto bits_len = m_total_len * 8;
+
+    uint8_t padding[128] = { 0x80 };
+    const auto padding_len = (m_buffer_len < 56 ? 56 : 120) - m_buffer_len;
+    for (size_t i = 0; i < 8; i++)
+    {
+        padding[padding_len + i] = static_cast<uint8_t>(bits_len >> (56 - i * 8));
+    }
+
+    update(padding, padding_len + 8);
+
+    for (auto i = 0; i < 8; i++)
+    {
+        pal_hash_store32_be(digest_out + i * 4, m_state[i]);
+    }
+}
+
+const char* pal_sha256::get_implementation()
+{
+    const char* name;
+    pal_sha256_get_compress(&name);
+    return name;
+}
+
+// - BLAKE3
+
+static const uint32_t pal_blake3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// Message word order of each of the seven rounds.
+static const uint8_t pal_blake3_schedule[7][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+    { 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+    { 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+    { 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+    { 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+    { 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 }
+};
+
+static const size_t pal_blake3_block_len = 64;
+static const size_t pal_blake3_chunk_len = 1024;
+
+static const uint32_t pal_blake3_chunk_start = 1 << 0;
+static const uint32_t pal_blake3_chunk_end = 1 << 1;
+static const uint32_t pal_blake3_parent = 1 << 2;
+static const uint32_t pal_blake3_root = 1 << 3;
+
+static inline void pal_blake3_g(uint32_t* state, const int a, const int b, const int c, const int d, const uint32_t x, const uint32_t y)
+{
+    state[a] = state[a] + state[b] + x;
+    state[d] = pal_hash_rotr32(state[d] ^ state[a], 16);
+    state[c] = state[c] + state[d];
+    state[b] = pal_hash_rotr32(state[b] ^ state[c], 12);
+    state[a] = state[a] + state[b] + y;
+    state[d] = pal_hash_rotr32(state[d] ^ state[a], 8);
+    state[c] = state[c] + state[d];
+    state[b] = pal_hash_rotr32(state[b] ^ state[c], 7);
+}
+
+static void pal_blake3_compress(const uint32_t cv[8], const uint8_t block[64], const uint32_t block_len,
+    const uint64_t counter, const uint32_t flags, uint32_t cv_out[8])
+{
+    uint32_t m[16];
+    for (auto i = 0; i < 16; i++)
+    {
+        m[i] = pal_hash_load32_le(block + i * 4);
+    }
+
+    uint32_t state[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        pal_blake3_iv[0], pal_blake3_iv[1], pal_blake3_iv[2], pal_blake3_iv[3],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), block_len, flags
+    };
+
+    for (const auto& schedule : pal_blake3_schedule)
+    {
+        pal_blake3_g(state, 0, 4, 8, 12, m[schedule[0]], m[schedule[1]]);
+        pal_blake3_g(state, 1, 5, 9, 13, m[schedule[2]], m[schedule[3]]);
+        pal_blake3_g(state, 2, 6, 10, 14, m[schedule[4]], m[schedule[5]]);
+        pal_blake3_g(state, 3, 7, 11, 15, m[schedule[6]], m[schedule[7]]);
+        pal_blake3_g(state, 0, 5, 10, 15, m[schedule[8]], m[schedule[9]]);
+        pal_blake3_g(state, 1, 6, 11, 12, m[schedule[10]], m[schedule[11]]);
+        pal_blake3_g(state, 2, 7, 8, 13, m[schedule[12]], m[schedule[13]]);
+        pal_blake3_g(state, 3, 4, 9, 14, m[schedule[14]], m[schedule[15]]);
+    }
+
+    for (auto i = 0; i < 8; i++)
+    {
+        cv_out[i] = state[i] ^ state[i + 8];
+    }
+}
+
+// Hashes whole chunks in parallel, one chunk per vector lane. inputs_len is the degree of the kernel
+// and chunk i gets counter + i.
+typedef void(*pal_blake3_hash_many_fn)(const uint8_t* const* inputs, uint64_t counter, uint32_t (*cvs_out)[8]);
+
+#if defined(PAL_HASH_X86)
+PAL_HASH_TARGET("sse4.1")
+static inline __m128i pal_blake3_rotr16_sse41(const __m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+PAL_HASH_TARGET("sse4.1")
+static inline __m128i pal_blake3_rotr8_sse41(const __m128i x)
+{
+    return _mm_shuffle_epi8(x, _mm_set_epi8(12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+PAL_HASH_TARGET("sse4.1")
+static inline void pal_blake3_g_sse41(__m128i* v, const int a, const int b, const int c, const int d, const __m128i x, const __m128i y)
+{
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x);
+    v[d] = pal_blake3_rotr16_sse41(_mm_xor_si128(v[d], v[a]));
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = _mm_xor_si128(v[b], v[c]);
+    v[b] = _mm_or_si128(_mm_srli_epi32(v[b], 12), _mm_slli_epi32(v[b], 20));
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y);
+    v[d] = pal_blake3_rotr8_sse41(_mm_xor_si128(v[d], v[a]));
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = _mm_xor_si128(v[b], v[c]);
+    v[b] = _mm_or_si128(_mm_srli_epi32(v[b], 7), _mm_slli_epi32(v[b], 25));
+}
+
+// Turns four rows of four words (one row per lane) into four vectors holding word i of every lane.
+PAL_HASH_TARGET("sse4.1")
+static inline void pal_blake3_transpose4_sse41(const uint8_t* const* inputs, const size_t offset, __m128i* out)
+{
+    const auto r0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[0] + offset));
+    const auto r1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[1] + offset));
+    const auto r2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[2] + offset));
+    const auto r3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inputs[3] + offset));
+
+    const auto t0 = _mm_unpacklo_epi32(r0, r1);
+    const auto t1 = _mm_unpackhi_epi32(r0, r1);
+    const auto t2 = _mm_unpacklo_epi32(r2, r3);
+    const auto t3 = _mm_unpackhi_epi32(r2, r3);
+
+    out[0] = _mm_unpacklo_epi64(t0, t2);
+    out[1] = _mm_unpackhi_epi64(t0, t2);
+    out[2] = _mm_unpacklo_epi64(t1, t3);
+    out[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+PAL_HASH_TARGET("sse4.1")
+static void pal_blake3_hash4_sse41(const uint8_t* const* inputs, const uint64_t counter, uint32_t (*cvs_out)[8])
+{
+    __m128i h[8];
+    for (auto i = 0; i < 8; i++)
+    {
+        h[i] = _mm_set1_epi32(static_cast<int>(pal_blake3_iv[i]));
+    }
+
+    const auto counter_lo = _mm_set_epi32(
+        static_cast<int>(static_cast<uint32_t>(counter + 3)), static_cast<int>(static_cast<uint32_t>(counter + 2)),
+        static_cast<int>(static_cast<uint32_t>(counter + 1)), static_cast<int>(static_cast<uint32_t>(counter)));
+    const auto counter_hi = _mm_set_epi32(
+        static_cast<int>((counter + 3) >> 32), static_cast<int>((counter + 2) >> 32),
+        static_cast<int>((counter + 1) >> 32), static_cast<int>(counter >> 32));
+
+    for (size_t block = 0; block < pal_blake3_chunk_len / pal_blake3_block_len; block++)
+    {
+        __m128i m[16];
+        for (size_t i = 0; i < 4; i++)
+        {
+            pal_blake3_transpose4_sse41(inputs, block * pal_blake3_block_len + i * 16, &m[i * 4]);
+        }
+
+        const auto flags = (block == 0 ? pal_blake3_chunk_start : 0) | (block == 15 ? pal_blake3_chunk_end : 0);
+
+        __m128i v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            _mm_set1_epi32(static_cast<int>(pal_blake3_iv[0])), _mm_set1_epi32(static_cast<int>(pal_blake3_iv[1])),
+            _mm_set1_epi32(static_cast<int>(pal_blake3_iv[2])), _mm_set1_epi32(static_cast<int>(pal_blake3_iv[3])),
+            counter_lo, counter_hi,
+            _mm_set1_epi32(static_cast<int>(pal_blake3_block_len)), _mm_set1_epi32(static_cast<int>(flags))
+        };
+
+        for (const auto& s : pal_blake3_schedule)
+        {
+            pal_blake3_g_sse41(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            pal_blake3_g_sse41(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            pal_blake3_g_sse41(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            pal_blake3_g_sse41(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            pal_blake3_g_sse41(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            pal_blake3_g_sse41(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            pal_blake3_g_sse41(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            pal_blake3_g_sse41(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+
+        for (auto i = 0; i < 8; i++)
+        {
+            h[i] = _mm_xor_si128(v[i], v[i + 8]);
+        }
+    }
+
+    alignas(16) uint32_t words[8][4];
+    for (auto i = 0; i < 8; i++)
+    {
+        _mm_store_si128(reinterpret_cast<__m128i*>(words[i]), h[i]);
+    }
+
+    for (auto lane = 0; lane < 4; lane++)
+    {
+        for (auto i = 0; i < 8; i++)
+        {
+            cvs_out[lane][i] = words[i][lane];
+        }
+    }
+}
+
+PAL_HASH_TARGET("avx2")
+static inline __m256i pal_blake3_rotr16_avx2(const __m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_set_epi8(
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+        13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+PAL_HASH_TARGET("avx2")
+static inline __m256i pal_blake3_rotr8_avx2(const __m256i x)
+{
+    return _mm256_shuffle_epi8(x, _mm256_set_epi8(
+        12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1,
+        12, 15, 14, 13, 8, 11, 10, 9, 4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+PAL_HASH_TARGET("avx2")
+static inline void pal_blake3_g_avx2(__m256i* v, const int a, const int b, const int c, const int d, const __m256i x, const __m256i y)
+{
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), x);
+    v[d] = pal_blake3_rotr16_avx2(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = _mm256_xor_si256(v[b], v[c]);
+    v[b] = _mm256_or_si256(_mm256_srli_epi32(v[b], 12), _mm256_slli_epi32(v[b], 20));
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), y);
+    v[d] = pal_blake3_rotr8_avx2(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = _mm256_xor_si256(v[b], v[c]);
+    v[b] = _mm256_or_si256(_mm256_srli_epi32(v[b], 7), _mm256_slli_epi32(v[b], 25));
+}
+
+PAL_HASH_TARGET("avx2")
+static void pal_blake3_hash8_avx2(const uint8_t* const* inputs, const uint64_t counter, uint32_t (*cvs_out)[8])
+{
+    __m256i h[8];
+    for (auto i = 0; i < 8; i++)
+    {
+        h[i] = _mm256_set1_epi32(static_cast<int>(pal_blake3_iv[i]));
+    }
+
+    alignas(32) uint32_t counters_lo[8];
+    alignas(32) uint32_t counters_hi[8];
+    for (size_t lane = 0; lane < 8; lane++)
+    {
+        counters_lo[lane] = static_cast<uint32_t>(counter + lane);
+        counters_hi[lane] = static_cast<uint32_t>((counter + lane) >> 32);
+    }
+    const auto counter_lo = _mm256_load_si256(reinterpret_cast<const __m256i*>(counters_lo));
+    const auto counter_hi = _mm256_load_si256(reinterpret_cast<const __m256i*>(counters_hi));
+
+    for (size_t block = 0; block < pal_blake3_chunk_len / pal_blake3_block_len; block++)
+    {
+        __m256i m[16];
+        for (size_t i = 0; i < 4; i++)
+        {
+            __m128i lo[4];
+            __m128i hi[4];
+            pal_blake3_transpose4_sse41(inputs, block * pal_blake3_block_len + i * 16, lo);
+            pal_blake3_transpose4_sse41(inputs + 4, block * pal_blake3_block_len + i * 16, hi);
+            for (size_t j = 0; j < 4; j++)
+            {
+                m[i * 4 + j] = _mm256_inserti128_si256(_mm256_castsi128_si256(lo[j]), hi[j], 1);
+            }
+        }
+
+        const auto flags = (block == 0 ? pal_blake3_chunk_start : 0) | (block == 15 ? pal_blake3_chunk_end : 0);
+
+        __m256i v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            _mm256_set1_epi32(static_cast<int>(pal_blake3_iv[0])), _mm256_set1_epi32(static_cast<int>(pal_blake3_iv[1])),
+            _mm256_set1_epi32(static_cast<int>(pal_blake3_iv[2])), _mm256_set1_epi32(static_cast<int>(pal_blake3_iv[3])),
+            counter_lo, counter_hi,
+            _mm256_set1_epi32(static_cast<int>(pal_blake3_block_len)), _mm256_set1_epi32(static_cast<int>(flags))
+        };
+
+        for (const auto& s : pal_blake3_schedule)
+        {
+            pal_blake3_g_avx2(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            pal_blake3_g_avx2(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            pal_blake3_g_avx2(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            pal_blake3_g_avx2(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            pal_blake3_g_avx2(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            pal_blake3_g_avx2(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            pal_blake3_g_avx2(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            pal_blake3_g_avx2(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+
+        for (auto i = 0; i < 8; i++)
+        {
+            h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        }
+    }
+
+    alignas(32) uint32_t words[8][8];
+    for (auto i = 0; i < 8; i++)
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), h[i]);
+    }
+
+    for (auto lane = 0; lane < 8; lane++)
+    {
+        for (auto i = 0; i < 8; i++)
+        {
+            cvs_out[lane][i] = words[i][lane];
+        }
+    }
+}
+#endif
+
+#if defined(PAL_HASH_ARM64)
+static inline uint32x4_t pal_blake3_rotr_neon(const uint32x4_t x, const int bits)
+{
+    switch (bits)
+    {
+    case 16:
+        return vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(x)));
+    case 12:
+        return vsriq_n_u32(vshlq_n_u32(x, 20), x, 12);
+    case 8:
+        return vsriq_n_u32(vshlq_n_u32(x, 24), x, 8);
+    default:
+        return vsriq_n_u32(vshlq_n_u32(x, 25), x, 7);
+    }
+}
+
+static inline void pal_blake3_g_neon(uint32x4_t* v, const int a, const int b, const int c, const int d, const uint32x4_t x, const uint32x4_t y)
+{
+    v[a] = vaddq_u32(vaddq_u32(v[a], v[b]), x);
+    v[d] = pal_blake3_rotr_neon(veorq_u32(v[d], v[a]), 16);
+    v[c] = vaddq_u32(v[c], v[d]);
+    v[b] = pal_blake3_rotr_neon(veorq_u32(v[b], v[c]), 12);
+    v[a] = vaddq_u32(vaddq_u32(v[a], v[b]), y);
+    v[d] = pal_blake3_rotr_neon(veorq_u32(v[d], v[a]), 8);
+    v[c] = vaddq_u32(v[c], v[d]);
+    v[b] = pal_blake3_rotr_neon(veorq_u32(v[b], v[c]), 7);
+}
+
+static inline void pal_blake3_transpose4_neon(const uint8_t* const* inputs, const size_t offset, uint32x4_t* out)
+{
+    const auto t01 = vtrnq_u32(vreinterpretq_u32_u8(vld1q_u8(inputs[0] + offset)), vreinterpretq_u32_u8(vld1q_u8(inputs[1] + offset)));
+    const auto t23 = vtrnq_u32(vreinterpretq_u32_u8(vld1q_u8(inputs[2] + offset)), vreinterpretq_u32_u8(vld1q_u8(inputs[3] + offset)));
+
+    out[0] = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+    out[1] = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+    out[2] = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+    out[3] = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+}
+
+static void pal_blake3_hash4_neon(const uint8_t* const* inputs, const uint64_t counter, uint32_t (*cvs_out)[8])
+{
+    uint32x4_t h[8];
+    for (auto i = 0; i < 8; i++)
+    {
+        h[i] = vdupq_n_u32(pal_blake3_iv[i]);
+    }
+
+    const uint32_t counters_lo[4] = {
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter + 1),
+        static_cast<uint32_t>(counter + 2), static_cast<uint32_t>(counter + 3)
+    };
+    const uint32_t counters_hi[4] = {
+        static_cast<uint32_t>(counter >> 32), static_cast<uint32_t>((counter + 1) >> 32),
+        static_cast<uint32_t>((counter + 2) >> 32), static_cast<uint32_t>((counter + 3) >> 32)
+    };
+    const auto counter_lo = vld1q_u32(counters_lo);
+    const auto counter_hi = vld1q_u32(counters_hi);
+
+    for (size_t block = 0; block < pal_blake3_chunk_len / pal_blake3_block_len; block++)
+    {
+        uint32x4_t m[16];
+        for (auto i = 0; i < 4; i++)
+        {
+            pal_blake3_transpose4_neon(inputs, block * pal_blake3_block_len + i * 16, &m[i * 4]);
+        }
+
+        const auto flags = (block == 0 ? pal_blake3_chunk_start : 0) | (block == 15 ? pal_blake3_chunk_end : 0);
+
+        uint32x4_t v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            vdupq_n_u32(pal_blake3_iv[0]), vdupq_n_u32(pal_blake3_iv[1]),
+            vdupq_n_u32(pal_blake3_iv[2]), vdupq_n_u32(pal_blake3_iv[3]),
+            counter_lo, counter_hi,
+            vdupq_n_u32(static_cast<uint32_t>(pal_blake3_block_len)), vdupq_n_u32(flags)
+        };
+
+        for (const auto& s : pal_blake3_schedule)
+        {
+            pal_blake3_g_neon(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            pal_blake3_g_neon(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            pal_blake3_g_neon(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            pal_blake3_g_neon(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            pal_blake3_g_neon(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            pal_blake3_g_neon(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            pal_blake3_g_neon(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            pal_blake3_g_neon(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+
+        for (auto i = 0; i < 8; i++)
+        {
+            h[i] = veorq_u32(v[i], v[i + 8]);
+        }
+    }
+
+    uint32_t words[8][4];
+    for (auto i = 0; i < 8; i++)
+    {
+        vst1q_u32(words[i], h[i]);
+    }
+
+    for (auto lane = 0; lane < 4; lane++)
+    {
+        for (auto i = 0; i < 8; i++)
+        {
+            cvs_out[lane][i] = words[i][lane];
+        }
+    }
+}
+#endif
+
+// Returns the widest kernel the cpu supports and its degree, or nullptr when chunks have to be
+// hashed one at a time.
+static pal_blake3_hash_many_fn pal_blake3_get_hash_many(size_t* degree_out, const char** name_out)
+{
+    const auto features = pal_hash_get_cpu_features();
+    PAL_UNUSED(features);
+
+#if defined(PAL_HASH_X86)
+    if (features.avx2)
+    {
+        *degree_out = 8;
+        *name_out = "avx2";
+        return pal_blake3_hash8_avx2;
+    }
+
+    if (features.sse41)
+    {
+        *degree_out = 4;
+        *name_out = "sse4.1";
+        return pal_blake3_hash4_sse41;
+    }
+#elif defined(PAL_HASH_ARM64)
+    if (features.neon)
+    {
+        *degree_out = 4;
+        *name_out = "neon";
+        return pal_blake3_hash4_neon;
+    }
+#endif
+
+    *degree_out = 1;
+    *name_out = "portable";
+    return nullptr;
+}
+
+static void pal_blake3_output_cv(const pal_blake3::output& output, uint32_t cv_out[8])
+{
+    pal_blake3_compress(output.cv, output.block, output.block_len, output.counter, output.flags, cv_out);
+}
+
+static pal_blake3::output pal_blake3_parent_output(const uint32_t left_cv[8], const uint32_t right_cv[8])
+{
+    pal_blake3::output output = {};
+    std::memcpy(output.cv, pal_blake3_iv, sizeof output.cv);
+    for (auto i = 0; i < 8; i++)
+    {
+        pal_hash_store32_le(output.block + i * 4, left_cv[i]);
+        pal_hash_store32_le(output.block + 32 + i * 4, right_cv[i]);
+    }
+    output.counter = 0;
+    output.block_len = pal_blake3_block_len;
+    output.flags = pal_blake3_parent;
+    return output;
+}
+
+pal_blake3::pal_blake3() :
+    m_chunk_cv{},
+    m_chunk_counter(0),
+    m_block{},
+    m_block_len(0),
+    m_blocks_compressed(0),
+    m_cv_stack{},
+    m_cv_stack_len(0)
+{
+    chunk_reset(0);
+}
+
+size_t pal_blake3::chunk_len() const
+{
+    return m_blocks_compressed * pal_blake3_block_len + m_block_len;
+}
+
+void pal_blake3::chunk_reset(const uint64_t chunk_counter)
+{
+    std::memcpy(m_chunk_cv, pal_blake3_iv, sizeof m_chunk_cv);
+    m_chunk_counter = chunk_counter;
+    m_block_len = 0;
+    m_blocks_compressed = 0;
+}
+
+// Compresses every block of the current chunk except the last one, which needs the chunk end flag
+// and, for single chunk inputs, the root flag.
+void pal_blake3::chunk_update(const uint8_t* data, size_t data_len)
+{
+    while (data_len > 0)
+    {
+        if (m_block_len == pal_blake3_block_len)
+        {
+            const auto flags = m_blocks_compressed == 0 ? pal_blake3_chunk_start : 0;
+            pal_blake3_compress(m_chunk_cv, m_block, pal_blake3_block_len, m_chunk_counter, flags, m_chunk_cv);
+            m_blocks_compressed++;
+            m_block_len = 0;
+        }
+
+        // Avoid the copy for blocks that are followed by more input.
+        if (m_block_len == 0 && data_len > pal_blake3_block_len)
+        {
+            const auto flags = m_blocks_compressed == 0 ? pal_blake3_chunk_start : 0;
+            pal_blake3_compress(m_chunk_cv, data, pal_blake3_block_len, m_chunk_counter, flags, m_chunk_cv);
+            m_blocks_compressed++;
+            data += pal_blake3_block_len;
+            data_len -= pal_blake3_block_len;
+            continue;
+        }
+
+        const auto take = std::min(pal_blake3_block_len - m_block_len, data_len);
+        std::memcpy(m_block + m_block_len, data, take);
+        m_block_len += take;
+        data += take;
+        data_len -= take;
+    }
+}
+
+pal_blake3::output pal_blake3::chunk_output() const
+{
+    output output = {};
+    std::memcpy(output.cv, m_chunk_cv, sizeof output.cv);
+    std::memcpy(output.block, m_block, m_block_len);
+    output.counter = m_chunk_counter;
+    output.block_len = static_cast<uint32_t>(m_block_len);
+    output.flags = (m_blocks_compressed == 0 ? pal_blake3_chunk_start : 0) | pal_blake3_chunk_end;
+    return output;
+}
+
+// Merges completed subtrees: every trailing zero bit of total_chunks means a subtree on the stack
+// now has a right sibling of equal size.
+void pal_blake3::push_chunk_cv(const uint32_t cv[8], uint64_t total_chunks)
+{
+    uint32_t merged_cv[8];
+    std::memcpy(merged_cv, cv, sizeof merged_cv);
+
+    while ((total_chunks & 1) == 0)
+    {
+        m_cv_stack_len--;
+        pal_blake3_output_cv(pal_blake3_parent_output(m_cv_stack[m_cv_stack_len], merged_cv), merged_cv);
+        total_chunks >>= 1;
+    }
+
+    std::memcpy(m_cv_stack[m_cv_stack_len], merged_cv, sizeof merged_cv);
+    m_cv_stack_len++;
+}
+
+void pal_blake3::update(const uint8_t* data, size_t data_len)
+{
+    size_t degree;
+    const char* name;
+    const auto hash_many = pal_blake3_get_hash_many(&degree, &name);
+
+    while (data_len > 0)
+    {
+        // A full chunk is only finalized once more input arrives, the last chunk may be the root.
+        if (chunk_len() == pal_blake3_chunk_len)
+        {
+            uint32_t cv[8];
+            pal_blake3_output_cv(chunk_output(), cv);
+            push_chunk_cv(cv, m_chunk_counter + 1);
+            chunk_reset(m_chunk_counter + 1);
+        }
+
+        if (hash_many != nullptr
+            && chunk_len() == 0
+            && data_len > degree * pal_blake3_chunk_len)
+        {
+            const uint8_t* inputs[8];
+            uint32_t cvs[8][8];
+            for (auto i = 0u; i < degree; i++)
+            {
+                inputs[i] = data + i * pal_blake3_chunk_len;
+            }
+
+            hash_many(inputs, m_chunk_counter, cvs);
+
+            for (auto i = 0u; i < degree; i++)
+            {
+                push_chunk_cv(cvs[i], m_chunk_counter + 1);
+                m_chunk_counter++;
+            }
+
+            chunk_reset(m_chunk_counter);
+            data += degree * pal_blake3_chunk_len;
+            data_len -= degree * pal_blake3_chunk_len;
+            continue;
+        }
+
+        const auto take = std::min(pal_blake3_chunk_len - chunk_len(), data_len);
+        chunk_update(data, take);
+        data += take;
+        data_len -= take;
+    }
+}
+
+void pal_blake3::finalize(uint8_t digest_out[PAL_HASH_DIGEST_SIZE]) const
+{
+    auto output = chunk_output();
+
+    for (auto i = m_cv_stack_len; i > 0; i--)
+    {
+        uint32_t cv[8];
+        pal_blake3_output_cv(output, cv);
+        output = pal_blake3_parent_output(m_cv_stack[i - 1], cv);
+    }
+
+    uint32_t root_cv[8];
+    pal_blake3_compress(output.cv, output.block, output.block_len, 0, output.flags | pal_blake3_root, root_cv);
+
+    for (auto i = 0; i < 8; i++)
+    {
+        pal_hash_store32_le(digest_out + i * 4, root_cv[i]);
+    }
+}
+
+const char* pal_blake3::get_implementation()
+{
+    size_t degree;
+    const char* name;
+    pal_blake3_get_hash_many(&degree, &name);
+    return name;
+}
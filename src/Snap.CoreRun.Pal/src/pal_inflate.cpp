@@ -0,0 +1,583 @@
+#include "pal/pal.hpp"
+#include "pal/pal_inflate.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__aarch64__) && defined(__GNUC__) && defined(PAL_PLATFORM_LINUX)
+#define PAL_CRC32_ARM64
+#include <arm_acle.h>
+#include <sys/auxv.h> // getauxval
+#include <asm/hwcap.h> // HWCAP_CRC32
+#endif
+
+// - CRC-32
+
+// Slicing-by-8 tables: table[0] is the classic byte table, table[k] advances a byte that is followed by k zero bytes.
+struct pal_crc32_tables
+{
+    uint32_t table[8][256];
+
+    pal_crc32_tables() : table{}
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            auto crc = i;
+            for (auto bit = 0; bit < 8; bit++)
+            {
+                crc = crc & 1 ? crc >> 1 ^ 0xEDB88320u : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            for (auto k = 1; k < 8; k++)
+            {
+                table[k][i] = table[k - 1][i] >> 8 ^ table[0][table[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+static uint32_t pal_crc32_portable(uint32_t crc, const uint8_t* data, size_t data_len)
+{
+    static const pal_crc32_tables tables;
+    const auto& t = tables.table;
+
+    while (data_len >= 8)
+    {
+        const auto lo = crc ^ (static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8
+            | static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24);
+        crc = t[7][lo & 0xff] ^ t[6][lo >> 8 & 0xff] ^ t[5][lo >> 16 & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        data_len -= 8;
+    }
+
+    while (data_len-- > 0)
+    {
+        crc = crc >> 8 ^ t[0][(crc ^ *data++) & 0xff];
+    }
+
+    return crc;
+}
+
+#if defined(PAL_CRC32_ARM64)
+// The ARMv8 CRC32 instructions use the zip polynomial (unlike SSE4.2, which implements CRC-32C).
+__attribute__((target("+crc")))
+static uint32_t pal_crc32_armv8(uint32_t crc, const uint8_t* data, size_t data_len)
+{
+    while (data_len >= 8)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof value);
+        crc = __crc32d(crc, value);
+        data += 8;
+        data_len -= 8;
+    }
+
+    while (data_len-- > 0)
+    {
+        crc = __crc32b(crc, *data++);
+    }
+
+    return crc;
+}
+#endif
+
+uint32_t pal_crc32(uint32_t crc, const uint8_t* data, const size_t data_len)
+{
+    crc = ~crc;
+
+#if defined(PAL_CRC32_ARM64)
+    static const auto has_crc32 = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+    if (has_crc32)
+    {
+        return ~pal_crc32_armv8(crc, data, data_len);
+    }
+#endif
+
+    return ~pal_crc32_portable(crc, data, data_len);
+}
+
+// - Inflate
+
+static const unsigned pal_inflate_fast_bits = 10;
+static const size_t pal_inflate_history_len = 32768;
+static const size_t pal_inflate_flush_len = 1024 * 1024;
+static const size_t pal_inflate_max_match = 258;
+// Matches are copied 8 bytes at a time and may write this far past their end.
+static const size_t pal_inflate_copy_slack = 8;
+// Zero bits appended past the end of the input before the stream is considered truncated.
+static const unsigned pal_inflate_max_pad_bits = 128;
+
+static const uint16_t pal_inflate_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t pal_inflate_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t pal_inflate_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t pal_inflate_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+pal_inflate::pal_inflate() :
+    m_window(pal_inflate_history_len + pal_inflate_flush_len + pal_inflate_max_match + pal_inflate_copy_slack),
+    m_window_len(0),
+    m_window_flushed(0),
+    m_sink(nullptr),
+    m_user_data(nullptr),
+    m_sink_failed(false),
+    m_input(nullptr),
+    m_input_len(0),
+    m_input_pos(0),
+    m_bit_buffer(0),
+    m_bit_count(0),
+    m_pad_bits(0),
+    m_total_out(0),
+    m_fixed_litlen(),
+    m_fixed_dist(),
+    m_litlen(),
+    m_dist()
+{
+    uint8_t lengths[288];
+    std::fill(lengths, lengths + 144, static_cast<uint8_t>(8));
+    std::fill(lengths + 144, lengths + 256, static_cast<uint8_t>(9));
+    std::fill(lengths + 256, lengths + 280, static_cast<uint8_t>(7));
+    std::fill(lengths + 280, lengths + 288, static_cast<uint8_t>(8));
+    build(m_fixed_litlen, lengths, 288);
+
+    std::fill(lengths, lengths + 30, static_cast<uint8_t>(5));
+    build(m_fixed_dist, lengths, 30);
+}
+
+// Builds canonical Huffman decoding tables. Incomplete codes are accepted (a single distance code is
+// legal), unused bit patterns then fail to decode.
+bool pal_inflate::build(huffman& huffman_out, const uint8_t* lengths, const size_t lengths_len)
+{
+    std::memset(huffman_out.count, 0, sizeof huffman_out.count);
+    for (auto i = 0u; i < lengths_len; i++)
+    {
+        huffman_out.count[lengths[i]]++;
+    }
+    huffman_out.count[0] = 0;
+
+    auto left = 1;
+    for (auto len = 1; len < 16; len++)
+    {
+        left <<= 1;
+        left -= huffman_out.count[len];
+        if (left < 0)
+        {
+            return false;
+        }
+    }
+
+    uint16_t offsets[16] = {};
+    uint16_t next_code[16] = {};
+    for (auto len = 1; len < 15; len++)
+    {
+        offsets[len + 1] = static_cast<uint16_t>(offsets[len] + huffman_out.count[len]);
+    }
+
+    uint16_t code = 0;
+    for (auto len = 1; len < 16; len++)
+    {
+        code = static_cast<uint16_t>((code + huffman_out.count[len - 1]) << 1);
+        next_code[len] = code;
+    }
+
+    std::memset(huffman_out.fast, 0, sizeof huffman_out.fast);
+
+    for (auto symbol = 0u; symbol < lengths_len; symbol++)
+    {
+        const auto len = lengths[symbol];
+        if (len == 0)
+        {
+            continue;
+        }
+
+        huffman_out.symbol[offsets[len]++] = static_cast<uint16_t>(symbol);
+
+        const auto symbol_code = next_code[len]++;
+        if (len > pal_inflate_fast_bits)
+        {
+            continue;
+        }
+
+        // Deflate stores codes most significant bit first, the bit buffer is read from the least significant bit.
+        uint32_t reversed = 0;
+        for (auto bit = 0; bit < len; bit++)
+        {
+            reversed |= ((symbol_code >> bit) & 1u) << (len - 1 - bit);
+        }
+
+        for (auto index = reversed; index < (1u << pal_inflate_fast_bits); index += 1u << len)
+        {
+            huffman_out.fast[index] = static_cast<uint16_t>(symbol << 4 | len);
+        }
+    }
+
+    return true;
+}
+
+void pal_inflate::refill()
+{
+    while (m_bit_count <= 56)
+    {
+        if (m_input_pos < m_input_len)
+        {
+            m_bit_buffer |= static_cast<uint64_t>(m_input[m_input_pos++]) << m_bit_count;
+        }
+        else
+        {
+            m_pad_bits += 8;
+        }
+        m_bit_count += 8;
+    }
+}
+
+uint32_t pal_inflate::bits(const unsigned count)
+{
+    if (m_bit_count < count)
+    {
+        refill();
+    }
+
+    const auto value = static_cast<uint32_t>(m_bit_buffer & ((1ull << count) - 1));
+    m_bit_buffer >>= count;
+    m_bit_count -= count;
+    return value;
+}
+
+int pal_inflate::decode(const huffman& huffman_in)
+{
+    if (m_bit_count < 15)
+    {
+        refill();
+    }
+
+    const auto entry = huffman_in.fast[m_bit_buffer & ((1u << pal_inflate_fast_bits) - 1)];
+    if (entry != 0)
+    {
+        m_bit_buffer >>= entry & 15;
+        m_bit_count -= entry & 15;
+        return entry >> 4;
+    }
+
+    // Codes longer than the fast table, decoded one bit at a time.
+    auto code = 0;
+    auto first = 0;
+    auto index = 0;
+    for (auto len = 1u; len < 16; len++)
+    {
+        code |= static_cast<int>((m_bit_buffer >> (len - 1)) & 1);
+        const auto count = huffman_in.count[len];
+        if (code - count < first)
+        {
+            m_bit_buffer >>= len;
+            m_bit_count -= len;
+            return huffman_in.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return -1;
+}
+
+bool pal_inflate::flush(const bool final)
+{
+    if (m_window_len > m_window_flushed)
+    {
+        if (!m_sink(m_window.data() + m_window_flushed, m_window_len - m_window_flushed, m_user_data))
+        {
+            m_sink_failed = true;
+            return false;
+        }
+        m_window_flushed = m_window_len;
+    }
+
+    if (!final && m_window_len > pal_inflate_history_len)
+    {
+        std::memmove(m_window.data(), m_window.data() + m_window_len - pal_inflate_history_len, pal_inflate_history_len);
+        m_window_len = pal_inflate_history_len;
+        m_window_flushed = m_window_len;
+    }
+
+    return true;
+}
+
+bool pal_inflate::ensure_space(const size_t len)
+{
+    if (m_window_len + len <= pal_inflate_history_len + pal_inflate_flush_len + pal_inflate_max_match)
+    {
+        return true;
+    }
+    return flush(false);
+}
+
+bool pal_inflate::stored_block()
+{
+    // Discard the rest of the current byte and hand whole bytes that were already buffered back to the input.
+    m_bit_buffer >>= m_bit_count & 7;
+    m_bit_count -= m_bit_count & 7;
+    if (m_pad_bits > m_bit_count)
+    {
+        return false;
+    }
+    m_input_pos -= (m_bit_count - m_pad_bits) / 8;
+    m_bit_buffer = 0;
+    m_bit_count = 0;
+    m_pad_bits = 0;
+
+    if (m_input_len - m_input_pos < 4)
+    {
+        return false;
+    }
+
+    const auto* const header = m_input + m_input_pos;
+    const auto len = static_cast<size_t>(header[0] | header[1] << 8);
+    const auto nlen = static_cast<size_t>(header[2] | header[3] << 8);
+    m_input_pos += 4;
+
+    if (len != (~nlen & 0xffff)
+        || m_input_len - m_input_pos < len)
+    {
+        return false;
+    }
+
+    for (size_t done = 0; done < len;)
+    {
+        if (!ensure_space(pal_inflate_max_match))
+        {
+            return false;
+        }
+
+        const auto chunk = std::min(len - done, pal_inflate_max_match);
+        std::memcpy(m_window.data() + m_window_len, m_input + m_input_pos + done, chunk);
+        m_window_len += chunk;
+        done += chunk;
+    }
+
+    m_input_pos += len;
+    m_total_out += len;
+    return true;
+}
+
+bool pal_inflate::dynamic_tables()
+{
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    const auto litlen_len = bits(5) + 257;
+    const auto dist_len = bits(5) + 1;
+    const auto codelen_len = bits(4) + 4;
+    if (litlen_len > 286 || dist_len > 30)
+    {
+        return false;
+    }
+
+    uint8_t lengths[286 + 30] = {};
+    for (auto i = 0u; i < codelen_len; i++)
+    {
+        lengths[order[i]] = static_cast<uint8_t>(bits(3));
+    }
+
+    huffman codelen;
+    if (!build(codelen, lengths, 19))
+    {
+        return false;
+    }
+
+    std::memset(lengths, 0, sizeof lengths);
+    for (auto index = 0u; index < litlen_len + dist_len;)
+    {
+        if (m_pad_bits > pal_inflate_max_pad_bits)
+        {
+            return false;
+        }
+
+        const auto symbol = decode(codelen);
+        if (symbol < 0)
+        {
+            return false;
+        }
+
+        if (symbol < 16)
+        {
+            lengths[index++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+
+        uint8_t value = 0;
+        unsigned repeat;
+        if (symbol == 16)
+        {
+            if (index == 0)
+            {
+                return false;
+            }
+            value = lengths[index - 1];
+            repeat = 3 + bits(2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + bits(3);
+        }
+        else
+        {
+            repeat = 11 + bits(7);
+        }
+
+        if (index + repeat > litlen_len + dist_len)
+        {
+            return false;
+        }
+
+        while (repeat-- > 0)
+        {
+            lengths[index++] = value;
+        }
+    }
+
+    // A block without an end of block code could never terminate.
+    if (lengths[256] == 0)
+    {
+        return false;
+    }
+
+    return build(m_litlen, lengths, litlen_len)
+        && build(m_dist, lengths + litlen_len, dist_len);
+}
+
+bool pal_inflate::codes(const huffman& litlen, const huffman& dist)
+{
+    while (true)
+    {
+        if (m_pad_bits > pal_inflate_max_pad_bits
+            || !ensure_space(pal_inflate_max_match))
+        {
+            return false;
+        }
+
+        // Longest symbol: 15 bit length code + 5 extra bits + 15 bit distance code + 13 extra bits.
+        if (m_bit_count < 48)
+        {
+            refill();
+        }
+
+        const auto symbol = decode(litlen);
+        if (symbol < 0)
+        {
+            return false;
+        }
+
+        if (symbol < 256)
+        {
+            m_window[m_window_len++] = static_cast<uint8_t>(symbol);
+            m_total_out++;
+            continue;
+        }
+
+        if (symbol == 256)
+        {
+            return true;
+        }
+
+        const auto length_index = symbol - 257;
+        if (length_index >= 29)
+        {
+            return false;
+        }
+
+        const size_t length = pal_inflate_length_base[length_index] + bits(pal_inflate_length_extra[length_index]);
+
+        const auto dist_index = decode(dist);
+        if (dist_index < 0 || dist_index >= 30)
+        {
+            return false;
+        }
+
+        const size_t distance = pal_inflate_dist_base[dist_index] + bits(pal_inflate_dist_extra[dist_index]);
+        if (distance > m_window_len)
+        {
+            return false;
+        }
+
+        auto* out = m_window.data() + m_window_len;
+        const auto* from = out - distance;
+        if (distance >= pal_inflate_copy_slack)
+        {
+            for (size_t i = 0; i < length; i += pal_inflate_copy_slack)
+            {
+                std::memcpy(out + i, from + i, pal_inflate_copy_slack);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                out[i] = from[i];
+            }
+        }
+
+        m_window_len += length;
+        m_total_out += length;
+    }
+}
+
+bool pal_inflate::run(const uint8_t* input, const size_t input_len, const sink_t sink, void* user_data)
+{
+    m_window_len = 0;
+    m_window_flushed = 0;
+    m_sink = sink;
+    m_user_data = user_data;
+    m_sink_failed = false;
+    m_input = input;
+    m_input_len = input_len;
+    m_input_pos = 0;
+    m_bit_buffer = 0;
+    m_bit_count = 0;
+    m_pad_bits = 0;
+    m_total_out = 0;
+
+    auto last = false;
+    while (!last)
+    {
+        last = bits(1) == 1;
+        const auto type = bits(2);
+
+        auto success = false;
+        switch (type)
+        {
+        case 0:
+            success = stored_block();
+            break;
+        case 1:
+            success = codes(m_fixed_litlen, m_fixed_dist);
+            break;
+        case 2:
+            success = dynamic_tables() && codes(m_litlen, m_dist);
+            break;
+        default:
+            break;
+        }
+
+        if (!success || m_pad_bits > m_bit_count)
+        {
+            return false;
+        }
+    }
+
+    // Report how much input the stream actually used, whole buffered bytes were read ahead.
+    m_input_pos -= (m_bit_count - m_pad_bits) / 8;
+
+    return flush(true);
+}
@@ -0,0 +1,173 @@
+#include "pal/pal.hpp"
+#include "pal/pal_io_uring.hpp"
+
+#if defined(PAL_IO_URING_SUPPORTED)
+
+#include <sys/mman.h> // mmap
+#include <sys/syscall.h> // SYS_io_uring_setup
+#include <unistd.h> // syscall
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+pal_io_uring::pal_io_uring() :
+    m_ring_fd(-1),
+    m_sq_ring(MAP_FAILED),
+    m_sq_ring_size(0),
+    m_cq_ring(MAP_FAILED),
+    m_cq_ring_size(0),
+    m_sqes(nullptr),
+    m_sqes_size(0),
+    m_sq_head(nullptr),
+    m_sq_tail(nullptr),
+    m_sq_mask(nullptr),
+    m_sq_array(nullptr),
+    m_cq_head(nullptr),
+    m_cq_tail(nullptr),
+    m_cq_mask(nullptr),
+    m_cqes(nullptr),
+    m_sq_entries(0),
+    m_sq_tail_local(0),
+    m_queued(0)
+{
+}
+
+pal_io_uring::~pal_io_uring() {
+    if (m_sqes != nullptr) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) {
+        munmap(m_cq_ring, m_cq_ring_size);
+    }
+    if (m_sq_ring != MAP_FAILED) {
+        munmap(m_sq_ring, m_sq_ring_size);
+    }
+    if (m_ring_fd != -1) {
+        close(m_ring_fd);
+    }
+}
+
+int pal_io_uring::try_create(const unsigned entries) {
+    io_uring_params params = {};
+    const auto ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd < 0) {
+        return errno;
+    }
+    m_ring_fd = ring_fd;
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    // Since 5.4 both rings share a single mapping.
+    const auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+    }
+
+    m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     m_ring_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED) {
+        return errno;
+    }
+
+    if (single_mmap) {
+        m_cq_ring = m_sq_ring;
+    } else {
+        m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ring_fd, IORING_OFF_CQ_RING);
+        if (m_cq_ring == MAP_FAILED) {
+            return errno;
+        }
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto* const sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            m_ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return errno;
+    }
+    m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+    auto* const sq_ring = static_cast<char*>(m_sq_ring);
+    m_sq_head = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.tail);
+    m_sq_mask = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(sq_ring + params.sq_off.array);
+
+    auto* const cq_ring = static_cast<char*>(m_cq_ring);
+    m_cq_head = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.tail);
+    m_cq_mask = reinterpret_cast<unsigned*>(cq_ring + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+
+    m_sq_entries = params.sq_entries;
+    m_sq_tail_local = *m_sq_tail;
+
+    return 0;
+}
+
+unsigned pal_io_uring::sq_space_left() const {
+    return m_sq_entries - (m_sq_tail_local - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE));
+}
+
+io_uring_sqe* pal_io_uring::get_sqe() {
+    if (sq_space_left() == 0) {
+        return nullptr;
+    }
+
+    const auto index = m_sq_tail_local & *m_sq_mask;
+    auto* const sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+
+    m_sq_array[index] = index;
+    m_sq_tail_local++;
+    m_queued++;
+
+    return sqe;
+}
+
+int pal_io_uring::submit_and_wait(const unsigned wait_nr) {
+    // Publish the entries written by get_sqe before the kernel can observe the new tail.
+    __atomic_store_n(m_sq_tail, m_sq_tail_local, __ATOMIC_RELEASE);
+
+    auto to_submit = m_queued;
+    while (true) {
+        const auto flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0u;
+        const auto submitted = syscall(__NR_io_uring_enter, m_ring_fd, to_submit, wait_nr, flags, nullptr, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+
+        to_submit -= std::min(to_submit, static_cast<unsigned>(submitted));
+        m_queued = to_submit;
+        return 0;
+    }
+}
+
+int pal_io_uring::wait_cqe() {
+    while (0 > syscall(__NR_io_uring_enter, m_ring_fd, 0u, 1u, IORING_ENTER_GETEVENTS, nullptr, 0)) {
+        if (errno != EINTR) {
+            return errno;
+        }
+    }
+    return 0;
+}
+
+bool pal_io_uring::pop_cqe(uint64_t* user_data_out, int* res_out) {
+    const auto head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    const auto* const cqe = &m_cqes[head & *m_cq_mask];
+    *user_data_out = cqe->user_data;
+    *res_out = cqe->res;
+
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include "pal/pal.hpp"
+#include "pal/pal_mmap.hpp"
+
+#if defined(PAL_PLATFORM_LINUX)
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <cerrno>
+#endif
+
+pal_mapped_file::pal_mapped_file() :
+    m_data(nullptr),
+    m_size(0)
+#if defined(PAL_PLATFORM_WINDOWS)
+    , m_mapping(nullptr)
+#endif
+{
+}
+
+pal_mapped_file::~pal_mapped_file() {
+#if defined(PAL_PLATFORM_WINDOWS)
+    if (m_data != nullptr) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping != nullptr) {
+        CloseHandle(m_mapping);
+    }
+#elif defined(PAL_PLATFORM_LINUX)
+    if (m_data != nullptr) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+#endif
+}
+
+int pal_mapped_file::try_open(const char* filename_in, const bool sequential) {
+    if (filename_in == nullptr || m_data != nullptr) {
+#if defined(PAL_PLATFORM_WINDOWS)
+        return ERROR_INVALID_PARAMETER;
+#else
+        return EINVAL;
+#endif
+    }
+
+#if defined(PAL_PLATFORM_WINDOWS)
+    pal_utf16_string filename_utf16_string(filename_in);
+
+    auto* const h_file = CreateFile(filename_utf16_string.data(),
+                                    GENERIC_READ,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr,
+                                    OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : 0),
+                                    nullptr);
+    if (h_file == INVALID_HANDLE_VALUE) {
+        return static_cast<int>(GetLastError());
+    }
+
+    LARGE_INTEGER file_size = {};
+    if (0 == GetFileSizeEx(h_file, &file_size)) {
+        const auto error = static_cast<int>(GetLastError());
+        CloseHandle(h_file);
+        return error;
+    }
+
+    if (static_cast<unsigned long long>(file_size.QuadPart) > SIZE_MAX) {
+        CloseHandle(h_file);
+        return ERROR_FILE_TOO_LARGE;
+    }
+
+    if (file_size.QuadPart == 0) {
+        CloseHandle(h_file);
+        return 0;
+    }
+
+    // The mapping keeps the file open, the file handle itself is no longer needed.
+    m_mapping = CreateFileMapping(h_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const auto mapping_error = static_cast<int>(GetLastError());
+    CloseHandle(h_file);
+    if (m_mapping == nullptr) {
+        return mapping_error;
+    }
+
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr) {
+        return static_cast<int>(GetLastError());
+    }
+
+    m_size = static_cast<size_t>(file_size.QuadPart);
+    return 0;
+#elif defined(PAL_PLATFORM_LINUX)
+    const auto fd = open(filename_in, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+
+    struct stat st = {};
+    if (0 != fstat(fd, &st)) {
+        const auto error = errno;
+        close(fd);
+        return error;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return ENODEV;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const auto size = static_cast<size_t>(st.st_size);
+    auto* const mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    const auto mapping_error = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return mapping_error;
+    }
+
+    if (sequential) {
+        madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+
+    m_data = static_cast<const uint8_t*>(mapping);
+    m_size = size;
+    return 0;
+#else
+    PAL_UNUSED(sequential);
+    return -1;
+#endif
+}
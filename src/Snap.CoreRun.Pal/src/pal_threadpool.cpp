@@ -0,0 +1,213 @@
+#include "pal/pal.hpp"
+#include "pal/pal_threadpool.hpp"
+
+namespace
+{
+    // Lets submit and wait find the queue owned by the calling worker.
+    thread_local const pal_threadpool* tls_threadpool = nullptr;
+    thread_local size_t tls_worker_index = 0;
+}
+
+pal_wait_group::pal_wait_group() :
+    m_count(0)
+{
+}
+
+void pal_wait_group::add()
+{
+    ++m_count;
+}
+
+bool pal_wait_group::done()
+{
+    return --m_count == 0;
+}
+
+bool pal_wait_group::is_done() const
+{
+    return m_count.load() == 0;
+}
+
+pal_threadpool::pal_threadpool(const size_t worker_count) :
+    m_worker_count(std::max<size_t>(1, worker_count)),
+    m_queues(),
+    m_workers(),
+    m_queued(0),
+    m_steal_offset(0),
+    m_sleep_mutex(),
+    m_sleep_condition(),
+    m_wait_condition(),
+    m_stopping(false)
+{
+    for (auto i = 0u; i <= m_worker_count; i++)
+    {
+        m_queues.emplace_back(std::make_unique<task_queue>());
+    }
+
+    m_workers.reserve(m_worker_count);
+
+    try
+    {
+        for (auto i = 0u; i < m_worker_count; i++)
+        {
+            m_workers.emplace_back(&pal_threadpool::worker_main, this, i);
+        }
+    }
+    catch (...)
+    {
+        // The destructor does not run when the constructor throws, so join the workers that did start.
+        stop();
+        throw;
+    }
+}
+
+pal_threadpool::~pal_threadpool()
+{
+    stop();
+}
+
+void pal_threadpool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stopping = true;
+    }
+
+    m_sleep_condition.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+size_t pal_threadpool::get_worker_count() const
+{
+    return m_worker_count;
+}
+
+void pal_threadpool::submit(const callback_t callback, void* user_data, pal_wait_group* wait_group)
+{
+    if (wait_group != nullptr)
+    {
+        wait_group->add();
+    }
+
+    const auto queue_index = tls_threadpool == this ? tls_worker_index : m_worker_count;
+    auto& queue = *m_queues[queue_index];
+
+    // Counted before the task is visible, so that the pop of a concurrent thread cannot decrement first.
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        ++m_queued;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ callback, user_data, wait_group });
+    }
+
+    m_sleep_condition.notify_one();
+    m_wait_condition.notify_all();
+}
+
+void pal_threadpool::wait(pal_wait_group& wait_group)
+{
+    const auto own_index = tls_threadpool == this ? tls_worker_index : m_worker_count;
+
+    while (!wait_group.is_done())
+    {
+        task task_next;
+        if (try_pop(own_index, task_next))
+        {
+            run(task_next);
+            continue;
+        }
+
+        // The remaining tasks are running elsewhere, sleep until they complete or queue nested work.
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wait_condition.wait(lock, [this, &wait_group] { return wait_group.is_done() || m_queued.load() > 0; });
+    }
+}
+
+void pal_threadpool::worker_main(const size_t index)
+{
+    tls_threadpool = this;
+    tls_worker_index = index;
+
+    while (true)
+    {
+        task task_next;
+        if (try_pop(index, task_next))
+        {
+            run(task_next);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_sleep_condition.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+
+        if (m_stopping && m_queued.load() == 0)
+        {
+            break;
+        }
+    }
+
+    tls_threadpool = nullptr;
+}
+
+bool pal_threadpool::try_pop(const size_t own_index, task& task_out)
+{
+    // Newest task from our own queue first, it is the most likely to be cache hot.
+    if (own_index < m_worker_count)
+    {
+        auto& queue = *m_queues[own_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task_out = queue.tasks.back();
+            queue.tasks.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+
+    // Then the oldest task of the injection queue and of the other workers. Threads outside the pool
+    // own no queue and take from the injection queue as well.
+    const auto queues_len = m_queues.size();
+    const auto offset = m_steal_offset++;
+    for (auto i = 0u; i < queues_len; i++)
+    {
+        const auto queue_index = (queues_len - 1 + offset + i) % queues_len;
+        if (queue_index == own_index && own_index < m_worker_count)
+        {
+            continue;
+        }
+
+        auto& queue = *m_queues[queue_index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task_out = queue.tasks.front();
+            queue.tasks.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void pal_threadpool::run(const task& task)
+{
+    task.callback(task.user_data);
+
+    if (task.wait_group != nullptr && task.wait_group->done())
+    {
+        // Taking the mutex orders the wakeup after the predicate check of a waiter that is about to sleep.
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        }
+        m_wait_condition.notify_all();
+    }
+}
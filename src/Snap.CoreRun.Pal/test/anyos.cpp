@@ -1,7 +1,10 @@
 #include "gtest/gtest.h"
 #include "pal/pal.hpp"
+#include "pal/pal_hash.hpp"
 #include "nlohmann/json.hpp"
 #include "tests/support/utils.hpp"
+#include <atomic>
+#include <thread>
 
 using json = nlohmann::json;
 using testutils = corerun::support::util::test_utils;
@@ -116,6 +119,183 @@ namespace
         EXPECT_TRUE(pal_process_is_running(pid));
     }
 
+    TEST(PAL_GENERIC, pal_process_is_running_batch_DoesNotSegfault)
+    {
+        uint64_t start_time = 0;
+        EXPECT_TRUE(pal_process_is_running_batch(nullptr, nullptr, 0, nullptr));
+        EXPECT_FALSE(pal_process_is_running_batch(nullptr, nullptr, 1, nullptr));
+        EXPECT_FALSE(pal_process_get_start_time(0, nullptr));
+        EXPECT_FALSE(pal_process_get_start_time(0x7ffffff0, &start_time));
+    }
+
+    TEST(PAL_GENERIC, pal_process_is_running_batch_DetectsReusedPids)
+    {
+        pal_pid_t pid;
+        ASSERT_TRUE(pal_process_get_pid(&pid));
+
+        uint64_t start_time = 0;
+        ASSERT_TRUE(pal_process_get_start_time(pid, &start_time));
+        EXPECT_NE(start_time, 0u);
+
+        // Bits 0 and 2 are this process, bit 1 a pid that is not in use, bit 3 this process with a
+        // start time of an earlier owner of the pid, and bits 8 and 9 are in the second byte.
+        const pal_pid_t pids[] = { pid, 0x7ffffff0, pid, pid, 0x7ffffff0, 0x7ffffff0, 0x7ffffff0, 0x7ffffff0, pid, pid };
+        const uint64_t start_times[] = { start_time, 0, 0, start_time - 1, 0, 0, 0, 0, 0, start_time };
+        uint8_t running[2] = { 0xff, 0xff };
+
+        ASSERT_TRUE(pal_process_is_running_batch(pids, start_times, 10, running));
+        EXPECT_EQ(running[0], 0x05);
+        EXPECT_EQ(running[1], 0x03);
+
+        ASSERT_TRUE(pal_process_is_running_batch(pids, nullptr, 10, running));
+        EXPECT_EQ(running[0], 0x0d);
+        EXPECT_EQ(running[1], 0x03);
+    }
+
+    TEST(PAL_GENERIC, pal_process_sampler_DoesNotSegfault)
+    {
+        pal_process_sample_t sample = {};
+        BOOL exited = FALSE;
+        EXPECT_FALSE(pal_process_sampler_create(0, nullptr));
+        EXPECT_FALSE(pal_process_sampler_sample(nullptr, &sample));
+        EXPECT_FALSE(pal_process_sampler_free(nullptr));
+        EXPECT_FALSE(pal_process_wait_exit(0, 0, nullptr));
+        EXPECT_TRUE(pal_process_wait_exit(0x7ffffff0, 0, &exited));
+        EXPECT_TRUE(exited);
+    }
+
+    TEST(PAL_GENERIC, pal_process_sampler_ComputesDeltas)
+    {
+        pal_pid_t pid;
+        ASSERT_TRUE(pal_process_get_pid(&pid));
+
+        pal_process_sampler_t* sampler = nullptr;
+        ASSERT_TRUE(pal_process_sampler_create(pid, &sampler));
+
+        pal_process_sample_t first = {};
+        ASSERT_TRUE(pal_process_sampler_sample(sampler, &first));
+        EXPECT_EQ(first.interval_us, 0u);
+        EXPECT_EQ(first.cpu_permille, 0u);
+        EXPECT_GT(first.rss_bytes, 0u);
+        EXPECT_GE(first.vm_bytes, first.rss_bytes);
+        if (pal_is_linux())
+        {
+            EXPECT_GE(first.threads_count, 1u);
+        }
+
+        // Burn enough cpu time to be visible with a 10 ms clock tick.
+        const auto started = std::chrono::steady_clock::now();
+        volatile uint64_t spin = 0;
+        while (std::chrono::steady_clock::now() - started < std::chrono::milliseconds(100))
+        {
+            spin = spin + 1;
+        }
+
+        pal_process_sample_t second = {};
+        ASSERT_TRUE(pal_process_sampler_sample(sampler, &second));
+        EXPECT_GE(second.interval_us, 100000u);
+        EXPECT_EQ(second.interval_us, second.timestamp_us - first.timestamp_us);
+        EXPECT_GT(second.user_time_us + second.system_time_us, first.user_time_us + first.system_time_us);
+        EXPECT_GT(second.cpu_permille, 0u);
+
+        BOOL exited = TRUE;
+        ASSERT_TRUE(pal_process_wait_exit(pid, 10, &exited));
+        EXPECT_FALSE(exited);
+
+        ASSERT_TRUE(pal_process_sampler_free(sampler));
+    }
+
+    TEST(PAL_GENERIC, pal_watchdog_DoesNotSegfault)
+    {
+        pal_watchdog_t* watchdog = nullptr;
+        uint64_t beats = 0;
+        EXPECT_FALSE(pal_watchdog_open(nullptr, &watchdog));
+        EXPECT_FALSE(pal_watchdog_open("corerun-tests", nullptr));
+        EXPECT_FALSE(pal_watchdog_beat(nullptr));
+        EXPECT_FALSE(pal_watchdog_read(nullptr, &beats));
+        EXPECT_FALSE(pal_watchdog_free(nullptr));
+    }
+
+    TEST(PAL_GENERIC, pal_watchdog_SharesBeatsBetweenHandles)
+    {
+        // The segment outlives the handles, so the counter continues from earlier test runs.
+        pal_watchdog_t* application = nullptr;
+        pal_watchdog_t* supervisor = nullptr;
+        ASSERT_TRUE(pal_watchdog_open("corerun/tests", &application));
+        ASSERT_TRUE(pal_watchdog_open("corerun/tests", &supervisor));
+
+        uint64_t beats_before = 0;
+        ASSERT_TRUE(pal_watchdog_read(supervisor, &beats_before));
+
+        for (auto i = 0; i < 3; i++)
+        {
+            ASSERT_TRUE(pal_watchdog_beat(application));
+        }
+
+        uint64_t beats = 0;
+        ASSERT_TRUE(pal_watchdog_read(supervisor, &beats));
+        EXPECT_EQ(beats, beats_before + 3);
+
+        ASSERT_TRUE(pal_watchdog_free(application));
+        ASSERT_TRUE(pal_watchdog_free(supervisor));
+    }
+
+    TEST(PAL_GENERIC, pal_standby_wait_ReturnsWhenNotGated)
+    {
+        EXPECT_FALSE(pal_standby_wait(nullptr));
+
+        BOOL released = FALSE;
+        ASSERT_TRUE(pal_standby_wait(&released));
+        EXPECT_TRUE(released);
+    }
+
+    TEST(PAL_GENERIC, pal_process_find_by_exe_prefix_DoesNotSegfault)
+    {
+        pal_pid_t* pids = nullptr;
+        size_t pids_len = 0;
+        EXPECT_FALSE(pal_process_find_by_exe_prefix(nullptr, &pids, &pids_len));
+        EXPECT_FALSE(pal_process_find_by_exe_prefix("", &pids, &pids_len));
+        EXPECT_FALSE(pal_process_find_by_exe_prefix("a", nullptr, &pids_len));
+        EXPECT_FALSE(pal_process_find_by_exe_prefix("a", &pids, nullptr));
+    }
+
+    TEST(PAL_GENERIC, pal_process_find_by_exe_prefix_FindsThisProcess)
+    {
+        pal_pid_t pid;
+        ASSERT_TRUE(pal_process_get_pid(&pid));
+
+        char* exe = nullptr;
+        ASSERT_TRUE(pal_process_get_real_path(&exe));
+        const std::string exe_filename(exe);
+        free(exe);
+
+        const auto exe_dir = exe_filename.substr(0, exe_filename.find_last_of(PAL_DIRECTORY_SEPARATOR_C));
+
+        const auto find = [](const std::string& prefix)
+        {
+            pal_pid_t* pids = nullptr;
+            size_t pids_len = 0;
+            EXPECT_TRUE(pal_process_find_by_exe_prefix(prefix.c_str(), &pids, &pids_len));
+            std::vector<pal_pid_t> found(pids, pids + pids_len);
+            delete[] pids;
+            return found;
+        };
+
+        const auto contains = [pid](const std::vector<pal_pid_t>& pids)
+        {
+            return std::find(pids.begin(), pids.end(), pid) != pids.end();
+        };
+
+        EXPECT_TRUE(contains(find(exe_filename)));
+        EXPECT_TRUE(contains(find(exe_dir)));
+        EXPECT_TRUE(contains(find(exe_dir + PAL_DIRECTORY_SEPARATOR_STR)));
+
+        // Prefixes only match whole path components.
+        EXPECT_FALSE(contains(find(exe_dir.substr(0, exe_dir.size() - 1))));
+        EXPECT_FALSE(contains(find(exe_filename + "x")));
+        EXPECT_TRUE(find(exe_dir + PAL_DIRECTORY_SEPARATOR_STR + "missing-app-dir").empty());
+    }
+
     TEST(PAL_GENERIC, pal_sleep_ms_DoesNotSegFault)
     {
         pal_sleep_ms(0);
@@ -127,6 +307,134 @@ namespace
         EXPECT_FALSE(pal_is_unknown_os());
     }
 
+    TEST(PAL_THREADING, pal_cpu_get_effective_count_ReturnsAtLeastOne)
+    {
+        size_t count = 0;
+        EXPECT_FALSE(pal_cpu_get_effective_count(nullptr));
+        EXPECT_TRUE(pal_cpu_get_effective_count(&count));
+        EXPECT_GE(count, 1u);
+        EXPECT_LE(count, std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    TEST(PAL_THREADING, pal_threadpool_DoesNotSegfault)
+    {
+        pal_threadpool_t* threadpool = nullptr;
+        EXPECT_FALSE(pal_threadpool_create(0, nullptr));
+        EXPECT_FALSE(pal_threadpool_submit(nullptr, nullptr, nullptr, nullptr));
+        EXPECT_FALSE(pal_threadpool_get_worker_count(nullptr, nullptr));
+        EXPECT_FALSE(pal_wait_group_wait(threadpool, nullptr));
+        EXPECT_FALSE(pal_threadpool_free(nullptr));
+        EXPECT_FALSE(pal_wait_group_free(nullptr));
+    }
+
+    TEST(PAL_THREADING, pal_threadpool_create_RespectsMaxWorkers)
+    {
+        pal_threadpool_t* threadpool = nullptr;
+        ASSERT_TRUE(pal_threadpool_create(1, &threadpool));
+
+        size_t worker_count = 0;
+        EXPECT_TRUE(pal_threadpool_get_worker_count(threadpool, &worker_count));
+        EXPECT_EQ(worker_count, 1u);
+
+        EXPECT_TRUE(pal_threadpool_free(threadpool));
+    }
+
+    TEST(PAL_THREADING, pal_wait_group_wait_WaitsForAllTasks)
+    {
+        pal_threadpool_t* threadpool = nullptr;
+        ASSERT_TRUE(pal_threadpool_create(0, &threadpool));
+
+        pal_wait_group_t* wait_group = nullptr;
+        ASSERT_TRUE(pal_wait_group_create(&wait_group));
+
+        std::atomic<size_t> counter{ 0 };
+        for (auto i = 0; i < 1000; i++)
+        {
+            EXPECT_TRUE(pal_threadpool_submit(threadpool, wait_group, [](void* user_data)
+            {
+                ++*static_cast<std::atomic<size_t>*>(user_data);
+            }, &counter));
+        }
+
+        EXPECT_TRUE(pal_wait_group_wait(threadpool, wait_group));
+        EXPECT_EQ(counter.load(), 1000u);
+
+        EXPECT_TRUE(pal_wait_group_free(wait_group));
+        EXPECT_TRUE(pal_threadpool_free(threadpool));
+    }
+
+    TEST(PAL_THREADING, pal_wait_group_wait_RunsInjectedTasksOnTheWaitingThread)
+    {
+        pal_threadpool_t* threadpool = nullptr;
+        ASSERT_TRUE(pal_threadpool_create(1, &threadpool));
+
+        pal_wait_group_t* wait_group = nullptr;
+        ASSERT_TRUE(pal_wait_group_create(&wait_group));
+
+        // The only worker takes the oldest task and blocks in it until the waiting thread runs the second one.
+        std::atomic<bool> released{ false };
+        EXPECT_TRUE(pal_threadpool_submit(threadpool, wait_group, [](void* user_data)
+        {
+            while (!static_cast<std::atomic<bool>*>(user_data)->load())
+            {
+                std::this_thread::yield();
+            }
+        }, &released));
+        EXPECT_TRUE(pal_threadpool_submit(threadpool, wait_group, [](void* user_data)
+        {
+            static_cast<std::atomic<bool>*>(user_data)->store(true);
+        }, &released));
+
+        EXPECT_TRUE(pal_wait_group_wait(threadpool, wait_group));
+        EXPECT_TRUE(released.load());
+
+        EXPECT_TRUE(pal_wait_group_free(wait_group));
+        EXPECT_TRUE(pal_threadpool_free(threadpool));
+    }
+
+    TEST(PAL_THREADING, pal_wait_group_wait_SupportsNestedSubmissions)
+    {
+        struct nested_state
+        {
+            pal_threadpool_t* threadpool;
+            std::atomic<size_t> counter;
+        } state;
+
+        state.counter = 0;
+
+        // A single worker would deadlock if waiting inside a task blocked instead of helping.
+        ASSERT_TRUE(pal_threadpool_create(1, &state.threadpool));
+
+        pal_wait_group_t* wait_group = nullptr;
+        ASSERT_TRUE(pal_wait_group_create(&wait_group));
+
+        for (auto i = 0; i < 8; i++)
+        {
+            EXPECT_TRUE(pal_threadpool_submit(state.threadpool, wait_group, [](void* user_data)
+            {
+                auto* const state = static_cast<nested_state*>(user_data);
+
+                pal_wait_group_t* nested_wait_group = nullptr;
+                pal_wait_group_create(&nested_wait_group);
+                for (auto j = 0; j < 8; j++)
+                {
+                    pal_threadpool_submit(state->threadpool, nested_wait_group, [](void* nested_user_data)
+                    {
+                        ++static_cast<nested_state*>(nested_user_data)->counter;
+                    }, state);
+                }
+                pal_wait_group_wait(state->threadpool, nested_wait_group);
+                pal_wait_group_free(nested_wait_group);
+            }, &state));
+        }
+
+        EXPECT_TRUE(pal_wait_group_wait(state.threadpool, wait_group));
+        EXPECT_EQ(state.counter.load(), 64u);
+
+        EXPECT_TRUE(pal_wait_group_free(wait_group));
+        EXPECT_TRUE(pal_threadpool_free(state.threadpool));
+    }
+
     TEST(PAL_ENV, pal_env_set_DoesNotSegfault)
     {
         EXPECT_FALSE(pal_env_set(nullptr, nullptr));
@@ -197,6 +505,133 @@ namespace
         EXPECT_TRUE(pal_fs_file_exists(*exe_abs_path));
     }
 
+    TEST(PAL_FS, pal_fs_stat_DoesNotSegfault)
+    {
+        pal_fs_stat_t st;
+        EXPECT_FALSE(pal_fs_stat(nullptr, TRUE, &st));
+        EXPECT_FALSE(pal_fs_stat_batch(nullptr, nullptr, 0, TRUE, nullptr, nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_stat_ReturnsTypeAndSize)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, "test.txt");
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), "hello", 5));
+
+        pal_fs_stat_t file_stat;
+        ASSERT_TRUE(pal_fs_stat(filename.c_str(), TRUE, &file_stat));
+        EXPECT_EQ(file_stat.type, static_cast<uint32_t>(PAL_FS_TYPE_FILE));
+        EXPECT_EQ(file_stat.size, 5u);
+        EXPECT_EQ(file_stat.nlink, 1u);
+        EXPECT_GT(file_stat.mtime_ns, 0u);
+
+        pal_fs_stat_t dir_stat;
+        ASSERT_TRUE(pal_fs_stat(working_dir.c_str(), TRUE, &dir_stat));
+        EXPECT_EQ(dir_stat.type, static_cast<uint32_t>(PAL_FS_TYPE_DIRECTORY));
+        EXPECT_EQ(dir_stat.dev, file_stat.dev);
+
+        pal_fs_stat_t missing_stat;
+        EXPECT_FALSE(pal_fs_stat(testutils::path_combine(working_dir, "missing").c_str(), TRUE, &missing_stat));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_stat_batch_ReportsErrorPerEntry)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        ASSERT_TRUE(pal_fs_write(testutils::path_combine(working_dir, "a.txt").c_str(), "a", 1));
+        ASSERT_TRUE(pal_fs_write(testutils::path_combine(working_dir, "b.txt").c_str(), "bb", 2));
+
+        const char* names[] = { "a.txt", "missing.txt", "b.txt" };
+        pal_fs_stat_t stats[3];
+        int errors[3];
+        EXPECT_FALSE(pal_fs_stat_batch(working_dir.c_str(), names, 3, TRUE, stats, errors));
+
+        EXPECT_EQ(errors[0], 0);
+        EXPECT_EQ(stats[0].size, 1u);
+        EXPECT_NE(errors[1], 0);
+        EXPECT_EQ(stats[1].type, static_cast<uint32_t>(PAL_FS_TYPE_UNKNOWN));
+        EXPECT_EQ(errors[2], 0);
+        EXPECT_EQ(stats[2].size, 2u);
+        EXPECT_NE(stats[0].inode, stats[2].inode);
+
+        EXPECT_TRUE(pal_fs_stat_batch(working_dir.c_str(), names, 1, TRUE, stats, nullptr));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_batch_DoesNotSegfault)
+    {
+        pal_fs_batch_t* batch = nullptr;
+        EXPECT_FALSE(pal_fs_batch_create(nullptr, TRUE, &batch));
+        EXPECT_EQ(batch, nullptr);
+        EXPECT_FALSE(pal_fs_batch_execute(nullptr, nullptr, 0));
+        EXPECT_FALSE(pal_fs_batch_free(nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_batch_execute_StatReadAndUnlink)
+    {
+        for (const auto use_io_uring : { TRUE, FALSE })
+        {
+            const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+
+            std::vector<std::string> names;
+            for (auto i = 0; i < 300; i++)
+            {
+                names.emplace_back("file" + std::to_string(i) + ".txt");
+                const auto contents = std::string(static_cast<size_t>(i), 'x');
+                ASSERT_TRUE(pal_fs_write(testutils::path_combine(working_dir, names.back()).c_str(), contents.c_str(), contents.size()));
+            }
+
+            pal_fs_batch_t* batch = nullptr;
+            ASSERT_TRUE(pal_fs_batch_create(working_dir.c_str(), use_io_uring, &batch));
+            if (!use_io_uring)
+            {
+                EXPECT_FALSE(pal_fs_batch_is_io_uring(batch));
+            }
+
+            std::vector<pal_fs_batch_op_t> ops(names.size() * 2 + 1);
+            for (auto i = 0u; i < names.size(); i++)
+            {
+                ops[i * 2].type = PAL_FS_BATCH_OP_STAT;
+                ops[i * 2].path = names[i].c_str();
+                ops[i * 2 + 1].type = PAL_FS_BATCH_OP_READ;
+                ops[i * 2 + 1].path = names[i].c_str();
+            }
+            ops.back().type = PAL_FS_BATCH_OP_STAT;
+            ops.back().path = "missing.txt";
+
+            EXPECT_FALSE(pal_fs_batch_execute(batch, ops.data(), ops.size()));
+
+            for (auto i = 0u; i < names.size(); i++)
+            {
+                const auto& stat_op = ops[i * 2];
+                EXPECT_EQ(stat_op.error, 0);
+                EXPECT_EQ(stat_op.stat.size, i);
+                EXPECT_EQ(stat_op.stat.type, static_cast<uint32_t>(PAL_FS_TYPE_FILE));
+
+                const auto& read_op = ops[i * 2 + 1];
+                EXPECT_EQ(read_op.error, 0);
+                EXPECT_EQ(std::string(read_op.data, read_op.data_len), std::string(i, 'x'));
+                delete[] read_op.data;
+            }
+            EXPECT_NE(ops.back().error, 0);
+
+            std::vector<pal_fs_batch_op_t> unlink_ops(names.size());
+            for (auto i = 0u; i < names.size(); i++)
+            {
+                unlink_ops[i].type = PAL_FS_BATCH_OP_UNLINK;
+                unlink_ops[i].path = names[i].c_str();
+            }
+
+            EXPECT_TRUE(pal_fs_batch_execute(batch, unlink_ops.data(), unlink_ops.size()));
+            EXPECT_FALSE(pal_fs_file_exists(testutils::path_combine(working_dir, names[0]).c_str()));
+
+            EXPECT_TRUE(pal_fs_batch_free(batch));
+            EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), FALSE));
+        }
+    }
+
     TEST(PAL_FS, pal_fs_list_directories_DoesNotSegfault)
     {
         char** directories_array = nullptr;
@@ -266,6 +701,29 @@ namespace
         EXPECT_NE(*this_process_real_path, nullptr);
     }
 
+    TEST(PAL_FS, pal_fs_link_replace_DoesNotSegfault)
+    {
+        EXPECT_FALSE(pal_fs_link_replace(nullptr, nullptr));
+        EXPECT_FALSE(pal_fs_link_read(nullptr, nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_link_replace_ReplacesExistingLink)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto link_path = testutils::path_combine(working_dir, "current");
+
+        for (const auto* const target : { "app-1.0.0", "app-2.0.0" })
+        {
+            ASSERT_TRUE(pal_fs_link_replace(link_path.c_str(), target));
+
+            const auto link_target = std::make_unique<char*>(nullptr);
+            ASSERT_TRUE(pal_fs_link_read(link_path.c_str(), link_target.get()));
+            ASSERT_STREQ(*link_target, target);
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
     TEST(PAL_FS, pal_fs_directory_exists_ReturnsTrueThatThisWorkingDirectoryExists)
     {
         const auto working_dir = testutils::get_process_cwd();
@@ -347,6 +805,51 @@ namespace
 
     }
     
+    TEST(PAL_FS, pal_fs_read_file_chunked_DoesNotSegfault)
+    {
+        EXPECT_FALSE(pal_fs_read_file_chunked(nullptr, 0, nullptr, nullptr, nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_read_file_chunked_ReadsWholeFileInChunks)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, "test.bin");
+
+        std::string data;
+        for (auto i = 0; i < 3 * 4096 + 17; i++)
+        {
+            data.push_back(static_cast<char>(i % 251));
+        }
+
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), data.c_str(), data.size()));
+
+        struct read_state
+        {
+            std::string data;
+            size_t chunks;
+        } state = { std::string(), 0 };
+
+        const auto callback = [](const char* chunk_in, const size_t chunk_len_in, void* user_data_in) -> BOOL
+        {
+            auto* const state = static_cast<read_state*>(user_data_in);
+            state->data.append(chunk_in, chunk_len_in);
+            state->chunks++;
+            return TRUE;
+        };
+
+        size_t bytes_read = 0;
+        ASSERT_TRUE(pal_fs_read_file_chunked(filename.c_str(), 4096, callback, &state, &bytes_read));
+        EXPECT_EQ(bytes_read, data.size());
+        EXPECT_EQ(state.chunks, 4u);
+        EXPECT_EQ(state.data, data);
+
+        const auto abort_callback = [](const char*, size_t, void*) -> BOOL { return FALSE; };
+        EXPECT_FALSE(pal_fs_read_file_chunked(filename.c_str(), 4096, abort_callback, nullptr, &bytes_read));
+        EXPECT_EQ(bytes_read, 4096u);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
     TEST(PAL_FS, pal_fs_mkdir_DoesNotSegfault)
     {
         EXPECT_FALSE(pal_fs_mkdir(nullptr, 0));
@@ -498,6 +1001,45 @@ namespace
         EXPECT_FALSE(pal_fs_directory_exists(parent_dir.c_str()));
     }
 
+    TEST(PAL_FS, pal_fs_rmdir_recursive_DoesNotSegfault)
+    {
+        EXPECT_FALSE(pal_fs_rmdir_recursive(nullptr, FALSE, nullptr));
+        EXPECT_FALSE(pal_fs_rmdir_recursive(nullptr, TRUE, nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_rmdir_recursive_ReturnsFirstErrorWhenDirectoryDoesNotExist)
+    {
+        const auto directory = testutils::path_combine(testutils::get_process_cwd(), testutils::build_random_dirname());
+
+        pal_fs_rmdir_stats_t stats = {};
+        EXPECT_FALSE(pal_fs_rmdir_recursive(directory.c_str(), FALSE, &stats));
+        EXPECT_EQ(stats.removed_count, 0u);
+        EXPECT_NE(stats.first_error, 0);
+    }
+
+    TEST(PAL_FS, pal_fs_rmdir_recursive_CountsRemovedEntries)
+    {
+        for (const auto parallel : { FALSE, TRUE })
+        {
+            const auto parent_dir = testutils::mkdir_random(testutils::get_process_cwd());
+            testutils::mkfile(parent_dir, "test.txt");
+
+            for (auto i = 0; i < 4; i++)
+            {
+                const auto sub_dir = testutils::mkdir(parent_dir, "subdirectory");
+                testutils::mkfile(sub_dir, "test1.txt");
+                testutils::mkfile(sub_dir, "test2.txt");
+                testutils::mkdir(sub_dir, "subdirectory");
+            }
+
+            pal_fs_rmdir_stats_t stats = {};
+            EXPECT_TRUE(pal_fs_rmdir_recursive(parent_dir.c_str(), parallel, &stats));
+            EXPECT_FALSE(pal_fs_directory_exists(parent_dir.c_str()));
+            EXPECT_EQ(stats.removed_count, 1u + 1u + 4u * 4u);
+            EXPECT_EQ(stats.first_error, 0);
+        }
+    }
+
     TEST(PAL_FS, pal_fs_rmfile_DoesNotSegFault)
     {
         EXPECT_FALSE(pal_fs_rmfile(nullptr));
@@ -524,6 +1066,113 @@ namespace
         EXPECT_FALSE(pal_fs_write(nullptr, nullptr, 0));
     }
 
+    TEST(PAL_FS, pal_fs_write_atomic_DoesNotSegfault)
+    {
+        EXPECT_FALSE(pal_fs_write_atomic(nullptr, nullptr, 0));
+        EXPECT_FALSE(pal_fs_write_batch_create(nullptr));
+        EXPECT_FALSE(pal_fs_write_batch_add(nullptr, nullptr, nullptr, 0));
+        EXPECT_FALSE(pal_fs_write_batch_commit(nullptr));
+        EXPECT_FALSE(pal_fs_write_batch_free(nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_write_atomic_ReplacesExistingFile)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::mkfile(working_dir, "test.txt");
+
+        const std::string text("Hello Atomic World");
+        ASSERT_TRUE(pal_fs_write_atomic(filename.c_str(), text.c_str(), text.size()));
+
+        char* data = nullptr;
+        size_t data_len = 0;
+        ASSERT_TRUE(pal_fs_read_file(filename.c_str(), &data, &data_len));
+        EXPECT_EQ(std::string(data, data_len), text);
+        delete[] data;
+
+        char** files_array = nullptr;
+        size_t files_len = 0u;
+        ASSERT_TRUE(pal_fs_list_files(working_dir.c_str(), nullptr, nullptr, &files_array, &files_len));
+        EXPECT_EQ(files_len, 1u);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_write_batch_IsOnlyVisibleAfterCommit)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+
+        // Large enough to take the syncfs path.
+        const auto files_len = 20u;
+        std::vector<std::string> filenames;
+
+        pal_fs_write_batch_t* batch = nullptr;
+        ASSERT_TRUE(pal_fs_write_batch_create(&batch));
+
+        for (auto i = 0u; i < files_len; i++)
+        {
+            filenames.emplace_back(testutils::path_combine(working_dir, std::to_string(i) + ".txt"));
+            const auto text = std::to_string(i);
+            ASSERT_TRUE(pal_fs_write_batch_add(batch, filenames.back().c_str(), text.c_str(), text.size()));
+            EXPECT_FALSE(pal_fs_file_exists(filenames.back().c_str()));
+        }
+
+        ASSERT_TRUE(pal_fs_write_batch_commit(batch));
+        ASSERT_TRUE(pal_fs_write_batch_free(batch));
+
+        for (auto i = 0u; i < files_len; i++)
+        {
+            char* data = nullptr;
+            size_t data_len = 0;
+            ASSERT_TRUE(pal_fs_read_file(filenames[i].c_str(), &data, &data_len));
+            EXPECT_EQ(std::string(data, data_len), std::to_string(i));
+            delete[] data;
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_write_batch_commit_RemovesTemporaryFilesOfFailedReplaces)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, "test.txt");
+        // A file cannot replace a directory.
+        const auto directory = testutils::path_combine(working_dir, "directory");
+        ASSERT_TRUE(pal_fs_mkdirp(directory.c_str(), 0777));
+
+        pal_fs_write_batch_t* batch = nullptr;
+        ASSERT_TRUE(pal_fs_write_batch_create(&batch));
+        ASSERT_TRUE(pal_fs_write_batch_add(batch, filename.c_str(), "test", 4));
+        ASSERT_TRUE(pal_fs_write_batch_add(batch, directory.c_str(), "test", 4));
+        EXPECT_FALSE(pal_fs_write_batch_commit(batch));
+        ASSERT_TRUE(pal_fs_write_batch_free(batch));
+
+        char** files_array = nullptr;
+        size_t files_len = 0u;
+        ASSERT_TRUE(pal_fs_list_files(working_dir.c_str(), nullptr, nullptr, &files_array, &files_len));
+        ASSERT_EQ(files_len, 1u);
+        EXPECT_EQ(std::string(files_array[0]), filename);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_write_batch_free_DiscardsUncommittedFiles)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, "test.txt");
+
+        pal_fs_write_batch_t* batch = nullptr;
+        ASSERT_TRUE(pal_fs_write_batch_create(&batch));
+        ASSERT_TRUE(pal_fs_write_batch_add(batch, filename.c_str(), "test", 4));
+        ASSERT_TRUE(pal_fs_write_batch_free(batch));
+
+        char** files_array = nullptr;
+        size_t files_len = 0u;
+        ASSERT_TRUE(pal_fs_list_files(working_dir.c_str(), nullptr, nullptr, &files_array, &files_len));
+        EXPECT_EQ(files_len, 0u);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
     // - Path
 
     TEST(PAL_PATH, pal_path_normalize_DoesNotSegfault)
@@ -617,4 +1266,941 @@ namespace
         pal_semaphore_machine_wide sema3(sema_name);
         EXPECT_TRUE(sema2.try_create());
     }
+
+    std::string hash_pattern(const size_t length)
+    {
+        std::string data;
+        for (size_t i = 0; i < length; i++)
+        {
+            data.push_back(static_cast<char>(i % 251));
+        }
+        return data;
+    }
+
+    std::string hash_to_hex(const uint8_t* digest)
+    {
+        static const char* hex = "0123456789abcdef";
+        std::string str;
+        for (auto i = 0; i < PAL_HASH_DIGEST_SIZE; i++)
+        {
+            str.push_back(hex[digest[i] >> 4]);
+            str.push_back(hex[digest[i] & 0xf]);
+        }
+        return str;
+    }
+
+    std::string hash_buffer(const uint32_t algorithm, const std::string& data, const size_t piece_len)
+    {
+        pal_hash_t* hash = nullptr;
+        EXPECT_TRUE(pal_hash_create(algorithm, &hash));
+
+        for (size_t offset = 0; offset < data.size(); offset += piece_len)
+        {
+            EXPECT_TRUE(pal_hash_update(hash, data.data() + offset, std::min(piece_len, data.size() - offset)));
+        }
+
+        uint8_t digest[PAL_HASH_DIGEST_SIZE];
+        EXPECT_TRUE(pal_hash_final(hash, digest));
+        EXPECT_TRUE(pal_hash_free(hash));
+        return hash_to_hex(digest);
+    }
+
+    // Inputs are hash_pattern(length), digests computed with python's hashlib and the BLAKE3 reference implementation.
+    struct hash_vector
+    {
+        size_t length;
+        const char* sha256;
+        const char* blake3;
+    };
+
+    const hash_vector hash_vectors[] = {
+        { 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262" },
+        { 3, "ae4b3280e56e2faf83f414a6e3dabe9d5fbe18976544c05fed121accb85b53fc", "e1be4d7a8ab5560aa4199eea339849ba8e293d55ca0a81006726d184519e647f" },
+        { 64, "fdeab9acf3710362bd2658cdc9a29e8f9c757fcf9811603a8c447cd1d9151108", "4eed7141ea4a5cd4b788606bd23f46e212af9cacebacdc7d1f4c6dc7f2511b98" },
+        { 65, "4bfd2c8b6f1eec7a2afeb48b934ee4b2694182027e6d0fc075074f2fabb31781", "de1e5fa0be70df6d2be8fffd0e99ceaa8eb6e8c93a63f2d8d1c30ecb6b263dee" },
+        { 1023, "1c5e88a585b61754df6137d66632a7348557a88358afc401b0a0a4fc427104a9", "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11" },
+        { 1024, "2bce1ba628720664be4b9fdd77aae0678e5f0f3f02fc6ff641ec879094f6a404", "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7" },
+        { 1025, "bc0b6b10b89b9487a12fda2a8cc13194e7091c217aabf8b92846274026f4bcd0", "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444" },
+        { 4096, "d67c656e01756650d77717b0839985a056ec28ffe174601d690fc407a2ceffca", "015094013f57a5277b59d8475c0501042c0b642e531b0a1c8f58d2163229e969" },
+        { 4097, "a16560d668b843fb3be99ace41dbd18471f342bd3255a1d21204b35e43f74436", "9b4052b38f1c5fc8b1f9ff7ac7b27cd242487b3d890d15c96a1c25b8aa0fb995" },
+        { 8193, "7e3691790cd64b19d4edb1a80e988214515abeb53aa0f34ffbfe4b4bf405d120", "bab6c09cb8ce8cf459261398d2e7aef35700bf488116ceb94a36d0f5f1b7bc3b" },
+        { 16385, "ba4f9b37402df1e3ad948a794ab43a9ed887d63e3a389c208ca4314fdd5add58", "1dabe216be2578830263b049de1639f39f05a4da616b9b78c7a5e4e41662fd1f" },
+        { 102400, "74588b7f0bcc354ac14d9cf199fa3a20c05f0c7293b9075b2f2e146e718de800", "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085" },
+        { 1048583, "9e037498ddbb955fba0752812031c14ba299a4875cb400e8b8c1d77b3962c90e", "89541f1047f7a56806fe16efda4c2cdc45f141c838e413019f0124189fa55232" }
+    };
+
+    TEST(PAL_HASH, pal_hash_DoesNotSegfault)
+    {
+        pal_hash_t* hash = nullptr;
+        uint8_t digest[PAL_HASH_DIGEST_SIZE];
+        const char* name = nullptr;
+        EXPECT_FALSE(pal_hash_create(PAL_HASH_SHA256, nullptr));
+        EXPECT_FALSE(pal_hash_create(2, &hash));
+        EXPECT_FALSE(pal_hash_update(nullptr, nullptr, 0));
+        EXPECT_FALSE(pal_hash_final(nullptr, digest));
+        EXPECT_FALSE(pal_hash_free(nullptr));
+        EXPECT_FALSE(pal_hash_get_implementation(2, &name));
+        EXPECT_FALSE(pal_hash_file(nullptr, PAL_HASH_SHA256, FALSE, digest));
+    }
+
+    TEST(PAL_HASH, pal_hash_MatchesReferenceDigests)
+    {
+        for (const auto& vector : hash_vectors)
+        {
+            const auto data = hash_pattern(vector.length);
+            EXPECT_EQ(hash_buffer(PAL_HASH_SHA256, data, data.size() + 1), vector.sha256) << vector.length;
+            EXPECT_EQ(hash_buffer(PAL_HASH_BLAKE3, data, data.size() + 1), vector.blake3) << vector.length;
+        }
+    }
+
+    TEST(PAL_HASH, pal_hash_update_IsIndependentOfPieceSize)
+    {
+        const auto& vector = hash_vectors[12];
+        const auto data = hash_pattern(vector.length);
+
+        for (const size_t piece_len : { 1u, 63u, 1000u, 1024u, 8191u, 65537u })
+        {
+            EXPECT_EQ(hash_buffer(PAL_HASH_SHA256, data, piece_len), vector.sha256) << piece_len;
+            EXPECT_EQ(hash_buffer(PAL_HASH_BLAKE3, data, piece_len), vector.blake3) << piece_len;
+        }
+    }
+
+    TEST(PAL_HASH, pal_hash_PortableMatchesAccelerated)
+    {
+        const char* sha256_name = nullptr;
+        const char* blake3_name = nullptr;
+        ASSERT_TRUE(pal_hash_get_implementation(PAL_HASH_SHA256, &sha256_name));
+        ASSERT_TRUE(pal_hash_get_implementation(PAL_HASH_BLAKE3, &blake3_name));
+        ASSERT_NE(sha256_name, nullptr);
+        ASSERT_NE(blake3_name, nullptr);
+
+        pal_hash_force_portable(true);
+
+        const char* portable_name = nullptr;
+        EXPECT_TRUE(pal_hash_get_implementation(PAL_HASH_BLAKE3, &portable_name));
+        EXPECT_STREQ(portable_name, "portable");
+
+        for (const auto& vector : hash_vectors)
+        {
+            const auto data = hash_pattern(vector.length);
+            EXPECT_EQ(hash_buffer(PAL_HASH_SHA256, data, 4099), vector.sha256) << vector.length;
+            EXPECT_EQ(hash_buffer(PAL_HASH_BLAKE3, data, 4099), vector.blake3) << vector.length;
+        }
+
+        pal_hash_force_portable(false);
+    }
+
+    TEST(PAL_HASH, pal_hash_file)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+
+        for (const auto& vector : { hash_vectors[0], hash_vectors[6], hash_vectors[12] })
+        {
+            const auto filename = testutils::path_combine(working_dir, std::to_string(vector.length) + ".bin");
+            const auto data = hash_pattern(vector.length);
+            ASSERT_TRUE(pal_fs_write(filename.c_str(), data.data(), data.size()));
+
+            for (const auto use_mmap : { FALSE, TRUE })
+            {
+                uint8_t digest[PAL_HASH_DIGEST_SIZE];
+                ASSERT_TRUE(pal_hash_file(filename.c_str(), PAL_HASH_SHA256, use_mmap, digest));
+                EXPECT_EQ(hash_to_hex(digest), vector.sha256);
+                ASSERT_TRUE(pal_hash_file(filename.c_str(), PAL_HASH_BLAKE3, use_mmap, digest));
+                EXPECT_EQ(hash_to_hex(digest), vector.blake3);
+            }
+        }
+
+        uint8_t digest[PAL_HASH_DIGEST_SIZE];
+        const auto missing = testutils::path_combine(working_dir, "missing.bin");
+        EXPECT_FALSE(pal_hash_file(missing.c_str(), PAL_HASH_SHA256, TRUE, digest));
+        EXPECT_FALSE(pal_hash_file(missing.c_str(), PAL_HASH_SHA256, FALSE, digest));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_verify_directory_DoesNotSegfault)
+    {
+        pal_fs_verify_entry_t entry = {};
+        EXPECT_FALSE(pal_fs_verify_directory(nullptr, PAL_HASH_SHA256, &entry, 1, nullptr));
+        EXPECT_FALSE(pal_fs_verify_directory(".", PAL_HASH_SHA256, nullptr, 1, nullptr));
+        EXPECT_FALSE(pal_fs_verify_directory(".", 2, &entry, 1, nullptr));
+        EXPECT_FALSE(pal_fs_verify_directory(".", PAL_HASH_SHA256, &entry, 1, nullptr));
+        EXPECT_EQ(entry.status, static_cast<uint32_t>(PAL_FS_VERIFY_ERROR));
+    }
+
+    TEST(PAL_FS, pal_fs_verify_directory_ReportsStatusPerEntry)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto cache_filename = testutils::path_combine(working_dir, "verify.cache");
+        const auto app_dir = testutils::path_combine(working_dir, "app-1.0.0");
+        ASSERT_TRUE(pal_fs_mkdirp(testutils::path_combine(app_dir, "lib").c_str(), 0777));
+
+        const auto data = hash_pattern(70000);
+        for (const auto* name : { "app.bin", "lib/lib.bin", "truncated.bin", "corrupt.bin" })
+        {
+            const auto filename = testutils::path_combine(app_dir, name);
+            const auto file_data = std::string(name) == "truncated.bin" ? data.substr(0, 100) : data;
+            ASSERT_TRUE(pal_fs_write(filename.c_str(), file_data.data(), file_data.size()));
+        }
+
+        const auto corrupt_filename = testutils::path_combine(app_dir, "corrupt.bin");
+        ASSERT_TRUE(pal_fs_write(corrupt_filename.c_str(), data.substr(1).append("x").data(), data.size()));
+
+        uint8_t digest[PAL_HASH_DIGEST_SIZE];
+        ASSERT_TRUE(pal_hash_file(testutils::path_combine(app_dir, "app.bin").c_str(), PAL_HASH_BLAKE3, FALSE, digest));
+
+        pal_fs_verify_entry_t entries[] = {
+            { "app.bin", data.size(), {}, 0, FALSE },
+            { "lib/lib.bin", data.size(), {}, 0, FALSE },
+            { "truncated.bin", data.size(), {}, 0, FALSE },
+            { "corrupt.bin", data.size(), {}, 0, FALSE },
+            { "missing.bin", data.size(), {}, 0, FALSE },
+            { "../app-1.0.0/app.bin", data.size(), {}, 0, FALSE },
+            { "lib", data.size(), {}, 0, FALSE }
+        };
+
+        for (auto& entry : entries)
+        {
+            std::memcpy(entry.digest, digest, sizeof digest);
+        }
+
+        const uint32_t expected[] = {
+            PAL_FS_VERIFY_OK,
+            PAL_FS_VERIFY_OK,
+            PAL_FS_VERIFY_SIZE_MISMATCH,
+            PAL_FS_VERIFY_HASH_MISMATCH,
+            PAL_FS_VERIFY_MISSING,
+            PAL_FS_VERIFY_ERROR,
+            PAL_FS_VERIFY_ERROR
+        };
+
+        for (auto run = 0; run < 2; run++)
+        {
+            EXPECT_FALSE(pal_fs_verify_directory(app_dir.c_str(), PAL_HASH_BLAKE3, entries, 7, cache_filename.c_str()));
+            for (auto i = 0u; i < 7; i++)
+            {
+                EXPECT_EQ(entries[i].status, expected[i]) << entries[i].path;
+            }
+        }
+
+        EXPECT_TRUE(pal_fs_file_exists(cache_filename.c_str()));
+        EXPECT_TRUE(pal_fs_verify_directory(app_dir.c_str(), PAL_HASH_BLAKE3, entries, 2, cache_filename.c_str()));
+        EXPECT_FALSE(pal_fs_verify_directory(app_dir.c_str(), PAL_HASH_SHA256, entries, 2, cache_filename.c_str()));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    struct patch_record
+    {
+        std::string add;
+        std::string copy;
+        int64_t seek;
+    };
+
+    std::string patch_encode64(const uint64_t value)
+    {
+        std::string encoded;
+        for (auto i = 0; i < 8; i++)
+        {
+            encoded.push_back(static_cast<char>(value >> (i * 8)));
+        }
+        return encoded;
+    }
+
+    std::string patch_build(const size_t old_size, const std::vector<patch_record>& records)
+    {
+        uint64_t new_size = 0;
+        std::string body;
+        for (const auto& record : records)
+        {
+            body += patch_encode64(record.add.size()) + patch_encode64(record.copy.size())
+                + patch_encode64(static_cast<uint64_t>(record.seek)) + record.add + record.copy;
+            new_size += record.add.size() + record.copy.size();
+        }
+        return "SNAPXDF1" + patch_encode64(old_size) + patch_encode64(new_size) + body;
+    }
+
+    // Encodes the bytes of expected that overlap old at old_offset as differences, bytes beyond the old file read as zero.
+    std::string patch_diff(const std::string& old_data, const int64_t old_offset, const std::string& expected)
+    {
+        std::string diff;
+        for (auto i = 0u; i < expected.size(); i++)
+        {
+            const auto pos = old_offset + static_cast<int64_t>(i);
+            const auto old_value = pos >= 0 && pos < static_cast<int64_t>(old_data.size()) ? old_data[static_cast<size_t>(pos)] : 0;
+            diff.push_back(static_cast<char>(expected[i] - old_value));
+        }
+        return diff;
+    }
+
+    TEST(PAL_FS, pal_fs_patch_apply_DoesNotSegfault)
+    {
+        EXPECT_FALSE(pal_fs_patch_apply(nullptr, nullptr, nullptr));
+        EXPECT_FALSE(pal_fs_patch_apply_batch(nullptr, 1));
+        EXPECT_TRUE(pal_fs_patch_apply_batch(nullptr, 0));
+    }
+
+    TEST(PAL_FS, pal_fs_patch_apply)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto old_filename = testutils::path_combine(working_dir, "old.bin");
+        const auto patch_filename = testutils::path_combine(working_dir, "new.patch");
+        const auto new_filename = testutils::path_combine(working_dir, "new.bin");
+
+        const auto old_data = hash_pattern(3 * 1024 * 1024 + 5);
+        ASSERT_TRUE(pal_fs_write(old_filename.c_str(), old_data.data(), old_data.size()));
+
+        // Modified old contents, new bytes, the head of the old file again and a tail that runs past the old file.
+        auto modified = old_data;
+        for (auto i = 0u; i < modified.size(); i += 4093)
+        {
+            modified[i] = static_cast<char>(modified[i] ^ 0x5a);
+        }
+        const auto head = old_data.substr(0, 4096);
+        const std::string tail = old_data.substr(old_data.size() - 10) + std::string(54, 'z');
+
+        const auto patch = patch_build(old_data.size(), {
+            { patch_diff(old_data, 0, modified), std::string(1000, 'x'), -static_cast<int64_t>(old_data.size()) },
+            { patch_diff(old_data, 0, head), std::string(), static_cast<int64_t>(old_data.size()) - 4096 - 10 },
+            { patch_diff(old_data, static_cast<int64_t>(old_data.size()) - 10, tail), "end", 0 }
+        });
+        ASSERT_TRUE(pal_fs_write(patch_filename.c_str(), patch.data(), patch.size()));
+
+        const auto expected = modified + std::string(1000, 'x') + head + tail + "end";
+
+        for (auto run = 0; run < 2; run++)
+        {
+            ASSERT_TRUE(pal_fs_patch_apply(old_filename.c_str(), patch_filename.c_str(), new_filename.c_str()));
+
+            char* new_data = nullptr;
+            size_t new_data_len = 0;
+            ASSERT_TRUE(pal_fs_read_file(new_filename.c_str(), &new_data, &new_data_len));
+            EXPECT_TRUE(std::string(new_data, new_data_len) == expected);
+            delete[] new_data;
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_patch_apply_RejectsInvalidPatches)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto old_filename = testutils::path_combine(working_dir, "old.bin");
+        const auto patch_filename = testutils::path_combine(working_dir, "new.patch");
+        const auto new_filename = testutils::path_combine(working_dir, "new.bin");
+
+        const auto old_data = hash_pattern(1000);
+        ASSERT_TRUE(pal_fs_write(old_filename.c_str(), old_data.data(), old_data.size()));
+
+        const auto valid = patch_build(old_data.size(), { { std::string(100, '\0'), "abc", 0 } });
+        const std::string invalid_patches[] = {
+            valid.substr(0, valid.size() - 1),
+            patch_build(old_data.size() + 1, { { std::string(100, '\0'), "abc", 0 } }),
+            "SNAPXDF0" + valid.substr(8),
+            patch_build(old_data.size(), { { std::string(), "abc", INT64_MIN } }) + patch_build(0, { { "a", "", 0 } }).substr(24),
+            std::string()
+        };
+
+        for (const auto& patch : invalid_patches)
+        {
+            ASSERT_TRUE(pal_fs_write(patch_filename.c_str(), patch.data(), patch.size()));
+            EXPECT_FALSE(pal_fs_patch_apply(old_filename.c_str(), patch_filename.c_str(), new_filename.c_str()));
+            EXPECT_FALSE(pal_fs_file_exists(new_filename.c_str()));
+        }
+
+        ASSERT_TRUE(pal_fs_write(patch_filename.c_str(), valid.data(), valid.size()));
+        EXPECT_TRUE(pal_fs_patch_apply(old_filename.c_str(), patch_filename.c_str(), new_filename.c_str()));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_patch_apply_batch)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+
+        std::vector<std::string> filenames;
+        std::vector<pal_fs_patch_op_t> ops(16);
+        filenames.reserve(ops.size() * 3);
+
+        for (auto i = 0u; i < ops.size(); i++)
+        {
+            const auto old_data = hash_pattern(65536 + i);
+            filenames.emplace_back(testutils::path_combine(working_dir, std::to_string(i) + ".old"));
+            filenames.emplace_back(testutils::path_combine(working_dir, std::to_string(i) + ".patch"));
+            filenames.emplace_back(testutils::path_combine(working_dir, std::to_string(i) + ".new"));
+
+            // The last patch does not match its old file.
+            const auto patch = patch_build(old_data.size() + (i == ops.size() - 1 ? 1 : 0), {
+                { std::string(old_data.size(), '\1'), std::to_string(i), 0 }
+            });
+
+            ASSERT_TRUE(pal_fs_write(filenames[i * 3].c_str(), old_data.data(), old_data.size()));
+            ASSERT_TRUE(pal_fs_write(filenames[i * 3 + 1].c_str(), patch.data(), patch.size()));
+
+            ops[i].old_filename = filenames[i * 3].c_str();
+            ops[i].patch_filename = filenames[i * 3 + 1].c_str();
+            ops[i].new_filename = filenames[i * 3 + 2].c_str();
+        }
+
+        EXPECT_FALSE(pal_fs_patch_apply_batch(ops.data(), ops.size()));
+
+        for (auto i = 0u; i < ops.size(); i++)
+        {
+            if (i == ops.size() - 1)
+            {
+                EXPECT_NE(ops[i].error, 0);
+                EXPECT_FALSE(pal_fs_file_exists(ops[i].new_filename));
+                continue;
+            }
+
+            EXPECT_EQ(ops[i].error, 0);
+
+            auto expected = hash_pattern(65536 + i);
+            for (auto& value : expected)
+            {
+                value = static_cast<char>(value + 1);
+            }
+            expected += std::to_string(i);
+
+            char* new_data = nullptr;
+            size_t new_data_len = 0;
+            ASSERT_TRUE(pal_fs_read_file(ops[i].new_filename, &new_data, &new_data_len));
+            EXPECT_TRUE(std::string(new_data, new_data_len) == expected);
+            delete[] new_data;
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    // Produced with python's zlib (raw deflate, level 9) from zip_release_notes(8) and zip_release_notes(32):
+    // the first is a single fixed Huffman block, the second a dynamic Huffman block.
+    const uint8_t zip_deflate_fixed[] = {
+        0xcb, 0xc9, 0xcc, 0x4b, 0x55, 0x30, 0x50, 0xc8, 0x4f, 0x53, 0x28, 0xc9, 0x48, 0x55, 0x28, 0xce,
+        0x4b, 0x2c, 0xa8, 0x50, 0x28, 0x4a, 0xcd, 0x49, 0x4d, 0x2c, 0x4e, 0x55, 0xc8, 0xcb, 0x2f, 0x49,
+        0x2d, 0xe6, 0xca, 0x01, 0xa9, 0x30, 0x24, 0xa8, 0xc2, 0x88, 0xa0, 0x0a, 0x63, 0x82, 0x2a, 0x4c,
+        0x08, 0xaa, 0x30, 0x25, 0xa8, 0xc2, 0x8c, 0xa0, 0x0a, 0x73, 0x7c, 0x2a, 0x00
+    };
+
+    const uint8_t zip_deflate_dynamic[] = {
+        0x8d, 0xd2, 0xb1, 0x0d, 0x83, 0x40, 0x14, 0x04, 0xd1, 0xdc, 0x55, 0xfc, 0x12, 0xbc, 0x7b, 0x36,
+        0xd8, 0xe5, 0x10, 0x7c, 0x0b, 0x4b, 0xa7, 0x03, 0x71, 0x04, 0x2e, 0xdf, 0xa2, 0x01, 0x86, 0x7c,
+        0xa2, 0xa7, 0xa9, 0xdf, 0x96, 0x71, 0x8f, 0xe5, 0x13, 0xfb, 0x9c, 0xd1, 0xdb, 0xb4, 0xfe, 0x62,
+        0xcb, 0x9a, 0x53, 0xcf, 0x68, 0xcb, 0x9e, 0xfd, 0x56, 0x8f, 0x42, 0x58, 0x18, 0x8b, 0x82, 0xc5,
+        0x03, 0x8b, 0x27, 0x16, 0x03, 0x16, 0x23, 0x16, 0x2f, 0x2c, 0xde, 0x2c, 0x76, 0x01, 0x95, 0x55,
+        0xc5, 0xac, 0x62, 0x57, 0x31, 0xac, 0x58, 0x56, 0x4c, 0x2b, 0xb6, 0x15, 0xe3, 0x8a, 0x75, 0xcd,
+        0xba, 0xbe, 0xf0, 0x2c, 0xeb, 0x9a, 0x75, 0xcd, 0xba, 0x66, 0x5d, 0xb3, 0xae, 0x59, 0xd7, 0xac,
+        0x6b, 0xd6, 0x2d, 0xac, 0x5b, 0x4e, 0x75, 0xff
+    };
+
+    std::string zip_release_notes(const size_t lines)
+    {
+        std::string notes;
+        for (auto i = 0u; i < lines; i++)
+        {
+            notes += "line " + std::to_string(i) + " of the snapx release notes\n";
+        }
+        return notes;
+    }
+
+    uint32_t zip_crc32(const std::string& data)
+    {
+        uint32_t crc = 0xffffffff;
+        for (const auto value : data)
+        {
+            crc ^= static_cast<uint8_t>(value);
+            for (auto bit = 0; bit < 8; bit++)
+            {
+                crc = crc & 1 ? crc >> 1 ^ 0xEDB88320u : crc >> 1;
+            }
+        }
+        return ~crc;
+    }
+
+    // Raw deflate stream of stored blocks.
+    std::string zip_deflate_stored(const std::string& data)
+    {
+        std::string stream;
+        size_t offset = 0;
+        do
+        {
+            const auto len = std::min<size_t>(data.size() - offset, 65535);
+            const auto last = offset + len == data.size();
+            stream.push_back(static_cast<char>(last ? 1 : 0));
+            stream += patch_encode64(len | (~len & 0xffff) << 16).substr(0, 4);
+            stream += data.substr(offset, len);
+            offset += len;
+        } while (offset < data.size());
+        return stream;
+    }
+
+    // Raw deflate stream for hash_pattern(length) in one fixed Huffman block: the first period as
+    // literals and the rest as 258 byte matches 251 bytes back, which exercises matches that refer
+    // to history the decoder has already flushed.
+    std::string zip_deflate_fixed_pattern(const size_t length)
+    {
+        std::string stream;
+        uint64_t bit_buffer = 0;
+        unsigned bit_count = 0;
+
+        const auto put = [&](const uint32_t value, const unsigned len)
+        {
+            bit_buffer |= static_cast<uint64_t>(value) << bit_count;
+            bit_count += len;
+            while (bit_count >= 8)
+            {
+                stream.push_back(static_cast<char>(bit_buffer));
+                bit_buffer >>= 8;
+                bit_count -= 8;
+            }
+        };
+
+        // Huffman codes are stored most significant bit first.
+        const auto put_code = [&](const uint32_t code, const unsigned len)
+        {
+            uint32_t reversed = 0;
+            for (auto bit = 0u; bit < len; bit++)
+            {
+                reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+            }
+            put(reversed, len);
+        };
+
+        const auto put_literal = [&](const uint8_t value)
+        {
+            if (value < 144)
+            {
+                put_code(0x30 + value, 8);
+            }
+            else
+            {
+                put_code(0x190 + value - 144, 9);
+            }
+        };
+
+        put(1, 1);
+        put(1, 2);
+
+        size_t pos = 0;
+        for (; pos < length && pos < 251; pos++)
+        {
+            put_literal(static_cast<uint8_t>(pos % 251));
+        }
+
+        for (; length - pos >= 258; pos += 258)
+        {
+            put_code(0xc0 + 5, 8); // Length symbol 285: 258 bytes.
+            put_code(15, 5); // Distance symbol 15: 193 + 6 extra bits.
+            put(251 - 193, 6);
+        }
+
+        for (; pos < length; pos++)
+        {
+            put_literal(static_cast<uint8_t>(pos % 251));
+        }
+
+        put_code(0, 7); // End of block.
+        put(0, 7);
+        return stream;
+    }
+
+    struct zip_test_entry
+    {
+        std::string name;
+        uint16_t method;
+        std::string compressed;
+        std::string uncompressed;
+        uint32_t unix_mode;
+    };
+
+    std::string zip_encode16(const uint32_t value)
+    {
+        return patch_encode64(value).substr(0, 2);
+    }
+
+    std::string zip_encode32(const uint32_t value)
+    {
+        return patch_encode64(value).substr(0, 4);
+    }
+
+    // With zip64 every size and offset is saturated and stored in zip64 extra fields and records instead.
+    std::string zip_build(const std::vector<zip_test_entry>& entries, const bool zip64 = false)
+    {
+        std::string archive;
+        std::string central_directory;
+        for (const auto& entry : entries)
+        {
+            const auto crc = zip_crc32(entry.uncompressed);
+            const auto sizes = zip_encode32(static_cast<uint32_t>(entry.compressed.size()))
+                + zip_encode32(static_cast<uint32_t>(entry.uncompressed.size()));
+            const auto common_head = zip_encode16(zip64 ? 45 : 20) + zip_encode16(0) + zip_encode16(entry.method)
+                + zip_encode32(0) + zip_encode32(crc);
+            const auto name_len = zip_encode16(static_cast<uint32_t>(entry.name.size()));
+
+            const auto extra = zip64
+                ? zip_encode16(0x0001) + zip_encode16(24) + patch_encode64(entry.uncompressed.size())
+                    + patch_encode64(entry.compressed.size()) + patch_encode64(archive.size())
+                : std::string();
+            central_directory += zip_encode32(0x02014b50) + zip_encode16(entry.unix_mode != 0 ? 0x0314 : 0x0014)
+                + common_head + (zip64 ? zip_encode32(0xffffffff) + zip_encode32(0xffffffff) : sizes) + name_len
+                + zip_encode16(static_cast<uint32_t>(extra.size())) + zip_encode16(0) + zip_encode16(0) + zip_encode16(0)
+                + zip_encode32(entry.unix_mode << 16) + zip_encode32(zip64 ? 0xffffffff : static_cast<uint32_t>(archive.size()))
+                + entry.name + extra;
+
+            archive += zip_encode32(0x04034b50) + common_head + sizes + name_len + zip_encode16(0) + entry.name + entry.compressed;
+        }
+
+        const auto central_directory_offset = archive.size();
+        archive += central_directory;
+        if (zip64)
+        {
+            const auto zip64_eocd_offset = archive.size();
+            archive += zip_encode32(0x06064b50) + patch_encode64(44) + zip_encode16(45) + zip_encode16(45)
+                + zip_encode32(0) + zip_encode32(0) + patch_encode64(entries.size()) + patch_encode64(entries.size())
+                + patch_encode64(central_directory.size()) + patch_encode64(central_directory_offset);
+            archive += zip_encode32(0x07064b50) + zip_encode32(0) + patch_encode64(zip64_eocd_offset) + zip_encode32(1);
+        }
+        archive += zip_encode32(0x06054b50) + zip_encode16(0) + zip_encode16(0)
+            + zip_encode16(zip64 ? 0xffff : static_cast<uint32_t>(entries.size()))
+            + zip_encode16(zip64 ? 0xffff : static_cast<uint32_t>(entries.size()))
+            + zip_encode32(zip64 ? 0xffffffff : static_cast<uint32_t>(central_directory.size()))
+            + zip_encode32(zip64 ? 0xffffffff : static_cast<uint32_t>(central_directory_offset))
+            + zip_encode16(7) + "comment";
+        return archive;
+    }
+
+    std::string zip_read(const std::string& filename)
+    {
+        char* data = nullptr;
+        size_t data_len = 0;
+        if (!pal_fs_read_file(filename.c_str(), &data, &data_len))
+        {
+            return std::string();
+        }
+        std::string contents(data, data_len);
+        delete[] data;
+        return contents;
+    }
+
+    TEST(PAL_FS, pal_fs_zip_extract_DoesNotSegfault)
+    {
+        EXPECT_FALSE(pal_fs_zip_extract(nullptr, nullptr, nullptr));
+        EXPECT_FALSE(pal_fs_zip_extract("missing.zip", nullptr, nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_zip_extract)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto archive_filename = testutils::path_combine(working_dir, "test.zip");
+        const auto target_dir = testutils::path_combine(working_dir, "app");
+
+        const auto large = hash_pattern(3 * 1024 * 1024 + 7);
+        const auto stored = hash_pattern(70000);
+        const std::vector<zip_test_entry> entries = {
+            { "lib/", 0, std::string(), std::string(), 0 },
+            { "lib/net/large.bin", 8, zip_deflate_fixed_pattern(large.size()), large, 0 },
+            { "lib\\stored.bin", 0, stored, stored, 0 },
+            { "lib/net/stored_blocks.bin", 8, zip_deflate_stored(stored), stored, 0 },
+            { "docs/fixed.txt", 8, std::string(reinterpret_cast<const char*>(zip_deflate_fixed), sizeof zip_deflate_fixed), zip_release_notes(8), 0 },
+            { "docs/dynamic.txt", 8, std::string(reinterpret_cast<const char*>(zip_deflate_dynamic), sizeof zip_deflate_dynamic), zip_release_notes(32), 0 },
+            { "empty.txt", 0, std::string(), std::string(), 0 },
+            { "empty_dir/", 0, std::string(), std::string(), 0 }
+        };
+
+        const auto archive = zip_build(entries);
+        ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), archive.data(), archive.size()));
+
+        pal_fs_zip_extract_stats_t stats = {};
+        ASSERT_TRUE(pal_fs_zip_extract(archive_filename.c_str(), target_dir.c_str(), &stats));
+        EXPECT_EQ(stats.files_count, 6u);
+        EXPECT_EQ(stats.directories_count, 4u);
+        EXPECT_EQ(stats.bytes_written, large.size() + stored.size() * 2 + zip_release_notes(8).size() + zip_release_notes(32).size());
+        EXPECT_EQ(stats.first_error, 0);
+
+        for (const auto& entry : entries)
+        {
+            auto name = entry.name;
+            std::replace(name.begin(), name.end(), '\\', '/');
+            if (name.back() == '/')
+            {
+                EXPECT_TRUE(pal_fs_directory_exists(testutils::path_combine(target_dir, name.substr(0, name.size() - 1)).c_str()));
+                continue;
+            }
+            EXPECT_TRUE(zip_read(testutils::path_combine(target_dir, name)) == entry.uncompressed) << name;
+        }
+
+        // Entries must not exist yet, and the files that are in the way are left alone.
+        EXPECT_FALSE(pal_fs_zip_extract(archive_filename.c_str(), target_dir.c_str(), nullptr));
+        EXPECT_TRUE(zip_read(testutils::path_combine(target_dir, "lib/net/large.bin")) == large);
+        EXPECT_TRUE(pal_fs_file_exists(testutils::path_combine(target_dir, "empty.txt").c_str()));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_zip_extract_ReadsZip64Archives)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto archive_filename = testutils::path_combine(working_dir, "test.zip");
+        const auto target_dir = testutils::path_combine(working_dir, "app");
+
+        const auto stored = hash_pattern(70000);
+        const std::vector<zip_test_entry> entries = {
+            { "lib/stored.bin", 0, stored, stored, 0 },
+            { "docs/dynamic.txt", 8, std::string(reinterpret_cast<const char*>(zip_deflate_dynamic), sizeof zip_deflate_dynamic), zip_release_notes(32), 0 }
+        };
+
+        const auto archive = zip_build(entries, true);
+        ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), archive.data(), archive.size()));
+
+        pal_fs_zip_extract_stats_t stats = {};
+        ASSERT_TRUE(pal_fs_zip_extract(archive_filename.c_str(), target_dir.c_str(), &stats));
+        EXPECT_EQ(stats.files_count, 2u);
+        for (const auto& entry : entries)
+        {
+            EXPECT_TRUE(zip_read(testutils::path_combine(target_dir, entry.name)) == entry.uncompressed) << entry.name;
+        }
+
+        // The locator sits in front of the end of central directory record and its comment, point it one byte off.
+        auto broken = archive;
+        const auto locator_offset = broken.size() - std::string("comment").size() - 22 - 20;
+        broken[locator_offset + 8] = static_cast<char>(broken[locator_offset + 8] + 1);
+        ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), broken.data(), broken.size()));
+        EXPECT_FALSE(pal_fs_zip_extract(archive_filename.c_str(), testutils::path_combine(working_dir, "x").c_str(), nullptr));
+
+        // Too short to hold a zip64 record in front of the locator, which points at a signature in its own last field.
+        const auto truncated = zip_encode32(0x07064b50) + zip_encode32(0) + patch_encode64(16) + zip_encode32(0x06064b50)
+            + zip_encode32(0x06054b50) + zip_encode16(0) + zip_encode16(0) + zip_encode16(0xffff) + zip_encode16(0xffff)
+            + zip_encode32(0xffffffff) + zip_encode32(0xffffffff) + zip_encode16(0);
+        ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), truncated.data(), truncated.size()));
+        EXPECT_FALSE(pal_fs_zip_extract(archive_filename.c_str(), testutils::path_combine(working_dir, "x").c_str(), nullptr));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_zip_extract_RejectsEntriesOutsideDirectory)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto archive_filename = testutils::path_combine(working_dir, "test.zip");
+        const auto target_dir = testutils::path_combine(working_dir, "app");
+
+        const std::string names[] = { "../evil.txt", "lib/../../evil.txt", "/evil.txt", "..\\evil.txt", "C:evil.txt" };
+        for (const auto& name : names)
+        {
+            const auto archive = zip_build({
+                { "good.txt", 0, "good", "good", 0 },
+                { name, 0, "evil", "evil", 0 }
+            });
+            ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), archive.data(), archive.size()));
+            EXPECT_FALSE(pal_fs_zip_extract(archive_filename.c_str(), target_dir.c_str(), nullptr)) << name;
+            EXPECT_FALSE(pal_fs_file_exists(testutils::path_combine(working_dir, "evil.txt").c_str())) << name;
+            EXPECT_FALSE(pal_fs_file_exists(testutils::path_combine(target_dir, "good.txt").c_str())) << name;
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_zip_extract_RejectsCorruptEntries)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto archive_filename = testutils::path_combine(working_dir, "test.zip");
+
+        const auto notes = zip_release_notes(32);
+        const std::string dynamic(reinterpret_cast<const char*>(zip_deflate_dynamic), sizeof zip_deflate_dynamic);
+        auto corrupt_dynamic = dynamic;
+        corrupt_dynamic[40] = static_cast<char>(corrupt_dynamic[40] ^ 0x10);
+
+        const std::vector<std::vector<zip_test_entry>> archives = {
+            { { "crc.txt", 0, "abcd", "abce", 0 } },
+            { { "truncated.txt", 8, dynamic.substr(0, dynamic.size() - 10), notes, 0 } },
+            { { "corrupt.txt", 8, corrupt_dynamic, notes, 0 } },
+            { { "size.txt", 8, dynamic, notes.substr(1), 0 } },
+            { { "method.txt", 12, "abcd", "abcd", 0 } }
+        };
+
+        for (auto i = 0u; i < archives.size(); i++)
+        {
+            const auto target_dir = testutils::path_combine(working_dir, std::to_string(i));
+            const auto archive = zip_build(archives[i]);
+            ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), archive.data(), archive.size()));
+
+            pal_fs_zip_extract_stats_t stats = {};
+            EXPECT_FALSE(pal_fs_zip_extract(archive_filename.c_str(), target_dir.c_str(), &stats)) << i;
+            EXPECT_FALSE(pal_fs_file_exists(testutils::path_combine(target_dir, archives[i][0].name).c_str())) << i;
+        }
+
+        // Not an archive, and an archive cut short in its central directory.
+        const auto valid = zip_build({ { "a.txt", 0, "a", "a", 0 } });
+        for (const auto& archive : { std::string("not a zip archive"), valid.substr(0, valid.size() - 30) })
+        {
+            ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), archive.data(), archive.size()));
+            EXPECT_FALSE(pal_fs_zip_extract(archive_filename.c_str(), testutils::path_combine(working_dir, "x").c_str(), nullptr));
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_pack_DoesNotSegfault)
+    {
+        pal_fs_pack_t* pack = nullptr;
+        pal_fs_pack_entry_t entry = {};
+        EXPECT_FALSE(pal_fs_pack_create(nullptr, nullptr, nullptr, 0, PAL_HASH_SHA256));
+        EXPECT_FALSE(pal_fs_pack_open(nullptr, &pack));
+        EXPECT_FALSE(pal_fs_pack_open("missing.pack", &pack));
+        EXPECT_FALSE(pal_fs_pack_get_info(nullptr, nullptr, nullptr));
+        EXPECT_FALSE(pal_fs_pack_get_entry(nullptr, 0, &entry));
+        EXPECT_FALSE(pal_fs_pack_find(nullptr, "a", &entry));
+        EXPECT_FALSE(pal_fs_pack_install(nullptr, nullptr, FALSE, nullptr));
+        EXPECT_FALSE(pal_fs_pack_free(nullptr));
+    }
+
+    TEST(PAL_FS, pal_fs_pack)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto app_dir = testutils::path_combine(working_dir, "app");
+        const auto install_dir = testutils::path_combine(working_dir, "installed");
+        const auto pack_filename = testutils::path_combine(working_dir, "app.pack");
+
+        const std::vector<std::pair<std::string, std::string>> files = {
+            { "lib/net/large.dll", hash_pattern(1024 * 1024 + 3) },
+            { "demoapp", hash_pattern(4097) },
+            { "lib/block.bin", hash_pattern(4096) },
+            { "empty.txt", std::string() },
+            { "lib/one.txt", "1" }
+        };
+
+        std::vector<const char*> paths;
+        ASSERT_TRUE(pal_fs_mkdirp(testutils::path_combine(app_dir, "lib/net").c_str(), 0777));
+        for (const auto& file : files)
+        {
+            ASSERT_TRUE(pal_fs_write(testutils::path_combine(app_dir, file.first).c_str(), file.second.data(), file.second.size()));
+            paths.push_back(file.first.c_str());
+        }
+
+        ASSERT_TRUE(pal_fs_pack_create(pack_filename.c_str(), app_dir.c_str(), paths.data(), paths.size(), PAL_HASH_BLAKE3));
+
+        size_t pack_len = 0;
+        ASSERT_TRUE(pal_fs_get_file_size(pack_filename.c_str(), &pack_len));
+        EXPECT_EQ(pack_len % 4096, 0u);
+
+        pal_fs_pack_t* pack = nullptr;
+        ASSERT_TRUE(pal_fs_pack_open(pack_filename.c_str(), &pack));
+
+        size_t entries_len = 0;
+        uint32_t algorithm = PAL_HASH_SHA256;
+        ASSERT_TRUE(pal_fs_pack_get_info(pack, &entries_len, &algorithm));
+        EXPECT_EQ(entries_len, files.size());
+        EXPECT_EQ(algorithm, static_cast<uint32_t>(PAL_HASH_BLAKE3));
+
+        // The index is sorted and every payload is page aligned inside the pack.
+        std::string previous_path;
+        pal_fs_pack_entry_t first_entry = {};
+        ASSERT_TRUE(pal_fs_pack_get_entry(pack, 0, &first_entry));
+        for (auto i = 0u; i < entries_len; i++)
+        {
+            pal_fs_pack_entry_t entry = {};
+            ASSERT_TRUE(pal_fs_pack_get_entry(pack, i, &entry));
+            EXPECT_LT(previous_path, std::string(entry.path));
+            EXPECT_EQ((entry.data - first_entry.data) % 4096, 0);
+            previous_path = entry.path;
+        }
+        pal_fs_pack_entry_t entry = {};
+        EXPECT_FALSE(pal_fs_pack_get_entry(pack, entries_len, &entry));
+
+        for (const auto& file : files)
+        {
+            ASSERT_TRUE(pal_fs_pack_find(pack, file.first.c_str(), &entry)) << file.first;
+            EXPECT_EQ(entry.size, file.second.size());
+            EXPECT_TRUE(std::string(reinterpret_cast<const char*>(entry.data), entry.size) == file.second);
+
+            uint8_t digest[PAL_HASH_DIGEST_SIZE];
+            ASSERT_TRUE(pal_hash_file(testutils::path_combine(app_dir, file.first).c_str(), PAL_HASH_BLAKE3, FALSE, digest));
+            EXPECT_EQ(0, std::memcmp(digest, entry.digest, PAL_HASH_DIGEST_SIZE));
+        }
+        EXPECT_FALSE(pal_fs_pack_find(pack, "lib", &entry));
+        EXPECT_FALSE(pal_fs_pack_find(pack, "missing", &entry));
+
+        pal_fs_pack_install_stats_t stats = {};
+        ASSERT_TRUE(pal_fs_pack_install(pack, install_dir.c_str(), TRUE, &stats));
+        EXPECT_EQ(stats.files_count, files.size());
+        EXPECT_EQ(stats.first_error, 0);
+
+        uint64_t total_len = 0;
+        for (const auto& file : files)
+        {
+            total_len += file.second.size();
+            EXPECT_TRUE(zip_read(testutils::path_combine(install_dir, file.first)) == file.second) << file.first;
+        }
+        EXPECT_LE(stats.bytes_copied, total_len);
+
+        // Files must not exist yet, and the files that are in the way are left alone.
+        EXPECT_FALSE(pal_fs_pack_install(pack, install_dir.c_str(), FALSE, nullptr));
+        for (const auto& file : files)
+        {
+            EXPECT_TRUE(zip_read(testutils::path_combine(install_dir, file.first)) == file.second) << file.first;
+        }
+
+        EXPECT_TRUE(pal_fs_pack_free(pack));
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS, pal_fs_pack_RejectsInvalidPacks)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto app_dir = testutils::mkdir_random(working_dir);
+        const auto pack_filename = testutils::path_combine(working_dir, "app.pack");
+
+        const auto data = hash_pattern(5000);
+        ASSERT_TRUE(pal_fs_write(testutils::path_combine(app_dir, "a.bin").c_str(), data.data(), data.size()));
+        ASSERT_TRUE(pal_fs_write(testutils::path_combine(app_dir, "b.bin").c_str(), data.data(), data.size()));
+
+        const char* escaping_paths[] = { "../a.bin" };
+        EXPECT_FALSE(pal_fs_pack_create(pack_filename.c_str(), app_dir.c_str(), escaping_paths, 1, PAL_HASH_SHA256));
+        const char* duplicate_paths[] = { "a.bin", "a.bin" };
+        EXPECT_FALSE(pal_fs_pack_create(pack_filename.c_str(), app_dir.c_str(), duplicate_paths, 2, PAL_HASH_SHA256));
+        const char* missing_paths[] = { "missing.bin" };
+        EXPECT_FALSE(pal_fs_pack_create(pack_filename.c_str(), app_dir.c_str(), missing_paths, 1, PAL_HASH_SHA256));
+        EXPECT_FALSE(pal_fs_file_exists(pack_filename.c_str()));
+
+        const char* paths[] = { "b.bin", "a.bin" };
+        ASSERT_TRUE(pal_fs_pack_create(pack_filename.c_str(), app_dir.c_str(), paths, 2, PAL_HASH_SHA256));
+        const auto valid = zip_read(pack_filename);
+        ASSERT_FALSE(valid.empty());
+
+        // Truncated, bad magic, names swapped so that the index is no longer sorted, and a path escaping the directory.
+        auto unsorted = valid;
+        const auto names_offset = 64 + 2 * 64;
+        std::swap(unsorted[names_offset], unsorted[names_offset + 6]);
+        auto escaping = valid;
+        escaping.replace(names_offset, 5, "../ab");
+        const std::string invalid_packs[] = {
+            valid.substr(0, valid.size() - 1),
+            "SNAPXPK0" + valid.substr(8),
+            unsorted,
+            escaping,
+            std::string()
+        };
+
+        pal_fs_pack_t* pack = nullptr;
+        for (const auto& invalid_pack : invalid_packs)
+        {
+            ASSERT_TRUE(pal_fs_write(pack_filename.c_str(), invalid_pack.data(), invalid_pack.size()));
+            EXPECT_FALSE(pal_fs_pack_open(pack_filename.c_str(), &pack));
+        }
+
+        // A corrupt payload is only noticed when installing with verification.
+        auto corrupt = valid;
+        corrupt[corrupt.size() - 4096 - 1] = static_cast<char>(corrupt[corrupt.size() - 4096 - 1] ^ 1);
+        ASSERT_TRUE(pal_fs_write(pack_filename.c_str(), corrupt.data(), corrupt.size()));
+        ASSERT_TRUE(pal_fs_pack_open(pack_filename.c_str(), &pack));
+
+        const auto verified_dir = testutils::path_combine(working_dir, "verified");
+        pal_fs_pack_install_stats_t stats = {};
+        EXPECT_FALSE(pal_fs_pack_install(pack, verified_dir.c_str(), TRUE, &stats));
+        EXPECT_NE(stats.first_error, 0);
+        EXPECT_FALSE(pal_fs_file_exists(testutils::path_combine(verified_dir, "b.bin").c_str()));
+
+        EXPECT_TRUE(pal_fs_pack_install(pack, testutils::path_combine(working_dir, "trusted").c_str(), FALSE, nullptr));
+
+        EXPECT_TRUE(pal_fs_pack_free(pack));
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
 }
@@ -1,6 +1,13 @@
 #include "gtest/gtest.h"
 #include "pal/pal.hpp"
 #include "tests/support/utils.hpp"
+#include <sched.h>
+#include <fcntl.h> // AT_FDCWD
+#include <sys/stat.h> // utimensat
+#include <sys/resource.h> // getrlimit
+#include <algorithm>
+#include <sstream>
+#include <thread>
 #include <vector>
 
 using testutils = corerun::support::util::test_utils;
@@ -147,6 +154,439 @@ namespace
         ASSERT_EQ(exit_code, 0);
     }
 
+    TEST(PAL_GENERIC_UNIX, pal_process_exec_ex_ReportsResourceUsage)
+    {
+        char arg0[] = "-c";
+        char arg1[] = "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done; exit 3";
+        char* argv[] = { arg0, arg1 };
+
+        pal_process_exec_stats_t stats = {};
+        ASSERT_TRUE(pal_process_exec_ex("sh", nullptr, 2, argv, 0, 0, &stats));
+        EXPECT_EQ(stats.exit_code, 3);
+        EXPECT_EQ(stats.term_signal, 0);
+        EXPECT_FALSE(stats.timed_out);
+        EXPECT_GT(stats.wall_time_us, 0u);
+        EXPECT_GT(stats.user_time_us + stats.system_time_us, 0u);
+        EXPECT_GT(stats.max_rss_kb, 0u);
+        EXPECT_GT(stats.minor_faults, 0u);
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_exec_ex_EscalatesToSigkillAfterTimeout)
+    {
+        char arg0[] = "-c";
+        char arg1[] = "trap '' TERM; exec sleep 10";
+        char* argv[] = { arg0, arg1 };
+
+        pal_process_exec_stats_t stats = {};
+        ASSERT_TRUE(pal_process_exec_ex("sh", nullptr, 2, argv, 100, 100, &stats));
+        EXPECT_TRUE(stats.timed_out);
+        EXPECT_EQ(stats.term_signal, SIGKILL);
+        EXPECT_EQ(stats.exit_code, 128 + SIGKILL);
+        EXPECT_LT(stats.wall_time_us, 5000000u);
+
+        char arg2[] = "exec sleep 10";
+        argv[1] = arg2;
+        ASSERT_TRUE(pal_process_exec_ex("sh", nullptr, 2, argv, 100, 5000, &stats));
+        EXPECT_TRUE(stats.timed_out);
+        EXPECT_EQ(stats.term_signal, SIGTERM);
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_exec_ex_FailsWhenExecutableIsMissing)
+    {
+        const auto cwd = testutils::get_process_cwd();
+        pal_process_exec_stats_t stats = {};
+        ASSERT_FALSE(pal_process_exec_ex("corerun-does-not-exist", nullptr, 0, nullptr, 0, 0, &stats));
+        ASSERT_FALSE(pal_process_exec_ex("ls", "/corerun-does-not-exist", 0, nullptr, 0, 0, &stats));
+        ASSERT_TRUE(pal_process_exec_ex("ls", "/", 0, nullptr, 0, 0, &stats));
+        EXPECT_EQ(testutils::get_process_cwd(), cwd);
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_sampler_StopsWhenProcessExits)
+    {
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            usleep(100 * 1000);
+            _exit(0);
+        }
+
+        pal_process_sampler_t* sampler = nullptr;
+        ASSERT_TRUE(pal_process_sampler_create(child_pid, &sampler));
+
+        pal_process_sample_t sample = {};
+        ASSERT_TRUE(pal_process_sampler_sample(sampler, &sample));
+        EXPECT_EQ(sample.threads_count, 1u);
+
+        BOOL exited = FALSE;
+        ASSERT_TRUE(pal_process_wait_exit(child_pid, 5000, &exited));
+        EXPECT_TRUE(exited);
+        ASSERT_EQ(waitpid(child_pid, nullptr, 0), child_pid);
+
+        EXPECT_FALSE(pal_process_sampler_sample(sampler, &sample));
+        ASSERT_TRUE(pal_process_sampler_free(sampler));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_HoldsGatedProcessUntilReleased)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        char arg0[] = "-c";
+        char arg1[] = "[ -n \"$(head -c 1 <&$SNAPX_CORERUN_STANDBY_FD)\" ] && echo released > gate.txt || echo cancelled > gate.txt";
+        char* argv[] = { arg0, arg1 };
+
+        pal_process_spawn_options_t options = {};
+        options.gated = TRUE;
+
+        for (const auto release : { true, false })
+        {
+            pal_pid_t pid = 0;
+            pal_process_gate_t* gate = nullptr;
+            ASSERT_TRUE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, &gate));
+            ASSERT_NE(gate, nullptr);
+
+            pal_sleep_ms(50);
+            BOOL exited = TRUE;
+            ASSERT_TRUE(pal_process_wait_exit(pid, 0, &exited));
+            EXPECT_FALSE(exited);
+
+            ASSERT_TRUE(release ? pal_process_gate_release(gate) : pal_process_gate_cancel(gate));
+            ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+
+            char* data = nullptr;
+            size_t data_len = 0;
+            ASSERT_TRUE(pal_fs_read_file(testutils::path_combine(working_dir, "gate.txt").c_str(), &data, &data_len));
+            EXPECT_EQ(std::string(data, data_len), release ? "released\n" : "cancelled\n");
+            delete[] data;
+        }
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_CapturesOutputInRotatedLogs)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto log_filename = testutils::path_combine(working_dir, "app.log");
+        char arg0[] = "-c";
+        char arg1[] = "for i in 0 1 2 3 4 5 6 7 8 9; do echo line-$i; echo error-$i >&2; done";
+        char* argv[] = { arg0, arg1 };
+
+        pal_process_spawn_options_t options = {};
+        options.output_log_filename = log_filename.c_str();
+        options.output_log_max_bytes = 40;
+        options.output_log_max_files = 10;
+
+        pal_pid_t pid = 0;
+        ASSERT_TRUE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, nullptr));
+        ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+
+        std::string expected;
+        for (auto i = 0; i < 10; i++)
+        {
+            expected += "line-" + std::to_string(i) + "\nerror-" + std::to_string(i) + "\n";
+        }
+
+        // The pump finishes on its own once it read everything, the rotated logs hold whole lines.
+        std::string output;
+        size_t rotated_count = 0;
+        for (auto attempt = 0; attempt < 100 && output != expected; attempt++)
+        {
+            pal_sleep_ms(50);
+            output.clear();
+            rotated_count = 0;
+            for (auto i = 10; i >= 0; i--)
+            {
+                const auto filename = i == 0 ? log_filename : log_filename + "." + std::to_string(i);
+                char* data = nullptr;
+                size_t data_len = 0;
+                if (!pal_fs_read_file(filename.c_str(), &data, &data_len))
+                {
+                    continue;
+                }
+                const std::string log(data, data_len);
+                delete[] data;
+                if (i > 0)
+                {
+                    rotated_count++;
+                    EXPECT_EQ(log.back(), '\n');
+                }
+                output += log;
+            }
+        }
+
+        EXPECT_EQ(output, expected);
+        EXPECT_GE(rotated_count, 3u);
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_SharesOutputLogBetweenInstances)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto log_filename = testutils::path_combine(working_dir, "app.log");
+
+        pal_process_spawn_options_t options = {};
+        options.output_log_filename = log_filename.c_str();
+        options.output_log_max_bytes = 64;
+        options.output_log_max_files = 50;
+
+        // Two instances write at the same time, like a released standby next to the previous version.
+        std::vector<pal_pid_t> pids;
+        std::vector<std::string> expected;
+        for (const auto* name : { "a", "b" })
+        {
+            char arg0[] = "-c";
+            auto script = std::string("for i in $(seq 10 49); do echo ") + name + "-$i; done";
+            char* argv[] = { arg0, &script[0] };
+
+            pal_pid_t pid = 0;
+            ASSERT_TRUE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, nullptr));
+            pids.push_back(pid);
+
+            for (auto i = 10; i < 50; i++)
+            {
+                expected.push_back(std::string(name) + "-" + std::to_string(i));
+            }
+        }
+        for (const auto pid : pids)
+        {
+            ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+        }
+        std::sort(expected.begin(), expected.end());
+
+        // Every line ends up in exactly one of the logs, nothing is overwritten by the other pump.
+        std::vector<std::string> lines;
+        for (auto attempt = 0; attempt < 100 && lines != expected; attempt++)
+        {
+            pal_sleep_ms(50);
+            lines.clear();
+            for (auto i = 0; i <= 50; i++)
+            {
+                const auto filename = i == 0 ? log_filename : log_filename + "." + std::to_string(i);
+                char* data = nullptr;
+                size_t data_len = 0;
+                if (!pal_fs_read_file(filename.c_str(), &data, &data_len))
+                {
+                    continue;
+                }
+                std::istringstream log(std::string(data, data_len));
+                delete[] data;
+                for (std::string line; std::getline(log, line);)
+                {
+                    lines.push_back(line);
+                }
+            }
+            std::sort(lines.begin(), lines.end());
+        }
+
+        EXPECT_EQ(lines, expected);
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_MergesEnvironment)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        ASSERT_TRUE(pal_env_set("CORERUN_TESTS_REPLACED", "inherited"));
+        ASSERT_TRUE(pal_env_set("CORERUN_TESTS_REMOVED", "inherited"));
+
+        char arg0[] = "-c";
+        char arg1[] = "echo \"$CORERUN_TESTS_REPLACED ${CORERUN_TESTS_REMOVED-unset} $CORERUN_TESTS_ADDED\" > env.txt";
+        char* argv[] = { arg0, arg1 };
+        const char* environment[] = { "CORERUN_TESTS_REPLACED=profile", "CORERUN_TESTS_REMOVED", "CORERUN_TESTS_ADDED=a=b" };
+
+        pal_process_spawn_options_t options = {};
+        options.environment = environment;
+        options.environment_len = 3;
+
+        pal_pid_t pid = 0;
+        ASSERT_TRUE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, nullptr));
+        ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+        unsetenv("CORERUN_TESTS_REPLACED");
+        unsetenv("CORERUN_TESTS_REMOVED");
+
+        char* data = nullptr;
+        size_t data_len = 0;
+        ASSERT_TRUE(pal_fs_read_file(testutils::path_combine(working_dir, "env.txt").c_str(), &data, &data_len));
+        EXPECT_EQ(std::string(data, data_len), "profile unset a=b\n");
+        delete[] data;
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_AppliesLaunchPolicy)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+
+        // Only settings an unprivileged process may change: a cpu it already runs on, lower priorities and limits.
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        ASSERT_EQ(sched_getaffinity(0, sizeof(cpu_set), &cpu_set), 0);
+        uint32_t cpu = 0;
+        while (!CPU_ISSET(cpu, &cpu_set))
+        {
+            cpu++;
+        }
+
+        pal_process_launch_policy_t policy = {};
+        policy.affinity_cpus = &cpu;
+        policy.affinity_cpus_len = 1;
+        policy.scheduler = PAL_PROCESS_SCHEDULER_BATCH;
+        policy.nice_set = TRUE;
+        policy.nice = 5;
+        policy.io_class = PAL_PROCESS_IO_CLASS_BEST_EFFORT;
+        policy.io_level = 7;
+        policy.oom_score_adj_set = TRUE;
+        policy.oom_score_adj = 500;
+        policy.rlimit_nofile = 256;
+
+        char arg0[] = "-c";
+        char arg1[] = "echo \"$(grep Cpus_allowed_list /proc/$$/status | cut -f2) $(cut -d' ' -f19 /proc/$$/stat)"
+            " $(cat /proc/$$/oom_score_adj) $(ulimit -n) $(ulimit -Hn)\" > policy.txt";
+        char* argv[] = { arg0, arg1 };
+
+        pal_process_spawn_options_t options = {};
+        options.policy = &policy;
+
+        pal_pid_t pid = 0;
+        ASSERT_TRUE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, nullptr));
+        ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+
+        char* data = nullptr;
+        size_t data_len = 0;
+        ASSERT_TRUE(pal_fs_read_file(testutils::path_combine(working_dir, "policy.txt").c_str(), &data, &data_len));
+        // The hard limit is inherited.
+        struct rlimit nofile = {};
+        ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &nofile), 0);
+        const auto hard_limit = nofile.rlim_max == RLIM_INFINITY ? std::string("unlimited") : std::to_string(nofile.rlim_max);
+        EXPECT_EQ(std::string(data, data_len), std::to_string(cpu) + " 5 500 256 " + hard_limit + "\n");
+        delete[] data;
+
+        policy.io_level = 8;
+        EXPECT_FALSE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, nullptr));
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_FailsWhenExecutableIsMissing)
+    {
+        pal_process_spawn_options_t options = {};
+        options.gated = TRUE;
+
+        pal_pid_t pid = 0;
+        pal_process_gate_t* gate = nullptr;
+        EXPECT_FALSE(pal_process_daemonize_ex("corerun-does-not-exist", "/", 0, nullptr, &options, &pid, &gate));
+        EXPECT_EQ(gate, nullptr);
+        EXPECT_FALSE(pal_process_daemonize_ex("sh", "/", 0, nullptr, &options, &pid, nullptr));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_standby_wait_ReadsGateFromEnvironment)
+    {
+        int gate_pipe[2];
+        ASSERT_EQ(pipe(gate_pipe), 0);
+        ASSERT_TRUE(pal_env_set("SNAPX_CORERUN_STANDBY_FD", std::to_string(gate_pipe[0]).c_str()));
+        ASSERT_EQ(write(gate_pipe[1], "1", 1), 1);
+        close(gate_pipe[1]);
+
+        BOOL released = FALSE;
+        ASSERT_TRUE(pal_standby_wait(&released));
+        EXPECT_TRUE(released);
+        EXPECT_EQ(getenv("SNAPX_CORERUN_STANDBY_FD"), nullptr);
+        EXPECT_EQ(fcntl(gate_pipe[0], F_GETFD), -1);
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_socket_listen_RejectsInvalidAddresses)
+    {
+        pal_socket_t listen_socket;
+        EXPECT_FALSE(pal_socket_listen(nullptr, &listen_socket));
+        EXPECT_FALSE(pal_socket_listen("udp:127.0.0.1:0", &listen_socket));
+        EXPECT_FALSE(pal_socket_listen("tcp:", &listen_socket));
+        EXPECT_FALSE(pal_socket_listen("tcp:127.0.0.1:http", &listen_socket));
+        EXPECT_FALSE(pal_socket_listen("unix:", &listen_socket));
+
+        ASSERT_TRUE(pal_socket_listen("tcp:127.0.0.1:0", &listen_socket));
+        uint16_t port = 0;
+        ASSERT_TRUE(pal_socket_get_port(listen_socket, &port));
+        EXPECT_NE(port, 0);
+        ASSERT_TRUE(pal_socket_close(listen_socket));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_daemonize_ex_PassesListenSockets)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto address = "unix:" + testutils::path_combine(working_dir, "app.sock");
+
+        pal_socket_t listen_socket;
+        ASSERT_TRUE(pal_socket_listen(address.c_str(), &listen_socket));
+
+        char arg0[] = "-c";
+        char arg1[] = "echo \"$LISTEN_FDS $LISTEN_PID $$ $(readlink /proc/$$/fd/3)\" > fds.txt";
+        char* argv[] = { arg0, arg1 };
+
+        pal_process_spawn_options_t options = {};
+        options.listen_sockets = &listen_socket;
+        options.listen_sockets_len = 1;
+
+        pal_pid_t pid = 0;
+        ASSERT_TRUE(pal_process_daemonize_ex("sh", working_dir.c_str(), 2, argv, &options, &pid, nullptr));
+        ASSERT_EQ(waitpid(pid, nullptr, 0), pid);
+
+        char* data = nullptr;
+        size_t data_len = 0;
+        ASSERT_TRUE(pal_fs_read_file(testutils::path_combine(working_dir, "fds.txt").c_str(), &data, &data_len));
+        const auto expected = "1 " + std::to_string(pid) + " " + std::to_string(pid) + " socket:[";
+        EXPECT_EQ(std::string(data, data_len).rfind(expected, 0), 0u) << std::string(data, data_len);
+        delete[] data;
+
+        // The socket outlives the process and is found again among inherited fds.
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            if (listen_socket != 3 && (dup2(listen_socket, 3) != 3 || close(listen_socket) != 0))
+            {
+                _exit(1);
+            }
+
+            pal_socket_t inherited_socket = -1;
+            const auto found = setenv("LISTEN_FDS", "1", 1) == 0
+                && pal_socket_listen_inherited(address.c_str(), &inherited_socket)
+                && inherited_socket == 3
+                && !pal_socket_listen_inherited("unix:/corerun-does-not-exist.sock", &inherited_socket);
+            _exit(found ? 0 : 1);
+        }
+
+        auto status = 0;
+        ASSERT_EQ(waitpid(child_pid, &status, 0), child_pid);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        ASSERT_TRUE(pal_socket_close(listen_socket));
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_socket_listen_ReplacesOnlyStaleUnixSockets)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto path = testutils::path_combine(working_dir, "app.sock");
+        const auto address = "unix:" + path;
+
+        pal_socket_t listen_socket;
+        ASSERT_TRUE(pal_socket_listen(address.c_str(), &listen_socket));
+
+        // The socket file of a live listener stays in place.
+        pal_socket_t second_socket;
+        errno = 0;
+        EXPECT_FALSE(pal_socket_listen(address.c_str(), &second_socket));
+        EXPECT_EQ(errno, EADDRINUSE);
+        EXPECT_TRUE(pal_fs_file_exists(path.c_str()));
+
+        // Closing the listener leaves the file behind, which refuses connections from now on.
+        ASSERT_TRUE(pal_socket_close(listen_socket));
+        ASSERT_TRUE(pal_socket_listen(address.c_str(), &listen_socket));
+        ASSERT_TRUE(pal_socket_close(listen_socket));
+
+        // Anything but a socket is never removed.
+        ASSERT_TRUE(pal_fs_rmfile(path.c_str()));
+        ASSERT_TRUE(pal_fs_write(path.c_str(), "data", 4));
+        EXPECT_FALSE(pal_socket_listen(address.c_str(), &listen_socket));
+        EXPECT_TRUE(pal_fs_file_exists(path.c_str()));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
     TEST(PAL_ENV_UNIX, pal_env_get_variable_Reads_PWD_Variable)
     {
         char *environment_variable = nullptr;
@@ -169,6 +609,429 @@ namespace
         ASSERT_TRUE(pal_fs_directory_exists(working_dir));
     }
 
+    TEST(PAL_FS_UNIX, pal_fs_read_file_ReadsProcfsFilesWithoutReliableSize)
+    {
+        char* data = nullptr;
+        size_t data_len = 0;
+        ASSERT_TRUE(pal_fs_read_file("/proc/self/status", &data, &data_len));
+        ASSERT_GT(data_len, 0u);
+        EXPECT_EQ(std::string(data, data_len).rfind("Name:", 0), 0u);
+        delete[] data;
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_rmdir_recursive_RemovesDeepTrees)
+    {
+        const auto parent_dir = testutils::mkdir_random(testutils::get_process_cwd());
+
+        auto directory = parent_dir;
+        for (auto depth = 0; depth < 200; depth++)
+        {
+            directory += "/d";
+            ASSERT_TRUE(pal_fs_mkdir(directory.c_str(), 0777));
+        }
+        testutils::mkfile(directory, "test.txt");
+
+        pal_fs_rmdir_stats_t stats = {};
+        EXPECT_TRUE(pal_fs_rmdir_recursive(parent_dir.c_str(), FALSE, &stats));
+        EXPECT_FALSE(pal_fs_directory_exists(parent_dir.c_str()));
+        EXPECT_EQ(stats.removed_count, 1u + 200u + 1u);
+        EXPECT_EQ(stats.first_error, 0);
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_rmdir_recursive_RunsInParallelAfterForkAndSharedPoolTeardown)
+    {
+        const auto make_tree = []
+        {
+            const auto parent_dir = testutils::mkdir_random(testutils::get_process_cwd());
+            for (auto i = 0; i < 16; i++)
+            {
+                const auto sub_dir = testutils::mkdir(parent_dir, ("subdirectory" + std::to_string(i)).c_str());
+                testutils::mkfile(sub_dir, "test.txt");
+            }
+            return parent_dir;
+        };
+
+        // Starts the shared pool in the parent.
+        ASSERT_TRUE(pal_fs_rmdir_recursive(make_tree().c_str(), TRUE, nullptr));
+
+        const auto child_dir = make_tree();
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            _exit(pal_fs_rmdir_recursive(child_dir.c_str(), TRUE, nullptr) ? 0 : 1);
+        }
+
+        int status = 0;
+        ASSERT_EQ(waitpid(child_pid, &status, 0), child_pid);
+        ASSERT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(WEXITSTATUS(status), 0);
+        EXPECT_FALSE(pal_fs_directory_exists(child_dir.c_str()));
+
+        ASSERT_TRUE(pal_threadpool_free_shared());
+        const auto parent_dir = make_tree();
+        EXPECT_TRUE(pal_fs_rmdir_recursive(parent_dir.c_str(), TRUE, nullptr));
+        EXPECT_FALSE(pal_fs_directory_exists(parent_dir.c_str()));
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_stat_DoesNotFollowSymlinksWhenAsked)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, "target.txt");
+        const auto link = testutils::path_combine(working_dir, "link");
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), "data", 4));
+        ASSERT_EQ(0, symlink(filename.c_str(), link.c_str()));
+
+        pal_fs_stat_t link_stat;
+        ASSERT_TRUE(pal_fs_stat(link.c_str(), FALSE, &link_stat));
+        EXPECT_EQ(link_stat.type, static_cast<uint32_t>(PAL_FS_TYPE_SYMLINK));
+
+        pal_fs_stat_t target_stat;
+        ASSERT_TRUE(pal_fs_stat(link.c_str(), TRUE, &target_stat));
+        EXPECT_EQ(target_stat.type, static_cast<uint32_t>(PAL_FS_TYPE_FILE));
+        EXPECT_EQ(target_stat.size, 4u);
+        EXPECT_NE(target_stat.inode, link_stat.inode);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_batch_execute_ReadsProcfsFilesAndAbsolutePaths)
+    {
+        for (const auto use_io_uring : { TRUE, FALSE })
+        {
+            pal_fs_batch_t* batch = nullptr;
+            ASSERT_TRUE(pal_fs_batch_create("/proc/self", use_io_uring, &batch));
+
+            pal_fs_batch_op_t ops[2] = {};
+            ops[0].type = PAL_FS_BATCH_OP_READ;
+            ops[0].path = "status";
+            ops[1].type = PAL_FS_BATCH_OP_READ;
+            ops[1].path = "/proc/self/cmdline";
+
+            EXPECT_TRUE(pal_fs_batch_execute(batch, ops, 2));
+            for (const auto& op : ops)
+            {
+                EXPECT_EQ(op.error, 0);
+                EXPECT_GT(op.data_len, 0u);
+                delete[] op.data;
+            }
+
+            EXPECT_TRUE(pal_fs_batch_free(batch));
+        }
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_verify_directory_SkipsUnchangedFilesUsingCache)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto cache_filename = testutils::path_combine(working_dir, "verify.cache");
+
+        // Files modified within the last seconds are never cached, so pretend they are an hour old.
+        const auto backdate = [&](const std::string& filename, const time_t seconds_ago)
+        {
+            struct timespec times[2] = {};
+            times[0].tv_sec = times[1].tv_sec = time(nullptr) - seconds_ago;
+            ASSERT_EQ(utimensat(AT_FDCWD, filename.c_str(), times, 0), 0);
+        };
+
+        const std::string data(8192, 'a');
+        std::vector<pal_fs_verify_entry_t> entries(16);
+        std::vector<std::string> names;
+        names.reserve(entries.size());
+        for (auto i = 0u; i < entries.size(); i++)
+        {
+            names.emplace_back(std::to_string(i) + ".bin");
+            const auto filename = testutils::path_combine(working_dir, names[i]);
+            ASSERT_TRUE(pal_fs_write(filename.c_str(), data.data(), data.size()));
+            backdate(filename, 3600);
+
+            entries[i].path = names[i].c_str();
+            entries[i].size = data.size();
+            ASSERT_TRUE(pal_hash_file(filename.c_str(), PAL_HASH_SHA256, TRUE, entries[i].digest));
+        }
+
+        ASSERT_TRUE(pal_fs_verify_directory(working_dir.c_str(), PAL_HASH_SHA256, entries.data(), entries.size(), cache_filename.c_str()));
+        for (const auto& entry : entries)
+        {
+            EXPECT_FALSE(entry.cached);
+        }
+
+        ASSERT_TRUE(pal_fs_verify_directory(working_dir.c_str(), PAL_HASH_SHA256, entries.data(), entries.size(), cache_filename.c_str()));
+        for (const auto& entry : entries)
+        {
+            EXPECT_TRUE(entry.cached);
+        }
+
+        // Same size, different contents and mtime.
+        const auto modified_filename = testutils::path_combine(working_dir, names[3]);
+        const std::string modified_data(data.size(), 'b');
+        ASSERT_TRUE(pal_fs_write(modified_filename.c_str(), modified_data.data(), modified_data.size()));
+        backdate(modified_filename, 1800);
+
+        EXPECT_FALSE(pal_fs_verify_directory(working_dir.c_str(), PAL_HASH_SHA256, entries.data(), entries.size(), cache_filename.c_str()));
+        EXPECT_EQ(entries[3].status, static_cast<uint32_t>(PAL_FS_VERIFY_HASH_MISMATCH));
+        EXPECT_FALSE(entries[3].cached);
+        EXPECT_TRUE(entries[4].cached);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_patch_apply_KeepsPermissionsOfOldFile)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto old_filename = testutils::path_combine(working_dir, "demoapp");
+        const auto patch_filename = testutils::path_combine(working_dir, "demoapp.patch");
+        const auto new_filename = testutils::path_combine(working_dir, "demoapp.new");
+
+        ASSERT_TRUE(pal_fs_write(old_filename.c_str(), "old", 3));
+        ASSERT_EQ(chmod(old_filename.c_str(), 0750), 0);
+
+        // No records, the new file is empty.
+        const std::string patch = std::string("SNAPXDF1") + '\3' + std::string(15, '\0');
+        ASSERT_TRUE(pal_fs_write(patch_filename.c_str(), patch.data(), patch.size()));
+        ASSERT_TRUE(pal_fs_patch_apply(old_filename.c_str(), patch_filename.c_str(), new_filename.c_str()));
+
+        struct stat new_stat = {};
+        ASSERT_EQ(stat(new_filename.c_str(), &new_stat), 0);
+        EXPECT_EQ(new_stat.st_mode & 07777, 0750u);
+        EXPECT_EQ(new_stat.st_size, 0);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_zip_extract_AppliesUnixPermissions)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto archive_filename = testutils::path_combine(working_dir, "test.zip");
+        const auto target_dir = testutils::path_combine(working_dir, "app");
+
+        const auto le = [](const uint32_t value, const size_t len)
+        {
+            std::string encoded;
+            for (auto i = 0u; i < len; i++)
+            {
+                encoded.push_back(static_cast<char>(value >> (i * 8)));
+            }
+            return encoded;
+        };
+
+        // One empty stored entry made on unix (host 3) with mode 04755, setuid must be dropped.
+        const std::string name = "demoapp";
+        const auto common = le(20, 2) + le(0, 2) + le(0, 2) + le(0, 4) + le(0, 4) + le(0, 4) + le(0, 4) + le(name.size(), 2);
+        const auto local = le(0x04034b50, 4) + common + le(0, 2) + name;
+        const auto central = le(0x02014b50, 4) + le(0x0314, 2) + common + le(0, 2) + le(0, 2) + le(0, 2) + le(0, 2)
+            + le(0104755u << 16, 4) + le(0, 4) + name;
+        const auto archive = local + central + le(0x06054b50, 4) + le(0, 2) + le(0, 2) + le(1, 2) + le(1, 2)
+            + le(central.size(), 4) + le(local.size(), 4) + le(0, 2);
+        ASSERT_TRUE(pal_fs_write(archive_filename.c_str(), archive.data(), archive.size()));
+
+        ASSERT_TRUE(pal_fs_zip_extract(archive_filename.c_str(), target_dir.c_str(), nullptr));
+
+        struct stat extracted_stat = {};
+        ASSERT_EQ(stat(testutils::path_combine(target_dir, name).c_str(), &extracted_stat), 0);
+        EXPECT_EQ(extracted_stat.st_mode & 07777, 0755u);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_FS_UNIX, pal_fs_pack_install_KeepsPermissions)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto app_dir = testutils::mkdir_random(working_dir);
+        const auto install_dir = testutils::path_combine(working_dir, "installed");
+        const auto pack_filename = testutils::path_combine(working_dir, "app.pack");
+
+        ASSERT_TRUE(pal_fs_write(testutils::path_combine(app_dir, "demoapp").c_str(), "demoapp", 7));
+        ASSERT_EQ(chmod(testutils::path_combine(app_dir, "demoapp").c_str(), 0750), 0);
+
+        const char* paths[] = { "demoapp" };
+        ASSERT_TRUE(pal_fs_pack_create(pack_filename.c_str(), app_dir.c_str(), paths, 1, PAL_HASH_SHA256));
+
+        pal_fs_pack_t* pack = nullptr;
+        ASSERT_TRUE(pal_fs_pack_open(pack_filename.c_str(), &pack));
+        pal_fs_pack_install_stats_t stats = {};
+        ASSERT_TRUE(pal_fs_pack_install(pack, install_dir.c_str(), TRUE, &stats));
+        EXPECT_TRUE(pal_fs_pack_free(pack));
+
+        // Either reflinked or copied, depending on the filesystem.
+        EXPECT_EQ(stats.cloned_count == 1 ? 0u : 7u, stats.bytes_copied);
+
+        struct stat installed_stat = {};
+        ASSERT_EQ(stat(testutils::path_combine(install_dir, "demoapp").c_str(), &installed_stat), 0);
+        EXPECT_EQ(installed_stat.st_mode & 07777, 0750u);
+        EXPECT_EQ(installed_stat.st_size, 7);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_is_running_batch_ReportsExitedChild)
+    {
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            pause();
+            _exit(0);
+        }
+
+        uint64_t start_time = 0;
+        ASSERT_TRUE(pal_process_get_start_time(child_pid, &start_time));
+
+        uint8_t running = 0;
+        ASSERT_TRUE(pal_process_is_running_batch(&child_pid, &start_time, 1, &running));
+        EXPECT_EQ(running, 1);
+
+        ASSERT_EQ(kill(child_pid, SIGKILL), 0);
+        ASSERT_EQ(waitpid(child_pid, nullptr, 0), child_pid);
+
+        ASSERT_TRUE(pal_process_is_running_batch(&child_pid, &start_time, 1, &running));
+        EXPECT_EQ(running, 0);
+        EXPECT_FALSE(pal_process_get_start_time(child_pid, &start_time));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_find_by_exe_prefix_FindsProcessesOfDeletedExecutables)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto exe_filename = testutils::path_combine(working_dir, "app");
+
+        char* data = nullptr;
+        size_t data_len = 0;
+        ASSERT_TRUE(pal_fs_read_file("/bin/sleep", &data, &data_len));
+        ASSERT_TRUE(pal_fs_write(exe_filename.c_str(), data, data_len));
+        delete[] data;
+        ASSERT_EQ(chmod(exe_filename.c_str(), 0755), 0);
+
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            execl(exe_filename.c_str(), "sleep", "30", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+
+        // Until exec the child still runs the test binary.
+        const auto link_path = "/proc/" + std::to_string(child_pid) + "/exe";
+        char link[PAL_MAX_PATH];
+        for (auto i = 0; i < 500; i++)
+        {
+            const auto link_len = readlink(link_path.c_str(), link, sizeof link - 1);
+            if (link_len > 0
+                && std::string(link, static_cast<size_t>(link_len)) == exe_filename)
+            {
+                break;
+            }
+            pal_sleep_ms(10);
+        }
+
+        // The link now reads "<exe_filename> (deleted)".
+        ASSERT_TRUE(pal_fs_rmfile(exe_filename.c_str()));
+
+        for (const auto& prefix : { exe_filename, working_dir })
+        {
+            pal_pid_t* pids = nullptr;
+            size_t pids_len = 0;
+            ASSERT_TRUE(pal_process_find_by_exe_prefix(prefix.c_str(), &pids, &pids_len));
+            const std::vector<pal_pid_t> found(pids, pids + pids_len);
+            delete[] pids;
+            EXPECT_EQ(found, std::vector<pal_pid_t>({ child_pid })) << prefix;
+        }
+
+        ASSERT_EQ(kill(child_pid, SIGKILL), 0);
+        ASSERT_EQ(waitpid(child_pid, nullptr, 0), child_pid);
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(PAL_GENERIC_UNIX, pal_process_wait_exit_or_signal_ReportsShutdownSignal)
+    {
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            pause();
+            _exit(0);
+        }
+
+        pal_signal_listener_t* listener = nullptr;
+        ASSERT_TRUE(pal_signal_listener_create(&listener));
+
+        BOOL exited = TRUE;
+        auto signum = -1;
+        ASSERT_TRUE(pal_process_wait_exit_or_signal(child_pid, 0, listener, &exited, &signum));
+        EXPECT_FALSE(exited);
+        EXPECT_EQ(signum, 0);
+
+        // Blocked, so it is queued for the listener instead of terminating the test.
+        ASSERT_EQ(raise(SIGTERM), 0);
+        ASSERT_TRUE(pal_process_wait_exit_or_signal(child_pid, 5000, listener, &exited, &signum));
+        EXPECT_FALSE(exited);
+        EXPECT_EQ(signum, SIGTERM);
+
+        // Processes started meanwhile do not inherit the blocked signals.
+        char arg0[] = "-c";
+        char arg1[] = "kill -TERM $$; exit 0";
+        char* argv[] = { arg0, arg1 };
+        pal_process_exec_stats_t stats = {};
+        ASSERT_TRUE(pal_process_exec_ex("sh", nullptr, 2, argv, 0, 0, &stats));
+        EXPECT_EQ(stats.term_signal, SIGTERM);
+
+        ASSERT_TRUE(pal_process_signal(child_pid, SIGKILL));
+        ASSERT_TRUE(pal_process_wait_exit_or_signal(child_pid, 5000, listener, &exited, &signum));
+        EXPECT_TRUE(exited);
+        EXPECT_EQ(signum, 0);
+        ASSERT_EQ(waitpid(child_pid, nullptr, 0), child_pid);
+
+        EXPECT_TRUE(pal_signal_listener_free(listener));
+    }
+
+    TEST(PAL_THREADING_UNIX, pal_cpu_get_effective_count_RespectsAffinityMask)
+    {
+        size_t count = 0;
+
+        // Affinity is per thread, so restrict a scratch thread instead of the test runner.
+        std::thread([&count]()
+        {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(static_cast<size_t>(sched_getcpu()), &cpu_set);
+            if (0 == sched_setaffinity(0, sizeof(cpu_set), &cpu_set))
+            {
+                pal_cpu_get_effective_count(&count);
+            }
+        }).join();
+
+        EXPECT_EQ(count, 1u);
+    }
+
+    TEST(PAL_THREADING_UNIX, pal_cpu_get_affinity_ReportsCpuOfAffinityMask)
+    {
+        pal_cpu_t* cpus = nullptr;
+        size_t cpus_len = 0;
+        auto cpu_id = -1;
+
+        std::thread([&]()
+        {
+            cpu_id = sched_getcpu();
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(static_cast<size_t>(cpu_id), &cpu_set);
+            if (0 == sched_setaffinity(0, sizeof(cpu_set), &cpu_set))
+            {
+                pal_cpu_get_affinity(&cpus, &cpus_len);
+            }
+        }).join();
+
+        ASSERT_EQ(cpus_len, 1u);
+        EXPECT_EQ(cpus[0].id, static_cast<uint32_t>(cpu_id));
+        EXPECT_GE(cpus[0].numa_node, -1);
+        delete[] cpus;
+
+        uint64_t limit = 0;
+        if (pal_memory_get_limit(&limit))
+        {
+            EXPECT_GT(limit, 0u);
+        }
+    }
+
     TEST(PAL_PATH_UNIX, pal_path_combine)
     {
         ASSERT_GT(path_combine_test_cases.size(), 0u);
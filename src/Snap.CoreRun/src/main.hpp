@@ -7,40 +7,207 @@
 
 #if PAL_PLATFORM_LINUX
 #include "unistd.h" // fork
-#include <csignal>
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
 #include <memory>
+#include <sstream>
+#include <vector>
+
+// Fixed-size history of the samples taken while supervising, the oldest sample is overwritten when it is full.
+class corerun_process_time_series
+{
+    std::vector<pal_process_sample_t> m_samples;
+    size_t m_next;
+    size_t m_size;
+
+public:
+    explicit corerun_process_time_series(const size_t capacity) :
+        m_samples(capacity), m_next(0), m_size(0)
+    {
+    }
+
+    void push(const pal_process_sample_t& sample)
+    {
+        if (m_samples.empty())
+        {
+            return;
+        }
+
+        m_samples[m_next] = sample;
+        m_next = (m_next + 1) % m_samples.size();
+        m_size = std::min(m_size + 1, m_samples.size());
+    }
+
+    [[nodiscard]] size_t size() const { return m_size; }
+    [[nodiscard]] size_t capacity() const { return m_samples.size(); }
+
+    // Index 0 is the oldest sample.
+    [[nodiscard]] const pal_process_sample_t& at(const size_t index) const
+    {
+        return m_samples[(m_next + m_samples.size() - m_size + index) % m_samples.size()];
+    }
+};
+
+// Metrics of the supervised application in the Prometheus text format, written atomically so that a textfile
+// collector never sees a partial file. Counters survive restarts because each supervisor continues from the
+// file its predecessor left behind.
+class corerun_supervisor_metrics
+{
+    std::string m_filename;
+    std::string m_application_id;
+    std::chrono::steady_clock::time_point m_written{};
+    bool m_has_written = false;
+
+public:
+    // Atomic writes are flushed to disk, scrapers do not need them more often than this.
+    static constexpr std::chrono::seconds write_interval = std::chrono::seconds(10);
+
+    uint64_t restarts_total = 0;
+    double launch_latency_seconds = 0; // Time spent starting the most recent standby instance.
+    double restart_latency_seconds = 0; // From the exit of the application until the supervisor started it again.
+    bool up = false;
+    double uptime_seconds = 0; // Since the supervisor started watching the application.
+    pal_process_sample_t sample = {};
+
+    corerun_supervisor_metrics(std::string filename, std::string application_id) :
+        m_filename(std::move(filename)), m_application_id(std::move(application_id))
+    {
+    }
+
+    void load()
+    {
+        char* data = nullptr;
+        size_t data_len = 0;
+        if (!pal_fs_read_file(m_filename.c_str(), &data, &data_len))
+        {
+            return;
+        }
+
+        std::istringstream lines(std::string(data, data_len));
+        delete[] data;
+
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            const auto value_pos = line.rfind(' ');
+            if (line.empty() || line[0] == '#' || value_pos == std::string::npos)
+            {
+                continue;
+            }
+
+            const auto name = line.substr(0, line.find('{'));
+            const auto value = line.substr(value_pos + 1);
+            if (name == "snapx_corerun_restarts_total")
+            {
+                restarts_total = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (name == "snapx_corerun_launch_latency_seconds")
+            {
+                launch_latency_seconds = std::strtod(value.c_str(), nullptr);
+            }
+            else if (name == "snapx_corerun_restart_latency_seconds")
+            {
+                restart_latency_seconds = std::strtod(value.c_str(), nullptr);
+            }
+        }
+    }
+
+    [[nodiscard]] std::string format() const
+    {
+        std::string labels = "{app=\"";
+        for (const auto c : m_application_id)
+        {
+            if (c == '\\' || c == '"')
+            {
+                labels += '\\';
+                labels += c;
+            }
+            else if (c == '\n')
+            {
+                labels += "\\n";
+            }
+            else
+            {
+                labels += c;
+            }
+        }
+        labels += "\"}";
+
+        std::ostringstream out;
+        const auto metric = [&out, &labels](const char* name, const char* type, const char* help, const auto value)
+        {
+            out << "# HELP " << name << ' ' << help << '\n'
+                << "# TYPE " << name << ' ' << type << '\n'
+                << name << labels << ' ' << value << '\n';
+        };
+
+        metric("snapx_corerun_restarts_total", "counter", "Restarts of the application by the supervisor.", restarts_total);
+        metric("snapx_corerun_launch_latency_seconds", "gauge", "Time spent starting the most recent standby instance.", launch_latency_seconds);
+        metric("snapx_corerun_restart_latency_seconds", "gauge", "Time from the exit of the application until it was started again.", restart_latency_seconds);
+        metric("snapx_corerun_up", "gauge", "Whether the supervised application is running.", up ? 1 : 0);
+        metric("snapx_corerun_uptime_seconds", "gauge", "Time the supervisor has been watching the application.", uptime_seconds);
+        metric("snapx_corerun_cpu_seconds_total", "counter", "User and system cpu time of the application.",
+            static_cast<double>(sample.user_time_us + sample.system_time_us) / 1000000);
+        metric("snapx_corerun_cpu_usage_ratio", "gauge", "Cpu time per wall time during the last sample interval.",
+            static_cast<double>(sample.cpu_permille) / 1000);
+        metric("snapx_corerun_resident_memory_bytes", "gauge", "Resident memory of the application.", sample.rss_bytes);
+        metric("snapx_corerun_threads", "gauge", "Threads of the application.", sample.threads_count);
+
+        return out.str();
+    }
+
+    bool write()
+    {
+        m_written = std::chrono::steady_clock::now();
+        m_has_written = true;
+        const auto text = format();
+        return pal_fs_write_atomic(m_filename.c_str(), text.data(), text.size()) == TRUE;
+    }
+
+    bool maybe_write()
+    {
+        if (m_has_written && std::chrono::steady_clock::now() - m_written < write_interval)
+        {
+            return true;
+        }
+        return write();
+    }
+};
 
 static std::unique_ptr<pal_semaphore_machine_wide> corerun_supervisor_semaphore;
 
+// Ten minutes of history at the default interval.
+static const size_t corerun_supervisor_time_series_capacity = 600;
+
+// Time a stalled application gets to exit after SIGTERM before it is killed.
+static const uint32_t corerun_supervisor_stall_kill_grace_ms = 5000;
+
+struct corerun_supervise_options
+{
+    std::string application_id{};
+    int sample_interval_ms = 1000; // 0 disables sampling.
+    std::string metrics_filename{}; // Empty disables metrics.
+    int stall_timeout_ms = 0; // 0 disables the watchdog.
+    bool standby = false; // Start the next instance gated while the current one runs.
+    std::vector<std::string> listen_addresses{}; // Sockets passed to every instance, see pal_socket_listen.
+    int drain_timeout_ms = 10000; // 0 leaves the process running when the supervisor is stopped.
+};
+
 inline int corerun_command_supervise(
     const std::string& stub_executable_full_path,
     std::vector<std::string>& arguments,
     int process_id,
-    const std::string& process_application_id,
+    const corerun_supervise_options& supervise_options,
     int cmd_show_windows);
-inline void main_wait_for_pid(pal_pid_t pid);
+inline int main_wait_for_pid(pal_pid_t pid, uint64_t start_time, const corerun_supervise_options& supervise_options,
+    pal_signal_listener_t* signal_listener, corerun_process_time_series* time_series, corerun_supervisor_metrics* metrics);
 inline void snapx_maybe_wait_for_debugger();
 
-#if PAL_PLATFORM_LINUX
-void corerun_main_signal_handler(int signum) {
-    LOGD << "Interrupt signal: " << signum;
-
-    if(corerun_supervisor_semaphore != nullptr) {
-        LOGD << "Supervisor semaphore released: " << (corerun_supervisor_semaphore->release() ? "true" : "false");
-    }
-
-    LOGD << "Supervisor will now exit.";
-    exit(signum);
-}
-#endif
-
 inline int corerun_main_impl(int argc, char **argv, const int cmd_show_windows) {
-#if PAL_PLATFORM_LINUX
-    std::signal(SIGTERM, corerun_main_signal_handler);
-#endif
-    
     LOGD << "Process started. "
          << "Startup arguments(" << std::to_string(argc) << "): "
          << this_exe::build_argv_str(argc, argv);
@@ -73,7 +240,7 @@ inline int corerun_main_impl(int argc, char **argv, const int cmd_show_windows)
     cxxopts::Options options(argv[0], "");
 
     auto supervise_process_id = 0;
-    std::string supervise_id;
+    corerun_supervise_options supervise_options;
 
     options
             .add_options()
@@ -83,7 +250,31 @@ inline int corerun_main_impl(int argc, char **argv, const int cmd_show_windows)
                         )
                     ("corerun-supervise-id",
                         "A unique id that identifies current application.",
-                        cxxopts::value<std::string>(supervise_id)
+                        cxxopts::value<std::string>(supervise_options.application_id)
+                        )
+                    ("corerun-supervise-sample-interval-ms",
+                        "Interval between resource usage samples of the supervised process, 0 disables sampling.",
+                        cxxopts::value<int>(supervise_options.sample_interval_ms)
+                        )
+                    ("corerun-supervise-metrics-file",
+                        "Metrics of the supervised process in the Prometheus text format are written to this file.",
+                        cxxopts::value<std::string>(supervise_options.metrics_filename)
+                        )
+                    ("corerun-supervise-stall-timeout-ms",
+                        "Restart the supervised process when its watchdog heartbeat stalls for this long, 0 disables the watchdog.",
+                        cxxopts::value<int>(supervise_options.stall_timeout_ms)
+                        )
+                    ("corerun-supervise-standby",
+                        "Start the next instance right away and hold it in pal_standby_wait until the supervised process exits.",
+                        cxxopts::value<bool>(supervise_options.standby)
+                        )
+                    ("corerun-supervise-listen",
+                        "Listening sockets (tcp:<host>:<port> or unix:<path>) kept open across restarts and passed to every instance with LISTEN_FDS.",
+                        cxxopts::value<std::vector<std::string>>(supervise_options.listen_addresses)
+                        )
+                    ("corerun-supervise-drain-timeout-ms",
+                        "Time the supervised process gets to exit after a forwarded SIGTERM or SIGINT before it is killed, 0 leaves it running.",
+                        cxxopts::value<int>(supervise_options.drain_timeout_ms)
                         );
 
     try {
@@ -94,7 +285,7 @@ inline int corerun_main_impl(int argc, char **argv, const int cmd_show_windows)
 
     if (supervise_process_id > 0) {
         return corerun_command_supervise(stub_executable_full_path, stub_executable_arguments,
-                supervise_process_id, supervise_id, cmd_show_windows);
+                supervise_process_id, supervise_options, cmd_show_windows);
     }
 
     return snap::stubexecutable::run(stub_executable_arguments, cmd_show_windows);
@@ -104,15 +295,21 @@ inline int corerun_command_supervise(
     const std::string& stub_executable_full_path,
     std::vector<std::string>& arguments,
     const int process_id,
-    const std::string& process_application_id,
+    const corerun_supervise_options& supervise_options,
     const int cmd_show_windows)
 {
+    const auto& process_application_id = supervise_options.application_id;
+
     if(!pal_process_is_running(process_id))  
     {
         LOGE << "Supervision of target process with id " << std::to_string(process_id) << " cancelled because the program is not running.";
         return 1;
     }
 
+    // Taken while the process is known to run, so that a pid reused after it exits does not keep the supervisor waiting.
+    uint64_t process_start_time = 0;
+    pal_process_get_start_time(process_id, &process_start_time);
+
     auto semaphore_name("corerun-" + process_application_id);
 
     if (semaphore_name.size() > PAL_MAX_PATH) {
@@ -126,47 +323,288 @@ inline int corerun_command_supervise(
         return 1;
     }
 
+    // Shutdown signals are read in the wait loop below, a signal that arrives before that stays pending.
+    pal_signal_listener_t* signal_listener = nullptr;
+    if (!pal_signal_listener_create(&signal_listener)) {
+        LOGW << "Unable to listen for shutdown signals, they will not be forwarded to process: " << std::to_string(process_id);
+    }
+
     const auto* const corerun_dash_dash = "--corerun-";
 
-    auto index = 0;
-    for (const auto &value : arguments) {
-        if (pal_str_startswith(value.c_str(), corerun_dash_dash)) {
-            arguments.erase(arguments.begin() + index);
+    arguments.erase(std::remove_if(arguments.begin(), arguments.end(), [corerun_dash_dash](const std::string& value) {
+        return pal_str_startswith(value.c_str(), corerun_dash_dash);
+    }), arguments.end());
+
+    LOGD << "Supervisor is waiting for target process to exit: " << std::to_string(process_id);
+
+#if defined(PAL_PLATFORM_LINUX)
+    PAL_UNUSED(cmd_show_windows);
+    const auto restart_cmd_show = -1;
+#else
+    const auto restart_cmd_show = cmd_show_windows;
+#endif
+
+    // Sockets are taken over from the supervised process when it passed them on, so they are only created once.
+    // An address that is in use was most likely bound by the supervised process itself, it is created once that
+    // process exited so that at least the instances after the next restart get it passed on.
+    std::vector<pal_socket_t> listen_sockets;
+    std::vector<std::string> deferred_listen_addresses;
+    for (const auto& listen_address : supervise_options.listen_addresses) {
+        pal_socket_t listen_socket;
+        if (pal_socket_listen_inherited(listen_address.c_str(), &listen_socket)
+            || pal_socket_listen(listen_address.c_str(), &listen_socket)) {
+            listen_sockets.push_back(listen_socket);
+        } else if (errno == EADDRINUSE) {
+            LOGW << "Address is in use, it is taken over after process " << std::to_string(process_id) << " exited: " << listen_address;
+            deferred_listen_addresses.push_back(listen_address);
+        } else {
+            LOGE << "Unable to listen on: " << listen_address << ". The socket will not be passed to restarted processes.";
         }
-        ++index;
     }
 
-    LOGD << "Supervisor is waiting for target process to exit: " << std::to_string(process_id);
+    pal_process_spawn_options_t restart_options = {};
+    restart_options.cmd_show = restart_cmd_show;
+    restart_options.listen_sockets = listen_sockets.data();
+    restart_options.listen_sockets_len = listen_sockets.size();
+
+    std::unique_ptr<corerun_supervisor_metrics> metrics;
+    if (!supervise_options.metrics_filename.empty()) {
+        metrics = std::make_unique<corerun_supervisor_metrics>(supervise_options.metrics_filename, process_application_id);
+        metrics->load();
+    }
+
+    snap::stubexecutable::standby standby;
+    const auto standby_started = std::chrono::steady_clock::now();
+    if (supervise_options.standby
+        && !snap::stubexecutable::start_standby(arguments, restart_options, standby)) {
+        LOGW << "Unable to start standby instance, the process will be restarted from scratch.";
+    } else if (supervise_options.standby && metrics != nullptr) {
+        metrics->launch_latency_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - standby_started).count();
+    }
+
+    corerun_process_time_series time_series(corerun_supervisor_time_series_capacity);
+    const auto shutdown_signum = main_wait_for_pid(process_id, process_start_time, supervise_options,
+        signal_listener, &time_series, metrics.get());
+    const auto exited = std::chrono::steady_clock::now();
+
+    if (signal_listener != nullptr) {
+        pal_signal_listener_free(signal_listener);
+    }
+
+    if (time_series.size() > 0) {
+        uint64_t peak_rss_bytes = 0;
+        uint64_t cpu_permille_sum = 0;
+        size_t cpu_samples_count = 0;
+        for (size_t i = 0; i < time_series.size(); i++) {
+            peak_rss_bytes = std::max(peak_rss_bytes, time_series.at(i).rss_bytes);
+            // The first sample of a sampler has no interval to measure cpu usage over.
+            if (time_series.at(i).interval_us > 0) {
+                cpu_permille_sum += time_series.at(i).cpu_permille;
+                cpu_samples_count++;
+            }
+        }
 
-    main_wait_for_pid(process_id);
+        const auto& last = time_series.at(time_series.size() - 1);
+        LOGD << "Resource usage of process " << std::to_string(process_id) << ". "
+             << "Samples: " << time_series.size() << ". "
+             << "Peak rss: " << peak_rss_bytes / 1024 << " KiB. "
+             << "Average cpu: " << (cpu_samples_count > 0 ? cpu_permille_sum / cpu_samples_count / 10 : 0) << "%. "
+             << "Cpu time: " << (last.user_time_us + last.system_time_us) / 1000 << " ms. "
+             << "Threads: " << last.threads_count << ". "
+             << "Read: " << last.io_read_bytes / 1024 << " KiB. "
+             << "Written: " << last.io_write_bytes / 1024 << " KiB.";
+    }
 
     LOGD << "Process exited: " << std::to_string(process_id) << ". "
          << "Semaphore released: " <<  corerun_supervisor_semaphore->release() << ". "
          << "Startup arguments("<< std::to_string(arguments.size()) << "): "
          << this_exe::build_argv_str(arguments);
 
+    if (shutdown_signum != 0) {
+        if (standby.gate != nullptr) {
+            pal_process_gate_cancel(standby.gate);
+            standby.gate = nullptr;
+        }
+        if (metrics != nullptr) {
+            metrics->up = false;
+            metrics->write();
+        }
+        LOGD << "Supervisor stopped by signal " << shutdown_signum << ", the process is not restarted.";
+        return shutdown_signum;
+    }
+
+    // The supervisor of the restarted instance continues from the metrics file, so it is written for the
+    // last time before that instance can start.
+    const auto restart = [&]()
+    {
+        // A standby instance was started without these sockets and binds them itself once it is released.
+        if (standby.gate == nullptr) {
+            for (const auto& listen_address : deferred_listen_addresses) {
+                pal_socket_t listen_socket;
+                if (pal_socket_listen(listen_address.c_str(), &listen_socket)) {
+                    listen_sockets.push_back(listen_socket);
+                }
+            }
+            restart_options.listen_sockets = listen_sockets.data();
+            restart_options.listen_sockets_len = listen_sockets.size();
+        }
+
+        if (metrics != nullptr) {
+            metrics->restarts_total++;
+            metrics->restart_latency_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - exited).count();
+            metrics->up = false;
+            metrics->write();
+        }
+        return snap::stubexecutable::release_standby(standby, arguments, restart_options);
+    };
+
 #if defined(PAL_PLATFORM_LINUX)
-    PAL_UNUSED(cmd_show_windows);
     const auto child_pid = fork();
     if (child_pid == 0)
     {
-        return snap::stubexecutable::run(arguments, -1);
+        return restart();
     }
     return 0;
 #else
-    return snap::stubexecutable::run(arguments, cmd_show_windows);
+    return restart();
 #endif
 }
 
-inline void main_wait_for_pid(const pal_pid_t pid) {
+// Sends signum to an application and kills it when it is still running after grace_ms.
+inline void main_stop_pid(const pal_pid_t pid, const int signum, const uint32_t grace_ms) {
+    pal_process_signal(pid, signum);
+
+    BOOL exited = FALSE;
+    if (pal_process_wait_exit(pid, grace_ms, &exited) && exited) {
+        return;
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    LOGW << "Process did not exit within " << grace_ms << " ms after signal " << signum << ", sending SIGKILL: " << std::to_string(pid);
+    pal_process_signal(pid, SIGKILL);
+    pal_process_wait_exit(pid, grace_ms, &exited);
+#endif
+}
+
+// Returns the signal that stopped the supervisor, 0 when the application exited or was killed by the watchdog.
+inline int main_wait_for_pid(const pal_pid_t pid, const uint64_t start_time, const corerun_supervise_options& supervise_options,
+    pal_signal_listener_t* signal_listener, corerun_process_time_series* time_series, corerun_supervisor_metrics* metrics) {
     pal_pid_t this_pid;
     if (!pal_process_get_pid(&this_pid) || this_pid == pid) {
-        return;
+        return 0;
     }
 
-    while (TRUE == pal_process_is_running(pid)) {
-        pal_sleep_ms(250);
+    const auto sample_interval_ms = static_cast<uint32_t>(std::max(0, supervise_options.sample_interval_ms));
+    const auto stall_timeout = std::chrono::milliseconds(std::max(0, supervise_options.stall_timeout_ms));
+
+    pal_watchdog_t* watchdog = nullptr;
+    if (stall_timeout.count() > 0
+        && !pal_watchdog_open(supervise_options.application_id.c_str(), &watchdog)) {
+        LOGW << "Unable to open watchdog of process: " << std::to_string(pid);
+    }
+
+    // The watchdog is armed by the first heartbeat, applications that never beat are not killed.
+    uint64_t beats = 0;
+    auto beats_armed = false;
+    auto beats_changed = std::chrono::steady_clock::now();
+    if (watchdog != nullptr) {
+        pal_watchdog_read(watchdog, &beats);
     }
+
+    pal_process_sampler_t* sampler = nullptr;
+    if (sample_interval_ms > 0 && time_series != nullptr
+        && !pal_process_sampler_create(pid, &sampler)) {
+        LOGW << "Unable to sample resource usage of process: " << std::to_string(pid);
+    }
+
+    // The start time is checked before each wait because waiting alone cannot tell a reused pid apart.
+    auto wait_ms = sampler != nullptr ? sample_interval_ms : 250u;
+    if (watchdog != nullptr) {
+        wait_ms = std::min(wait_ms, std::max(1u, static_cast<uint32_t>(stall_timeout.count()) / 4));
+    }
+    const auto started = std::chrono::steady_clock::now();
+    auto next_sample = started;
+    auto shutdown_signum = 0;
+    uint8_t running = 0;
+    while (pal_process_is_running_batch(&pid, &start_time, 1, &running) && running != 0) {
+        const auto now = std::chrono::steady_clock::now();
+
+        pal_process_sample_t sample;
+        if (sampler != nullptr && now >= next_sample && pal_process_sampler_sample(sampler, &sample)) {
+            next_sample = now + std::chrono::milliseconds(sample_interval_ms);
+            time_series->push(sample);
+            if (metrics != nullptr) {
+                metrics->sample = sample;
+            }
+        }
+
+        if (metrics != nullptr) {
+            metrics->up = true;
+            metrics->uptime_seconds = std::chrono::duration<double>(now - started).count();
+            metrics->maybe_write();
+        }
+
+        uint64_t current_beats = 0;
+        if (watchdog != nullptr && pal_watchdog_read(watchdog, &current_beats)) {
+            if (current_beats != beats) {
+                beats = current_beats;
+                beats_armed = true;
+                beats_changed = now;
+            } else if (beats_armed && now - beats_changed >= stall_timeout) {
+                LOGW << "Process stopped beating its watchdog " << std::chrono::duration_cast<std::chrono::milliseconds>(now - beats_changed).count()
+                     << " ms ago, killing it: " << std::to_string(pid);
+                main_stop_pid(pid, SIGTERM, corerun_supervisor_stall_kill_grace_ms);
+                break;
+            }
+        }
+
+        BOOL exited = FALSE;
+        auto signum = 0;
+        if (!pal_process_wait_exit_or_signal(pid, wait_ms, signal_listener, &exited, &signum)) {
+            pal_sleep_ms(wait_ms);
+            continue;
+        }
+
+#if defined(PAL_PLATFORM_LINUX)
+        // Reload requests are passed on without ending the supervision.
+        if (signum == SIGHUP) {
+            LOGD << "Forwarding SIGHUP to process: " << std::to_string(pid);
+            if (!exited) {
+                pal_process_signal(pid, SIGHUP);
+            }
+            signum = 0;
+        }
+#endif
+
+        if (signum != 0) {
+            shutdown_signum = signum;
+            if (exited) {
+                break;
+            }
+            if (supervise_options.drain_timeout_ms <= 0) {
+                LOGD << "Supervisor interrupted by signal " << signum << ", leaving process running: " << std::to_string(pid);
+                break;
+            }
+            LOGD << "Forwarding signal " << signum << " to process " << std::to_string(pid) << ", draining for "
+                 << supervise_options.drain_timeout_ms << " ms.";
+            main_stop_pid(pid, signum, static_cast<uint32_t>(supervise_options.drain_timeout_ms));
+            break;
+        }
+
+        if (exited) {
+            break;
+        }
+    }
+
+    if (sampler != nullptr) {
+        pal_process_sampler_free(sampler);
+    }
+
+    if (watchdog != nullptr) {
+        pal_watchdog_free(watchdog);
+    }
+
+    return shutdown_signum;
 }
 
 inline void snapx_maybe_wait_for_debugger() {
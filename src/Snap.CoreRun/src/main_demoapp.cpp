@@ -15,10 +15,18 @@ int corerun_demoapp_main_impl(const int argc, char **argv)
 {
     this_exe::plog_init();
 
-    LOGD << "Process started. Arguments: " << this_exe::build_argv_str(argc, argv);
+    LOGD << "Process started. Arguments: " << this_exe::build_argv_str(static_cast<uint32_t>(argc), argv);
 
     pal_mitigate_dll_hijacking();
 
+    // Started ahead of time by a supervisor in standby mode, everything above overlaps with the previous instance.
+    BOOL released = TRUE;
+    if (pal_standby_wait(&released) && !released)
+    {
+        LOGD << "Standby cancelled by supervisor.";
+        return unit_test_success_exit_code;
+    }
+
     char* app_name = nullptr;
     if (!pal_process_get_name(&app_name))
     {
@@ -1,54 +1,338 @@
 #include "stubexecutable.hpp"
 #include "vendor/semver/semver200.h"
+#include "nlohmann/json.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <optional>
 #include <string>
+#include <sstream>
 #include <iostream>
 
+namespace
+{
+    // A variable without value is removed from the environment of the application.
+    using launch_profile_environment = std::map<std::string, std::optional<std::string>>;
+
+    // A policy setting without value falls back to the one of the enclosing scope.
+    struct launch_profile_scope
+    {
+        launch_profile_environment environment{};
+        launch_profile_environment policy{};
+    };
+
+    // Collects the environment and policy scopes of a launch profile while it is parsed, unknown keys are skipped.
+    class launch_profile_sax : public nlohmann::json_sax<nlohmann::json>
+    {
+        std::vector<std::string> m_path{}; // Keys of the objects and arrays enclosing the current value.
+        std::string m_key{};
+        size_t m_depth = 0;
+
+        bool value(std::optional<std::string> value)
+        {
+            launch_profile_scope* scope = nullptr;
+            if (m_depth == 1 && m_key == "channel" && value.has_value())
+            {
+                channel = *value;
+            }
+            else if (m_path.size() == 1)
+            {
+                scope = &base;
+            }
+            else if (m_path.size() == 3 && m_path[0] == "channels")
+            {
+                scope = &channels[m_path[1]];
+            }
+            else if (m_path.size() == 3 && m_path[0] == "versions")
+            {
+                scope = &versions[m_path[1]];
+            }
+
+            if (scope != nullptr && m_path.back() == "policy")
+            {
+                scope->policy[m_key] = std::move(value);
+                return true;
+            }
+
+            if (scope == nullptr || m_path.back() != "environment")
+            {
+                return true;
+            }
+
+            if (m_key.empty() || m_key.find('=') != std::string::npos)
+            {
+                error = "Invalid environment variable name: " + m_key;
+                return false;
+            }
+
+            scope->environment[m_key] = std::move(value);
+            return true;
+        }
+
+        bool enter()
+        {
+            if (m_depth++ > 0)
+            {
+                m_path.push_back(m_key);
+            }
+            m_key.clear();
+            return true;
+        }
+
+        bool leave()
+        {
+            if (--m_depth > 0)
+            {
+                m_path.pop_back();
+            }
+            return true;
+        }
+
+    public:
+        std::string channel{}; // Used when SNAPX_CORERUN_CHANNEL is not set.
+        launch_profile_scope base{};
+        std::map<std::string, launch_profile_scope> channels{};
+        std::map<std::string, launch_profile_scope> versions{};
+        std::string error{};
+
+        bool null() override { return value(std::nullopt); }
+        bool boolean(const bool val) override { return value(std::string(val ? "1" : "0")); }
+        bool number_integer(const number_integer_t val) override { return value(std::to_string(val)); }
+        bool number_unsigned(const number_unsigned_t val) override { return value(std::to_string(val)); }
+        bool number_float(number_float_t, const string_t& s) override { return value(s); }
+        bool string(string_t& val) override { return value(val); }
+        bool start_object(std::size_t) override { return enter(); }
+        bool key(string_t& val) override { m_key = val; return true; }
+        bool end_object() override { return leave(); }
+        bool start_array(std::size_t) override { return enter(); }
+        bool end_array() override { return leave(); }
+
+        bool parse_error(const std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override
+        {
+            if (error.empty())
+            {
+                error = "Parse error at byte " + std::to_string(position) + ": " + ex.what();
+            }
+            return false;
+        }
+    };
+
+    // Reads a decimal number of at most max_value from an environment variable, keeping value_out when
+    // the variable is missing or invalid.
+    void env_get_unsigned(const char* name, const uint64_t max_value, uint64_t& value_out)
+    {
+        char* text = nullptr;
+        if (!pal_env_get(name, &text))
+        {
+            return;
+        }
+
+        char* end = nullptr;
+        errno = 0;
+        const auto value = std::strtoull(text, &end, 10);
+        if (*text < '0' || *text > '9' || *end != '\0' || errno != 0 || value > max_value)
+        {
+            LOGW << "Ignoring invalid " << name << ": " << text << ". Using " << value_out << ".";
+        }
+        else
+        {
+            value_out = value;
+        }
+        free(text);
+    }
+}
+
 int snap::stubexecutable::run(std::vector<std::string> arguments, const int cmd_show)
 {
-    auto exit_code = 1;
-    std::string executable_full_path;
+    pal_process_spawn_options_t options = {};
+    options.cmd_show = cmd_show;
+    return run(arguments, options);
+}
+
+int snap::stubexecutable::run(const std::vector<std::string>& arguments, const pal_process_spawn_options_t& options)
+{
     std::string app_dir_str;
+    pal_process_spawn_options_t options_not_gated = options;
+    options_not_gated.gated = FALSE;
+
+    pal_pid_t process_pid;
+    if (!start(arguments, options_not_gated, app_dir_str, &process_pid, nullptr))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+bool snap::stubexecutable::start_standby(const std::vector<std::string>& arguments, pal_process_spawn_options_t options, standby& standby_out)
+{
+    options.gated = TRUE;
+    return start(arguments, options, standby_out.app_dir, &standby_out.pid, &standby_out.gate);
+}
+
+int snap::stubexecutable::release_standby(standby& standby, const std::vector<std::string>& arguments, const pal_process_spawn_options_t& options)
+{
+    if (standby.gate == nullptr)
+    {
+        return run(arguments, options);
+    }
+
+    // A version installed while the standby was waiting takes precedence.
+    const auto app_dir = find_current_app_dir();
+    if (app_dir != standby.app_dir || !pal_process_is_running(standby.pid))
+    {
+        LOGW << "Standby process is outdated or no longer running, starting current version instead. Pid: " << standby.pid;
+        pal_process_gate_cancel(standby.gate);
+        standby.gate = nullptr;
+        return run(arguments, options);
+    }
 
+    const auto released = pal_process_gate_release(standby.gate);
+    standby.gate = nullptr;
+    if (!released)
+    {
+        LOGE << "Failed to release standby process, starting current version instead. Pid: " << standby.pid;
+        return run(arguments, options);
+    }
+
+    LOGV << "Standby process released. Pid: " << standby.pid;
+    return 0;
+}
+
+bool snap::stubexecutable::start(const std::vector<std::string>& arguments, const pal_process_spawn_options_t& options,
+    std::string& app_dir_out, pal_pid_t* pid_out, pal_process_gate_t** gate_out)
+{
     const auto app_name = this_exe::get_process_name();
     if (app_name.empty())
     {
         LOGE << "Error: Unable to find own executable name";
-        return exit_code;
+        return false;
     }
 
-    app_dir_str = find_current_app_dir();
-    if (app_dir_str.empty())
+    app_dir_out = find_current_app_dir();
+    if (app_dir_out.empty())
     {
         LOGE << "Error: Unable to find current app dir";
-        return exit_code;
+        return false;
     }
 
-    executable_full_path = app_dir_str + PAL_DIRECTORY_SEPARATOR_C + app_name;
-
-    const auto argc = static_cast<uint32_t>(arguments.size());
-    auto* const argv = new char* [argc];
+    const auto executable_full_path = app_dir_out + PAL_DIRECTORY_SEPARATOR_C + app_name;
 
-    for (auto i = 0u; i < argc; i++)
+    std::vector<char*> argv;
+    argv.reserve(arguments.size());
+    for (const auto& argument : arguments)
     {
-        argv[i] = _strdup(arguments[i].c_str());
+        argv.push_back(const_cast<char*>(argument.c_str()));
     }
 
+    const auto argc = static_cast<int>(argv.size());
+
     LOGV << "Starting executable: " << executable_full_path
          << ". Arguments(" << std::to_string(argc) << "): "
-         << this_exe::build_argv_str(argc, argv);
+         << this_exe::build_argv_str(arguments);
 
-    pal_pid_t process_pid;
-    if (pal_process_daemonize(executable_full_path.c_str(), app_dir_str.c_str(), static_cast<int>(argc), argv, cmd_show, &process_pid))
+    // Inherited by the application and by the supervisor it starts, so restarted processes write to the same log.
+    pal_process_spawn_options_t spawn_options = options;
+
+    // Tuning can be rolled out by changing the profile beside the stub, without a new release of the application.
+    launch_profile profile;
+    auto cwd = std::make_unique<char*>(nullptr);
+    auto app_dir_name = std::make_unique<char*>(nullptr);
+    auto profile_path = std::make_unique<char*>(nullptr);
+    if (pal_process_get_cwd(cwd.get())
+        && pal_path_get_directory_name(app_dir_out.c_str(), app_dir_name.get())
+        && pal_str_startswith(*app_dir_name, "app-")
+        && pal_path_combine(*cwd, launch_profile_name, profile_path.get())
+        && pal_fs_file_exists(*profile_path))
     {
-        LOGV << "Process successfully started. Pid: " << process_pid;
-        exit_code = 0;
-    } else
+        std::string channel;
+        char* channel_value = nullptr;
+        if (pal_env_get("SNAPX_CORERUN_CHANNEL", &channel_value))
+        {
+            channel = channel_value;
+            free(channel_value);
+        }
+
+        const auto version = std::string(*app_dir_name).substr(std::strlen("app-"));
+        if (!load_launch_profile(*profile_path, channel, version, profile))
+        {
+            LOGE << "Ignoring launch profile: " << *profile_path;
+            profile = launch_profile();
+        }
+    }
+
+    pal_process_launch_policy_t policy = profile.policy;
+    if (profile.has_policy && !pal_is_linux())
+    {
+        LOGW << "Launch policies are only supported on Linux, the process inherits the policy of corerun.";
+    }
+    else if (profile.has_policy)
+    {
+        policy.affinity_cpus = profile.affinity_cpus.data();
+        policy.affinity_cpus_len = profile.affinity_cpus.size();
+        spawn_options.policy = &policy;
+    }
+
+    size_t heap_count = 0;
+    uint64_t memory_limit = 0;
+    auto cpus = std::make_unique<pal_cpu_t*>(nullptr);
+    size_t cpus_len = 0;
+    pal_cpu_get_effective_count(&heap_count);
+    pal_memory_get_limit(&memory_limit);
+    if (!pal_cpu_get_affinity(cpus.get(), &cpus_len))
+    {
+        *cpus = nullptr;
+        cpus_len = 0;
+    }
+
+    merge_launch_environment(profile.environment, gc_environment(*cpus, cpus_len, heap_count, memory_limit));
+    delete[] *cpus;
+
+    std::vector<const char*> environment;
+    for (const auto& variable : profile.environment)
     {
-        LOGE << "Failed to start process."; 
+        LOGV << "Launch environment: " << variable;
+        environment.push_back(variable.c_str());
     }
+    spawn_options.environment = environment.data();
+    spawn_options.environment_len = environment.size();
+
+    std::string output_log_filename;
+    char* output_log = nullptr;
+    if (pal_env_get("SNAPX_CORERUN_OUTPUT_LOG", &output_log))
+    {
+        output_log_filename = output_log;
+        free(output_log);
+    }
+
+    if (!output_log_filename.empty() && !pal_is_linux())
+    {
+        LOGW << "Output capture is only supported on Linux, the process inherits stdout and stderr.";
+    }
+    else if (!output_log_filename.empty())
+    {
+        spawn_options.output_log_filename = output_log_filename.c_str();
+        spawn_options.output_log_max_bytes = output_log_max_bytes_default;
+
+        uint64_t max_files = output_log_max_files_default;
+        env_get_unsigned("SNAPX_CORERUN_OUTPUT_LOG_MAX_BYTES", UINT64_MAX, spawn_options.output_log_max_bytes);
+        env_get_unsigned("SNAPX_CORERUN_OUTPUT_LOG_MAX_FILES", UINT32_MAX, max_files);
+        spawn_options.output_log_max_files = static_cast<uint32_t>(max_files);
 
-    return exit_code;
+        LOGV << "Capturing output in: " << output_log_filename;
+    }
+
+    if (!pal_process_daemonize_ex(executable_full_path.c_str(), app_dir_out.c_str(), argc, argv.data(), &spawn_options, pid_out, gate_out))
+    {
+        LOGE << "Failed to start process.";
+        return false;
+    }
+
+    LOGV << "Process successfully started. Pid: " << *pid_out << (options.gated ? ". Waiting for release." : "");
+    return true;
 }
 
 std::string snap::stubexecutable::find_current_app_dir()
@@ -62,12 +346,52 @@ std::string snap::stubexecutable::find_current_app_dir()
 
     std::string app_dir(*cwd);
 
+    std::vector<std::string> candidates;
+
+    auto linked_app_dir = find_current_app_dir_from_link(app_dir);
+    if (!linked_app_dir.empty())
+    {
+        candidates.emplace_back(linked_app_dir);
+    }
+
+    const auto verify = pal_env_get_bool("SNAPX_CORERUN_VERIFY");
+
+    // The remaining versions are only needed when the linked one is missing or fails verification.
+    if (candidates.empty() || verify)
+    {
+        for (const auto& versioned_app_dir : find_app_dirs_by_version(app_dir))
+        {
+            if (versioned_app_dir != linked_app_dir)
+            {
+                candidates.emplace_back(versioned_app_dir);
+            }
+        }
+    }
+
+    for (const auto& candidate : candidates)
+    {
+        if (verify && !verify_app_dir(candidate))
+        {
+            LOGE << "Skipping app dir that failed verification: " << candidate;
+            continue;
+        }
+
+        LOGV << "Final app dir: " << candidate;
+        return candidate;
+    }
+
+    return std::string();
+}
+
+// Returns every app-<version> directory inside app_dir, most recent version first.
+std::vector<std::string> snap::stubexecutable::find_app_dirs_by_version(const std::string& app_dir)
+{
     auto paths_out = std::make_unique<char**>(nullptr);
     size_t paths_out_len = 0;
     if (!pal_fs_list_directories(app_dir.c_str(), nullptr, nullptr, paths_out.get(), &paths_out_len))
     {
         LOGE << "Failed to list directories inside app dir: " << app_dir;
-        return std::string();
+        return std::vector<std::string>();
     }
 
     std::vector<char*> paths(*paths_out, *paths_out + paths_out_len);
@@ -75,12 +399,11 @@ std::string snap::stubexecutable::find_current_app_dir()
     if (paths.empty())
     {
         LOGE << "Could not find any directories in: " << app_dir;
-        return std::string();
+        return std::vector<std::string>();
     }
 
-    std::string most_recent_semver_str("0.0.0");
-    version::Semver200_version most_recent_semver(most_recent_semver_str);
-    auto app_dir_found = false;
+    const version::Semver200_version min_semver("0.0.0");
+    std::vector<std::pair<version::Semver200_version, std::string>> app_versions;
 
     for (const auto &full_path : paths)
     {
@@ -111,30 +434,499 @@ std::string snap::stubexecutable::find_current_app_dir()
             continue;
         }
 
-        if (current_app_semver > most_recent_semver)
+        if (current_app_semver > min_semver)
+        {
+            app_versions.emplace_back(current_app_semver, current_app_ver_str);
+        }
+    }
+
+    std::stable_sort(app_versions.begin(), app_versions.end(), [](const auto& lhs, const auto& rhs)
+    {
+        return lhs.first > rhs.first;
+    });
+
+    std::vector<std::string> app_dirs;
+    for (const auto& app_version : app_versions)
+    {
+        const auto app_dir_version_str = "app-" + app_version.second;
+
+        auto final_dir = std::make_unique<char*>(nullptr);
+        if (!pal_path_combine(app_dir.c_str(), app_dir_version_str.c_str(), final_dir.get()))
+        {
+            LOGE << "Error! Unable to build final dir. App dir: " << app_dir << ". App dir version: " << app_dir_version_str;
+            continue;
+        }
+
+        app_dirs.emplace_back(*final_dir);
+    }
+
+    return app_dirs;
+}
+
+// Sizes the server GC from the limits of this process instead of the host: one heap per cpu of the quota, heaps
+// affinitized to the cpus of as few NUMA nodes as possible and a hard limit of 75% of the memory limit, leaving
+// room for native allocations. The affinity mask only covers the first 64 cpus, it is omitted beyond that.
+std::vector<std::string> snap::stubexecutable::gc_environment(const pal_cpu_t* cpus, const size_t cpus_len,
+    const size_t heap_count, const uint64_t memory_limit)
+{
+    const auto hex = [](const uint64_t value)
+    {
+        std::ostringstream hex_stream;
+        hex_stream << "0x" << std::hex << value;
+        return hex_stream.str();
+    };
+
+    std::vector<std::string> environment;
+    if (heap_count > 0)
+    {
+        environment.push_back("DOTNET_GCHeapCount=" + hex(heap_count));
+    }
+
+    if (heap_count > 0 && heap_count < cpus_len)
+    {
+        std::map<int32_t, std::vector<uint32_t>> nodes;
+        for (size_t i = 0; i < cpus_len; i++)
+        {
+            nodes[cpus[i].numa_node].push_back(cpus[i].id);
+        }
+
+        std::vector<std::vector<uint32_t>> nodes_by_size;
+        for (auto& node : nodes)
+        {
+            nodes_by_size.push_back(std::move(node.second));
+        }
+        std::stable_sort(nodes_by_size.begin(), nodes_by_size.end(), [](const auto& lhs, const auto& rhs)
+        {
+            return lhs.size() > rhs.size();
+        });
+
+        uint64_t mask = 0;
+        size_t assigned = 0;
+        auto fits = true;
+        for (const auto& node : nodes_by_size)
+        {
+            for (auto id = node.begin(); id != node.end() && assigned < heap_count; ++id, assigned++)
+            {
+                fits &= *id < 64;
+                mask |= fits ? 1ULL << *id : 0;
+            }
+        }
+
+        if (fits)
+        {
+            environment.push_back("DOTNET_GCHeapAffinitizeMask=" + hex(mask));
+        }
+    }
+
+    if (memory_limit > 0)
+    {
+        environment.push_back("DOTNET_GCHeapHardLimit=" + hex(memory_limit / 4 * 3));
+    }
+
+    return environment;
+}
+
+// A default is skipped when the profile sets the variable (even to null) or it is inherited from the environment.
+// Variables injected by a previous launch are inherited by the supervisor that restarts the application, so
+// their names are kept in SNAPX_CORERUN_INJECTED_ENV: they are recomputed instead of being taken for overrides,
+// and the ones that are no longer injected are removed.
+void snap::stubexecutable::merge_launch_environment(std::vector<std::string>& environment,
+    const std::vector<std::string>& defaults)
+{
+    std::vector<std::string> previously_injected;
+    char* injected_value = nullptr;
+    if (pal_env_get(injected_environment_name, &injected_value))
+    {
+        std::istringstream names(injected_value);
+        free(injected_value);
+        for (std::string name; std::getline(names, name, ',');)
+        {
+            if (!name.empty())
+            {
+                previously_injected.push_back(name);
+            }
+        }
+    }
+
+    const auto sets_variable = [&environment](const std::string& name)
+    {
+        return std::any_of(environment.begin(), environment.end(), [&name](const std::string& variable)
+        {
+            return variable.compare(0, variable.find('='), name) == 0;
+        });
+    };
+
+    for (const auto& variable : defaults)
+    {
+        const auto name = variable.substr(0, variable.find('='));
+        char* value = nullptr;
+        if (pal_env_get(name.c_str(), &value))
+        {
+            free(value);
+            if (std::find(previously_injected.begin(), previously_injected.end(), name) == previously_injected.end())
+            {
+                continue;
+            }
+        }
+
+        if (!sets_variable(name))
+        {
+            environment.push_back(variable);
+        }
+    }
+
+    std::string injected;
+    for (const auto& variable : environment)
+    {
+        const auto separator = variable.find('=');
+        if (separator != std::string::npos)
+        {
+            injected += (injected.empty() ? "" : ",") + variable.substr(0, separator);
+        }
+    }
+
+    for (const auto& name : previously_injected)
+    {
+        if (!sets_variable(name))
+        {
+            environment.push_back(name);
+        }
+    }
+
+    environment.push_back(injected.empty() ? std::string(injected_environment_name)
+        : std::string(injected_environment_name) + "=" + injected);
+}
+
+// The profile is a JSON object whose "environment" object applies to every launch. Objects in "channels" and
+// "versions" with an "environment" of their own override it, in that order, for the channel in SNAPX_CORERUN_CHANNEL
+// (or the "channel" of the profile) and for the exact version of the app dir. Numbers and booleans (as 1 or 0)
+// are passed as text, null removes a variable. Parsed with SAX, so no document is built.
+//
+// A "policy" object is merged the same way and applied to the process before it executes (Linux only):
+// "cpus" ("2-3,6"), "scheduler" (other, batch, idle, fifo or rr), "scheduler_priority" (1-99 for fifo and rr),
+// "nice", "io_class" (realtime, best-effort or idle), "io_level" (0-7), "oom_score_adj", "nofile" and "memlock"
+// (a number or "unlimited"). Settings that are missing or null are inherited from corerun.
+bool snap::stubexecutable::load_launch_profile(const std::string& filename, const std::string& channel,
+    const std::string& version, launch_profile& profile_out)
+{
+    auto profile = std::make_unique<char*>(nullptr);
+    size_t profile_len = 0;
+    if (!pal_fs_read_file(filename.c_str(), profile.get(), &profile_len))
+    {
+        LOGE << "Failed to read launch profile: " << filename;
+        return false;
+    }
+
+    launch_profile_sax sax;
+    const auto parsed = nlohmann::json::sax_parse(*profile, *profile + profile_len, &sax);
+    delete[] *profile;
+    if (!parsed)
+    {
+        LOGE << "Invalid launch profile: " << filename << ". " << sax.error;
+        return false;
+    }
+
+    auto environment = sax.base.environment;
+    auto policy = sax.base.policy;
+    const auto overlay = [&environment, &policy](const std::map<std::string, launch_profile_scope>& scopes, const std::string& name)
+    {
+        const auto scope = scopes.find(name);
+        if (scope == scopes.end())
+        {
+            return;
+        }
+        for (const auto& variable : scope->second.environment)
+        {
+            environment[variable.first] = variable.second;
+        }
+        for (const auto& setting : scope->second.policy)
+        {
+            policy[setting.first] = setting.second;
+        }
+    };
+    overlay(sax.channels, channel.empty() ? sax.channel : channel);
+    overlay(sax.versions, version);
+
+    profile_out = launch_profile();
+    for (const auto& variable : environment)
+    {
+        profile_out.environment.push_back(variable.second.has_value() ? variable.first + "=" + *variable.second : variable.first);
+    }
+
+    const auto to_integer = [](const std::string& text, long long& value)
+    {
+        char* end = nullptr;
+        errno = 0;
+        value = std::strtoll(text.c_str(), &end, 10);
+        return !text.empty() && *end == '\0' && errno == 0;
+    };
+
+    for (const auto& setting : policy)
+    {
+        if (!setting.second.has_value())
+        {
+            continue;
+        }
+
+        const auto& name = setting.first;
+        const auto& text = *setting.second;
+        auto& out = profile_out.policy;
+        long long number = 0;
+        auto valid = true;
+        if (name == "cpus")
+        {
+            std::istringstream cpus_stream(text);
+            std::string range;
+            while (valid && std::getline(cpus_stream, range, ','))
+            {
+                const auto dash = range.find('-');
+                long long first = 0, last = 0;
+                valid = to_integer(range.substr(0, dash), first)
+                    && to_integer(dash == std::string::npos ? range : range.substr(dash + 1), last)
+                    && first >= 0 && first <= last && last < 4096;
+                for (auto cpu = first; valid && cpu <= last; cpu++)
+                {
+                    profile_out.affinity_cpus.push_back(static_cast<uint32_t>(cpu));
+                }
+            }
+            valid = valid && !profile_out.affinity_cpus.empty();
+        }
+        else if (name == "scheduler")
+        {
+            static const std::map<std::string, pal_process_scheduler_t> schedulers = {
+                { "other", PAL_PROCESS_SCHEDULER_OTHER },
+                { "batch", PAL_PROCESS_SCHEDULER_BATCH },
+                { "idle", PAL_PROCESS_SCHEDULER_IDLE },
+                { "fifo", PAL_PROCESS_SCHEDULER_FIFO },
+                { "rr", PAL_PROCESS_SCHEDULER_RR }
+            };
+            const auto scheduler = schedulers.find(text);
+            valid = scheduler != schedulers.end();
+            out.scheduler = valid ? scheduler->second : PAL_PROCESS_SCHEDULER_INHERIT;
+        }
+        else if (name == "io_class")
+        {
+            static const std::map<std::string, pal_process_io_class_t> io_classes = {
+                { "realtime", PAL_PROCESS_IO_CLASS_REALTIME },
+                { "best-effort", PAL_PROCESS_IO_CLASS_BEST_EFFORT },
+                { "idle", PAL_PROCESS_IO_CLASS_IDLE }
+            };
+            const auto io_class = io_classes.find(text);
+            valid = io_class != io_classes.end();
+            out.io_class = valid ? io_class->second : PAL_PROCESS_IO_CLASS_INHERIT;
+        }
+        else if (name == "nofile" || name == "memlock")
+        {
+            auto& limit = name == "nofile" ? out.rlimit_nofile : out.rlimit_memlock;
+            valid = text == "unlimited" || (to_integer(text, number) && number > 0);
+            limit = text == "unlimited" ? UINT64_MAX : static_cast<uint64_t>(number);
+        }
+        else if (name == "scheduler_priority" || name == "nice" || name == "io_level" || name == "oom_score_adj")
+        {
+            // The ranges pal_process_daemonize_ex accepts. An out of range value rejects the profile, start() then
+            // logs it and launches without the profile instead of failing the launch.
+            static const std::map<std::string, std::pair<long long, long long>> ranges = {
+                { "scheduler_priority", { 1, 99 } },
+                { "nice", { -20, 19 } },
+                { "io_level", { 0, 7 } },
+                { "oom_score_adj", { -1000, 1000 } }
+            };
+            const auto& range = ranges.at(name);
+            valid = to_integer(text, number) && number >= range.first && number <= range.second;
+            const auto value = static_cast<int>(number);
+            if (name == "scheduler_priority")
+            {
+                out.scheduler_priority = value;
+            }
+            else if (name == "nice")
+            {
+                out.nice_set = TRUE;
+                out.nice = value;
+            }
+            else if (name == "io_level")
+            {
+                out.io_level = value;
+            }
+            else
+            {
+                out.oom_score_adj_set = TRUE;
+                out.oom_score_adj = value;
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            LOGE << "Invalid launch policy setting: " << name << "=" << text << ". Profile: " << filename;
+            return false;
+        }
+
+        profile_out.has_policy = true;
+    }
+
+    const auto& out = profile_out.policy;
+    if ((out.scheduler == PAL_PROCESS_SCHEDULER_FIFO || out.scheduler == PAL_PROCESS_SCHEDULER_RR)
+        && out.scheduler_priority == 0)
+    {
+        LOGE << "Invalid launch policy, a realtime scheduler requires a scheduler_priority. Profile: " << filename;
+        return false;
+    }
+
+    return true;
+}
+
+// Checks the files listed in the manifest of an app dir. The manifest starts with
+// "snapx-manifest 1 <sha256|blake3>" followed by one "<hex digest> <size> <relative path>"
+// line per file. App dirs without a manifest cannot be verified and are accepted.
+bool snap::stubexecutable::verify_app_dir(const std::string& app_dir)
+{
+    auto manifest_path = std::make_unique<char*>(nullptr);
+    auto cache_path = std::make_unique<char*>(nullptr);
+    if (!pal_path_combine(app_dir.c_str(), app_dir_manifest_name, manifest_path.get())
+        || !pal_path_combine(app_dir.c_str(), app_dir_manifest_cache_name, cache_path.get()))
+    {
+        return false;
+    }
+
+    if (!pal_fs_file_exists(*manifest_path))
+    {
+        LOGW << "App dir does not contain a manifest, skipping verification: " << app_dir;
+        return true;
+    }
+
+    auto manifest = std::make_unique<char*>(nullptr);
+    size_t manifest_len = 0;
+    if (!pal_fs_read_file(*manifest_path, manifest.get(), &manifest_len))
+    {
+        LOGE << "Failed to read manifest: " << *manifest_path;
+        return false;
+    }
+
+    std::istringstream manifest_stream(std::string(*manifest, manifest_len));
+    delete[] *manifest;
+
+    std::string line;
+    std::getline(manifest_stream, line);
+
+    std::istringstream header_stream(line);
+    std::string header_name, header_version, header_algorithm;
+    if (!(header_stream >> header_name >> header_version >> header_algorithm)
+        || header_name != "snapx-manifest"
+        || header_version != "1"
+        || (header_algorithm != "sha256" && header_algorithm != "blake3"))
+    {
+        LOGE << "Unsupported manifest header: " << line << ". Manifest: " << *manifest_path;
+        return false;
+    }
+
+    const auto algorithm = header_algorithm == "sha256" ? PAL_HASH_SHA256 : PAL_HASH_BLAKE3;
+
+    const auto hex_value = [](const char c) -> int
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+
+    std::vector<std::string> paths;
+    std::vector<pal_fs_verify_entry_t> entries;
+    while (std::getline(manifest_stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        if (line.empty())
         {
-            most_recent_semver = current_app_semver;
-            most_recent_semver_str = current_app_ver_str;
-            app_dir_found = true;
             continue;
         }
+
+        std::istringstream line_stream(line);
+        std::string digest_hex;
+        pal_fs_verify_entry_t entry = {};
+        std::string path;
+        if (!(line_stream >> digest_hex >> entry.size)
+            || line_stream.get() != ' '
+            || !std::getline(line_stream, path)
+            || path.empty()
+            || digest_hex.size() != PAL_HASH_DIGEST_SIZE * 2)
+        {
+            LOGE << "Invalid manifest entry: " << line << ". Manifest: " << *manifest_path;
+            return false;
+        }
+
+        for (size_t i = 0; i < PAL_HASH_DIGEST_SIZE; i++)
+        {
+            const auto high = hex_value(digest_hex[i * 2]);
+            const auto low = hex_value(digest_hex[i * 2 + 1]);
+            if (high < 0 || low < 0)
+            {
+                LOGE << "Invalid manifest digest: " << digest_hex << ". Manifest: " << *manifest_path;
+                return false;
+            }
+            entry.digest[i] = static_cast<uint8_t>(high << 4 | low);
+        }
+
+        paths.emplace_back(path);
+        entries.emplace_back(entry);
     }
 
-    if(!app_dir_found)
+    // Fill in paths once the vector no longer reallocates.
+    for (auto i = 0u; i < entries.size(); i++)
+    {
+        entries[i].path = paths[i].c_str();
+    }
+
+    const auto verified = pal_fs_verify_directory(app_dir.c_str(), algorithm, entries.data(), entries.size(), *cache_path);
+
+    auto cached = 0u;
+    for (const auto& entry : entries)
+    {
+        cached += entry.cached ? 1 : 0;
+    }
+
+    LOGV << "Verified app dir: " << app_dir << ". Files: " << entries.size() << ". Cached: " << cached
+         << ". Result: " << (verified ? "ok" : "failed");
+
+    return verified == TRUE;
+}
+
+std::string snap::stubexecutable::find_current_app_dir_from_link(const std::string& app_dir)
+{
+    auto link_path = std::make_unique<char*>(nullptr);
+    if (!pal_path_combine(app_dir.c_str(), current_app_dir_link_name, link_path.get()))
+    {
+        return std::string();
+    }
+
+    auto link_target = std::make_unique<char*>(nullptr);
+    if (!pal_fs_link_read(*link_path, link_target.get()))
     {
         return std::string();
     }
 
-    const auto app_dir_version_str = "app-" + most_recent_semver_str;
+    // Only accept a sibling app-<version> directory so that a stale or foreign link
+    // cannot redirect the launch outside of the install directory.
+    const std::string link_target_str(*link_target);
+    if (!pal_str_startswith(link_target_str.c_str(), "app-")
+        || link_target_str.find_first_of("/\\") != std::string::npos)
+    {
+        LOGW << "Ignoring current app dir link with unexpected target: " << link_target_str;
+        return std::string();
+    }
 
-    auto final_dir = std::make_unique<char*>(nullptr);
-    if (!pal_path_combine(app_dir.c_str(), app_dir_version_str.c_str(), final_dir.get()))
+    auto linked_app_dir = std::make_unique<char*>(nullptr);
+    if (!pal_path_combine(app_dir.c_str(), link_target_str.c_str(), linked_app_dir.get())
+        || !pal_fs_directory_exists(*linked_app_dir))
     {
-        LOGE << "Error! Unable to build final dir. App dir: " << app_dir << ". App dir version: " << app_dir_version_str;
+        LOGW << "Ignoring current app dir link because target does not exist: " << link_target_str;
         return std::string();
     }
 
-    std::string final_dir_str(*final_dir);
-    LOGV << "Final app dir: " << final_dir_str;
-    return final_dir_str;
+    return std::string(*linked_app_dir);
 }
@@ -10,8 +10,58 @@ namespace snap
     class stubexecutable
     {
     public:
+        // Name of the link inside the install directory that points to the active app-<version> directory.
+        static constexpr const char* current_app_dir_link_name = "current";
+        // Optional list of files inside an app-<version> directory with their size and hash, see verify_app_dir.
+        static constexpr const char* app_dir_manifest_name = ".snapx-manifest";
+        // Verdicts of previous verifications, stored next to the manifest.
+        static constexpr const char* app_dir_manifest_cache_name = ".snapx-manifest.cache";
+        // Rotation of the output log enabled by SNAPX_CORERUN_OUTPUT_LOG, overridden by
+        // SNAPX_CORERUN_OUTPUT_LOG_MAX_BYTES and SNAPX_CORERUN_OUTPUT_LOG_MAX_FILES.
+        static constexpr uint64_t output_log_max_bytes_default = 10 * 1024 * 1024;
+        static constexpr uint32_t output_log_max_files_default = 5;
+        // Optional runtime tuning beside the stub, see load_launch_profile.
+        static constexpr const char* launch_profile_name = ".snapx-launch-profile.json";
+        // Names of the variables injected into the environment of the application, see merge_launch_environment.
+        static constexpr const char* injected_environment_name = "SNAPX_CORERUN_INJECTED_ENV";
+
+        // A version started ahead of time that waits in pal_standby_wait until it is released.
+        struct standby
+        {
+            pal_pid_t pid = 0;
+            pal_process_gate_t* gate = nullptr;
+            std::string app_dir{};
+        };
+
+        // What a launch profile sets for one channel and version of the application.
+        struct launch_profile
+        {
+            std::vector<std::string> environment{}; // NAME=value, or NAME to remove it.
+            std::vector<uint32_t> affinity_cpus{}; // Set as policy.affinity_cpus when the policy is passed to the PAL.
+            pal_process_launch_policy_t policy = {};
+            bool has_policy = false;
+        };
+
         static int run(std::vector<std::string> arguments, int cmd_show);
+        static int run(const std::vector<std::string>& arguments, const pal_process_spawn_options_t& options);
+        // Starts the current version gated, so that it initializes while the running version is still alive.
+        static bool start_standby(const std::vector<std::string>& arguments, pal_process_spawn_options_t options, standby& standby_out);
+        // Lets the standby continue, or starts the current version from scratch when the standby exited
+        // or a newer version was installed in the meantime.
+        static int release_standby(standby& standby, const std::vector<std::string>& arguments, const pal_process_spawn_options_t& options);
+        // DOTNET_GCHeapCount, DOTNET_GCHeapAffinitizeMask and DOTNET_GCHeapHardLimit for the given limits.
+        static std::vector<std::string> gc_environment(const pal_cpu_t* cpus, size_t cpus_len, size_t heap_count, uint64_t memory_limit);
+        // Adds the defaults to the environment of a profile and removes variables injected by a previous launch.
+        static void merge_launch_environment(std::vector<std::string>& environment, const std::vector<std::string>& defaults);
+        // Reads the environment and launch policy a profile sets for one channel and version of the application.
+        static bool load_launch_profile(const std::string& filename, const std::string& channel, const std::string& version,
+            launch_profile& profile_out);
     private:
+        static bool start(const std::vector<std::string>& arguments, const pal_process_spawn_options_t& options,
+            std::string& app_dir_out, pal_pid_t* pid_out, pal_process_gate_t** gate_out);
         static std::string find_current_app_dir();
+        static std::string find_current_app_dir_from_link(const std::string& app_dir);
+        static std::vector<std::string> find_app_dirs_by_version(const std::string& app_dir);
+        static bool verify_app_dir(const std::string& app_dir);
     };
 }
@@ -10,6 +10,11 @@
 #include <random>
 #include <utility>
 
+#if defined(PAL_PLATFORM_LINUX)
+#include <sys/mman.h> // shm_unlink
+#include <sys/wait.h> // waitpid
+#endif
+
 using json = nlohmann::json;
 using testutils = corerun::support::util::test_utils;
 
@@ -106,6 +111,7 @@ namespace {
     private:
         std::string m_unique_id;
         std::vector<corerun_app_details> m_apps;
+        std::string m_current_version;
 
     public:
         std::string app_name;
@@ -120,6 +126,7 @@ namespace {
         snapx(const std::string& app_name, const std::string& working_dir, const std::string& os_file_ext) :
             m_unique_id(xg::newGuid()),
             m_apps(std::vector<corerun_app_details>()),
+            m_current_version(std::string()),
             app_name(app_name),
             working_dir(working_dir),
             working_dir_demoapp_exe(testutils::path_combine(working_dir, "corerun_demoapp" + os_file_ext)),
@@ -152,6 +159,49 @@ namespace {
                 this->app_name + this->os_file_ext, version, version_invalid));
         }
 
+        void set_current(const std::string& version)
+        {
+            const auto link_path = testutils::path_combine(this->install_dir, snap::stubexecutable::current_app_dir_link_name);
+            ASSERT_TRUE(pal_fs_link_replace(link_path.c_str(), ("app-" + version).c_str())) << "Failed to set current version: " << version;
+            this->m_current_version = version;
+        }
+
+        // Lists the app executable in the manifest of an installed version, optionally with a wrong digest.
+        void write_manifest(const std::string& version, const bool corrupt_digest = false)
+        {
+            const auto app_dir = testutils::path_combine(this->install_dir, "app-" + version);
+            const auto app_exe = testutils::path_combine(app_dir, this->app_name + this->os_file_ext);
+
+            size_t app_exe_size = 0;
+            uint8_t digest[PAL_HASH_DIGEST_SIZE];
+            ASSERT_TRUE(pal_fs_get_file_size(app_exe.c_str(), &app_exe_size));
+            ASSERT_TRUE(pal_hash_file(app_exe.c_str(), PAL_HASH_SHA256, TRUE, digest));
+
+            if (corrupt_digest)
+            {
+                digest[0] ^= 0xff;
+            }
+
+            std::string digest_hex;
+            for (const auto value : digest)
+            {
+                static const char* hex = "0123456789abcdef";
+                digest_hex.push_back(hex[value >> 4]);
+                digest_hex.push_back(hex[value & 0xf]);
+            }
+
+            const auto manifest = "snapx-manifest 1 sha256\n" + digest_hex + " " + std::to_string(app_exe_size)
+                + " " + this->app_name + this->os_file_ext + "\n";
+            const auto manifest_path = testutils::path_combine(app_dir, snap::stubexecutable::app_dir_manifest_name);
+            ASSERT_TRUE(pal_fs_write(manifest_path.c_str(), manifest.c_str(), manifest.size()));
+        }
+
+        // Overrides the version that the test expects corerun to start.
+        void expect_version(const std::string& version)
+        {
+            this->m_current_version = version;
+        }
+
         static bool file_copy(const char* src_filename, const char* dest_filename)
         {
             if (src_filename == nullptr
@@ -266,6 +316,15 @@ namespace {
 
             for (const auto &app : this->m_apps)
             {
+                if (!this->m_current_version.empty())
+                {
+                    if (app.version_str == this->m_current_version)
+                    {
+                        return app;
+                    }
+                    continue;
+                }
+
                 if (app.version > most_recent_app.version)
                 {
                     most_recent_app = app;
@@ -311,6 +370,303 @@ namespace {
         ASSERT_NO_THROW(pal_is_elevated());
     }
     
+    TEST(MAIN, corerun_process_time_series_KeepsMostRecentSamples)
+    {
+        corerun_process_time_series time_series(3);
+        ASSERT_EQ(time_series.size(), 0u);
+        ASSERT_EQ(time_series.capacity(), 3u);
+
+        for (uint64_t i = 1; i <= 5; i++)
+        {
+            pal_process_sample_t sample = {};
+            sample.timestamp_us = i;
+            time_series.push(sample);
+        }
+
+        ASSERT_EQ(time_series.size(), 3u);
+        EXPECT_EQ(time_series.at(0).timestamp_us, 3u);
+        EXPECT_EQ(time_series.at(1).timestamp_us, 4u);
+        EXPECT_EQ(time_series.at(2).timestamp_us, 5u);
+
+        corerun_process_time_series disabled(0);
+        disabled.push(pal_process_sample_t());
+        EXPECT_EQ(disabled.size(), 0u);
+    }
+
+    TEST(MAIN, corerun_supervisor_metrics_CarriesCountersAcrossSupervisors)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, "demoapp.prom");
+
+        corerun_supervisor_metrics metrics(filename, "demo\"app");
+        metrics.restarts_total = 2;
+        metrics.restart_latency_seconds = 0.25;
+        metrics.up = true;
+        metrics.sample.rss_bytes = 4096;
+        ASSERT_TRUE(metrics.write());
+
+        const auto text = metrics.format();
+        EXPECT_NE(text.find("# TYPE snapx_corerun_restarts_total counter\n"), std::string::npos);
+        EXPECT_NE(text.find("snapx_corerun_restarts_total{app=\"demo\\\"app\"} 2\n"), std::string::npos);
+        EXPECT_NE(text.find("snapx_corerun_up{app=\"demo\\\"app\"} 1\n"), std::string::npos);
+        EXPECT_NE(text.find("snapx_corerun_resident_memory_bytes{app=\"demo\\\"app\"} 4096\n"), std::string::npos);
+
+        corerun_supervisor_metrics next(filename, "demo\"app");
+        next.load();
+        EXPECT_EQ(next.restarts_total, 2u);
+        EXPECT_DOUBLE_EQ(next.restart_latency_seconds, 0.25);
+        EXPECT_FALSE(next.up);
+    }
+
+    TEST(MAIN, stubexecutable_gc_environment_PlacesHeapsOnLargestNumaNode)
+    {
+        const pal_cpu_t cpus[] = { { 0, 0 }, { 1, 0 }, { 2, 1 }, { 3, 1 }, { 4, 1 } };
+
+        EXPECT_EQ(snap::stubexecutable::gc_environment(cpus, 5, 3, 1024 * 1024 * 1024), std::vector<std::string>({
+            "DOTNET_GCHeapCount=0x3",
+            "DOTNET_GCHeapAffinitizeMask=0x1c",
+            "DOTNET_GCHeapHardLimit=0x30000000"
+        }));
+
+        // Heaps on every cpu of the mask are affinitized by the runtime itself.
+        EXPECT_EQ(snap::stubexecutable::gc_environment(cpus, 5, 5, 0), std::vector<std::string>({
+            "DOTNET_GCHeapCount=0x5"
+        }));
+
+        const pal_cpu_t many_cpus[] = { { 70, 0 }, { 71, 0 }, { 1, 1 } };
+        EXPECT_EQ(snap::stubexecutable::gc_environment(many_cpus, 3, 2, 0), std::vector<std::string>({
+            "DOTNET_GCHeapCount=0x2"
+        }));
+    }
+
+    TEST(MAIN, stubexecutable_merge_launch_environment_RecomputesInjectedVariables)
+    {
+        ASSERT_TRUE(pal_env_set("DOTNET_GCHeapCount", "0x4"));
+        ASSERT_TRUE(pal_env_set("DOTNET_GCHeapHardLimit", "0x10000000"));
+
+        // Inherited variables override the defaults.
+        std::vector<std::string> environment({ "DOTNET_TieredPGO=0" });
+        snap::stubexecutable::merge_launch_environment(environment, { "DOTNET_GCHeapCount=0x2", "DOTNET_GCHeapHardLimit=0x20000000" });
+        EXPECT_EQ(environment, std::vector<std::string>({
+            "DOTNET_TieredPGO=0",
+            "SNAPX_CORERUN_INJECTED_ENV=DOTNET_TieredPGO"
+        }));
+
+        // Unless a previous launch injected them, the ones that are no longer injected are removed.
+        ASSERT_TRUE(pal_env_set("SNAPX_CORERUN_INJECTED_ENV", "DOTNET_TieredPGO,DOTNET_GCHeapCount"));
+        environment = { "DOTNET_TC_QuickJitForLoops=0" };
+        snap::stubexecutable::merge_launch_environment(environment, { "DOTNET_GCHeapCount=0x2", "DOTNET_GCHeapHardLimit=0x20000000" });
+        EXPECT_EQ(environment, std::vector<std::string>({
+            "DOTNET_TC_QuickJitForLoops=0",
+            "DOTNET_GCHeapCount=0x2",
+            "DOTNET_TieredPGO",
+            "SNAPX_CORERUN_INJECTED_ENV=DOTNET_TC_QuickJitForLoops,DOTNET_GCHeapCount"
+        }));
+
+        environment = {};
+        snap::stubexecutable::merge_launch_environment(environment, {});
+        EXPECT_EQ(environment, std::vector<std::string>({
+            "DOTNET_TieredPGO",
+            "DOTNET_GCHeapCount",
+            "SNAPX_CORERUN_INJECTED_ENV"
+        }));
+
+        ASSERT_TRUE(pal_env_set("SNAPX_CORERUN_INJECTED_ENV", nullptr));
+        ASSERT_TRUE(pal_env_set("DOTNET_GCHeapCount", nullptr));
+        ASSERT_TRUE(pal_env_set("DOTNET_GCHeapHardLimit", nullptr));
+    }
+
+    TEST(MAIN, stubexecutable_load_launch_profile_MergesChannelAndVersionOverBase)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, snap::stubexecutable::launch_profile_name);
+
+        const std::string profile = R"({
+            "channel": "beta",
+            "environment": { "DOTNET_TieredPGO": 1, "DOTNET_gcServer": true, "DOTNET_ReadyToRun": "1" },
+            "channels": {
+                "beta": { "environment": { "DOTNET_TieredPGO": 0, "DOTNET_GCHeapHardLimit": "0x20000000" } },
+                "stable": { "environment": { "DOTNET_TieredCompilation": 0 } }
+            },
+            "versions": {
+                "1.0.0": { "environment": { "DOTNET_GCHeapHardLimit": null, "DOTNET_TC_QuickJitForLoops": false } },
+                "2.0.0": { "environment": { "DOTNET_ReadyToRun": 0 } }
+            },
+            "comment": [ "unknown keys are ignored", { "environment": { "IGNORED": 1 } } ]
+        })";
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), profile.data(), profile.size()));
+
+        snap::stubexecutable::launch_profile launch_profile;
+        ASSERT_TRUE(snap::stubexecutable::load_launch_profile(filename, "", "1.0.0", launch_profile));
+        EXPECT_FALSE(launch_profile.has_policy);
+        EXPECT_EQ(launch_profile.environment, std::vector<std::string>({
+            "DOTNET_GCHeapHardLimit",
+            "DOTNET_ReadyToRun=1",
+            "DOTNET_TC_QuickJitForLoops=0",
+            "DOTNET_TieredPGO=0",
+            "DOTNET_gcServer=1"
+        }));
+
+        ASSERT_TRUE(snap::stubexecutable::load_launch_profile(filename, "stable", "3.0.0", launch_profile));
+        EXPECT_EQ(launch_profile.environment, std::vector<std::string>({
+            "DOTNET_ReadyToRun=1",
+            "DOTNET_TieredCompilation=0",
+            "DOTNET_TieredPGO=1",
+            "DOTNET_gcServer=1"
+        }));
+
+        const std::string invalid = R"({ "environment": { "A=B": 1 } })";
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), invalid.data(), invalid.size()));
+        EXPECT_FALSE(snap::stubexecutable::load_launch_profile(filename, "", "1.0.0", launch_profile));
+
+        const std::string truncated = R"({ "environment": { "A": )";
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), truncated.data(), truncated.size()));
+        EXPECT_FALSE(snap::stubexecutable::load_launch_profile(filename, "", "1.0.0", launch_profile));
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+    TEST(MAIN, stubexecutable_load_launch_profile_MergesPolicy)
+    {
+        const auto working_dir = testutils::mkdir_random(testutils::get_process_cwd());
+        const auto filename = testutils::path_combine(working_dir, snap::stubexecutable::launch_profile_name);
+
+        const std::string profile = R"({
+            "policy": { "cpus": "2-3,6", "nice": -5, "io_class": "best-effort", "io_level": 2, "nofile": 65536 },
+            "channels": {
+                "latency": { "policy": { "scheduler": "fifo", "scheduler_priority": 10, "nice": null, "memlock": "unlimited" } }
+            },
+            "versions": {
+                "1.0.0": { "policy": { "cpus": 4, "oom_score_adj": -500 } }
+            }
+        })";
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), profile.data(), profile.size()));
+
+        snap::stubexecutable::launch_profile launch_profile;
+        ASSERT_TRUE(snap::stubexecutable::load_launch_profile(filename, "", "2.0.0", launch_profile));
+        ASSERT_TRUE(launch_profile.has_policy);
+        EXPECT_EQ(launch_profile.affinity_cpus, std::vector<uint32_t>({ 2, 3, 6 }));
+        EXPECT_EQ(launch_profile.policy.affinity_cpus, nullptr);
+        EXPECT_EQ(launch_profile.policy.scheduler, PAL_PROCESS_SCHEDULER_INHERIT);
+        EXPECT_TRUE(launch_profile.policy.nice_set);
+        EXPECT_EQ(launch_profile.policy.nice, -5);
+        EXPECT_EQ(launch_profile.policy.io_class, PAL_PROCESS_IO_CLASS_BEST_EFFORT);
+        EXPECT_EQ(launch_profile.policy.io_level, 2);
+        EXPECT_FALSE(launch_profile.policy.oom_score_adj_set);
+        EXPECT_EQ(launch_profile.policy.rlimit_nofile, 65536u);
+        EXPECT_EQ(launch_profile.policy.rlimit_memlock, 0u);
+
+        ASSERT_TRUE(snap::stubexecutable::load_launch_profile(filename, "latency", "1.0.0", launch_profile));
+        EXPECT_EQ(launch_profile.affinity_cpus, std::vector<uint32_t>({ 4 }));
+        EXPECT_EQ(launch_profile.policy.scheduler, PAL_PROCESS_SCHEDULER_FIFO);
+        EXPECT_EQ(launch_profile.policy.scheduler_priority, 10);
+        EXPECT_FALSE(launch_profile.policy.nice_set);
+        EXPECT_TRUE(launch_profile.policy.oom_score_adj_set);
+        EXPECT_EQ(launch_profile.policy.oom_score_adj, -500);
+        EXPECT_EQ(launch_profile.policy.rlimit_memlock, UINT64_MAX);
+
+        const std::string invalid = R"({ "policy": { "scheduler": "deadline" } })";
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), invalid.data(), invalid.size()));
+        EXPECT_FALSE(snap::stubexecutable::load_launch_profile(filename, "", "1.0.0", launch_profile));
+
+        const std::string invalid_cpus = R"({ "policy": { "cpus": "3-1" } })";
+        ASSERT_TRUE(pal_fs_write(filename.c_str(), invalid_cpus.data(), invalid_cpus.size()));
+        EXPECT_FALSE(snap::stubexecutable::load_launch_profile(filename, "", "1.0.0", launch_profile));
+
+        // Values outside of the ranges the kernel accepts.
+        for (const auto& setting : { R"("nice": 20)", R"("io_level": 8)", R"("oom_score_adj": -1001)",
+            R"("scheduler": "rr", "scheduler_priority": 0)", R"("scheduler": "fifo")" })
+        {
+            const auto out_of_range = std::string(R"({ "policy": { )") + setting + " } }";
+            ASSERT_TRUE(pal_fs_write(filename.c_str(), out_of_range.data(), out_of_range.size()));
+            EXPECT_FALSE(snap::stubexecutable::load_launch_profile(filename, "", "1.0.0", launch_profile)) << setting;
+        }
+
+        EXPECT_TRUE(pal_fs_rmdir(working_dir.c_str(), TRUE));
+    }
+
+#if defined(PAL_PLATFORM_LINUX)
+    TEST(MAIN, main_wait_for_pid_KillsProcessWhenWatchdogStalls)
+    {
+        corerun_supervise_options supervise_options;
+        supervise_options.application_id = "corerun-tests-" + xg::newGuid().str();
+        supervise_options.sample_interval_ms = 0;
+        supervise_options.stall_timeout_ms = 200;
+
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            pal_watchdog_t* watchdog = nullptr;
+            if (pal_watchdog_open(supervise_options.application_id.c_str(), &watchdog))
+            {
+                for (auto i = 0; i < 5; i++)
+                {
+                    pal_watchdog_beat(watchdog);
+                    pal_sleep_ms(50);
+                }
+            }
+            pause();
+            _exit(0);
+        }
+
+        uint64_t start_time = 0;
+        ASSERT_TRUE(pal_process_get_start_time(child_pid, &start_time));
+
+        EXPECT_EQ(main_wait_for_pid(child_pid, start_time, supervise_options, nullptr, nullptr, nullptr), 0);
+
+        auto status = 0;
+        ASSERT_EQ(waitpid(child_pid, &status, 0), child_pid);
+        ASSERT_TRUE(WIFSIGNALED(status));
+        EXPECT_EQ(WTERMSIG(status), SIGTERM);
+
+        shm_unlink(("/corerun-watchdog-" + supervise_options.application_id).c_str());
+    }
+
+    TEST(MAIN, main_wait_for_pid_ForwardsShutdownSignalAndKillsAfterDrainTimeout)
+    {
+        corerun_supervise_options supervise_options;
+        supervise_options.sample_interval_ms = 0;
+        supervise_options.drain_timeout_ms = 200;
+
+        // The forwarded SIGTERM must not arrive before the child ignores it.
+        int ready_pipe[2];
+        ASSERT_EQ(pipe(ready_pipe), 0);
+
+        const auto child_pid = fork();
+        ASSERT_NE(child_pid, -1);
+        if (child_pid == 0)
+        {
+            std::signal(SIGTERM, SIG_IGN);
+            close(ready_pipe[1]);
+            pause();
+            _exit(0);
+        }
+
+        close(ready_pipe[1]);
+        char ready;
+        ASSERT_EQ(read(ready_pipe[0], &ready, 1), 0);
+        close(ready_pipe[0]);
+
+        uint64_t start_time = 0;
+        ASSERT_TRUE(pal_process_get_start_time(child_pid, &start_time));
+
+        pal_signal_listener_t* signal_listener = nullptr;
+        ASSERT_TRUE(pal_signal_listener_create(&signal_listener));
+        ASSERT_EQ(raise(SIGTERM), 0);
+
+        const auto started = std::chrono::steady_clock::now();
+        EXPECT_EQ(main_wait_for_pid(child_pid, start_time, supervise_options, signal_listener, nullptr, nullptr), SIGTERM);
+        EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(5));
+        EXPECT_TRUE(pal_signal_listener_free(signal_listener));
+
+        auto status = 0;
+        ASSERT_EQ(waitpid(child_pid, &status, 0), child_pid);
+        ASSERT_TRUE(WIFSIGNALED(status));
+        EXPECT_EQ(WTERMSIG(status), SIGKILL);
+    }
+#endif
+
     TEST(MAIN, corerun_StartsWhenThereAreZeroAppsInstalled)
     {
         if(is_ci_test())
@@ -490,6 +846,58 @@ namespace {
         }
     }
 
+    TEST(MAIN, corerun_StartsVersionPointedToByCurrentLink)
+    {
+        if(is_ci_test())
+        {
+#if defined(PAL_PLATFORM_WINDOWS)
+            GTEST_SKIP();
+#endif
+        }
+
+        const auto working_dir = testutils::get_process_cwd();
+
+        snapx snapx("demoapp", working_dir);
+        snapx.install("1.0.0");
+        snapx.install("2.0.0");
+        snapx.set_current("1.0.0");
+
+        const auto run_details = snapx.run_stubexecutable_with_args(std::vector<std::string> {
+            "--expected-version=1.0.0"
+        });
+
+        ASSERT_EQ(run_details->stub_exit_code, 0);
+        ASSERT_EQ(run_details->app_exit_code, demoapp_default_exit_code);
+        ASSERT_EQ(run_details->app_details.version_str, "1.0.0");
+        ASSERT_STREQ(run_details->run_working_dir.c_str(), run_details->app_details.working_dir.c_str());
+    }
+
+    TEST(MAIN, corerun_StartsMostRecentVersionWhenCurrentLinkTargetDoesNotExist)
+    {
+        if(is_ci_test())
+        {
+#if defined(PAL_PLATFORM_WINDOWS)
+            GTEST_SKIP();
+#endif
+        }
+
+        const auto working_dir = testutils::get_process_cwd();
+
+        snapx snapx("demoapp", working_dir);
+        snapx.install("1.0.0");
+        snapx.install("2.0.0");
+
+        const auto link_path = testutils::path_combine(snapx.install_dir, snap::stubexecutable::current_app_dir_link_name);
+        ASSERT_TRUE(pal_fs_link_replace(link_path.c_str(), "app-3.0.0"));
+
+        const auto run_details = snapx.run_stubexecutable_with_args(std::vector<std::string> {
+            "--expected-version=2.0.0"
+        });
+
+        ASSERT_EQ(run_details->stub_exit_code, 0);
+        ASSERT_EQ(run_details->app_details.version_str, "2.0.0");
+    }
+
     TEST(MAIN, corerun_StartsMostRecentVersionWhenThereAreLotsOfVersionsInRandomOrderInstalled)
     {
         if(is_ci_test())
@@ -545,4 +953,39 @@ namespace {
         }
     }
 
+
+    TEST(MAIN, corerun_StartsPreviousVersionWhenMostRecentVersionFailsVerification)
+    {
+        if(is_ci_test())
+        {
+#if defined(PAL_PLATFORM_WINDOWS)
+            GTEST_SKIP();
+#endif
+        }
+
+        const auto working_dir = testutils::get_process_cwd();
+
+        snapx snapx("demoapp", working_dir);
+        snapx.install("1.0.0");
+        snapx.install("2.0.0");
+        snapx.install("3.0.0");
+        snapx.write_manifest("1.0.0");
+        snapx.write_manifest("2.0.0");
+        snapx.write_manifest("3.0.0", true);
+        snapx.set_current("3.0.0");
+        snapx.expect_version("2.0.0");
+
+        ASSERT_TRUE(pal_env_set("SNAPX_CORERUN_VERIFY", "1"));
+
+        const auto run_details = snapx.run_stubexecutable_with_args(std::vector<std::string> {
+            "--expected-version=2.0.0"
+        });
+
+        ASSERT_TRUE(pal_env_set("SNAPX_CORERUN_VERIFY", nullptr));
+
+        ASSERT_EQ(run_details->stub_exit_code, 0);
+        ASSERT_EQ(run_details->app_exit_code, demoapp_default_exit_code);
+        ASSERT_EQ(run_details->app_details.version_str, "2.0.0");
+        ASSERT_STREQ(run_details->run_working_dir.c_str(), run_details->app_details.working_dir.c_str());
+    }
 }